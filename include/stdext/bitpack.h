@@ -0,0 +1,59 @@
+#ifndef STDEXT_BITPACK_INCLUDED
+#define STDEXT_BITPACK_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+#include <stdext/span.h>
+#include <stdext/stream.h>
+
+
+namespace stdext
+{
+    // Bit-packed integer arrays.  Values are encoded in blocks; each block stores a one-byte bit
+    // width and a reference value, followed by every value in the block less the reference,
+    // packed at that width.  With delta encoding, the differences between successive values are
+    // packed instead, which suits sorted identifiers and timestamps.  Values left over after the
+    // last full block are written as varints.
+    //
+    // The encoders return the number of bytes written; the destination must have room for
+    // bitpack_max_size bytes.  The decoders decode exactly dst.size() values and return the number
+    // of bytes consumed, throwing stream_error if the input is exhausted or malformed.  The same
+    // encoding and block size must be used for encoding and decoding.
+    enum class bitpack_encoding
+    {
+        frame_of_reference,
+        delta
+    };
+
+    enum class bitpack_block_size
+    {
+        values_128 = 128,
+        values_256 = 256
+    };
+
+    constexpr size_t bitpack_max_size(size_t count, bitpack_block_size block_size = bitpack_block_size::values_128) noexcept
+    {
+        auto block = size_t(block_size);
+        return count / block * (1 + 10 + block * 8) + count % block * 10;
+    }
+
+    [[nodiscard]] size_t bitpack_encode(array_view<const uint32_t> src, span<byte> dst,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128) noexcept;
+    [[nodiscard]] size_t bitpack_encode(array_view<const uint64_t> src, span<byte> dst,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128) noexcept;
+    [[nodiscard]] size_t bitpack_decode(array_view<const byte> src, span<uint32_t> dst,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128);
+    [[nodiscard]] size_t bitpack_decode(array_view<const byte> src, span<uint64_t> dst,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128);
+
+    void write_bitpacked(output_stream& s, array_view<const uint32_t> values,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128);
+    void write_bitpacked(output_stream& s, array_view<const uint64_t> values,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128);
+    void read_bitpacked(input_stream& s, span<uint32_t> values,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128);
+    void read_bitpacked(input_stream& s, span<uint64_t> values,
+        bitpack_encoding encoding = bitpack_encoding::delta, bitpack_block_size block_size = bitpack_block_size::values_128);
+}
+
+#endif
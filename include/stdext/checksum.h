@@ -0,0 +1,164 @@
+#ifndef STDEXT_CHECKSUM_INCLUDED
+#define STDEXT_CHECKSUM_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+#include <stdext/stream.h>
+
+
+namespace stdext
+{
+    // CRC-32C (Castagnoli), as used by iSCSI, ext4, and others.  The crc argument is the result of
+    // a previous call, which allows a checksum to be computed incrementally.
+    uint32_t crc32c(array_view<const byte> data, uint32_t crc = 0) noexcept;
+
+    // 32-bit and 64-bit xxHash (XXH32 and XXH64).
+    uint32_t xxhash32(array_view<const byte> data, uint32_t seed = 0) noexcept;
+    uint64_t xxhash64(array_view<const byte> data, uint64_t seed = 0) noexcept;
+
+    class crc32c_state
+    {
+    public:
+        using value_type = uint32_t;
+
+    public:
+        constexpr crc32c_state() noexcept = default;
+
+    public:
+        void update(array_view<const byte> data) noexcept { _crc = crc32c(data, _crc); }
+        constexpr value_type value() const noexcept { return _crc; }
+        constexpr void reset() noexcept { _crc = 0; }
+
+    private:
+        uint32_t _crc = 0;
+    };
+
+    class xxhash32_state
+    {
+    public:
+        using value_type = uint32_t;
+
+    public:
+        explicit xxhash32_state(uint32_t seed = 0) noexcept { reset(seed); }
+
+    public:
+        void update(array_view<const byte> data) noexcept;
+        value_type value() const noexcept;
+        void reset(uint32_t seed = 0) noexcept;
+
+    private:
+        uint32_t _acc[4];
+        uint32_t _seed;
+        uint64_t _total;
+        byte _buffer[16];
+        size_t _buffered;
+    };
+
+    class xxhash64_state
+    {
+    public:
+        using value_type = uint64_t;
+
+    public:
+        explicit xxhash64_state(uint64_t seed = 0) noexcept { reset(seed); }
+
+    public:
+        void update(array_view<const byte> data) noexcept;
+        value_type value() const noexcept;
+        void reset(uint64_t seed = 0) noexcept;
+
+    private:
+        uint64_t _acc[4];
+        uint64_t _seed;
+        uint64_t _total;
+        byte _buffer[32];
+        size_t _buffered;
+    };
+
+    // Stream decorators that compute a checksum of the bytes passing through them.  The checksum
+    // is updated directly from the caller's buffer as each read or write completes, so no second
+    // pass over the data is needed.
+    template <typename Checksum = crc32c_state>
+    class checksum_input_stream : public input_stream
+    {
+    public:
+        using checksum_type = Checksum;
+        using value_type = typename Checksum::value_type;
+
+    public:
+        explicit checksum_input_stream(input_stream& stream, const checksum_type& checksum = checksum_type())
+            : _stream(&stream), _checksum(checksum)
+        {
+        }
+
+        ~checksum_input_stream() override = default;
+
+    public:
+        value_type value() const noexcept { return _checksum.value(); }
+        checksum_type& checksum() noexcept { return _checksum; }
+        const checksum_type& checksum() const noexcept { return _checksum; }
+
+    private:
+        [[nodiscard]] size_t do_read(byte* buffer, size_t size) final
+        {
+            auto bytes = _stream->read(buffer, size);
+            _checksum.update({ buffer, bytes });
+            return bytes;
+        }
+
+        [[nodiscard]] size_t do_skip(size_t size) final
+        {
+            // Skipped bytes still contribute to the checksum.
+            byte buffer[512];
+            size_t skipped = 0;
+            while (skipped != size)
+            {
+                auto bytes = _stream->read(buffer, std::min(size - skipped, sizeof(buffer)));
+                if (bytes == 0)
+                    break;
+                _checksum.update({ buffer, bytes });
+                skipped += bytes;
+            }
+            return skipped;
+        }
+
+    private:
+        input_stream* _stream;
+        checksum_type _checksum;
+    };
+
+    template <typename Checksum = crc32c_state>
+    class checksum_output_stream : public output_stream
+    {
+    public:
+        using checksum_type = Checksum;
+        using value_type = typename Checksum::value_type;
+
+    public:
+        explicit checksum_output_stream(output_stream& stream, const checksum_type& checksum = checksum_type())
+            : _stream(&stream), _checksum(checksum)
+        {
+        }
+
+        ~checksum_output_stream() override = default;
+
+    public:
+        value_type value() const noexcept { return _checksum.value(); }
+        checksum_type& checksum() noexcept { return _checksum; }
+        const checksum_type& checksum() const noexcept { return _checksum; }
+
+    private:
+        [[nodiscard]] size_t do_write(const byte* buffer, size_t size) final
+        {
+            auto bytes = _stream->write(buffer, size);
+            _checksum.update({ buffer, bytes });
+            return bytes;
+        }
+
+    private:
+        output_stream* _stream;
+        checksum_type _checksum;
+    };
+}
+
+#endif
@@ -2,9 +2,15 @@
 #define STDEXT_ENDIAN_INCLUDED
 #pragma once
 
+#include <stdext/array_view.h>
+#include <stdext/span.h>
 #include <stdext/stream.h>
 #include <stdext/traits.h>
 
+#include <algorithm>
+
+#include <cstring>
+
 #if STDEXT_ARCH_X86 && !STDEXT_COMPILER_GCC
 #include <immintrin.h>
 #endif
@@ -71,7 +77,7 @@ namespace stdext
     }
 
     template <byte_order Order, typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
-    constexpr T swap(T v) noexcept
+    constexpr T endian_swap(T v) noexcept
     {
         if constexpr (Order == byte_order::native_endian)
             return v;
@@ -80,58 +86,155 @@ namespace stdext
         return T(_private::endian<Order, sized_t>::swap(sized_t(v)));
     }
 
+    namespace _private
+    {
+        // Reverses the bytes of each of count elements of the given size, using vector
+        // instructions where available.  src and dst may be unaligned and may be the same array.
+        void byte_swap(const void* src, void* dst, size_t count, size_t size) noexcept;
+
+        template <byte_order Order>
+        constexpr bool is_byte_reversal = Order != byte_order::native_endian
+            && (Order == byte_order::little_endian || Order == byte_order::big_endian)
+            && (byte_order::native_endian == byte_order::little_endian || byte_order::native_endian == byte_order::big_endian);
+    }
+
+    // Converts an array of integers between native and the given byte order.  src and dst may
+    // be the same array.
+    template <byte_order Order, typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
+    void endian_swap(const T* src, T* dst, size_t count) noexcept
+    {
+        if constexpr (Order == byte_order::native_endian || sizeof(T) == 1)
+        {
+            if (src != dst && count != 0)
+                std::memmove(dst, src, count * sizeof(T));
+        }
+        else if constexpr (_private::is_byte_reversal<Order>)
+            _private::byte_swap(src, dst, count, sizeof(T));
+        else
+        {
+            for (size_t n = 0; n != count; ++n)
+                dst[n] = endian_swap<Order>(src[n]);
+        }
+    }
+
     template <byte_order Order, typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
     T read(input_stream& s)
     {
         using sized_t = equivalent_sized_type_t<T>;
-        return T(swap<Order>(s.read<sized_t>()));
+        return T(endian_swap<Order>(s.read<sized_t>()));
     }
 
     template <byte_order Order, typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
     size_t read(input_stream& s, T* buffer, size_t count)
     {
         count = s.read(buffer, count);
-        if constexpr (Order != byte_order::native_endian)
-        {
-            for (size_t n = 0; n < count; ++n)
-                buffer[n] = swap<Order>(buffer[n]);
-        }
+        endian_swap<Order>(buffer, buffer, count);
         return count;
     }
 
     template <byte_order Order, typename T, size_t Length, STDEXT_REQUIRES(std::is_integral_v<T>)>
     size_t read(input_stream& s, T (&buffer)[Length])
     {
-        using sized_t = equivalent_sized_type_t<T>;
-        return _private::endian<Order, sized_t>::read(s, buffer, Length);
+        return read<Order>(s, buffer, Length);
     }
 
     template <byte_order Order, typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
     void write(output_stream& s, T v)
     {
-        s.write(swap<Order>(v));
+        s.write(endian_swap<Order>(v));
     }
 
     template <byte_order Order, typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
     size_t write(output_stream& s, const T* buffer, size_t count)
     {
-        if constexpr (Order == byte_order::native_endian)
+        if constexpr (Order == byte_order::native_endian || sizeof(T) == 1)
             return s.write(buffer, count);
-
-        size_t n = 0;
-        for (; n < count; ++n)
+        else
         {
-            auto v = swap<Order>(buffer[n]);
-            if (s.write(&v, 1) == 0)
-                break;
+            // Swap into a block on the stack so that each block is written with a single call.
+            constexpr size_t block_size = 4096 / sizeof(T);
+            T block[block_size];
+
+            size_t n = 0;
+            while (n != count)
+            {
+                auto chunk = std::min(count - n, block_size);
+                endian_swap<Order>(buffer + n, block, chunk);
+                auto written = s.write(block, chunk);
+                n += written;
+                if (written != chunk)
+                    break;
+            }
+            return n;
         }
-        return n;
     }
 
     template <byte_order Order, typename T, size_t Length, STDEXT_REQUIRES(std::is_integral_v<T>)>
     size_t write(output_stream& s, const T (&buffer)[Length])
     {
-        return write(s, buffer, Length);
+        return write<Order>(s, buffer, Length);
+    }
+
+    // Zigzag encoding maps signed integers to unsigned integers so that values of small
+    // magnitude have small encodings: 0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...
+    template <typename T, STDEXT_REQUIRES(std::is_integral_v<T> && std::is_signed_v<T>)>
+    constexpr std::make_unsigned_t<T> zigzag_encode(T v) noexcept
+    {
+        using unsigned_t = std::make_unsigned_t<T>;
+        return unsigned_t(unsigned_t(v) << 1 ^ (v < 0 ? ~unsigned_t(0) : unsigned_t(0)));
+    }
+
+    template <typename T, STDEXT_REQUIRES(std::is_integral_v<T> && std::is_unsigned_v<T>)>
+    constexpr std::make_signed_t<T> zigzag_decode(T v) noexcept
+    {
+        return std::make_signed_t<T>(T(v >> 1 ^ T(0 - T(v & 1))));
+    }
+
+    // Variable-length integers in LEB128 form: seven bits per byte, least significant group
+    // first, with the high bit set on every byte except the last.  Signed types are zigzag
+    // encoded.  Reading a varint that does not fit in T throws stream_error.
+    template <typename T>
+    constexpr size_t max_varint_size = (sizeof(T) * 8 + 6) / 7;
+
+    template <typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
+    T read_varint(input_stream& s)
+    {
+        using unsigned_t = std::make_unsigned_t<T>;
+        constexpr unsigned bits = sizeof(T) * 8;
+
+        unsigned_t value = 0;
+        for (unsigned shift = 0; ; shift += 7)
+        {
+            auto b = s.read<uint8_t>();
+            if (shift + 7 > bits && (shift >= bits || (b & 0x7F) >> (bits - shift) != 0))
+                throw stream_error("varint out of range");
+
+            value |= unsigned_t(unsigned_t(b & 0x7F) << shift);
+            if ((b & 0x80) == 0)
+                break;
+        }
+
+        if constexpr (std::is_signed_v<T>)
+            return zigzag_decode(value);
+        else
+            return value;
+    }
+
+    template <typename T, STDEXT_REQUIRES(std::is_integral_v<T>)>
+    void write_varint(output_stream& s, T v)
+    {
+        std::make_unsigned_t<T> value;
+        if constexpr (std::is_signed_v<T>)
+            value = zigzag_encode(v);
+        else
+            value = v;
+
+        uint8_t buffer[max_varint_size<T>];
+        size_t size = 0;
+        for (; value >= 0x80; value >>= 7)
+            buffer[size++] = uint8_t(value | 0x80);
+        buffer[size++] = uint8_t(value);
+        s.write_all(buffer, size);
     }
 
     namespace _private
@@ -432,17 +535,17 @@ namespace stdext
     {
     public:
         endian_int() noexcept = default;
-        constexpr endian_int(T value) noexcept : value_(swap<ByteOrder>(value)) { }
-        constexpr endian_int& operator = (T value) { value_ = value; return *this; }
+        constexpr endian_int(T value) noexcept : value_(endian_swap<ByteOrder>(value)) { }
+        constexpr endian_int& operator = (T value) { value_ = endian_swap<ByteOrder>(value); return *this; }
 
         friend constexpr bool operator == (const endian_int& lhs, const endian_int& rhs) noexcept
         {
-            return lhs.value == rhs.value;
+            return lhs.value_ == rhs.value_;
         }
 
         friend constexpr bool operator != (const endian_int& lhs, const endian_int& rhs) noexcept
         {
-            return lhs.value != rhs.value;
+            return lhs.value_ != rhs.value_;
         }
 
         friend constexpr bool operator == (const endian_int& lhs, T rhs) noexcept
@@ -505,13 +608,183 @@ namespace stdext
             return lhs >= rhs.get();
         }
 
-        constexpr T get() const noexcept { return swap<ByteOrder>(value_); }
+        constexpr T get() const noexcept { return endian_swap<ByteOrder>(value_); }
         constexpr operator T () const noexcept { return get(); }
 
     private:
         T value_;
     };
 
+    // A read-only view of an array of integers stored in the given byte order, such as a table in
+    // a memory-mapped file.  The underlying bytes need not be aligned; elements are loaded and
+    // converted to native byte order on access.  Use decode_to to convert many elements at once.
+    template <typename T, byte_order Order>
+    class endian_array_view
+    {
+        static_assert(std::is_integral_v<T>);
+
+    public:
+        class iterator;
+
+        using range_category = random_access_range_tag;
+        using value_type = T;
+        using position = const byte*;
+        using difference_type = ptrdiff_t;
+        using size_type = size_t;
+        using reference = T;
+        using const_iterator = iterator;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+
+    public:
+        constexpr endian_array_view() noexcept : _first(nullptr), _last(nullptr) { }
+        constexpr endian_array_view(const byte* data, size_type count) noexcept : _first(data), _last(data + count * sizeof(T)) { }
+        explicit constexpr endian_array_view(array_view<const byte> bytes) noexcept
+            : _first(bytes.data()), _last(bytes.data() + bytes.size() / sizeof(T) * sizeof(T))
+        {
+            assert(bytes.size() % sizeof(T) == 0);
+        }
+
+        friend constexpr bool operator == (const endian_array_view& a, const endian_array_view& b) noexcept
+        {
+            return a._first == b._first && a._last == b._last;
+        }
+        friend constexpr bool operator != (const endian_array_view& a, const endian_array_view& b) noexcept
+        {
+            return !(a == b);
+        }
+
+    public:
+        constexpr position begin_pos() const noexcept { return _first; }
+        constexpr void begin_pos(position pos) noexcept { _first = pos; }
+
+        constexpr position end_pos() const noexcept { return _last; }
+        constexpr void end_pos(position pos) noexcept { _last = pos; }
+
+        constexpr bool is_end_pos(position pos) const noexcept { return pos == _last; }
+
+        constexpr position& inc_pos(position& pos) const noexcept { return pos += sizeof(T); }
+        constexpr position& dec_pos(position& pos) const noexcept { return pos -= sizeof(T); }
+        constexpr position& advance_pos(position& pos, difference_type n) const noexcept { return pos += n * difference_type(sizeof(T)); }
+        constexpr difference_type distance(position p1, position p2) const noexcept { return (p2 - p1) / difference_type(sizeof(T)); }
+
+        static T at_pos(position pos) noexcept
+        {
+            T value;
+            std::memcpy(&value, pos, sizeof(T));
+            return endian_swap<Order>(value);
+        }
+
+        constexpr size_type size() const noexcept { return size_type(_last - _first) / sizeof(T); }
+        constexpr void resize(size_type n) noexcept
+        {
+            assert(n <= size());
+            _last = _first + n * sizeof(T);
+        }
+        constexpr bool empty() const noexcept { return _first == _last; }
+
+        constexpr const byte* data() const noexcept { return _first; }
+        constexpr size_type size_bytes() const noexcept { return size_type(_last - _first); }
+
+        T operator [] (size_type n) const noexcept
+        {
+            assert(n < size());
+            return at_pos(_first + n * sizeof(T));
+        }
+        T at(size_type n) const
+        {
+            if (n >= size())
+                throw std::out_of_range("element index out of range");
+            return at_pos(_first + n * sizeof(T));
+        }
+        T front() const noexcept { return (*this)[0]; }
+        T back() const noexcept { return (*this)[size() - 1]; }
+
+        constexpr iterator begin() const noexcept { return iterator(_first); }
+        constexpr iterator end() const noexcept { return iterator(_last); }
+        reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+        reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+        constexpr endian_array_view subview(size_type offset, size_type count) const noexcept
+        {
+            assert(offset <= size() && count <= size() - offset);
+            return endian_array_view(_first + offset * sizeof(T), count);
+        }
+
+        // Converts every element to native byte order; dst must have room for size() elements.
+        // Returns the number of elements written.
+        size_type decode_to(span<T> dst) const noexcept
+        {
+            auto count = size();
+            assert(dst.size() >= count);
+
+            if constexpr (_private::is_byte_reversal<Order> && sizeof(T) != 1)
+                _private::byte_swap(_first, dst.data(), count, sizeof(T));
+            else if constexpr (Order == byte_order::native_endian || sizeof(T) == 1)
+            {
+                if (count != 0)
+                    std::memcpy(dst.data(), _first, count * sizeof(T));
+            }
+            else
+            {
+                for (size_type n = 0; n != count; ++n)
+                    dst[n] = at_pos(_first + n * sizeof(T));
+            }
+
+            return count;
+        }
+
+    private:
+        position _first;
+        position _last;
+    };
+
+    template <typename T, byte_order Order>
+    class endian_array_view<T, Order>::iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = T;
+
+    public:
+        constexpr iterator() noexcept : _p(nullptr) { }
+        explicit constexpr iterator(const byte* p) noexcept : _p(p) { }
+
+        friend constexpr bool operator == (iterator a, iterator b) noexcept { return a._p == b._p; }
+        friend constexpr bool operator != (iterator a, iterator b) noexcept { return a._p != b._p; }
+        friend constexpr bool operator < (iterator a, iterator b) noexcept { return a._p < b._p; }
+        friend constexpr bool operator > (iterator a, iterator b) noexcept { return a._p > b._p; }
+        friend constexpr bool operator <= (iterator a, iterator b) noexcept { return a._p <= b._p; }
+        friend constexpr bool operator >= (iterator a, iterator b) noexcept { return a._p >= b._p; }
+
+    public:
+        T operator * () const noexcept { return endian_array_view::at_pos(_p); }
+        T operator [] (difference_type n) const noexcept { return endian_array_view::at_pos(_p + n * difference_type(sizeof(T))); }
+
+        constexpr iterator& operator ++ () noexcept { _p += sizeof(T); return *this; }
+        constexpr iterator operator ++ (int) noexcept { auto tmp = *this; ++*this; return tmp; }
+        constexpr iterator& operator -- () noexcept { _p -= sizeof(T); return *this; }
+        constexpr iterator operator -- (int) noexcept { auto tmp = *this; --*this; return tmp; }
+
+        constexpr iterator& operator += (difference_type n) noexcept { _p += n * difference_type(sizeof(T)); return *this; }
+        constexpr iterator& operator -= (difference_type n) noexcept { _p -= n * difference_type(sizeof(T)); return *this; }
+
+        friend constexpr iterator operator + (iterator it, difference_type n) noexcept { return it += n; }
+        friend constexpr iterator operator + (difference_type n, iterator it) noexcept { return it += n; }
+        friend constexpr iterator operator - (iterator it, difference_type n) noexcept { return it -= n; }
+        friend constexpr difference_type operator - (iterator a, iterator b) noexcept { return (a._p - b._p) / difference_type(sizeof(T)); }
+
+        constexpr const byte* base_pos() const noexcept { return _p; }
+
+    private:
+        const byte* _p;
+    };
+
+    template <typename T> using endian_array_view_le = endian_array_view<T, byte_order::little_endian>;
+    template <typename T> using endian_array_view_be = endian_array_view<T, byte_order::big_endian>;
+
     inline namespace literals
     {
         inline namespace endian
@@ -528,7 +801,7 @@ namespace stdext
                 if (size != 4)
                     throw "_4cc literal must have four characters";
 
-                return swap<byte_order::big_endian>(
+                return endian_swap<byte_order::big_endian>(
                     uint32_t(str[0]) << 24
                     | uint32_t(str[1]) << 16
                     | uint32_t(str[2]) << 8
@@ -537,47 +810,47 @@ namespace stdext
 
             constexpr uint16_t operator ""_le16(unsigned long long v)
             {
-                return swap<byte_order::little_endian>(uint16_t(v));
+                return endian_swap<byte_order::little_endian>(uint16_t(v));
             }
 
             constexpr uint16_t operator ""_be16(unsigned long long v)
             {
-                return swap<byte_order::big_endian>(uint16_t(v));
+                return endian_swap<byte_order::big_endian>(uint16_t(v));
             }
 
             constexpr uint16_t operator ""_pdp16(unsigned long long v)
             {
-                return swap<byte_order::pdp_endian>(uint16_t(v));
+                return endian_swap<byte_order::pdp_endian>(uint16_t(v));
             }
 
             constexpr uint32_t operator ""_le32(unsigned long long v)
             {
-                return swap<byte_order::little_endian>(uint32_t(v));
+                return endian_swap<byte_order::little_endian>(uint32_t(v));
             }
 
             constexpr uint32_t operator ""_be32(unsigned long long v)
             {
-                return swap<byte_order::big_endian>(uint32_t(v));
+                return endian_swap<byte_order::big_endian>(uint32_t(v));
             }
 
             constexpr uint32_t operator ""_pdp32(unsigned long long v)
             {
-                return swap<byte_order::pdp_endian>(uint32_t(v));
+                return endian_swap<byte_order::pdp_endian>(uint32_t(v));
             }
 
             constexpr uint64_t operator ""_le64(unsigned long long v)
             {
-                return swap<byte_order::little_endian>(uint64_t(v));
+                return endian_swap<byte_order::little_endian>(uint64_t(v));
             }
 
             constexpr uint64_t operator ""_be64(unsigned long long v)
             {
-                return swap<byte_order::big_endian>(uint64_t(v));
+                return endian_swap<byte_order::big_endian>(uint64_t(v));
             }
 
             constexpr uint64_t operator ""_pdp64(unsigned long long v)
             {
-                return swap<byte_order::pdp_endian>(uint64_t(v));
+                return endian_swap<byte_order::pdp_endian>(uint64_t(v));
             }
         }
     }
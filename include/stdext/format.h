@@ -92,9 +92,20 @@ namespace stdext
         {
             if (*i != '$')
             {
-                if (!out(*i))
-                    return false;
-                ++i;
+                if constexpr (is_consumer_v<std::decay_t<Consumer>, string_view>)
+                {
+                    // Literal text is passed on a run at a time.
+                    auto e = std::find(i, fmt.end(), '$');
+                    if (!out(fmt.substr(i - fmt.begin(), e - i)))
+                        return false;
+                    i = e;
+                }
+                else
+                {
+                    if (!out(*i))
+                        return false;
+                    ++i;
+                }
                 continue;
             }
 
@@ -147,7 +158,7 @@ namespace stdext
     template <typename... Args>
     std::string format_string(string_view fmt, Args&&... args)
     {
-        stringbuf buf;
+        string_builder buf;
         bool result = format(buf, fmt, stdext::forward<Args>(args)...);
         assert(result);
         discard(result);
@@ -415,16 +415,42 @@ namespace stdext
     }
 
     template <typename T> using generator_type = std::remove_reference_t<decltype(as_generator(declval<T>()))>;
+
+    namespace _private
+    {
+        // Generators that produce values in blocks provide next_chunk, which returns the values
+        // produced so far as a view and advances past them.
+        template <typename Generator, typename Consumer, typename = void>
+        struct can_consume_chunks : false_type { };
+        template <typename Generator, typename Consumer>
+        struct can_consume_chunks<Generator, Consumer, std::void_t<decltype(declval<Generator&>().next_chunk())>>
+            : bool_constant<std::is_invocable_r_v<bool, Consumer&, decltype(declval<Generator&>().next_chunk())>> { };
+        template <typename Generator, typename Consumer>
+        constexpr bool can_consume_chunks_v = can_consume_chunks<Generator, Consumer>::value;
+    }
 }
 
 template <typename Producer, typename Consumer,
     STDEXT_REQUIRES(stdext::can_generate_v<Producer> && stdext::is_consumer_v<stdext::remove_cvref_t<Consumer>, stdext::generator_value_type<stdext::generator_type<Producer>>>)>
 bool operator >> (Producer&& p, Consumer&& c)
 {
-    for (auto&& gen = stdext::as_generator(stdext::forward<Producer>(p)); gen; ++gen)
+    auto&& gen = stdext::as_generator(stdext::forward<Producer>(p));
+    if constexpr (stdext::_private::can_consume_chunks_v<stdext::remove_cvref_t<decltype(gen)>, Consumer>)
+    {
+        // Pass whole blocks to consumers that accept them.
+        while (gen)
+        {
+            if (!c(gen.next_chunk()))
+                return false;
+        }
+    }
+    else
     {
-        if (!c(*gen))
-            return false;
+        for (; gen; ++gen)
+        {
+            if (!c(*gen))
+                return false;
+        }
     }
 
     return true;
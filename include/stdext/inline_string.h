@@ -0,0 +1,237 @@
+#ifndef STDEXT_INLINE_STRING_INCLUDED
+#define STDEXT_INLINE_STRING_INCLUDED
+#pragma once
+
+#include <stdext/checksum.h>
+#include <stdext/string_view.h>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <cassert>
+#include <cstdint>
+
+
+namespace stdext
+{
+    // What an inline_string does with text that doesn't fit.  With truncate, as much of the text
+    // as fits is kept, and the operation returns false; as a consumer, this stops the producer.
+    // With throw_exception, the operation throws std::length_error and leaves the string unchanged.
+    enum class inline_string_overflow
+    {
+        truncate,
+        throw_exception,
+    };
+
+    template <size_t N, typename charT = char, inline_string_overflow Overflow = inline_string_overflow::throw_exception,
+        typename traits = std::char_traits<charT>>
+    class inline_string;
+
+    namespace _private
+    {
+        template <size_t N>
+        using inline_string_length_t = std::conditional_t<N <= UINT8_MAX, uint8_t,
+            std::conditional_t<N <= UINT16_MAX, uint16_t, std::conditional_t<N <= UINT32_MAX, uint32_t, size_t>>>;
+    }
+
+    // A string of at most N characters, held entirely within the object along with its length.
+    // It never allocates, and is trivially copyable, so it can be copied with memcpy and read from
+    // or written to a stream directly.  The characters past the end are always zero, so the string
+    // is null-terminated, and two equal strings have identical character arrays (though any
+    // padding after the length is unspecified).
+    //
+    // An inline_string converts implicitly to a string_view, and is a consumer of characters and
+    // string views, so it can receive the output of format and to_utf8.
+    template <size_t N, typename charT, inline_string_overflow Overflow, typename traits>
+    class inline_string
+    {
+        static_assert(N != 0, "An inline_string must have room for at least one character");
+
+    public:
+        using value_type = charT;
+        using traits_type = traits;
+        using size_type = size_t;
+        using difference_type = ptrdiff_t;
+        using reference = charT&;
+        using const_reference = const charT&;
+        using pointer = charT*;
+        using const_pointer = const charT*;
+        using iterator = const charT*;
+        using const_iterator = const charT*;
+        using string_view_type = basic_string_view<charT, traits>;
+
+        static constexpr inline_string_overflow overflow = Overflow;
+
+    public:
+        constexpr inline_string() noexcept = default;
+
+        explicit inline_string(string_view_type str) noexcept(Overflow == inline_string_overflow::truncate)
+        {
+            append(str);
+        }
+
+        explicit inline_string(const charT* str) noexcept(Overflow == inline_string_overflow::truncate)
+            : inline_string(string_view_type(str))
+        {
+        }
+
+        template <typename Allocator>
+        explicit inline_string(const std::basic_string<charT, traits, Allocator>& str) noexcept(Overflow == inline_string_overflow::truncate)
+            : inline_string(string_view_type(str))
+        {
+        }
+
+    public:
+        friend bool operator == (const inline_string& a, const inline_string& b) noexcept
+        {
+            return a._size == b._size && traits::compare(a._data, b._data, a._size) == 0;
+        }
+        friend bool operator == (const inline_string& a, string_view_type b) noexcept
+        {
+            return a._size == b.size() && traits::compare(a._data, b.data(), a._size) == 0;
+        }
+        friend bool operator == (string_view_type a, const inline_string& b) noexcept { return b == a; }
+
+        friend bool operator != (const inline_string& a, const inline_string& b) noexcept { return !(a == b); }
+        friend bool operator != (const inline_string& a, string_view_type b) noexcept { return !(a == b); }
+        friend bool operator != (string_view_type a, const inline_string& b) noexcept { return !(a == b); }
+
+        friend bool operator < (const inline_string& a, const inline_string& b) noexcept { return a.compare(b.view()) < 0; }
+        friend bool operator > (const inline_string& a, const inline_string& b) noexcept { return b < a; }
+        friend bool operator <= (const inline_string& a, const inline_string& b) noexcept { return !(b < a); }
+        friend bool operator >= (const inline_string& a, const inline_string& b) noexcept { return !(a < b); }
+
+    public:
+        operator string_view_type () const noexcept { return view(); }
+        string_view_type view() const noexcept { return string_view_type(_data, _size); }
+
+        const charT* data() const noexcept { return _data; }
+        const charT* c_str() const noexcept { return _data; }
+
+        size_type size() const noexcept { return _size; }
+        size_type length() const noexcept { return _size; }
+        bool empty() const noexcept { return _size == 0; }
+        static constexpr size_type capacity() noexcept { return N; }
+        static constexpr size_type max_size() noexcept { return N; }
+
+        const_iterator begin() const noexcept { return _data; }
+        const_iterator end() const noexcept { return _data + _size; }
+        const_iterator cbegin() const noexcept { return begin(); }
+        const_iterator cend() const noexcept { return end(); }
+
+        const charT& operator [] (size_type pos) const noexcept
+        {
+            assert(pos <= _size);
+            return _data[pos];
+        }
+
+        const charT& at(size_type pos) const
+        {
+            if (pos >= _size)
+                throw std::out_of_range("inline_string index out of range");
+            return _data[pos];
+        }
+
+        const charT& front() const noexcept { assert(!empty()); return _data[0]; }
+        const charT& back() const noexcept { assert(!empty()); return _data[_size - 1]; }
+
+        int compare(string_view_type str) const noexcept
+        {
+            auto result = traits::compare(_data, str.data(), std::min<size_type>(_size, str.size()));
+            if (result != 0)
+                return result;
+            return _size < str.size() ? -1 : _size > str.size() ? 1 : 0;
+        }
+
+        // Appends ch, returning false if there's no room.
+        bool push_back(charT ch) noexcept(Overflow == inline_string_overflow::truncate)
+        {
+            if (_size == N)
+                return overflowed();
+            _data[_size++] = ch;
+            return true;
+        }
+
+        // Appends str, returning false if it had to be truncated.
+        bool append(string_view_type str) noexcept(Overflow == inline_string_overflow::truncate)
+        {
+            auto count = str.size();
+            if (count > N - _size)
+            {
+                if constexpr (Overflow == inline_string_overflow::throw_exception)
+                    overflowed();
+                count = N - _size;
+            }
+
+            traits::copy(_data + _size, str.data(), count);
+            _size = length_type(_size + count);
+            return count == str.size();
+        }
+
+        bool operator () (charT ch) noexcept(Overflow == inline_string_overflow::truncate) { return push_back(ch); }
+        bool operator () (string_view_type str) noexcept(Overflow == inline_string_overflow::truncate) { return append(str); }
+
+        inline_string& operator += (charT ch) noexcept(Overflow == inline_string_overflow::truncate)
+        {
+            push_back(ch);
+            return *this;
+        }
+
+        inline_string& operator += (string_view_type str) noexcept(Overflow == inline_string_overflow::truncate)
+        {
+            append(str);
+            return *this;
+        }
+
+        void pop_back() noexcept
+        {
+            assert(!empty());
+            _data[--_size] = charT();
+        }
+
+        void clear() noexcept
+        {
+            traits::assign(_data, _size, charT());
+            _size = 0;
+        }
+
+    private:
+        using length_type = _private::inline_string_length_t<N>;
+
+        bool overflowed() const
+        {
+            if constexpr (Overflow == inline_string_overflow::throw_exception)
+                throw std::length_error("inline_string capacity exceeded");
+            return false;
+        }
+
+    private:
+        charT _data[N + 1] = { };
+        length_type _size = 0;
+    };
+
+    template <size_t N, inline_string_overflow Overflow = inline_string_overflow::throw_exception>
+    using inline_wstring = inline_string<N, wchar_t, Overflow>;
+    template <size_t N, inline_string_overflow Overflow = inline_string_overflow::throw_exception>
+    using inline_u16string = inline_string<N, char16_t, Overflow>;
+    template <size_t N, inline_string_overflow Overflow = inline_string_overflow::throw_exception>
+    using inline_u32string = inline_string<N, char32_t, Overflow>;
+}
+
+namespace std
+{
+    template <size_t N, typename charT, stdext::inline_string_overflow Overflow, typename traits>
+    struct hash<stdext::inline_string<N, charT, Overflow, traits>>
+    {
+        size_t operator () (const stdext::inline_string<N, charT, Overflow, traits>& str) const noexcept
+        {
+            return size_t(stdext::xxhash64(stdext::array_view<const stdext::byte>(
+                reinterpret_cast<const stdext::byte*>(str.data()), str.size() * sizeof(charT))));
+        }
+    };
+}
+
+#endif
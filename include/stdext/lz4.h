@@ -0,0 +1,132 @@
+#ifndef STDEXT_LZ4_INCLUDED
+#define STDEXT_LZ4_INCLUDED
+#pragma once
+
+#include <stdext/checksum.h>
+#include <stdext/flags.h>
+#include <stdext/span.h>
+#include <stdext/stream.h>
+
+#include <memory>
+
+
+namespace stdext
+{
+    class lz4_error : public stream_error
+    {
+        using stream_error::stream_error;
+    };
+
+    enum class lz4_block_size
+    {
+        max_64kb = 4,
+        max_256kb = 5,
+        max_1mb = 6,
+        max_4mb = 7
+    };
+
+    enum class lz4_frame_options
+    {
+        none = 0,
+        linked_blocks = 1,
+        block_checksum = 2,
+        content_checksum = 4
+    };
+
+    namespace _private
+    {
+        struct lz4_matcher;
+    }
+
+    // Raw LZ4 block format.  lz4_compress_block returns the compressed size, or zero if the result
+    // would not fit in the destination; a destination of lz4_compress_bound(src.size()) bytes is
+    // always sufficient.  lz4_decompress_block returns the decompressed size and throws lz4_error
+    // if the input is malformed or the output would not fit.  The decompressor may write past the
+    // end of its result, but never past the end of the destination.
+    constexpr size_t lz4_compress_bound(size_t size) noexcept { return size + size / 255 + 16; }
+    [[nodiscard]] size_t lz4_compress_block(array_view<const byte> src, span<byte> dst);
+    [[nodiscard]] size_t lz4_decompress_block(array_view<const byte> src, span<byte> dst);
+
+    // Stream decorators for the LZ4 frame format.  The output stream buffers a block at a time; the
+    // frame is completed by finish(), or by the destructor if finish() was never called.  The
+    // input stream reads any sequence of frames (including skippable frames) and exposes each
+    // decoded block directly through direct_readable.
+    class lz4_output_stream : public output_stream
+    {
+    public:
+        static constexpr flags<lz4_frame_options> default_options = { lz4_frame_options::content_checksum };
+
+    public:
+        explicit lz4_output_stream(output_stream& stream, lz4_block_size block_size = lz4_block_size::max_64kb,
+            flags<lz4_frame_options> options = default_options);
+        lz4_output_stream(const lz4_output_stream&) = delete;
+        lz4_output_stream& operator = (const lz4_output_stream&) = delete;
+        ~lz4_output_stream() override;
+
+    public:
+        void finish();
+
+    private:
+        [[nodiscard]] size_t do_write(const byte* buffer, size_t size) final;
+
+        void write_header();
+        void write_block();
+
+    private:
+        output_stream* _stream;
+        flags<lz4_frame_options> _options;
+        lz4_block_size _block_size;
+        size_t _block_capacity;
+        std::unique_ptr<byte[]> _buffer;
+        std::unique_ptr<byte[]> _compressed;
+        std::unique_ptr<_private::lz4_matcher> _matcher;
+        size_t _history = 0;
+        size_t _pending = 0;
+        uint64_t _position = 0;
+        xxhash32_state _content_checksum;
+        bool _started = false;
+        bool _finished = false;
+    };
+
+    class lz4_input_stream : public input_stream, public direct_readable
+    {
+    public:
+        explicit lz4_input_stream(input_stream& stream);
+        lz4_input_stream(const lz4_input_stream&) = delete;
+        lz4_input_stream& operator = (const lz4_input_stream&) = delete;
+        ~lz4_input_stream() override;
+
+    public:
+        [[nodiscard]] size_t direct_read(std::function<size_t(const byte* buffer, size_t size)> read) final;
+
+    private:
+        [[nodiscard]] size_t do_read(byte* buffer, size_t size) final;
+        [[nodiscard]] size_t do_skip(size_t size) final;
+
+        bool fill();
+        bool read_header();
+        void read_block();
+        void finish_frame();
+
+    private:
+        input_stream* _stream;
+        std::unique_ptr<byte[]> _buffer;
+        std::unique_ptr<byte[]> _compressed;
+        size_t _buffer_capacity = 0;
+        size_t _compressed_capacity = 0;
+        size_t _block_capacity = 0;
+        byte* _current = nullptr;
+        byte* _last = nullptr;
+        uint64_t _content_size = 0;
+        uint64_t _content_read = 0;
+        xxhash32_state _content_checksum;
+        bool _in_frame = false;
+        bool _linked = false;
+        bool _block_checksum = false;
+        bool _has_content_checksum = false;
+        bool _has_content_size = false;
+        bool _eof = false;
+    };
+}
+
+#endif
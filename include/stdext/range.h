@@ -150,6 +150,8 @@ namespace stdext
 
     namespace _private
     {
+        STDEXT_DECLARE_HAS_METHOD(advance_pos);
+
         template <typename Range>
         range_position_type<Range>& advance_pos(const Range& range, range_position_type<Range>& pos, range_difference_type<Range> n, multi_pass_range_tag)
         {
@@ -163,6 +165,10 @@ namespace stdext
         template <typename Range>
         range_position_type<Range>& advance_pos(const Range& range, range_position_type<Range>& pos, range_difference_type<Range> n, bidirectional_range_tag)
         {
+            // Some bidirectional ranges, such as trees, can skip ahead faster than one step at a time.
+            if constexpr (STDEXT_HAS_METHOD_V(const Range&, advance_pos, range_position_type<Range>&, range_difference_type<Range>))
+                return range.advance_pos(pos, n);
+
             for (; n > 0; --n)
                 range.inc_pos(pos);
             for (; n < 0; ++n)
@@ -791,7 +797,7 @@ namespace stdext
         class multi_pass_range_iterator
         {
         public:
-            using iterator_category = _private::range_iterator_category_map<range_category<Range>>;
+            using iterator_category = _private::range_iterator_category_map_t<range_category<Range>>;
             using value_type = stdext::range_value_type<Range>;
             using difference_type = stdext::range_difference_type<Range>;
             using pointer = value_type*;
@@ -0,0 +1,338 @@
+#ifndef STDEXT_RECORD_INCLUDED
+#define STDEXT_RECORD_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+#include <stdext/endian.h>
+#include <stdext/span.h>
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <utility>
+
+#include <cassert>
+#include <cstring>
+
+
+namespace stdext
+{
+    // Compile-time descriptions of binary records.  A record_layout lists the fields of a
+    // trivially copyable struct in wire order; the wire format is the concatenation of the
+    // fields with no padding, each in its stated byte order.  For example:
+    //
+    //     struct header { uint32_t magic; uint16_t version; uint16_t flags; uint64_t size; };
+    //     using header_layout = record_layout<header,
+    //         record_field<&header::magic, byte_order::big_endian>,
+    //         record_field<&header::version, byte_order::big_endian>,
+    //         record_field<&header::flags, byte_order::big_endian>,
+    //         record_field<&header::size, byte_order::big_endian>>;
+    //
+    //     header h = header_layout::read(stream);
+    //
+    // When the in-memory layout of the struct is identical to the wire format, records are
+    // transferred with a single read or write and no per-field work.  Otherwise each record is
+    // assembled from an unrolled sequence of per-field loads and byte swaps.
+
+    template <auto Member, byte_order Order = byte_order::native_endian>
+    struct record_field;
+
+    template <typename T, typename... Fields>
+    class record_layout;
+
+    namespace _private
+    {
+        template <typename MemberPointer> struct member_pointer_traits;
+
+        template <typename Class, typename Value>
+        struct member_pointer_traits<Value Class::*>
+        {
+            using class_type = Class;
+            using value_type = Value;
+        };
+    }
+
+    template <auto Member, byte_order Order>
+    struct record_field
+    {
+        using class_type = typename _private::member_pointer_traits<decltype(Member)>::class_type;
+        using value_type = typename _private::member_pointer_traits<decltype(Member)>::value_type;
+
+        static_assert(std::is_trivially_copyable_v<value_type>);
+
+        static constexpr auto member = Member;
+        static constexpr byte_order order = Order;
+        static constexpr size_t size = sizeof(value_type);
+
+        // Arithmetic and enumeration fields are converted to the given byte order; other fields
+        // (endian_int, character arrays, and so on) are copied as-is.
+        static constexpr bool is_swapped = Order != byte_order::native_endian && size > 1
+            && (std::is_arithmetic_v<value_type> || std::is_enum_v<value_type>);
+
+        static void encode(const value_type& value, byte* out) noexcept
+        {
+            if constexpr (is_swapped)
+            {
+                _private::make_sized_integral_type_t<size, false> bits;
+                std::memcpy(&bits, &value, size);
+                bits = endian_swap<Order>(bits);
+                std::memcpy(out, &bits, size);
+            }
+            else
+                std::memcpy(out, &value, size);
+        }
+
+        static void decode(const byte* in, value_type& value) noexcept
+        {
+            if constexpr (is_swapped)
+            {
+                _private::make_sized_integral_type_t<size, false> bits;
+                std::memcpy(&bits, in, size);
+                bits = endian_swap<Order>(bits);
+                std::memcpy(&value, &bits, size);
+            }
+            else
+                std::memcpy(&value, in, size);
+        }
+    };
+
+    template <typename T, typename... Fields>
+    class record_layout
+    {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>);
+        static_assert(sizeof...(Fields) != 0);
+        static_assert((... && std::is_same_v<typename Fields::class_type, T>));
+
+    public:
+        using record_type = T;
+
+        static constexpr size_t field_count = sizeof...(Fields);
+        static constexpr size_t wire_size = (size_t(0) + ... + Fields::size);
+
+        // Byte offset of each field within the wire format.
+        static constexpr std::array<size_t, field_count> wire_offsets = []
+        {
+            std::array<size_t, field_count> offsets = { };
+            const size_t sizes[] = { Fields::size... };
+            size_t offset = 0;
+            for (size_t n = 0; n != field_count; ++n)
+            {
+                offsets[n] = offset;
+                offset += sizes[n];
+            }
+            return offsets;
+        }();
+
+    public:
+        // True if a T in memory is byte-for-byte identical to its wire representation.  The
+        // result depends only on the layout of T; the field offsets are checked once, on first
+        // use, and remembered.
+        static bool is_identity() noexcept
+        {
+            if constexpr (sizeof(T) != wire_size || (... || Fields::is_swapped))
+                return false;
+            else
+            {
+                static const bool identity = is_identity(std::index_sequence_for<Fields...>());
+                return identity;
+            }
+        }
+
+        static void encode(const T& record, byte* out) noexcept
+        {
+            encode(record, out, std::index_sequence_for<Fields...>());
+        }
+
+        static void decode(const byte* in, T& record) noexcept
+        {
+            decode(in, record, std::index_sequence_for<Fields...>());
+        }
+
+        // Decodes dst.size() records from src and returns the number of bytes consumed.
+        static size_t decode(array_view<const byte> src, span<T> dst)
+        {
+            auto size = dst.size() * wire_size;
+            if (src.size() < size)
+                throw stream_error("premature end of stream");
+
+            if (is_identity())
+            {
+                if (size != 0)
+                    std::memcpy(dst.data(), src.data(), size);
+            }
+            else
+            {
+                auto in = src.data();
+                for (auto& record : dst)
+                {
+                    decode(in, record);
+                    in += wire_size;
+                }
+            }
+
+            return size;
+        }
+
+        // Encodes src into dst, which must have room for src.size() * wire_size bytes, and returns
+        // the number of bytes written.
+        static size_t encode(array_view<const T> src, span<byte> dst) noexcept
+        {
+            auto size = src.size() * wire_size;
+            assert(dst.size() >= size);
+
+            if (is_identity())
+            {
+                if (size != 0)
+                    std::memcpy(dst.data(), src.data(), size);
+            }
+            else
+            {
+                auto out = dst.data();
+                for (auto& record : src)
+                {
+                    encode(record, out);
+                    out += wire_size;
+                }
+            }
+
+            return size;
+        }
+
+        static T read(input_stream& s)
+        {
+            T record = { };
+            if (is_identity())
+                s.read_all(&record, 1);
+            else
+            {
+                byte buffer[wire_size];
+                s.read_all(buffer, wire_size);
+                decode(buffer, record);
+            }
+            return record;
+        }
+
+        static void read(input_stream& s, T* records, size_t count)
+        {
+            if (is_identity())
+            {
+                s.read_all(records, count);
+                return;
+            }
+
+            byte buffer[chunk_size];
+            while (count != 0)
+            {
+                auto chunk = std::min(count, chunk_records);
+                s.read_all(buffer, chunk * wire_size);
+                for (size_t n = 0; n != chunk; ++n)
+                    decode(buffer + n * wire_size, records[n]);
+                records += chunk;
+                count -= chunk;
+            }
+        }
+
+        static void write(output_stream& s, const T& record)
+        {
+            if (is_identity())
+                s.write(record);
+            else
+            {
+                byte buffer[wire_size];
+                encode(record, buffer);
+                s.write_all(buffer, wire_size);
+            }
+        }
+
+        static void write(output_stream& s, const T* records, size_t count)
+        {
+            if (is_identity())
+            {
+                s.write_all(records, count);
+                return;
+            }
+
+            byte buffer[chunk_size];
+            while (count != 0)
+            {
+                auto chunk = std::min(count, chunk_records);
+                for (size_t n = 0; n != chunk; ++n)
+                    encode(records[n], buffer + n * wire_size);
+                s.write_all(buffer, chunk * wire_size);
+                records += chunk;
+                count -= chunk;
+            }
+        }
+
+        // Struct-of-arrays decoding: the value of each field of count consecutive records is
+        // stored in the corresponding column.  A null column skips its field.  Each field is
+        // decoded in a separate pass over the records, which keeps the inner loops simple
+        // enough to vectorize.
+        static size_t decode_columns(array_view<const byte> src, size_t count, typename Fields::value_type*... columns)
+        {
+            auto size = count * wire_size;
+            if (src.size() < size)
+                throw stream_error("premature end of stream");
+
+            decode_columns(src.data(), count, std::make_tuple(columns...), std::index_sequence_for<Fields...>());
+            return size;
+        }
+
+        static void read_columns(input_stream& s, size_t count, typename Fields::value_type*... columns)
+        {
+            byte buffer[chunk_size];
+            auto column_pointers = std::make_tuple(columns...);
+            while (count != 0)
+            {
+                auto chunk = std::min(count, chunk_records);
+                s.read_all(buffer, chunk * wire_size);
+                decode_columns(buffer, chunk, column_pointers, std::index_sequence_for<Fields...>());
+                std::apply([&](auto*&... column) { ((column = column ? column + chunk : nullptr), ...); }, column_pointers);
+                count -= chunk;
+            }
+        }
+
+    private:
+        static constexpr size_t chunk_size = std::max(size_t(4096), wire_size);
+        static constexpr size_t chunk_records = chunk_size / wire_size;
+
+        template <size_t... I>
+        static bool is_identity(std::index_sequence<I...>) noexcept
+        {
+            const T probe = { };
+            auto base = reinterpret_cast<const unsigned char*>(&probe);
+            return (... && (reinterpret_cast<const unsigned char*>(&(probe.*Fields::member)) - base == ptrdiff_t(wire_offsets[I])));
+        }
+
+        template <size_t... I>
+        static void encode(const T& record, byte* out, std::index_sequence<I...>) noexcept
+        {
+            (Fields::encode(record.*Fields::member, out + wire_offsets[I]), ...);
+        }
+
+        template <size_t... I>
+        static void decode(const byte* in, T& record, std::index_sequence<I...>) noexcept
+        {
+            (Fields::decode(in + wire_offsets[I], record.*Fields::member), ...);
+        }
+
+        template <typename Columns, size_t... I>
+        static void decode_columns(const byte* in, size_t count, const Columns& columns, std::index_sequence<I...>) noexcept
+        {
+            (decode_column<Fields, I>(in, count, std::get<I>(columns)), ...);
+        }
+
+        template <typename Field, size_t I>
+        static void decode_column(const byte* in, size_t count, typename Field::value_type* column) noexcept
+        {
+            if (column == nullptr)
+                return;
+
+            in += wire_offsets[I];
+            for (size_t n = 0; n != count; ++n, in += wire_size)
+                Field::decode(in, column[n]);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,595 @@
+#ifndef STDEXT_ROPE_INCLUDED
+#define STDEXT_ROPE_INCLUDED
+#pragma once
+
+#include <stdext/generator.h>
+#include <stdext/range.h>
+#include <stdext/string_view.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <cassert>
+
+
+namespace stdext
+{
+    template <typename charT, typename traits = std::char_traits<charT>>
+    class basic_rope;
+    using rope = basic_rope<char>;
+    using wrope = basic_rope<wchar_t>;
+    using u16rope = basic_rope<char16_t>;
+    using u32rope = basic_rope<char32_t>;
+
+    template <typename charT, typename traits = std::char_traits<charT>>
+    class rope_generator;
+
+    // A string for large text that is built and edited incrementally.  The text is held in chunks
+    // of at most max_chunk_size characters at the leaves of a balanced (AVL) tree, and each node
+    // caches the length and the number of newlines beneath it.  Insertion, erasure, and substrings
+    // take logarithmic time (plus the length of any inserted text), as does indexing.
+    //
+    // Nodes are immutable and shared, so copying a rope is cheap, and a copy is unaffected by later
+    // edits to the original.  Edits copy the path from the root to the chunks they change; text
+    // appended to a chunk with room is merged into a new copy of that chunk.
+    //
+    // A rope is a bidirectional range whose advance_pos descends the tree rather than stepping, and
+    // a producer for operator >>, which passes its text on a chunk at a time.
+    template <typename charT, typename traits>
+    class basic_rope
+    {
+        friend class rope_generator<charT, traits>;
+
+    public:
+        using range_category = bidirectional_range_tag;
+        using traits_type = traits;
+        using value_type = charT;
+        using size_type = size_t;
+        using difference_type = ptrdiff_t;
+        using reference = const charT&;
+        using const_reference = const charT&;
+        using string_type = std::basic_string<charT, traits>;
+        using string_view_type = basic_string_view<charT, traits>;
+
+        static constexpr size_type npos = size_type(-1);
+        static constexpr size_type max_chunk_size = 0x400 / sizeof(charT);
+
+        class position
+        {
+            friend class basic_rope;
+            friend class rope_generator<charT, traits>;
+
+        public:
+            position() noexcept = default;
+
+            friend bool operator == (const position& a, const position& b) noexcept { return a._index == b._index; }
+            friend bool operator != (const position& a, const position& b) noexcept { return !(a == b); }
+
+            size_type index() const noexcept { return _index; }
+
+        private:
+            position(size_type index, const charT* chunk, size_type offset, size_type chunk_size) noexcept
+                : _index(index), _chunk(chunk), _offset(offset), _chunk_size(chunk_size)
+            {
+            }
+
+        private:
+            size_type _index = 0;
+            const charT* _chunk = nullptr;
+            size_type _offset = 0;
+            size_type _chunk_size = 0;
+        };
+
+    public:
+        basic_rope() noexcept = default;
+        explicit basic_rope(string_view_type str) : _root(build(str.data(), str.size())) { }
+        explicit basic_rope(const charT* str) : basic_rope(string_view_type(str)) { }
+        explicit basic_rope(const string_type& str) : basic_rope(string_view_type(str)) { }
+
+    public:
+        friend bool operator == (const basic_rope& a, const basic_rope& b)
+        {
+            if (a._root == b._root)
+                return true;
+            return a.size() == b.size() && a.equal(b);
+        }
+
+        friend bool operator != (const basic_rope& a, const basic_rope& b)
+        {
+            return !(a == b);
+        }
+
+        friend basic_rope operator + (const basic_rope& a, const basic_rope& b)
+        {
+            return basic_rope(join(a._root, b._root));
+        }
+
+        friend void swap(basic_rope& a, basic_rope& b) noexcept
+        {
+            a._root.swap(b._root);
+        }
+
+    public:
+        size_type size() const noexcept { return _root ? _root->size : 0; }
+        size_type length() const noexcept { return size(); }
+        bool empty() const noexcept { return !_root; }
+
+        // The number of newline characters in the text.
+        size_type newline_count() const noexcept { return _root ? _root->newlines : 0; }
+
+        // Returns the offset of the first character of the given line, counting from zero, or npos
+        // if the text has fewer lines.
+        size_type line_offset(size_type line) const noexcept
+        {
+            if (line == 0)
+                return 0;
+            if (line > newline_count())
+                return npos;
+
+            // Find the line'th newline; the line begins just after it.
+            size_type offset = 0;
+            auto p = _root.get();
+            while (p->height != 0)
+            {
+                auto& b = as_branch(*p);
+                if (line <= b.left->newlines)
+                    p = b.left.get();
+                else
+                {
+                    line -= b.left->newlines;
+                    offset += b.left->size;
+                    p = b.right.get();
+                }
+            }
+
+            auto& text = as_leaf(*p).text;
+            for (size_type n = 0; ; ++n)
+            {
+                if (traits::eq(text[n], charT('\n')) && --line == 0)
+                    return offset + n + 1;
+            }
+        }
+
+        const charT& operator [] (size_type pos) const noexcept
+        {
+            assert(pos < size());
+            auto p = locate(pos);
+            return p._chunk[p._offset];
+        }
+
+        const charT& at(size_type pos) const
+        {
+            if (pos >= size())
+                throw std::out_of_range("basic_rope::at");
+            return (*this)[pos];
+        }
+
+        basic_rope& append(string_view_type str)
+        {
+            _root = _root ? insert(_root, _root->size, str.data(), str.size()) : build(str.data(), str.size());
+            return *this;
+        }
+
+        basic_rope& append(const basic_rope& str)
+        {
+            _root = join(_root, str._root);
+            return *this;
+        }
+
+        basic_rope& operator += (string_view_type str) { return append(str); }
+        basic_rope& operator += (const basic_rope& str) { return append(str); }
+
+        basic_rope& insert(size_type pos, string_view_type str)
+        {
+            check_pos(pos);
+            _root = _root ? insert(_root, pos, str.data(), str.size()) : build(str.data(), str.size());
+            return *this;
+        }
+
+        basic_rope& insert(size_type pos, const basic_rope& str)
+        {
+            check_pos(pos);
+            auto parts = split(_root, pos);
+            _root = join(join(parts.first, str._root), parts.second);
+            return *this;
+        }
+
+        basic_rope& erase(size_type pos = 0, size_type count = npos)
+        {
+            check_pos(pos);
+            count = std::min(count, size() - pos);
+            auto head = split(_root, pos);
+            auto tail = split(head.second, count);
+            _root = join(head.first, tail.second);
+            return *this;
+        }
+
+        basic_rope substr(size_type pos = 0, size_type count = npos) const
+        {
+            check_pos(pos);
+            count = std::min(count, size() - pos);
+            return basic_rope(split(split(_root, pos).second, count).first);
+        }
+
+        void clear() noexcept
+        {
+            _root.reset();
+        }
+
+        string_type str() const
+        {
+            string_type result;
+            result.reserve(size());
+            for (auto p = begin_pos(); !is_end_pos(p); advance_pos(p, difference_type(p._chunk_size - p._offset)))
+                result.append(p._chunk + p._offset, p._chunk_size - p._offset);
+            return result;
+        }
+
+    public:
+        // Range interface
+        position begin_pos() const noexcept { return locate(0); }
+        position end_pos() const noexcept { return position(size(), nullptr, 0, 0); }
+        bool is_end_pos(position pos) const noexcept { return pos._index == size(); }
+
+        position& inc_pos(position& pos) const noexcept
+        {
+            assert(!is_end_pos(pos));
+            if (++pos._offset == pos._chunk_size)
+                pos = locate(pos._index + 1);
+            else
+                ++pos._index;
+            return pos;
+        }
+
+        position& dec_pos(position& pos) const noexcept
+        {
+            assert(pos._index != 0);
+            if (pos._offset == 0)
+                pos = locate(pos._index - 1);
+            else
+            {
+                --pos._offset;
+                --pos._index;
+            }
+            return pos;
+        }
+
+        position& advance_pos(position& pos, difference_type n) const noexcept
+        {
+            assert(n >= -difference_type(pos._index) && n <= difference_type(size() - pos._index));
+            if (n >= -difference_type(pos._offset) && n < difference_type(pos._chunk_size - pos._offset))
+            {
+                pos._offset += n;
+                pos._index += n;
+            }
+            else
+                pos = locate(pos._index + n);
+            return pos;
+        }
+
+        difference_type distance(position p1, position p2) const noexcept
+        {
+            return difference_type(p2._index - p1._index);
+        }
+
+        reference at_pos(position pos) const noexcept
+        {
+            assert(!is_end_pos(pos));
+            return pos._chunk[pos._offset];
+        }
+
+        auto begin() const noexcept { return range_iterator<basic_rope>(*this, begin_pos()); }
+        auto end() const noexcept { return range_iterator<basic_rope>(*this, end_pos()); }
+
+    private:
+        struct node
+        {
+            size_type size;
+            size_type newlines;
+            unsigned height;
+        };
+
+        struct leaf : node
+        {
+            string_type text;
+        };
+
+        struct branch : node
+        {
+            std::shared_ptr<const node> left;
+            std::shared_ptr<const node> right;
+        };
+
+        using node_ptr = std::shared_ptr<const node>;
+
+        explicit basic_rope(node_ptr root) noexcept : _root(stdext::move(root)) { }
+
+        static const leaf& as_leaf(const node& n) noexcept { return static_cast<const leaf&>(n); }
+        static const branch& as_branch(const node& n) noexcept { return static_cast<const branch&>(n); }
+
+        static size_type count_newlines(const charT* str, size_type size) noexcept
+        {
+            return size_type(std::count(str, str + size, charT('\n')));
+        }
+
+        static node_ptr make_leaf(const charT* str, size_type size)
+        {
+            if (size == 0)
+                return nullptr;
+            auto p = std::make_shared<leaf>();
+            p->size = size;
+            p->newlines = count_newlines(str, size);
+            p->height = 0;
+            p->text.assign(str, size);
+            return p;
+        }
+
+        static node_ptr make_branch(node_ptr left, node_ptr right)
+        {
+            auto p = std::make_shared<branch>();
+            p->size = left->size + right->size;
+            p->newlines = left->newlines + right->newlines;
+            p->height = std::max(left->height, right->height) + 1;
+            p->left = stdext::move(left);
+            p->right = stdext::move(right);
+            return p;
+        }
+
+        // Builds a perfectly balanced tree of full chunks.
+        static node_ptr build(const charT* str, size_type size)
+        {
+            if (size <= max_chunk_size)
+                return make_leaf(str, size);
+
+            auto chunks = (size + max_chunk_size - 1) / max_chunk_size;
+            auto left = chunks / 2 * max_chunk_size;
+            return make_branch(build(str, left), build(str + left, size - left));
+        }
+
+        // Concatenates two balanced trees.  Adjacent leaves small enough to share a chunk are merged.
+        static node_ptr join(const node_ptr& left, const node_ptr& right)
+        {
+            if (!left)
+                return right;
+            if (!right)
+                return left;
+
+            if (left->height == 0 && right->height == 0 && left->size + right->size <= max_chunk_size)
+            {
+                auto& a = as_leaf(*left).text;
+                auto& b = as_leaf(*right).text;
+                string_type text;
+                text.reserve(a.size() + b.size());
+                text.append(a).append(b);
+                return make_leaf(text.data(), text.size());
+            }
+
+            if (left->height > right->height + 1)
+                return join_right(left, right);
+            if (right->height > left->height + 1)
+                return join_left(left, right);
+            return make_branch(left, right);
+        }
+
+        // Joins right onto the right spine of left, which is more than one level taller, and
+        // restores the balance on the way back up.
+        static node_ptr join_right(const node_ptr& left, const node_ptr& right)
+        {
+            auto& b = as_branch(*left);
+            if (b.right->height <= right->height + 1)
+            {
+                if (std::max(b.right->height, right->height) + 1 <= b.left->height + 1)
+                    return make_branch(b.left, make_branch(b.right, right));
+
+                // b.right is the taller of the two, and too tall to sit beside b.left.
+                auto& c = as_branch(*b.right);
+                return make_branch(make_branch(b.left, c.left), make_branch(c.right, right));
+            }
+
+            auto joined = join_right(b.right, right);
+            if (joined->height <= b.left->height + 1)
+                return make_branch(b.left, joined);
+
+            auto& c = as_branch(*joined);
+            return make_branch(make_branch(b.left, c.left), c.right);
+        }
+
+        static node_ptr join_left(const node_ptr& left, const node_ptr& right)
+        {
+            auto& b = as_branch(*right);
+            if (b.left->height <= left->height + 1)
+            {
+                if (std::max(b.left->height, left->height) + 1 <= b.right->height + 1)
+                    return make_branch(make_branch(left, b.left), b.right);
+
+                auto& c = as_branch(*b.left);
+                return make_branch(make_branch(left, c.left), make_branch(c.right, b.right));
+            }
+
+            auto joined = join_left(left, b.left);
+            if (joined->height <= b.right->height + 1)
+                return make_branch(joined, b.right);
+
+            auto& c = as_branch(*joined);
+            return make_branch(c.left, make_branch(c.right, b.right));
+        }
+
+        // Splits a tree into the first pos characters and the rest.
+        static std::pair<node_ptr, node_ptr> split(const node_ptr& p, size_type pos)
+        {
+            if (pos == 0)
+                return { nullptr, p };
+            if (pos == p->size)
+                return { p, nullptr };
+
+            if (p->height == 0)
+            {
+                auto& text = as_leaf(*p).text;
+                return { make_leaf(text.data(), pos), make_leaf(text.data() + pos, text.size() - pos) };
+            }
+
+            auto& b = as_branch(*p);
+            if (pos <= b.left->size)
+            {
+                auto parts = split(b.left, pos);
+                return { parts.first, join(parts.second, b.right) };
+            }
+
+            auto parts = split(b.right, pos - b.left->size);
+            return { join(b.left, parts.first), parts.second };
+        }
+
+        // Inserts text into a nonempty tree, within a single chunk if it fits.
+        static node_ptr insert(const node_ptr& p, size_type pos, const charT* str, size_type size)
+        {
+            if (p->height == 0)
+            {
+                auto& text = as_leaf(*p).text;
+                if (text.size() + size <= max_chunk_size)
+                {
+                    string_type combined;
+                    combined.reserve(text.size() + size);
+                    combined.append(text, 0, pos).append(str, size).append(text, pos, string_type::npos);
+                    return make_leaf(combined.data(), combined.size());
+                }
+                return join(join(make_leaf(text.data(), pos), build(str, size)), make_leaf(text.data() + pos, text.size() - pos));
+            }
+
+            auto& b = as_branch(*p);
+            if (pos <= b.left->size)
+                return join(insert(b.left, pos, str, size), b.right);
+            return join(b.left, insert(b.right, pos - b.left->size, str, size));
+        }
+
+        position locate(size_type index) const noexcept
+        {
+            if (index == size())
+                return end_pos();
+
+            auto offset = index;
+            auto p = _root.get();
+            while (p->height != 0)
+            {
+                auto& b = as_branch(*p);
+                if (offset < b.left->size)
+                    p = b.left.get();
+                else
+                {
+                    offset -= b.left->size;
+                    p = b.right.get();
+                }
+            }
+
+            auto& text = as_leaf(*p).text;
+            return position(index, text.data(), offset, text.size());
+        }
+
+        // Compares the text of two ropes of the same size a chunk at a time.
+        bool equal(const basic_rope& other) const noexcept
+        {
+            auto p = begin_pos();
+            auto q = other.begin_pos();
+            while (!is_end_pos(p))
+            {
+                auto count = std::min(p._chunk_size - p._offset, q._chunk_size - q._offset);
+                if (traits::compare(p._chunk + p._offset, q._chunk + q._offset, count) != 0)
+                    return false;
+                advance_pos(p, difference_type(count));
+                other.advance_pos(q, difference_type(count));
+            }
+            return true;
+        }
+
+        void check_pos(size_type pos) const
+        {
+            if (pos > size())
+                throw std::out_of_range("basic_rope position out of range");
+        }
+
+    private:
+        node_ptr _root;
+    };
+
+    // Produces the text of a rope.  The generator holds a copy of the rope, so later edits to the
+    // original don't affect it.
+    template <typename charT, typename traits>
+    class rope_generator
+    {
+    public:
+        using iterator_category = generator_tag;
+        using value_type = charT;
+        using difference_type = ptrdiff_t;
+        using pointer = const charT*;
+        using reference = const charT&;
+        using rope_type = basic_rope<charT, traits>;
+
+    public:
+        rope_generator() = default;
+        explicit rope_generator(const rope_type& r) : _rope(r), _pos(_rope.begin_pos()) { }
+
+    public:
+        friend bool operator == (const rope_generator& a, const rope_generator& b) noexcept
+        {
+            return a._rope._root == b._rope._root && a._pos == b._pos;
+        }
+
+        friend bool operator != (const rope_generator& a, const rope_generator& b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend void swap(rope_generator& a, rope_generator& b) noexcept
+        {
+            swap(a._rope, b._rope);
+            std::swap(a._pos, b._pos);
+        }
+
+    public:
+        reference operator * () const noexcept { return _rope.at_pos(_pos); }
+        pointer operator -> () const noexcept { return &_rope.at_pos(_pos); }
+
+        rope_generator& operator ++ () noexcept
+        {
+            _rope.inc_pos(_pos);
+            return *this;
+        }
+
+        iterator_proxy<rope_generator> operator ++ (int)
+        {
+            iterator_proxy<rope_generator> proxy = **this;
+            ++*this;
+            return proxy;
+        }
+
+        explicit operator bool () const noexcept { return !_rope.is_end_pos(_pos); }
+
+        // Returns the rest of the current chunk, and advances to the next.
+        basic_string_view<charT, traits> next_chunk() noexcept
+        {
+            basic_string_view<charT, traits> chunk(_pos._chunk + _pos._offset, _pos._chunk_size - _pos._offset);
+            _rope.advance_pos(_pos, difference_type(chunk.size()));
+            return chunk;
+        }
+
+    private:
+        rope_type _rope;
+        typename rope_type::position _pos;
+    };
+
+    template <typename charT, typename traits>
+    auto make_generator(const basic_rope<charT, traits>& r)
+    {
+        return rope_generator<charT, traits>(r);
+    }
+
+    template <typename charT, typename traits>
+    auto make_generator(basic_rope<charT, traits>& r)
+    {
+        return rope_generator<charT, traits>(r);
+    }
+}
+
+#endif
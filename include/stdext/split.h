@@ -0,0 +1,174 @@
+#ifndef STDEXT_SPLIT_INCLUDED
+#define STDEXT_SPLIT_INCLUDED
+#pragma once
+
+#include <stdext/generator.h>
+#include <stdext/stream.h>
+#include <stdext/string_view.h>
+
+#include <memory>
+
+
+// Splitting text into tokens.  split produces the tokens of a string_view or an input_stream
+// separated by a delimiter character; split_any separates them by any of a set of characters.
+// Splitting follows getline: a token ends at each delimiter, and the text after the last
+// delimiter is a final token only if it isn't empty.  Thus "a\n\nb\n" splits into "a", "", and
+// "b", and an empty string produces no tokens at all.
+//
+// Delimiters are found 64 bytes at a time with vector instructions, as a bitmask whose set bits
+// are then visited in turn; no predicate is called per character.
+
+namespace stdext
+{
+    // Produces the tokens of a string_view.  The tokens are views of the original string.
+    class split_generator
+    {
+    public:
+        using iterator_category = generator_tag;
+        using value_type = string_view;
+        using difference_type = ptrdiff_t;
+        using pointer = const string_view*;
+        using reference = const string_view&;
+
+    public:
+        split_generator() noexcept = default;
+        split_generator(string_view str, const _private::byte_set& delimiters) noexcept;
+
+    public:
+        friend bool operator == (const split_generator& a, const split_generator& b) noexcept
+        {
+            return a._done == b._done && (a._done || (a._str == b._str && a._next == b._next));
+        }
+        friend bool operator != (const split_generator& a, const split_generator& b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend void swap(split_generator& a, split_generator& b) noexcept
+        {
+            std::swap(a, b);
+        }
+
+    public:
+        reference operator * () const noexcept { assert(!_done); return _token; }
+        pointer operator -> () const noexcept { assert(!_done); return &_token; }
+        split_generator& operator ++ () noexcept { next(); return *this; }
+        iterator_proxy<split_generator> operator ++ (int) noexcept
+        {
+            iterator_proxy<split_generator> proxy(_token);
+            ++*this;
+            return proxy;
+        }
+
+        explicit operator bool () const noexcept { return !_done; }
+
+    private:
+        void next() noexcept;
+
+    private:
+        _private::byte_set _delimiters = { };
+        string_view _str;
+        string_view _token;
+        size_t _next = 0;           // The start of the next token
+        size_t _scan = 0;           // The first byte not yet checked for delimiters
+        size_t _mask_base = 0;      // The offset of bit 0 of _mask
+        uint64_t _mask = 0;         // Delimiters found but not yet reached
+        bool _done = true;
+    };
+
+    // Produces the tokens of a stream, read in blocks of (initially) block_size bytes.  Tokens are
+    // views of the generator's buffer, and remain valid only until the generator is advanced.  A
+    // token that runs past the end of the buffer is moved to the front before the next block is
+    // read, and the buffer grows if a single token fills it; other tokens are never copied.
+    //
+    // Copies of a stream_split_generator share the stream and the buffer; as with any input
+    // iterator, advancing one invalidates the others.
+    class stream_split_generator
+    {
+    public:
+        using iterator_category = generator_tag;
+        using value_type = string_view;
+        using difference_type = ptrdiff_t;
+        using pointer = const string_view*;
+        using reference = const string_view&;
+
+        static constexpr size_t default_block_size = 0x10000;
+
+    public:
+        stream_split_generator() noexcept = default;
+        stream_split_generator(input_stream& stream, const _private::byte_set& delimiters, size_t block_size = default_block_size);
+
+    public:
+        friend bool operator == (const stream_split_generator& a, const stream_split_generator& b) noexcept
+        {
+            return a._state == b._state;
+        }
+        friend bool operator != (const stream_split_generator& a, const stream_split_generator& b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend void swap(stream_split_generator& a, stream_split_generator& b) noexcept
+        {
+            a._state.swap(b._state);
+        }
+
+    public:
+        reference operator * () const noexcept { assert(_state); return _state->token; }
+        pointer operator -> () const noexcept { assert(_state); return &_state->token; }
+        stream_split_generator& operator ++ () { next(); return *this; }
+        iterator_proxy<stream_split_generator> operator ++ (int)
+        {
+            iterator_proxy<stream_split_generator> proxy(_state->token);
+            ++*this;
+            return proxy;
+        }
+
+        explicit operator bool () const noexcept { return _state != nullptr; }
+
+    private:
+        struct state
+        {
+            input_stream* stream;
+            _private::byte_set delimiters;
+            std::unique_ptr<char[]> buffer;
+            size_t capacity;
+            size_t size = 0;            // The number of bytes in the buffer
+            size_t next = 0;            // The start of the next token
+            size_t scan = 0;            // The first byte not yet checked for delimiters
+            size_t mask_base = 0;       // The offset of bit 0 of mask
+            uint64_t mask = 0;          // Delimiters found but not yet reached
+            bool eof = false;
+            string_view token;
+        };
+
+        void next();
+
+    private:
+        std::shared_ptr<state> _state;
+    };
+
+    inline split_generator split(string_view str, char delimiter) noexcept
+    {
+        return split_generator(str, _private::make_byte_set(&delimiter, 1));
+    }
+
+    inline split_generator split_any(string_view str, string_view delimiters) noexcept
+    {
+        return split_generator(str, _private::make_byte_set(delimiters.data(), delimiters.size()));
+    }
+
+    inline stream_split_generator split(input_stream& stream, char delimiter,
+        size_t block_size = stream_split_generator::default_block_size)
+    {
+        return stream_split_generator(stream, _private::make_byte_set(&delimiter, 1), block_size);
+    }
+
+    inline stream_split_generator split_any(input_stream& stream, string_view delimiters,
+        size_t block_size = stream_split_generator::default_block_size)
+    {
+        return stream_split_generator(stream, _private::make_byte_set(delimiters.data(), delimiters.size()), block_size);
+    }
+}
+
+#endif
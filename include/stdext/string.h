@@ -10,10 +10,15 @@
 #define STDEXT_STRING_INCLUDED
 #pragma once
 
+#include <stdext/array_view.h>
 #include <stdext/generator.h>
+#include <stdext/span.h>
 #include <stdext/string_view.h>
 #include <stdext/utility.h>
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <system_error>
 
@@ -68,6 +73,189 @@ namespace stdext
         string_type str;
     };
 
+    template <typename charT, size_t N = 128, typename traits = std::char_traits<charT>, typename Allocator = std::allocator<charT>>
+    class basic_string_builder;
+    using string_builder = basic_string_builder<char>;
+    using wstring_builder = basic_string_builder<wchar_t>;
+    using u16string_builder = basic_string_builder<char16_t>;
+    using u32string_builder = basic_string_builder<char32_t>;
+
+    // A consumer that accumulates a string, like basic_stringbuf, but in N characters of inline
+    // storage until it outgrows them.  Capacity grows geometrically and is kept by extract and
+    // reset, so a builder can be reused without allocating.  Characters can also be written
+    // directly into spare capacity: prepare returns room for at least the requested number of
+    // characters, and commit appends the first count of them.
+    template <typename charT, size_t N, typename traits, typename Allocator>
+    class basic_string_builder
+    {
+        static_assert(N != 0, "basic_string_builder requires inline storage");
+
+    public:
+        using traits_type = traits;
+        using value_type = charT;
+        using allocator_type = Allocator;
+        using size_type = size_t;
+        using string_type = std::basic_string<charT, traits, Allocator>;
+        using string_view_type = basic_string_view<charT, traits>;
+
+    public:
+        basic_string_builder() = default;
+        explicit basic_string_builder(const Allocator& alloc) noexcept : _alloc(alloc) { }
+        explicit basic_string_builder(size_type capacity, const Allocator& alloc = Allocator()) : _alloc(alloc)
+        {
+            reserve(capacity);
+        }
+
+        basic_string_builder(const basic_string_builder& other)
+            : _alloc(alloc_traits::select_on_container_copy_construction(other._alloc))
+        {
+            (*this)(other.view());
+        }
+
+        basic_string_builder(basic_string_builder&& other) noexcept : _alloc(other._alloc)
+        {
+            take(other);
+        }
+
+        ~basic_string_builder()
+        {
+            deallocate();
+        }
+
+        basic_string_builder& operator = (const basic_string_builder& other)
+        {
+            if (this != &other)
+            {
+                _size = 0;
+                (*this)(other.view());
+            }
+            return *this;
+        }
+
+        basic_string_builder& operator = (basic_string_builder&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (other._data != other._inline)
+                {
+                    deallocate();
+                    _alloc = other._alloc;
+                }
+                take(other);
+            }
+            return *this;
+        }
+
+    public:
+        bool operator () (charT value)
+        {
+            if (_size == _capacity)
+                grow(1);
+            traits::assign(_data[_size++], value);
+            return true;
+        }
+
+        bool operator () (string_view_type value)
+        {
+            if (_capacity - _size < value.size())
+                grow(value.size());
+            traits::copy(_data + _size, value.data(), value.size());
+            _size += value.size();
+            return true;
+        }
+
+        span<charT> prepare(size_type count)
+        {
+            if (_capacity - _size < count)
+                grow(count);
+            return span<charT>(_data + _size, _capacity - _size);
+        }
+
+        void commit(size_type count) noexcept
+        {
+            assert(count <= _capacity - _size);
+            _size += count;
+        }
+
+        void reserve(size_type capacity)
+        {
+            if (capacity > _capacity)
+                reallocate(capacity);
+        }
+
+        size_type size() const noexcept { return _size; }
+        size_type capacity() const noexcept { return _capacity; }
+        bool empty() const noexcept { return _size == 0; }
+
+        const charT* data() const noexcept { return _data; }
+        string_view_type view() const noexcept { return string_view_type(_data, _size); }
+
+        string_type str() const
+        {
+            return string_type(_data, _size, _alloc);
+        }
+
+        string_type extract()
+        {
+            string_type result(_data, _size, _alloc);
+            _size = 0;
+            return result;
+        }
+
+        void reset() noexcept
+        {
+            _size = 0;
+        }
+
+    private:
+        using alloc_traits = std::allocator_traits<Allocator>;
+
+        void grow(size_type count)
+        {
+            reallocate(std::max(_size + count, _capacity * 2));
+        }
+
+        void reallocate(size_type capacity)
+        {
+            auto data = alloc_traits::allocate(_alloc, capacity);
+            traits::copy(data, _data, _size);
+            deallocate();
+            _data = data;
+            _capacity = capacity;
+        }
+
+        void deallocate() noexcept
+        {
+            if (_data != _inline)
+                alloc_traits::deallocate(_alloc, _data, _capacity);
+        }
+
+        // Takes other's heap storage if it has any, and copies its inline storage otherwise.
+        // Leaves other empty, with only its inline storage.
+        void take(basic_string_builder& other) noexcept
+        {
+            if (other._data != other._inline)
+            {
+                _data = stdext::exchange(other._data, other._inline);
+                _capacity = stdext::exchange(other._capacity, N);
+                _size = stdext::exchange(other._size, 0);
+            }
+            else
+            {
+                // The inline contents fit in whatever storage this builder has.
+                traits::copy(_data, other._data, other._size);
+                _size = stdext::exchange(other._size, 0);
+            }
+        }
+
+    private:
+        Allocator _alloc;
+        charT* _data = _inline;
+        size_type _size = 0;
+        size_type _capacity = N;
+        charT _inline[N];
+    };
+
     template <typename Char>
     bool cstring_termination_predicate(const Char& value)
     {
@@ -81,9 +269,57 @@ namespace stdext
             cstring_termination_predicate<iterator_value_type<std::decay_t<Iterator>>>);
     }
 
-    // Conversion between narrow and wide execution character sets
+    // Conversion between narrow and wide execution character sets.  The input is converted in a
+    // single pass; in a UTF-8 locale, the conversion is done without the C library.  Input that
+    // cannot be converted throws conversion_error, which gives the offset of the offending code
+    // unit.
+    class conversion_error : public std::system_error
+    {
+    public:
+        explicit conversion_error(size_t position)
+            : system_error(EILSEQ, std::generic_category()), _position(position)
+        {
+        }
+
+        size_t position() const noexcept { return _position; }
+
+    private:
+        size_t _position;
+    };
+
     std::string to_mbstring(const wchar_t* str);
+    std::string to_mbstring(wstring_view str);
     std::wstring to_wstring(const char* str);
+    std::wstring to_wstring(string_view str);
+
+    enum class string_conversion_status
+    {
+        ok,
+        partial_write,
+        error
+    };
+
+    struct string_conversion_result
+    {
+        string_conversion_status status;
+        size_t consumed;
+        size_t produced;
+    };
+
+    // Conversion into caller-supplied storage.  Returns the number of code units consumed and
+    // produced along with one of:
+    //   string_conversion_status::ok               all of str was converted;
+    //   string_conversion_status::partial_write    out is full; only complete characters are written;
+    //   string_conversion_status::error            str contains input that cannot be converted,
+    //                                              beginning at the consumed offset.
+    // The stringbuf overloads append to buf and never report partial_write.  Conversion always
+    // begins in the initial shift state, and conversion to multibyte ends in it: in a stateful
+    // encoding, the sequence that returns to it follows the last character.  If that sequence
+    // doesn't fit, the result is partial_write with all of str consumed.
+    string_conversion_result to_mbstring(wstring_view str, span<char> out);
+    string_conversion_result to_mbstring(wstring_view str, stringbuf& buf);
+    string_conversion_result to_wstring(string_view str, span<wchar_t> out);
+    string_conversion_result to_wstring(string_view str, wstringbuf& buf);
 
     namespace _private
     {
@@ -103,6 +339,175 @@ namespace stdext
         {
             return std::wcrtomb(s, wc, ps);
         }
+
+        // Checks whether the multibyte encoding of the current locale is UTF-8.  The conversion
+        // adaptors check once, when they are created; in a UTF-8 locale, they convert with the
+        // functions below instead of calling into the C library for every code unit.
+        bool locale_is_utf8() noexcept;
+
+        // Encodes a code point as UTF-8.  Returns the number of bytes written, or size_t(-1) for a
+        // surrogate or a value beyond U+10FFFF.
+        inline size_t encode_utf8(char* s, char32_t code) noexcept
+        {
+            if (code < 0x80)
+            {
+                s[0] = char(code);
+                return 1;
+            }
+            if (code < 0x800)
+            {
+                s[0] = char(0xC0 | code >> 6);
+                s[1] = char(0x80 | (code & 0x3F));
+                return 2;
+            }
+            if (code < 0x10000)
+            {
+                if (code >= 0xD800 && code < 0xE000)
+                    return size_t(-1);
+                s[0] = char(0xE0 | code >> 12);
+                s[1] = char(0x80 | (code >> 6 & 0x3F));
+                s[2] = char(0x80 | (code & 0x3F));
+                return 3;
+            }
+            if (code < 0x110000)
+            {
+                s[0] = char(0xF0 | code >> 18);
+                s[1] = char(0x80 | (code >> 12 & 0x3F));
+                s[2] = char(0x80 | (code >> 6 & 0x3F));
+                s[3] = char(0x80 | (code & 0x3F));
+                return 4;
+            }
+            return size_t(-1);
+        }
+
+        // to_mb for a UTF-8 locale.  A leading surrogate produces no bytes; it is held in pending
+        // until the trailing surrogate arrives.
+        inline size_t to_utf8_mb(char* s, char32_t c32, char32_t&) noexcept
+        {
+            return encode_utf8(s, c32);
+        }
+
+        inline size_t to_utf8_mb(char* s, char16_t c16, char32_t& pending) noexcept
+        {
+            if (pending != 0)
+            {
+                auto lead = stdext::exchange(pending, 0);
+                if (c16 < 0xDC00 || c16 > 0xDFFF)
+                    return size_t(-1);
+                return encode_utf8(s, 0x10000 + ((lead - 0xD800) << 10) + (c16 - 0xDC00));
+            }
+
+            if (c16 >= 0xD800 && c16 < 0xDC00)
+            {
+                pending = c16;
+                return 0;
+            }
+            return encode_utf8(s, c16);
+        }
+
+        inline size_t to_utf8_mb(char* s, wchar_t wc, char32_t& pending) noexcept
+        {
+            if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+                return to_utf8_mb(s, char16_t(wc), pending);
+            else
+                return to_utf8_mb(s, char32_t(wc), pending);
+        }
+
+        // Decodes the UTF-8 sequence beginning with lead, calling next(byte) for each subsequent
+        // byte; next returns false at the end of the input.  Returns char32_t(-1) if the sequence
+        // is invalid or incomplete.  As with the C library, noncharacters are accepted.
+        template <typename Next>
+        char32_t decode_utf8(unsigned char lead, Next&& next)
+        {
+            if (lead < 0x80)
+                return lead;
+
+            unsigned length;
+            char32_t code;
+            unsigned char low = 0x80;
+            unsigned char high = 0xBF;
+            if (lead < 0xC2)
+                return char32_t(-1);
+            else if (lead < 0xE0)
+            {
+                length = 1;
+                code = lead & 0x1F;
+            }
+            else if (lead < 0xF0)
+            {
+                length = 2;
+                code = lead & 0x0F;
+                if (lead == 0xE0)
+                    low = 0xA0;
+                else if (lead == 0xED)
+                    high = 0x9F;
+            }
+            else if (lead < 0xF5)
+            {
+                length = 3;
+                code = lead & 0x07;
+                if (lead == 0xF0)
+                    low = 0x90;
+                else if (lead == 0xF4)
+                    high = 0x8F;
+            }
+            else
+                return char32_t(-1);
+
+            for (; length != 0; --length)
+            {
+                unsigned char byte;
+                if (!next(byte) || byte < low || byte > high)
+                    return char32_t(-1);
+                code = code << 6 | (byte & 0x3F);
+                low = 0x80;
+                high = 0xBF;
+            }
+            return code;
+        }
+
+        // Block conversions for contiguous input.  Each converts code units from the front of in,
+        // advancing past them, into out, which must have room for at least MB_LEN_MAX bytes or two
+        // wide characters.  Returns the number produced, which is zero only if in is exhausted or
+        // ends with a leading surrogate.  Throws std::system_error for invalid input.
+#if STDEXT_HAS_C_UNICODE
+        size_t to_multibyte(array_view<const char16_t>& in, char* out, size_t size, std::mbstate_t& state, bool utf8);
+        size_t to_multibyte(array_view<const char32_t>& in, char* out, size_t size, std::mbstate_t& state, bool utf8);
+#endif
+        size_t to_multibyte(array_view<const wchar_t>& in, char* out, size_t size, std::mbstate_t& state, bool utf8);
+        size_t to_wchar(array_view<const char>& in, wchar_t* out, size_t size, std::mbstate_t& state, bool utf8);
+
+        // Contiguous producers of code units (strings, string views, array views, and the like) are
+        // converted a block at a time where possible.
+        template <typename Producer, typename = void>
+        struct contiguous_code_unit
+        {
+            using type = void;
+        };
+        template <typename Producer>
+        struct contiguous_code_unit<Producer, std::enable_if_t<std::is_class_v<Producer>,
+            std::void_t<decltype(std::data(declval<Producer&>())), decltype(std::size(declval<Producer&>()))>>>
+        {
+            using type = std::remove_cv_t<std::remove_pointer_t<decltype(std::data(declval<Producer&>()))>>;
+        };
+
+        template <typename Producer>
+        auto contiguous_view(Producer& in)
+        {
+            using value_type = typename contiguous_code_unit<Producer>::type;
+            return array_view<const value_type>(std::data(in), std::size(in));
+        }
+
+        template <typename Producer>
+        constexpr bool use_block_multibyte_v = std::is_same_v<typename contiguous_code_unit<std::remove_reference_t<Producer>>::type, wchar_t>
+#if STDEXT_HAS_C_UNICODE
+            || std::is_same_v<typename contiguous_code_unit<std::remove_reference_t<Producer>>::type, char16_t>
+            || std::is_same_v<typename contiguous_code_unit<std::remove_reference_t<Producer>>::type, char32_t>
+#endif
+            ;
+
+        template <typename Producer>
+        constexpr bool use_block_wchar_v = std::is_same_v<typename contiguous_code_unit<std::remove_reference_t<Producer>>::type, char>;
     }
 
     template <typename Generator>
@@ -118,16 +523,17 @@ namespace stdext
 
     public:
         to_multibyte_generator() = default;
-        to_multibyte_generator(const generator& g) : _g(g) { next(); }
-        to_multibyte_generator(generator&& g) : _g(stdext::move(g)) { next(); }
+        to_multibyte_generator(const generator& g) : _g(g), _utf8(_private::locale_is_utf8()) { next(); }
+        to_multibyte_generator(generator&& g) : _g(stdext::move(g)), _utf8(_private::locale_is_utf8()) { next(); }
 
     public:
         friend bool operator == (const to_multibyte_generator& a, const to_multibyte_generator& b) noexcept
         {
             return a._g == b._g
                 && a._state == b._state
+                && a._pending == b._pending
                 && a._current == b._current
-                && std::equal(a._value + a._current, a._value + std::size(a._value), b._value);
+                && std::equal(a._value + a._current, a._value + std::size(a._value), b._value + b._current);
         }
 
         friend bool operator != (const to_multibyte_generator& a, const to_multibyte_generator& b) noexcept
@@ -139,6 +545,8 @@ namespace stdext
         {
             swap(a._g, b._g);
             swap(a._state, b._state);
+            swap(a._pending, b._pending);
+            swap(a._utf8, b._utf8);
             swap(a._current, b._current);
             swap(a._value, b._value);
         }
@@ -162,42 +570,145 @@ namespace stdext
 
         iterator_proxy<to_multibyte_generator> operator ++ (int)
         {
-            iterator_proxy<to_multibyte_generator> proxy = _value;
+            iterator_proxy<to_multibyte_generator> proxy = **this;
             next();
             return proxy;
         }
 
         explicit operator bool() const noexcept
         {
-            return _g || _current == std::size(_value);
+            return _current != std::size(_value);
         }
 
     private:
+        // The bytes of the current character occupy the end of _value, from _current on.
         void next()
         {
-            if (_current == std::size(_value))
+            if (_current != std::size(_value))
+                ++_current;
+
+            while (_current == std::size(_value) && _g)
             {
-                assert(bool(_g));
-                auto length = _private::to_mb(_value, *_g, &_state);
+                auto length = _utf8 ? _private::to_utf8_mb(_value, *_g, _pending) : _private::to_mb(_value, *_g, &_state);
                 ++_g;
                 if (length == size_t(-1))
+                {
+                    if (_utf8)
+                        errno = EILSEQ;
                     throw std::system_error(errno, std::generic_category());
+                }
 
                 _current = std::size(_value) - length;
-                std::move(_value, _value + length, _value + _current);
-                return;
+                std::move_backward(_value, _value + length, std::end(_value));
             }
-
-            ++_current;
         }
 
     private:
         generator _g = { };
         std::mbstate_t _state = { };
+        char32_t _pending = 0;
+        bool _utf8 = false;
         size_t _current = std::size(_value);
         value_type _value[MB_LEN_MAX] = { };
     };
 
+    // Contiguous input is converted a block at a time.  The converted bytes are available
+    // individually, as with any generator, or a block at a time from next_chunk.  The block
+    // returned by next_chunk remains valid until the next call to next_chunk.
+    template <typename Char>
+    class to_multibyte_generator<array_view<const Char>>
+    {
+    public:
+        using iterator_category = generator_tag;
+        using value_type = char;
+        using difference_type = ptrdiff_t;
+        using pointer = const char*;
+        using reference = const char&;
+        using generator = array_view<const Char>;
+
+    public:
+        to_multibyte_generator() = default;
+        explicit to_multibyte_generator(const generator& in) : _in(in), _utf8(_private::locale_is_utf8()) { fill(); }
+
+    public:
+        friend bool operator == (const to_multibyte_generator& a, const to_multibyte_generator& b) noexcept
+        {
+            return a._in.data() == b._in.data()
+                && a._in.size() == b._in.size()
+                && a._count - a._pos == b._count - b._pos
+                && std::equal(a._buffer[a._current] + a._pos, a._buffer[a._current] + a._count, b._buffer[b._current] + b._pos);
+        }
+
+        friend bool operator != (const to_multibyte_generator& a, const to_multibyte_generator& b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend void swap(to_multibyte_generator& a, to_multibyte_generator& b)
+        {
+            std::swap(a, b);
+        }
+
+    public:
+        reference operator * () const noexcept
+        {
+            return _buffer[_current][_pos];
+        }
+
+        pointer operator -> () const noexcept
+        {
+            return &_buffer[_current][_pos];
+        }
+
+        to_multibyte_generator& operator ++ ()
+        {
+            if (++_pos == _count)
+                fill();
+            return *this;
+        }
+
+        iterator_proxy<to_multibyte_generator> operator ++ (int)
+        {
+            iterator_proxy<to_multibyte_generator> proxy = **this;
+            ++*this;
+            return proxy;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return _pos != _count;
+        }
+
+        // Returns all of the bytes converted so far but not yet produced, and advances past them.
+        string_view next_chunk()
+        {
+            string_view chunk(_buffer[_current] + _pos, _count - _pos);
+            _current ^= 1;
+            fill();
+            return chunk;
+        }
+
+    private:
+        static constexpr size_t buffer_size = 256;
+
+        void fill()
+        {
+            _pos = 0;
+            _count = 0;
+            while (_count == 0 && !_in.empty())
+                _count = _private::to_multibyte(_in, _buffer[_current], buffer_size, _state, _utf8);
+        }
+
+    private:
+        generator _in;
+        std::mbstate_t _state = { };
+        bool _utf8 = false;
+        size_t _current = 0;
+        size_t _pos = 0;
+        size_t _count = 0;
+        char _buffer[2][buffer_size];
+    };
+
     template <typename Generator>
     class to_wchar_generator
     {
@@ -211,14 +722,16 @@ namespace stdext
 
     public:
         to_wchar_generator() = default;
-        to_wchar_generator(const generator& g) : _g(g), _state(), _value() { next(); }
-        to_wchar_generator(generator&& g) : _g(stdext::move(g)), _state(), _value() { next(); }
+        to_wchar_generator(const generator& g) : _g(g), _utf8(_private::locale_is_utf8()) { next(); }
+        to_wchar_generator(generator&& g) : _g(stdext::move(g)), _utf8(_private::locale_is_utf8()) { next(); }
 
     public:
         friend bool operator == (const to_wchar_generator& a, const to_wchar_generator& b) noexcept
         {
             return a._g == b._g
                 && a._state == b._state
+                && a._pending == b._pending
+                && a._valid == b._valid
                 && a._value == b._value;
         }
 
@@ -231,6 +744,9 @@ namespace stdext
         {
             swap(a._g, b._g);
             swap(a._state, b._state);
+            swap(a._pending, b._pending);
+            swap(a._utf8, b._utf8);
+            swap(a._valid, b._valid);
             swap(a._value, b._value);
         }
 
@@ -260,29 +776,163 @@ namespace stdext
 
         explicit operator bool() const noexcept
         {
-            return _g || !mbsinit(&_state);
+            return _valid;
         }
 
     private:
         void next()
         {
-            size_t result;
-            do
+            _valid = _pending != 0 || _g;
+            if (_pending != 0)
+                _value = stdext::exchange(_pending, 0);
+            else if (!_g)
+                return;
+            else if (_utf8)
+                next_utf8();
+            else
             {
-                assert(bool(_g));
-                result = std::mbrtowc(&_value, &*_g, 1, &_state);
+                size_t result;
+                do
+                {
+                    if (!_g)
+                        throw std::system_error(EILSEQ, std::generic_category());
+                    result = std::mbrtowc(&_value, &*_g, 1, &_state);
+                    ++_g;
+                    if (result == size_t(-1))
+                        throw std::system_error(errno, std::generic_category());
+                } while (result == size_t(-2));
+            }
+        }
+
+        void next_utf8()
+        {
+            auto lead = static_cast<unsigned char>(*_g);
+            ++_g;
+            auto code = _private::decode_utf8(lead, [&](unsigned char& byte)
+            {
+                if (!_g)
+                    return false;
+                byte = static_cast<unsigned char>(*_g);
                 ++_g;
-                if (result == size_t(-1))
-                    throw std::system_error(errno, std::generic_category());
-            } while (result == size_t(-2));
+                return true;
+            });
+            if (code == char32_t(-1))
+                throw std::system_error(EILSEQ, std::generic_category());
+
+            if (sizeof(wchar_t) == sizeof(char16_t) && code >= 0x10000)
+            {
+                _value = wchar_t(0xD800 + ((code - 0x10000) >> 10));
+                _pending = wchar_t(0xDC00 + (code & 0x3FF));
+            }
+            else
+                _value = wchar_t(code);
         }
 
     private:
         generator _g = { };
-        mbstate_t _state = { };
+        std::mbstate_t _state = { };
+        wchar_t _pending = 0;
+        bool _utf8 = false;
+        bool _valid = false;
         value_type _value = { };
     };
 
+    // Contiguous input is converted a block at a time, as for to_multibyte_generator.
+    template <>
+    class to_wchar_generator<array_view<const char>>
+    {
+    public:
+        using iterator_category = generator_tag;
+        using value_type = wchar_t;
+        using difference_type = ptrdiff_t;
+        using pointer = const wchar_t*;
+        using reference = const wchar_t&;
+        using generator = array_view<const char>;
+
+    public:
+        to_wchar_generator() = default;
+        explicit to_wchar_generator(const generator& in) : _in(in), _utf8(_private::locale_is_utf8()) { fill(); }
+
+    public:
+        friend bool operator == (const to_wchar_generator& a, const to_wchar_generator& b) noexcept
+        {
+            return a._in.data() == b._in.data()
+                && a._in.size() == b._in.size()
+                && a._count - a._pos == b._count - b._pos
+                && std::equal(a._buffer[a._current] + a._pos, a._buffer[a._current] + a._count, b._buffer[b._current] + b._pos);
+        }
+
+        friend bool operator != (const to_wchar_generator& a, const to_wchar_generator& b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend void swap(to_wchar_generator& a, to_wchar_generator& b)
+        {
+            std::swap(a, b);
+        }
+
+    public:
+        reference operator * () const noexcept
+        {
+            return _buffer[_current][_pos];
+        }
+
+        pointer operator -> () const noexcept
+        {
+            return &_buffer[_current][_pos];
+        }
+
+        to_wchar_generator& operator ++ ()
+        {
+            if (++_pos == _count)
+                fill();
+            return *this;
+        }
+
+        iterator_proxy<to_wchar_generator> operator ++ (int)
+        {
+            iterator_proxy<to_wchar_generator> proxy = **this;
+            ++*this;
+            return proxy;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return _pos != _count;
+        }
+
+        // Returns all of the wide characters converted so far but not yet produced, and advances
+        // past them.
+        wstring_view next_chunk()
+        {
+            wstring_view chunk(_buffer[_current] + _pos, _count - _pos);
+            _current ^= 1;
+            fill();
+            return chunk;
+        }
+
+    private:
+        static constexpr size_t buffer_size = 256;
+
+        void fill()
+        {
+            _pos = 0;
+            _count = 0;
+            while (_count == 0 && !_in.empty())
+                _count = _private::to_wchar(_in, _buffer[_current], buffer_size, _state, _utf8);
+        }
+
+    private:
+        generator _in;
+        std::mbstate_t _state = { };
+        bool _utf8 = false;
+        size_t _current = 0;
+        size_t _pos = 0;
+        size_t _count = 0;
+        wchar_t _buffer[2][buffer_size];
+    };
+
     struct to_multibyte_tag { };
     struct to_wchar_tag { };
 
@@ -293,13 +943,25 @@ namespace stdext
 template <typename Producer, STDEXT_REQUIRES(stdext::can_generate_v<Producer>)>
 auto operator >> (Producer&& p, stdext::to_multibyte_tag)
 {
-    return stdext::to_multibyte_generator<stdext::generator_type<Producer>>(stdext::as_generator(stdext::forward<Producer>(p)));
+    if constexpr (stdext::_private::use_block_multibyte_v<Producer>)
+    {
+        auto in = stdext::_private::contiguous_view(p);
+        return stdext::to_multibyte_generator<decltype(in)>(in);
+    }
+    else
+        return stdext::to_multibyte_generator<stdext::generator_type<Producer>>(stdext::as_generator(stdext::forward<Producer>(p)));
 }
 
 template <typename Producer, STDEXT_REQUIRES(stdext::can_generate_v<Producer>)>
 auto operator >> (Producer&& p, stdext::to_wchar_tag)
 {
-    return stdext::to_wchar_generator<stdext::generator_type<Producer>>(stdext::as_generator(stdext::forward<Producer>(p)));
+    if constexpr (stdext::_private::use_block_wchar_v<Producer>)
+    {
+        auto in = stdext::_private::contiguous_view(p);
+        return stdext::to_wchar_generator<decltype(in)>(in);
+    }
+    else
+        return stdext::to_wchar_generator<stdext::generator_type<Producer>>(stdext::as_generator(stdext::forward<Producer>(p)));
 }
 
 #endif
@@ -0,0 +1,359 @@
+#ifndef STDEXT_STRING_POOL_INCLUDED
+#define STDEXT_STRING_POOL_INCLUDED
+#pragma once
+
+#include <stdext/checksum.h>
+#include <stdext/string_view.h>
+#include <stdext/utility.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <cassert>
+
+
+namespace stdext
+{
+    template <typename charT, typename traits = std::char_traits<charT>>
+    class basic_string_pool;
+    using string_pool = basic_string_pool<char>;
+    using wstring_pool = basic_string_pool<wchar_t>;
+    using u16string_pool = basic_string_pool<char16_t>;
+    using u32string_pool = basic_string_pool<char32_t>;
+
+    template <typename charT, size_t Shards = 16, typename traits = std::char_traits<charT>>
+    class basic_concurrent_string_pool;
+    using concurrent_string_pool = basic_concurrent_string_pool<char>;
+    using concurrent_wstring_pool = basic_concurrent_string_pool<wchar_t>;
+    using concurrent_u16string_pool = basic_concurrent_string_pool<char16_t>;
+    using concurrent_u32string_pool = basic_concurrent_string_pool<char32_t>;
+
+    namespace _private
+    {
+        template <typename charT>
+        uint64_t string_pool_hash(const charT* str, size_t size) noexcept
+        {
+            return xxhash64(array_view<const byte>(reinterpret_cast<const byte*>(str), size * sizeof(charT)));
+        }
+    }
+
+    // Interns strings: each distinct string is stored once, in large blocks allocated by the pool,
+    // and identified by a symbol.  Symbols are numbered from zero in the order the strings are
+    // first added.  Pooled strings are null-terminated and never move, so views of them remain
+    // valid until the pool is cleared or destroyed.  Since string_view equality compares identity,
+    // two views returned by the same pool are equal exactly when their strings are.
+    template <typename charT, typename traits>
+    class basic_string_pool
+    {
+        template <typename, size_t, typename> friend class basic_concurrent_string_pool;
+
+    public:
+        using value_type = charT;
+        using traits_type = traits;
+        using size_type = size_t;
+        using string_view_type = basic_string_view<charT, traits>;
+        using symbol = uint32_t;
+
+        static constexpr symbol no_symbol = symbol(-1);
+        static constexpr size_type default_block_size = 0x10000 / sizeof(charT);
+
+    public:
+        basic_string_pool() noexcept = default;
+        explicit basic_string_pool(size_type block_size) noexcept : _block_size(block_size) { }
+        basic_string_pool(const basic_string_pool&) = delete;
+        basic_string_pool& operator = (const basic_string_pool&) = delete;
+
+        basic_string_pool(basic_string_pool&& other) noexcept
+            : _block_size(other._block_size),
+            _blocks(stdext::move(other._blocks)),
+            _next(stdext::exchange(other._next, nullptr)),
+            _end(stdext::exchange(other._end, nullptr)),
+            _entries(stdext::move(other._entries)),
+            _slots(stdext::move(other._slots))
+        {
+            other.clear();
+        }
+
+        basic_string_pool& operator = (basic_string_pool&& other) noexcept
+        {
+            if (this != &other)
+            {
+                swap(*this, other);
+                other.clear();
+            }
+            return *this;
+        }
+
+        friend void swap(basic_string_pool& a, basic_string_pool& b) noexcept
+        {
+            using std::swap;
+            swap(a._block_size, b._block_size);
+            swap(a._blocks, b._blocks);
+            swap(a._next, b._next);
+            swap(a._end, b._end);
+            swap(a._entries, b._entries);
+            swap(a._slots, b._slots);
+        }
+
+    public:
+        // Adds str to the pool if it isn't already there, and returns its symbol.
+        symbol intern(string_view_type str)
+        {
+            return intern(str, _private::string_pool_hash(str.data(), str.size()));
+        }
+
+        // As intern, but returns the pooled copy of str.
+        string_view_type intern_view(string_view_type str)
+        {
+            return this->str(intern(str));
+        }
+
+        // Returns the symbol for str, or no_symbol if str isn't in the pool.
+        symbol find(string_view_type str) const noexcept
+        {
+            return find(str, _private::string_pool_hash(str.data(), str.size()));
+        }
+
+        string_view_type str(symbol id) const noexcept
+        {
+            assert(id < _entries.size());
+            return string_view_type(_entries[id].data, _entries[id].size);
+        }
+
+        const charT* c_str(symbol id) const noexcept
+        {
+            assert(id < _entries.size());
+            return _entries[id].data;
+        }
+
+        size_type size() const noexcept { return _entries.size(); }
+        bool empty() const noexcept { return _entries.empty(); }
+
+        void clear() noexcept
+        {
+            _blocks.clear();
+            _next = _end = nullptr;
+            _entries.clear();
+            _slots.clear();
+        }
+
+    private:
+        struct entry
+        {
+            const charT* data;
+            size_type size;
+        };
+
+        // The lookup table uses open addressing with linear probing, and is kept at most half full.
+        // Each slot holds the full hash of its string, so that most mismatches are rejected, and
+        // the table rehashed, without touching the strings themselves.
+        struct slot
+        {
+            uint64_t hash;
+            symbol id;
+        };
+
+        symbol intern(string_view_type str, uint64_t hash)
+        {
+            if ((_entries.size() + 1) * 2 > _slots.size())
+                rehash(std::max<size_type>(_slots.size() * 2, 64));
+
+            auto index = probe(str, hash);
+            if (_slots[index].id != no_symbol)
+                return _slots[index].id;
+
+            assert(_entries.size() < no_symbol);
+            auto id = symbol(_entries.size());
+            _entries.push_back({ store(str), str.size() });
+            _slots[index] = { hash, id };
+            return id;
+        }
+
+        symbol find(string_view_type str, uint64_t hash) const noexcept
+        {
+            return _slots.empty() ? no_symbol : _slots[probe(str, hash)].id;
+        }
+
+        // Returns the index of the slot holding str, or of the empty slot where it belongs.
+        size_type probe(string_view_type str, uint64_t hash) const noexcept
+        {
+            auto mask = _slots.size() - 1;
+            for (auto index = size_type(hash) & mask; ; index = (index + 1) & mask)
+            {
+                auto& s = _slots[index];
+                if (s.id == no_symbol)
+                    return index;
+                if (s.hash == hash)
+                {
+                    auto& e = _entries[s.id];
+                    if (e.size == str.size() && traits::compare(e.data, str.data(), str.size()) == 0)
+                        return index;
+                }
+            }
+        }
+
+        void rehash(size_type size)
+        {
+            std::vector<slot> slots(size, slot{ 0, no_symbol });
+            auto mask = size - 1;
+            for (auto& s : _slots)
+            {
+                if (s.id == no_symbol)
+                    continue;
+                auto index = size_type(s.hash) & mask;
+                while (slots[index].id != no_symbol)
+                    index = (index + 1) & mask;
+                slots[index] = s;
+            }
+            _slots = stdext::move(slots);
+        }
+
+        // Copies str into the pool, followed by a null terminator.  Strings too large to share a
+        // block get one of their own.
+        const charT* store(string_view_type str)
+        {
+            auto size = str.size() + 1;
+            charT* data;
+            if (size > _block_size / 4)
+                data = allocate(size);
+            else
+            {
+                if (size_type(_end - _next) < size)
+                {
+                    _next = allocate(_block_size);
+                    _end = _next + _block_size;
+                }
+                data = _next;
+                _next += size;
+            }
+
+            traits::copy(data, str.data(), str.size());
+            traits::assign(data[str.size()], charT());
+            return data;
+        }
+
+        charT* allocate(size_type size)
+        {
+            _blocks.emplace_back(new charT[size]);
+            return _blocks.back().get();
+        }
+
+    private:
+        size_type _block_size = default_block_size;
+        std::vector<std::unique_ptr<charT[]>> _blocks;
+        charT* _next = nullptr;
+        charT* _end = nullptr;
+        std::vector<entry> _entries;
+        std::vector<slot> _slots;
+    };
+
+    // A string pool that can be shared between threads.  Strings are divided by hash among Shards
+    // independently locked pools, so threads interning different strings rarely contend.  Symbols
+    // are unique across the shards, but are not assigned in order.
+    template <typename charT, size_t Shards, typename traits>
+    class basic_concurrent_string_pool
+    {
+        static_assert(Shards != 0 && (Shards & (Shards - 1)) == 0, "The number of shards must be a power of two");
+
+    public:
+        using pool_type = basic_string_pool<charT, traits>;
+        using value_type = charT;
+        using traits_type = traits;
+        using size_type = size_t;
+        using string_view_type = basic_string_view<charT, traits>;
+        using symbol = typename pool_type::symbol;
+
+        static constexpr symbol no_symbol = pool_type::no_symbol;
+
+    public:
+        basic_concurrent_string_pool() = default;
+        explicit basic_concurrent_string_pool(size_type block_size)
+        {
+            for (auto& s : _shards)
+                s.pool = pool_type(block_size);
+        }
+
+        basic_concurrent_string_pool(const basic_concurrent_string_pool&) = delete;
+        basic_concurrent_string_pool& operator = (const basic_concurrent_string_pool&) = delete;
+
+    public:
+        symbol intern(string_view_type str)
+        {
+            auto hash = _private::string_pool_hash(str.data(), str.size());
+            auto index = shard_index(hash);
+            auto& s = _shards[index];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return to_symbol(s.pool.intern(str, hash), index);
+        }
+
+        string_view_type intern_view(string_view_type str)
+        {
+            auto hash = _private::string_pool_hash(str.data(), str.size());
+            auto& s = _shards[shard_index(hash)];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return s.pool.str(s.pool.intern(str, hash));
+        }
+
+        symbol find(string_view_type str) const
+        {
+            auto hash = _private::string_pool_hash(str.data(), str.size());
+            auto index = shard_index(hash);
+            auto& s = _shards[index];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto id = s.pool.find(str, hash);
+            return id == no_symbol ? no_symbol : to_symbol(id, index);
+        }
+
+        string_view_type str(symbol id) const
+        {
+            auto& s = _shards[id % Shards];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return s.pool.str(symbol(id / Shards));
+        }
+
+        const charT* c_str(symbol id) const
+        {
+            auto& s = _shards[id % Shards];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return s.pool.c_str(symbol(id / Shards));
+        }
+
+        size_type size() const
+        {
+            size_type size = 0;
+            for (auto& s : _shards)
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                size += s.pool.size();
+            }
+            return size;
+        }
+
+    private:
+        static size_type shard_index(uint64_t hash) noexcept
+        {
+            // The pools index their tables with the low bits of the hash; take the high bits here.
+            return size_type(hash >> 32) & (Shards - 1);
+        }
+
+        static symbol to_symbol(symbol id, size_type index) noexcept
+        {
+            assert(id < no_symbol / Shards);
+            return symbol(id * Shards + index);
+        }
+
+    private:
+        // Each shard has a cache line of its own, so that the locks don't contend.
+        struct alignas(64) shard
+        {
+            mutable std::mutex mutex;
+            pool_type pool;
+        };
+
+        shard _shards[Shards];
+    };
+}
+
+#endif
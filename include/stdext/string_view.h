@@ -14,7 +14,11 @@
 #include <stdext/array_view.h>
 
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <type_traits>
+
+#include <cstdint>
 
 
 // This string_view is similar to the proposed string_view in Library Fundamentals, but has
@@ -46,6 +50,33 @@ namespace stdext
     double stod(string_view str, size_t* idx = nullptr);
     long double stold(string_view str, size_t* idx = nullptr);
 
+    namespace _private
+    {
+        // A set of bytes, as a bitmap for scalar lookups and as nibble tables for vector lookups.
+        // A byte c is in the set when the bit for its high nibble (c >> 4 & 7) is set in the entry
+        // for its low nibble (c & 15) in low[c >> 7].  pshufb looks up both halves of the table at
+        // once: it yields zero for indexes with the top bit set, so each table sees only the bytes
+        // that belong to it.
+        struct byte_set
+        {
+            uint64_t bits[4];
+            uint8_t low[2][16];
+
+            bool contains(uint8_t c) const noexcept { return (bits[c >> 6] >> (c & 63) & 1) != 0; }
+        };
+
+        byte_set make_byte_set(const char* set, size_t n) noexcept;
+
+        // Returns a mask with bit i set when str[i] is in set, for the 64 bytes at str.
+        uint64_t byte_set_mask(const char* str, const byte_set& set) noexcept;
+
+        // Searches of narrow strings, in string_view.cpp.  Positions and results are as for the
+        // corresponding members of basic_string_view.
+        size_t string_find(const char* str, size_t size, size_t pos, const char* s, size_t n) noexcept;
+        size_t string_find_first_of(const char* str, size_t size, size_t pos, const char* set, size_t n, bool match) noexcept;
+        size_t string_find_last_of(const char* str, size_t size, size_t pos, const char* set, size_t n, bool match) noexcept;
+    }
+
     template <typename charT, typename traits>
     class basic_string_view : public array_view<const charT>
     {
@@ -111,111 +142,126 @@ namespace stdext
             drop_last(*this, n);
         }
 
-        constexpr auto find(basic_string_view str, size_type pos = 0)
+        // The searches follow std::basic_string_view.  Narrow strings with the standard traits are
+        // searched by the library with vector instructions where available, and so can't be
+        // searched in constant expressions (except by rfind); other strings are searched a
+        // character at a time with the traits, and remain constexpr.
+        constexpr size_type find(basic_string_view str, size_type pos = 0) const noexcept
         {
-            pos = std::min(pos, length());
-            auto i = search(subrange_from(*this, this->begin() + pos), str);
-            return i == this->end() ? npos : size_type(std::distance(this->begin(), i));
+            if constexpr (is_narrow)
+                return _private::string_find(this->data(), length(), pos, str.data(), str.length());
+            else
+            {
+                if (pos > length() || str.length() > length() - pos)
+                    return npos;
+                if (str.empty())
+                    return pos;
+
+                auto last = this->data() + (length() - str.length()) + 1;
+                for (auto p = this->data() + pos; p != last; ++p)
+                {
+                    p = traits_type::find(p, size_type(last - p), *str.data());
+                    if (p == nullptr)
+                        break;
+                    if (traits_type::compare(p, str.data(), str.length()) == 0)
+                        return size_type(p - this->data());
+                }
+                return npos;
+            }
         }
 
-        constexpr auto find(const_pointer s, size_type pos, size_type n)
+        constexpr size_type find(const_pointer s, size_type pos, size_type n) const noexcept
         {
             return find(basic_string_view(s, n), pos);
         }
 
-        constexpr auto find(value_type c, size_type pos = 0)
+        constexpr size_type find(value_type c, size_type pos = 0) const noexcept
         {
             return find(basic_string_view(std::addressof(c), 1), pos);
         }
 
-        constexpr auto rfind(basic_string_view str, size_type pos = npos)
+        constexpr size_type rfind(basic_string_view str, size_type pos = npos) const noexcept
         {
-            pos = std::min(pos, length());
-            pos = std::min(pos + str.length(), length());
-            auto i = find_end(subrange_from(*this, this->begin() + pos), str);
-            return i == this->end() ? npos : size_type(std::distance(this->begin(), i));
+            if (str.length() > length())
+                return npos;
+
+            for (auto p = this->data() + std::min(pos, length() - str.length()); ; --p)
+            {
+                if (traits_type::compare(p, str.data(), str.length()) == 0)
+                    return size_type(p - this->data());
+                if (p == this->data())
+                    return npos;
+            }
         }
 
-        constexpr auto rfind(const_pointer s, size_type pos, size_type n)
+        constexpr size_type rfind(const_pointer s, size_type pos, size_type n) const noexcept
         {
             return rfind(basic_string_view(s, n), pos);
         }
 
-        constexpr auto rfind(value_type c, size_type pos = npos)
+        constexpr size_type rfind(value_type c, size_type pos = npos) const noexcept
         {
-            return rfind(basic_string_view(std::addressof(c), 1), pos);
+            return find_last_of(basic_string_view(std::addressof(c), 1), pos);
         }
 
-        constexpr auto find_first_of(basic_string_view str, size_type pos = 0)
+        constexpr size_type find_first_of(basic_string_view str, size_type pos = 0) const noexcept
         {
-            pos = std::min(pos, length());
-            auto i = find_first_of(subrange_from(*this, this->begin() + pos), str);
-            return i == this->end() ? npos : size_type(std::distance(this->begin(), i));
+            return find_first_in(str, pos, true);
         }
 
-        constexpr auto find_first_of(const_pointer s, size_type pos, size_type n)
+        constexpr size_type find_first_of(const_pointer s, size_type pos, size_type n) const noexcept
         {
             return find_first_of(basic_string_view(s, n), pos);
         }
 
-        constexpr auto find_first_of(value_type c, size_t pos = 0)
+        constexpr size_type find_first_of(value_type c, size_type pos = 0) const noexcept
         {
-            return find_first_of(basic_string_view(std::addressof(c), 1), pos);
+            return find(c, pos);
         }
 
-        constexpr auto find_last_of(basic_string_view str, size_type pos = 0)
+        constexpr size_type find_last_of(basic_string_view str, size_type pos = npos) const noexcept
         {
-            pos = std::min(pos, length());
-            auto reverse = make_reverse_range(subrange_to(*this, this->begin() + pos));
-            auto i = reverse.base_pos(find_first_of(reverse, str));
-            return i == this->begin() ? npos : size_type(std::distance(this->begin(), --i));
+            return find_last_in(str, pos, true);
         }
 
-        constexpr auto find_last_of(const_pointer s, size_type pos, size_type n)
+        constexpr size_type find_last_of(const_pointer s, size_type pos, size_type n) const noexcept
         {
-            return find_first_of(basic_string_view(s, n), pos);
+            return find_last_of(basic_string_view(s, n), pos);
         }
 
-        constexpr auto find_last_of(value_type c, size_t pos = 0)
+        constexpr size_type find_last_of(value_type c, size_type pos = npos) const noexcept
         {
-            return find_first_of(basic_string_view(std::addressof(c), 1), pos);
+            return find_last_of(basic_string_view(std::addressof(c), 1), pos);
         }
 
-        constexpr auto find_first_not_of(basic_string_view str, size_type pos = 0)
+        constexpr size_type find_first_not_of(basic_string_view str, size_type pos = 0) const noexcept
         {
-            pos = std::min(pos, length());
-            auto i = find_if(subrange_from(*this, this->begin() + pos),
-                [str](value_type c) { return str.find(c) == npos; });
-            return i == this->end() ? npos : size_type(std::distance(this->begin(), i));
+            return find_first_in(str, pos, false);
         }
 
-        constexpr auto find_first_not_of(const_pointer s, size_type pos, size_type n)
+        constexpr size_type find_first_not_of(const_pointer s, size_type pos, size_type n) const noexcept
         {
             return find_first_not_of(basic_string_view(s, n), pos);
         }
 
-        constexpr auto find_first_not_of(value_type c, size_t pos = 0)
+        constexpr size_type find_first_not_of(value_type c, size_type pos = 0) const noexcept
         {
             return find_first_not_of(basic_string_view(std::addressof(c), 1), pos);
         }
 
-        constexpr auto find_last_not_of(basic_string_view str, size_type pos = 0)
+        constexpr size_type find_last_not_of(basic_string_view str, size_type pos = npos) const noexcept
         {
-            pos = std::min(pos, length());
-            auto reverse = make_reverse_range(subrange_to(*this, this->begin() + pos));
-            auto i = reverse.base_pos(find_if(reverse,
-                [str](value_type c) { return str.find(c) == npos; }));
-            return i == this->begin() ? npos : size_type(std::distance(this->begin(), --i));
+            return find_last_in(str, pos, false);
         }
 
-        constexpr auto find_last_not_of(const_pointer s, size_type pos, size_type n)
+        constexpr size_type find_last_not_of(const_pointer s, size_type pos, size_type n) const noexcept
         {
-            return find_first_of(basic_string_view(s, n), pos);
+            return find_last_not_of(basic_string_view(s, n), pos);
         }
 
-        constexpr auto find_last_not_of(value_type c, size_t pos = 0)
+        constexpr size_type find_last_not_of(value_type c, size_type pos = npos) const noexcept
         {
-            return find_first_of(basic_string_view(std::addressof(c), 1), pos);
+            return find_last_not_of(basic_string_view(std::addressof(c), 1), pos);
         }
 
         constexpr auto substr(size_type pos = 0, size_type n = npos)
@@ -257,6 +303,45 @@ namespace stdext
         {
             return basic_string_view(*this, pos, n1).compare(basic_string_view(s, n2));
         }
+
+    private:
+        static constexpr bool is_narrow = std::is_same_v<traits_type, std::char_traits<char>>;
+
+        // Finds the first character at or after pos that is (or, if match is false, is not) in set.
+        constexpr size_type find_first_in(basic_string_view set, size_type pos, bool match) const noexcept
+        {
+            if constexpr (is_narrow)
+                return _private::string_find_first_of(this->data(), length(), pos, set.data(), set.length(), match);
+            else
+            {
+                for (; pos < length(); ++pos)
+                {
+                    if ((traits_type::find(set.data(), set.length(), this->data()[pos]) != nullptr) == match)
+                        return pos;
+                }
+                return npos;
+            }
+        }
+
+        // Finds the last character at or before pos that is (or is not) in set.
+        constexpr size_type find_last_in(basic_string_view set, size_type pos, bool match) const noexcept
+        {
+            if constexpr (is_narrow)
+                return _private::string_find_last_of(this->data(), length(), pos, set.data(), set.length(), match);
+            else
+            {
+                if (this->empty())
+                    return npos;
+
+                for (pos = std::min(pos, length() - 1); ; --pos)
+                {
+                    if ((traits_type::find(set.data(), set.length(), this->data()[pos]) != nullptr) == match)
+                        return pos;
+                    if (pos == 0)
+                        return npos;
+                }
+            }
+        }
     };
 }
 
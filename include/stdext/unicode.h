@@ -10,12 +10,19 @@
 #define STDEXT_UNICODE_INCLUDED
 #pragma once
 
+#include <stdext/array_view.h>
 #include <stdext/flags.h>
 #include <stdext/range.h>
+#include <stdext/span.h>
+#include <stdext/stream.h>
 #include <stdext/string.h>
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <tuple>
+#include <vector>
 
 
 namespace stdext
@@ -40,7 +47,9 @@ namespace stdext
     enum class utf_conversion_options
     {
         none = 0,
-        sanitize = 1
+        sanitize = 1,
+        // Length functions only: skip validation.  The result is unspecified for invalid input.
+        assume_valid = 2
     };
 
     struct utfstate_t
@@ -106,6 +115,167 @@ namespace stdext
             && !is_noncharacter(code);
     }
 
+    // Maps between code point indexes and byte offsets in UTF-8 text.  The text is divided into
+    // segments of some tens of kilobytes, each recording the offset of every checkpoint_interval'th
+    // code point and the number of code points before every checkpoint_interval'th byte, so a
+    // lookup is a binary search over the segments followed by a scan of at most one interval.  An
+    // edit reindexes only the segments it touches.
+    //
+    // Every byte other than a trailing byte is taken to begin a code point, so malformed text is
+    // indexed consistently, if not meaningfully.  The index does not keep the text; the members
+    // that need it take the indexed text as an argument.
+    class utf8_index
+    {
+    public:
+        static constexpr size_t checkpoint_interval = 256;
+        static constexpr size_t segment_size = 65536;
+
+    public:
+        utf8_index() = default;
+        explicit utf8_index(array_view<const char> str) { assign(str); }
+
+    public:
+        void assign(array_view<const char> str) { update(str, 0, size_bytes(), str.size()); }
+
+        // Updates the index after the erased bytes at offset are replaced by inserted bytes.  str
+        // is the text after the edit.
+        void update(array_view<const char> str, size_t offset, size_t erased, size_t inserted);
+
+        size_t size() const noexcept { return _code_point_starts.back(); }
+        size_t size_bytes() const noexcept { return _byte_starts.back(); }
+
+        // Returns the offset of the code point at index, or size_bytes() if index is size().
+        size_t byte_offset(array_view<const char> str, size_t index) const noexcept;
+
+        // Returns the number of code points that begin before offset: the index of the code
+        // point at offset, or of the next one if offset is partway through a code point.
+        size_t code_point_index(array_view<const char> str, size_t offset) const noexcept;
+
+    private:
+        struct segment
+        {
+            std::vector<uint32_t> offsets;  // of every checkpoint_interval'th code point
+            std::vector<uint32_t> counts;   // code points before every checkpoint_interval'th byte
+        };
+
+    private:
+        std::vector<segment> _segments;
+        std::vector<size_t> _byte_starts = { 0 };
+        std::vector<size_t> _code_point_starts = { 0 };
+    };
+
+    // Checks whether str is well-formed UTF-8, applying the same rules as to_utf32 (including the
+    // rejection of noncharacters).  Returns utf_result::ok and the length of str if it is valid.
+    // Otherwise, returns utf_result::error, or utf_result::partial_read if str ends partway through
+    // an otherwise valid sequence, along with the offset of the first code unit of the offending
+    // sequence.
+    std::pair<utf_result, size_t> utf8_validate(array_view<const char> str) noexcept;
+
+    // Checks whether str is well-formed UTF-16, applying the same rules as to_utf32.  The result is
+    // as for utf8_validate.
+    std::pair<utf_result, size_t> utf16_validate(array_view<const char16_t> str) noexcept;
+
+    struct utf_transcode_result
+    {
+        utf_result result;
+        size_t consumed;
+        size_t produced;
+    };
+
+    // Bulk conversion between Unicode encodings.  Converts as much of in as will fit in out, and
+    // returns the number of code units consumed and produced along with one of:
+    //   utf_result::ok             all of in was converted;
+    //   utf_result::partial_read   in ends partway through a code point, which is held in state;
+    //   utf_result::partial_write  out is full;
+    //   utf_result::error          in contains an invalid sequence beginning at the consumed offset.
+    // With utf_conversion_options::sanitize, invalid sequences are replaced by U+FFFD exactly as by
+    // the code-unit-at-a-time functions, and no error is reported.  state follows the same protocol
+    // as those functions, so a long input may be converted in chunks by passing the same state to
+    // each call, resuming partial_write results with the unconsumed input.  The overloads without
+    // a state argument treat in as complete: a partial final code point is reported as
+    // partial_read without being consumed, or replaced by U+FFFD when sanitizing.
+    utf_transcode_result transcode(array_view<const char> in, span<char16_t> out, utfstate_t& state,
+        flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    utf_transcode_result transcode(array_view<const char> in, span<char16_t> out,
+        flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    utf_transcode_result transcode(array_view<const char16_t> in, span<char> out, utfstate_t& state,
+        flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    utf_transcode_result transcode(array_view<const char16_t> in, span<char> out,
+        flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+
+    // Bulk length computation.  These produce the same results as the generic length functions
+    // below, which use them for contiguous input, but derive the length from counts of the input
+    // code units rather than by converting each code point.  With utf_conversion_options::assume_valid,
+    // validation is skipped as well.
+    std::pair<utf_result, size_t> to_utf8_length(array_view<const char> in, flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    std::pair<utf_result, size_t> to_utf8_length(array_view<const char16_t> in, flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    std::pair<utf_result, size_t> to_utf16_length(array_view<const char> in, flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    std::pair<utf_result, size_t> to_utf16_length(array_view<const char16_t> in, flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    std::pair<utf_result, size_t> to_utf32_length(array_view<const char> in, flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+    std::pair<utf_result, size_t> to_utf32_length(array_view<const char16_t> in, flags<utf_conversion_options> options = utf_conversion_options::none) noexcept;
+
+    // Multithreaded versions of the above for very large UTF-8 input, with the same results.  The
+    // input is split at code point boundaries into chunks that are processed on up to threads
+    // threads, or one per processor if threads is zero; input too small to be worth splitting is
+    // processed on the calling thread.  transcode_parallel measures each chunk, then converts the
+    // chunks concurrently, each into its own part of out.  These throw std::system_error if a
+    // thread cannot be started.
+    std::pair<utf_result, size_t> utf8_validate_parallel(array_view<const char> str, unsigned threads = 0);
+    std::pair<utf_result, size_t> to_utf16_length_parallel(array_view<const char> in,
+        flags<utf_conversion_options> options = utf_conversion_options::none, unsigned threads = 0);
+    utf_transcode_result transcode_parallel(array_view<const char> in, span<char16_t> out,
+        flags<utf_conversion_options> options = utf_conversion_options::none, unsigned threads = 0);
+
+    // The General_Category property, in the order listed by the Unicode Character Database.
+    enum class unicode_general_category
+    {
+        uppercase_letter,
+        lowercase_letter,
+        titlecase_letter,
+        modifier_letter,
+        other_letter,
+        nonspacing_mark,
+        spacing_mark,
+        enclosing_mark,
+        decimal_number,
+        letter_number,
+        other_number,
+        connector_punctuation,
+        dash_punctuation,
+        open_punctuation,
+        close_punctuation,
+        initial_punctuation,
+        final_punctuation,
+        other_punctuation,
+        math_symbol,
+        currency_symbol,
+        modifier_symbol,
+        other_symbol,
+        space_separator,
+        line_separator,
+        paragraph_separator,
+        control,
+        format,
+        surrogate,
+        private_use,
+        unassigned
+    };
+
+    // Character properties.  Values outside the range of Unicode code points are unassigned and
+    // fold to themselves.
+    unicode_general_category general_category(char32_t code) noexcept;
+    char32_t simple_casefold(char32_t code) noexcept;
+
+    // Case-insensitive comparison of UTF-8 text under simple case folding.  Returns a negative
+    // value, zero, or a positive value as lhs orders before, equal to, or after rhs, ordering by
+    // folded code point.  Invalid sequences compare as U+FFFD.  ASCII text is folded a block at a
+    // time.
+    int utf8_casefold_compare(array_view<const char> lhs, array_view<const char> rhs) noexcept;
+
+    // A hash of the simple case folding of UTF-8 text, consistent with utf8_casefold_compare:
+    // strings that compare equal have equal hashes.
+    size_t utf8_casefold_hash(array_view<const char> str) noexcept;
+
     // Converts code units between Unicode encodings.  Each function is intended to be called repeatedly for a single code
     // point until all input code units have been consumed and all output code units have been produced.  Conversion occurs
     // in two stages, each of which may involve multiple invocations.  In the first stage, input code units are consumed
@@ -253,12 +423,73 @@ namespace stdext
             return result;
         }
 
-        template <typename Char, typename Generator>
-        std::pair<utf_result, std::basic_string<Char>> to_ustring(Generator&& in, flags<utf_conversion_options> options)
+        // Contiguous producers of code units are converted with the bulk transcoders where
+        // available.
+        template <typename OutChar, typename InChar>
+        constexpr bool has_bulk_transcode_v = (std::is_same_v<OutChar, char16_t> && std::is_same_v<InChar, char>)
+            || (std::is_same_v<OutChar, char> && std::is_same_v<InChar, char16_t>);
+
+        template <typename OutChar, typename Producer>
+        constexpr bool use_bulk_transcode_v = has_bulk_transcode_v<OutChar,
+            typename contiguous_code_unit<std::remove_reference_t<Producer>>::type>;
+
+        template <typename Producer>
+        constexpr bool use_bulk_length_v = std::is_same_v<typename contiguous_code_unit<std::remove_reference_t<Producer>>::type, char>
+            || std::is_same_v<typename contiguous_code_unit<std::remove_reference_t<Producer>>::type, char16_t>;
+
+        template <typename Char, typename InChar, typename Consumer>
+        utf_result transcode(array_view<const InChar> in, Consumer&& out, utfstate_t& state, flags<utf_conversion_options> options)
+        {
+            Char buffer[256];
+            while (true)
+            {
+                auto result = stdext::transcode(in, buffer, state, options);
+                for (size_t n = 0; n != result.produced; ++n)
+                {
+                    if (!out(buffer[n]))
+                        return utf_result::partial_write;
+                }
+
+                if (result.result != utf_result::partial_write)
+                    return result.result;
+                in = array_view<const InChar>(in.data() + result.consumed, in.size() - result.consumed);
+            }
+        }
+
+        template <typename Char, typename Producer, typename Consumer>
+        utf_result to_utf_producer(Producer&& in, Consumer&& out, utfstate_t& state, flags<utf_conversion_options> options)
+        {
+            if constexpr (use_bulk_transcode_v<Char, Producer>)
+                return transcode<Char>(contiguous_view(in), stdext::forward<Consumer>(out), state, options);
+            else
+                return to_utf<Char>(as_generator(stdext::forward<Producer>(in)), stdext::forward<Consumer>(out), state, options);
+        }
+
+        template <typename Char, typename Producer>
+        std::pair<utf_result, std::basic_string<Char>> to_ustring(Producer&& in, flags<utf_conversion_options> options)
         {
             std::basic_string<Char> str;
             utfstate_t state;
-            return { to_utf<Char>(stdext::forward<Generator>(in), make_consumer<Char>(std::back_inserter(str)), state, options), stdext::move(str) };
+            if constexpr (use_bulk_transcode_v<Char, Producer>)
+            {
+                // Convert directly into the string, growing it as needed.
+                auto view = contiguous_view(in);
+                size_t size = 0;
+                while (true)
+                {
+                    str.resize(size + view.size() + 16);
+                    auto result = stdext::transcode(view, span<Char>(str.data() + size, str.size() - size), state, options);
+                    size += result.produced;
+                    if (result.result != utf_result::partial_write)
+                    {
+                        str.resize(size);
+                        return { result.result, stdext::move(str) };
+                    }
+                    view = decltype(view)(view.data() + result.consumed, view.size() - result.consumed);
+                }
+            }
+            else
+                return { to_utf<Char>(stdext::forward<Producer>(in), make_consumer<Char>(std::back_inserter(str)), state, options), stdext::move(str) };
         }
     }
 
@@ -266,7 +497,7 @@ namespace stdext
         STDEXT_REQUIRES(is_consumer_v<std::decay_t<Consumer>, generator_value_type<generator_type<Producer>>>)>
     utf_result to_utf8(Producer&& in, Consumer&& out, utfstate_t& state, flags<utf_conversion_options> options = utf_conversion_options::none)
     {
-        return _private::to_utf<char>(as_generator(stdext::forward<Producer>(in)), stdext::forward<Consumer>(out), state, options);
+        return _private::to_utf_producer<char>(stdext::forward<Producer>(in), stdext::forward<Consumer>(out), state, options);
     }
 
     template <typename Char, typename Consumer, STDEXT_REQUIRES(is_unicode_character_type_v<std::decay_t<Char>> && is_consumer_v<std::decay_t<Consumer>, Char>)>
@@ -280,7 +511,7 @@ namespace stdext
         STDEXT_REQUIRES(is_consumer_v<std::decay_t<Consumer>, generator_value_type<generator_type<Producer>>>)>
     utf_result to_utf16(Producer&& in, Consumer&& out, utfstate_t& state, flags<utf_conversion_options> options = utf_conversion_options::none)
     {
-        return _private::to_utf<char16_t>(as_generator(stdext::forward<Producer>(in)), stdext::forward<Consumer>(out), state, options);
+        return _private::to_utf_producer<char16_t>(stdext::forward<Producer>(in), stdext::forward<Consumer>(out), state, options);
     }
 
     template <typename Char, typename Consumer, STDEXT_REQUIRES(is_unicode_character_type_v<std::decay_t<Char>>)>
@@ -307,8 +538,13 @@ namespace stdext
     template <typename Producer, STDEXT_REQUIRES(can_generate_v<Producer>)>
     std::pair<utf_result, size_t> to_utf8_length(Producer&& in, flags<utf_conversion_options> options = utf_conversion_options::none)
     {
-        return _private::to_utf_length(as_generator(stdext::forward<Producer>(in)),
-            [](auto&&... args) { return to_utf8(stdext::forward<decltype(args)>(args)...); }, options);
+        if constexpr (_private::use_bulk_length_v<Producer>)
+            return to_utf8_length(_private::contiguous_view(in), options);
+        else
+        {
+            return _private::to_utf_length(as_generator(stdext::forward<Producer>(in)),
+                [](auto&&... args) { return to_utf8(stdext::forward<decltype(args)>(args)...); }, options);
+        }
     }
 
     template <typename Char, STDEXT_REQUIRES(is_unicode_character_type_v<std::decay_t<Char>>)>
@@ -320,8 +556,13 @@ namespace stdext
     template <typename Producer, STDEXT_REQUIRES(can_generate_v<Producer>)>
     std::pair<utf_result, size_t> to_utf16_length(Producer&& in, flags<utf_conversion_options> options = utf_conversion_options::none)
     {
-        return _private::to_utf_length(as_generator(stdext::forward<Producer>(in)),
-            [](auto&&... args) { return to_utf16(stdext::forward<decltype(args)>(args)...); }, options);
+        if constexpr (_private::use_bulk_length_v<Producer>)
+            return to_utf16_length(_private::contiguous_view(in), options);
+        else
+        {
+            return _private::to_utf_length(as_generator(stdext::forward<Producer>(in)),
+                [](auto&&... args) { return to_utf16(stdext::forward<decltype(args)>(args)...); }, options);
+        }
     }
 
     template <typename Char, STDEXT_REQUIRES(is_unicode_character_type_v<std::decay_t<Char>>)>
@@ -333,8 +574,13 @@ namespace stdext
     template <typename Producer, STDEXT_REQUIRES(can_generate_v<Producer>)>
     std::pair<utf_result, size_t> to_utf32_length(Producer&& in, flags<utf_conversion_options> options = utf_conversion_options::none)
     {
-        return _private::to_utf_length(as_generator(stdext::forward<Producer>(in)),
-            [](auto&&... args) { return to_utf32(stdext::forward<decltype(args)>(args)...); }, options);
+        if constexpr (_private::use_bulk_length_v<Producer>)
+            return to_utf32_length(_private::contiguous_view(in), options);
+        else
+        {
+            return _private::to_utf_length(as_generator(stdext::forward<Producer>(in)),
+                [](auto&&... args) { return to_utf32(stdext::forward<decltype(args)>(args)...); }, options);
+        }
     }
 
     template <typename Char, STDEXT_REQUIRES(is_unicode_character_type_v<std::decay_t<Char>>)>
@@ -529,6 +775,182 @@ namespace stdext
         Char value;
     };
 
+    // Contiguous input is converted a block at a time with the bulk transcoders.  The converted
+    // code units are available individually, as with any generator, or a block at a time from
+    // next_chunk.  The block returned by next_chunk remains valid until the next call to
+    // next_chunk.
+    template <typename InChar, typename Char>
+    class to_utf_generator<array_view<const InChar>, Char>
+    {
+    public:
+        using iterator_category = generator_tag;
+        using value_type = Char;
+        using difference_type = ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+        using generator = array_view<const InChar>;
+
+    public:
+        to_utf_generator() : in(), state(), current(0), pos(0), count(0) { }
+        explicit to_utf_generator(const generator& in) : in(in), state(), current(0), pos(0), count(0)
+        {
+            fill();
+        }
+
+    public:
+        friend bool operator == (const to_utf_generator& a, const to_utf_generator& b) noexcept
+        {
+            return a.in.data() == b.in.data()
+                && a.in.size() == b.in.size()
+                && a.count - a.pos == b.count - b.pos
+                && std::equal(a.buffer[a.current] + a.pos, a.buffer[a.current] + a.count, b.buffer[b.current] + b.pos);
+        }
+        friend bool operator != (const to_utf_generator& a, const to_utf_generator& b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend void swap(to_utf_generator& a, to_utf_generator& b)
+        {
+            std::swap(a, b);
+        }
+
+    public:
+        reference operator * () const { return buffer[current][pos]; }
+        pointer operator -> () const { return &buffer[current][pos]; }
+        to_utf_generator& operator ++ ()
+        {
+            if (++pos == count)
+                fill();
+            return *this;
+        }
+        iterator_proxy<to_utf_generator> operator ++ (int)
+        {
+            iterator_proxy<to_utf_generator> proxy = **this;
+            ++*this;
+            return proxy;
+        }
+
+        explicit operator bool () const noexcept
+        {
+            return pos != count;
+        }
+
+        // Returns all of the code units converted so far but not yet produced, and advances past
+        // them.
+        basic_string_view<Char> next_chunk()
+        {
+            basic_string_view<Char> chunk(buffer[current] + pos, count - pos);
+            current ^= 1;
+            fill();
+            return chunk;
+        }
+
+    private:
+        static constexpr size_t buffer_size = 256;
+
+        void fill()
+        {
+            pos = 0;
+            count = 0;
+            while (count == 0)
+            {
+                if (in.empty() && state.consumed != 0)
+                {
+                    // Ran out of code units during a partial read.
+                    state = { };
+                    std::pair<utf_result, Char> result;
+                    do
+                    {
+                        result = _private::to_utf<Char>(UNICODE_REPLACEMENT_CHARACTER, state);
+                        buffer[current][count++] = result.second;
+                    } while (result.first == utf_result::partial_write);
+                    return;
+                }
+
+                if (in.empty() && state.produced == 0)
+                    return;
+
+                auto result = transcode(in, span<Char>(buffer[current], buffer_size), state, utf_conversion_options::sanitize);
+                in = generator(in.data() + result.consumed, in.size() - result.consumed);
+                count = result.produced;
+            }
+        }
+
+    private:
+        generator in;
+        utfstate_t state;
+        size_t current;
+        size_t pos;
+        size_t count;
+        Char buffer[2][buffer_size];
+    };
+
+    enum class utf_encoding
+    {
+        utf8,
+        utf16le,
+        utf16be,
+        utf32le,
+        utf32be
+    };
+
+    enum class utf_stream_options
+    {
+        none = 0,
+        // Replace invalid and truncated sequences with U+FFFD instead of throwing stream_error.
+        sanitize = 1,
+        // Look for a byte order mark at the start of the stream.  If one is found, it determines
+        // the source encoding in place of the one given to the constructor, and is not passed on.
+        detect_bom = 2
+    };
+
+    // Presents a stream of Unicode text in another encoding.  The text is converted a block at a
+    // time with the bulk transcoders, and a code point split across reads of either stream is
+    // carried over to the next read.
+    class utf_transcoding_input_stream : public input_stream, public direct_readable
+    {
+    public:
+        explicit utf_transcoding_input_stream(input_stream& stream, utf_encoding from, utf_encoding to,
+            flags<utf_stream_options> options = utf_stream_options::none);
+        utf_transcoding_input_stream(const utf_transcoding_input_stream&) = delete;
+        utf_transcoding_input_stream& operator = (const utf_transcoding_input_stream&) = delete;
+        ~utf_transcoding_input_stream() override;
+
+    public:
+        // The encoding of the underlying stream.  With utf_stream_options::detect_bom, this reads
+        // the byte order mark if it has not been read already.
+        utf_encoding source_encoding();
+        utf_encoding target_encoding() const noexcept { return _to; }
+
+        [[nodiscard]] size_t direct_read(std::function<size_t(const byte* buffer, size_t size)> read) final;
+
+    private:
+        [[nodiscard]] size_t do_read(byte* buffer, size_t size) final;
+        [[nodiscard]] size_t do_skip(size_t size) final;
+
+        void start();
+        bool fill();
+        bool read_input();
+        size_t convert(byte* buffer, size_t size);
+
+    private:
+        input_stream* _stream;
+        std::unique_ptr<char32_t[]> _input;
+        std::unique_ptr<char32_t[]> _output;
+        size_t _input_first = 0;
+        size_t _input_last = 0;
+        size_t _output_first = 0;
+        size_t _output_last = 0;
+        utfstate_t _state;
+        utf_encoding _from;
+        utf_encoding _to;
+        bool _sanitize;
+        bool _detect_bom;
+        bool _started = false;
+        bool _eof = false;
+    };
+
     struct to_utf8_tag { };
     struct to_utf16_tag { };
     struct to_utf32_tag { };
@@ -541,13 +963,25 @@ namespace stdext
 template <typename Producer, STDEXT_REQUIRES(stdext::can_generate_v<Producer>)>
 auto operator >> (Producer&& p, stdext::to_utf8_tag)
 {
-    return stdext::to_utf_generator<stdext::generator_type<Producer>, char>(stdext::as_generator(stdext::forward<Producer>(p)));
+    if constexpr (stdext::_private::use_bulk_transcode_v<char, Producer>)
+    {
+        auto in = stdext::_private::contiguous_view(p);
+        return stdext::to_utf_generator<decltype(in), char>(in);
+    }
+    else
+        return stdext::to_utf_generator<stdext::generator_type<Producer>, char>(stdext::as_generator(stdext::forward<Producer>(p)));
 }
 
 template <typename Producer, STDEXT_REQUIRES(stdext::can_generate_v<Producer>)>
 auto operator >> (Producer&& p, stdext::to_utf16_tag)
 {
-    return stdext::to_utf_generator<stdext::generator_type<Producer>, char16_t>(stdext::as_generator(stdext::forward<Producer>(p)));
+    if constexpr (stdext::_private::use_bulk_transcode_v<char16_t, Producer>)
+    {
+        auto in = stdext::_private::contiguous_view(p);
+        return stdext::to_utf_generator<decltype(in), char16_t>(in);
+    }
+    else
+        return stdext::to_utf_generator<stdext::generator_type<Producer>, char16_t>(stdext::as_generator(stdext::forward<Producer>(p)));
 }
 
 template <typename Producer, STDEXT_REQUIRES(stdext::can_generate_v<Producer>)>
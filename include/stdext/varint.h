@@ -0,0 +1,31 @@
+#ifndef STDEXT_VARINT_INCLUDED
+#define STDEXT_VARINT_INCLUDED
+#pragma once
+
+#include <stdext/array_view.h>
+#include <stdext/endian.h>
+#include <stdext/span.h>
+
+
+namespace stdext
+{
+    // Bulk LEB128 codecs, using the same encoding as read_varint and write_varint.  The encoders
+    // return the number of bytes written; the destination must have room for the worst case of
+    // max_varint_size<T> bytes per value.  The decoders decode exactly dst.size() values and
+    // return the number of bytes consumed; they throw stream_error if the input is exhausted or
+    // holds a value that does not fit.
+    [[nodiscard]] size_t leb128_encode(array_view<const uint32_t> src, span<byte> dst) noexcept;
+    [[nodiscard]] size_t leb128_encode(array_view<const uint64_t> src, span<byte> dst) noexcept;
+    [[nodiscard]] size_t leb128_decode(array_view<const byte> src, span<uint32_t> dst);
+    [[nodiscard]] size_t leb128_decode(array_view<const byte> src, span<uint64_t> dst);
+
+    // Stream VByte: a block of two-bit length codes (one per value, four per byte) followed by
+    // the little-endian data bytes of each value, using one to four bytes per value.  Separating
+    // the lengths from the data allows the decoder to expand several values at once with a
+    // single byte shuffle.  The encoded size of count values is at most streamvbyte_max_size.
+    constexpr size_t streamvbyte_max_size(size_t count) noexcept { return (count + 3) / 4 + 4 * count; }
+    [[nodiscard]] size_t streamvbyte_encode(array_view<const uint32_t> src, span<byte> dst) noexcept;
+    [[nodiscard]] size_t streamvbyte_decode(array_view<const byte> src, span<uint32_t> dst);
+}
+
+#endif
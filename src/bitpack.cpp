@@ -0,0 +1,510 @@
+#include <stdext/bitpack.h>
+
+#include <stdext/endian.h>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include <cassert>
+#include <cstring>
+
+#if STDEXT_ARCH_X86_64
+#include <emmintrin.h>
+#elif STDEXT_ARCH_ARM64
+#include <arm_neon.h>
+#endif
+
+
+namespace stdext
+{
+    namespace
+    {
+        constexpr size_t max_block = size_t(bitpack_block_size::values_256);
+        constexpr size_t max_header = 1 + max_varint_size<uint64_t>;
+
+        [[noreturn]] void premature_end()
+        {
+            throw stream_error("premature end of stream");
+        }
+
+        // Four 32-bit lanes.  SSE2 and NEON are part of the baseline instruction sets of x86-64
+        // and ARM64, so no run-time dispatch is needed.
+#if STDEXT_ARCH_X86_64
+        struct vec4
+        {
+            using type = __m128i;
+            static type zero() noexcept { return _mm_setzero_si128(); }
+            static type splat(uint32_t v) noexcept { return _mm_set1_epi32(int(v)); }
+            static type load(const uint32_t* p) noexcept { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+            static void store(uint32_t* p, type v) noexcept { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+            static type bit_and(type a, type b) noexcept { return _mm_and_si128(a, b); }
+            static type bit_or(type a, type b) noexcept { return _mm_or_si128(a, b); }
+            static type shl(type v, unsigned n) noexcept { return _mm_sll_epi32(v, _mm_cvtsi32_si128(int(n))); }
+            static type shr(type v, unsigned n) noexcept { return _mm_srl_epi32(v, _mm_cvtsi32_si128(int(n))); }
+        };
+#elif STDEXT_ARCH_ARM64
+        struct vec4
+        {
+            using type = uint32x4_t;
+            static type zero() noexcept { return vdupq_n_u32(0); }
+            static type splat(uint32_t v) noexcept { return vdupq_n_u32(v); }
+            static type load(const uint32_t* p) noexcept { return vld1q_u32(p); }
+            static void store(uint32_t* p, type v) noexcept { vst1q_u32(p, v); }
+            static type bit_and(type a, type b) noexcept { return vandq_u32(a, b); }
+            static type bit_or(type a, type b) noexcept { return vorrq_u32(a, b); }
+            static type shl(type v, unsigned n) noexcept { return vshlq_u32(v, vdupq_n_s32(int(n))); }
+            static type shr(type v, unsigned n) noexcept { return vshlq_u32(v, vdupq_n_s32(-int(n))); }
+        };
+#else
+        struct vec4
+        {
+            struct type { uint32_t v[4]; };
+            static type zero() noexcept { return { }; }
+            static type splat(uint32_t v) noexcept { return { { v, v, v, v } }; }
+            static type load(const uint32_t* p) noexcept { type r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+            static void store(uint32_t* p, type v) noexcept { std::memcpy(p, v.v, sizeof(v.v)); }
+            static type bit_and(type a, type b) noexcept { for (int k = 0; k != 4; ++k) a.v[k] &= b.v[k]; return a; }
+            static type bit_or(type a, type b) noexcept { for (int k = 0; k != 4; ++k) a.v[k] |= b.v[k]; return a; }
+            static type shl(type v, unsigned n) noexcept { for (auto& x : v.v) x <<= n; return v; }
+            static type shr(type v, unsigned n) noexcept { for (auto& x : v.v) x >>= n; return v; }
+        };
+#endif
+
+        // Blocks use a vertical layout: value i belongs to lane i % Lanes, and each lane packs its
+        // 32 values into Bits consecutive words of that lane.  Every step of the loop therefore
+        // operates on a whole row of lanes at once.  The bit width is a template parameter so
+        // that the loops can be fully unrolled with constant shift counts.
+        template <unsigned Bits, unsigned Lanes>
+        void pack(const uint32_t* in, uint32_t* out) noexcept
+        {
+            constexpr unsigned groups = Lanes / 4;
+
+            if constexpr (Bits == 32)
+                std::memcpy(out, in, 32 * Lanes * sizeof(uint32_t));
+            else if constexpr (Bits != 0)
+            {
+                vec4::type acc[groups];
+                vec4::type v[groups];
+                for (unsigned g = 0; g != groups; ++g)
+                    acc[g] = vec4::zero();
+
+                unsigned filled = 0;
+                for (unsigned i = 0; i != 32; ++i)
+                {
+                    for (unsigned g = 0; g != groups; ++g)
+                    {
+                        v[g] = vec4::load(in + i * Lanes + 4 * g);
+                        acc[g] = vec4::bit_or(acc[g], vec4::shl(v[g], filled));
+                    }
+
+                    filled += Bits;
+                    if (filled >= 32)
+                    {
+                        for (unsigned g = 0; g != groups; ++g)
+                            vec4::store(out + 4 * g, acc[g]);
+                        out += Lanes;
+
+                        filled -= 32;
+                        for (unsigned g = 0; g != groups; ++g)
+                            acc[g] = filled != 0 ? vec4::shr(v[g], Bits - filled) : vec4::zero();
+                    }
+                }
+            }
+        }
+
+        template <unsigned Bits, unsigned Lanes>
+        void unpack(const uint32_t* in, uint32_t* out) noexcept
+        {
+            constexpr unsigned groups = Lanes / 4;
+
+            if constexpr (Bits == 0)
+                std::memset(out, 0, 32 * Lanes * sizeof(uint32_t));
+            else if constexpr (Bits == 32)
+                std::memcpy(out, in, 32 * Lanes * sizeof(uint32_t));
+            else
+            {
+                auto mask = vec4::splat((uint32_t(1) << Bits) - 1);
+                vec4::type w[groups];
+                for (unsigned g = 0; g != groups; ++g)
+                    w[g] = vec4::load(in + 4 * g);
+
+                unsigned used = 0;
+                for (unsigned i = 0; i != 32; ++i)
+                {
+                    for (unsigned g = 0; g != groups; ++g)
+                    {
+                        auto v = vec4::shr(w[g], used);
+                        if (used + Bits > 32)
+                        {
+                            w[g] = vec4::load(in + Lanes + 4 * g);
+                            v = vec4::bit_or(v, vec4::shl(w[g], 32 - used));
+                        }
+                        vec4::store(out + i * Lanes + 4 * g, vec4::bit_and(v, mask));
+                    }
+
+                    used += Bits;
+                    if (used >= 32)
+                    {
+                        in += Lanes;
+                        used -= 32;
+                        if (used == 0 && i != 31)
+                        {
+                            for (unsigned g = 0; g != groups; ++g)
+                                w[g] = vec4::load(in + 4 * g);
+                        }
+                    }
+                }
+            }
+        }
+
+        using kernel = void (*)(const uint32_t* in, uint32_t* out) noexcept;
+
+        template <unsigned Lanes, unsigned... Bits>
+        constexpr std::array<kernel, 33> make_pack_table(std::integer_sequence<unsigned, Bits...>) noexcept
+        {
+            return { { pack<Bits, Lanes>... } };
+        }
+
+        template <unsigned Lanes, unsigned... Bits>
+        constexpr std::array<kernel, 33> make_unpack_table(std::integer_sequence<unsigned, Bits...>) noexcept
+        {
+            return { { unpack<Bits, Lanes>... } };
+        }
+
+        constexpr auto pack128 = make_pack_table<4>(std::make_integer_sequence<unsigned, 33>());
+        constexpr auto pack256 = make_pack_table<8>(std::make_integer_sequence<unsigned, 33>());
+        constexpr auto unpack128 = make_unpack_table<4>(std::make_integer_sequence<unsigned, 33>());
+        constexpr auto unpack256 = make_unpack_table<8>(std::make_integer_sequence<unsigned, 33>());
+
+        unsigned bit_width(uint64_t v) noexcept
+        {
+            unsigned width = 0;
+            for (; v != 0; v >>= 1)
+                ++width;
+            return width;
+        }
+
+        // Packed words are stored little-endian.
+        void store_words(byte* p, const uint32_t* words, size_t count) noexcept
+        {
+#if STDEXT_BIG_ENDIAN
+            for (size_t n = 0; n != count; ++n, p += 4)
+            {
+                auto w = endian_swap<byte_order::little_endian>(words[n]);
+                std::memcpy(p, &w, 4);
+            }
+#else
+            std::memcpy(p, words, count * sizeof(uint32_t));
+#endif
+        }
+
+        void load_words(uint32_t* words, const byte* p, size_t count) noexcept
+        {
+            std::memcpy(words, p, count * sizeof(uint32_t));
+#if STDEXT_BIG_ENDIAN
+            for (size_t n = 0; n != count; ++n)
+                words[n] = endian_swap<byte_order::little_endian>(words[n]);
+#endif
+        }
+
+        byte* put_varint(byte* p, uint64_t value) noexcept
+        {
+            for (; value >= 0x80; value >>= 7)
+                *p++ = byte(value | 0x80);
+            *p++ = byte(value);
+            return p;
+        }
+
+        uint64_t get_varint(const byte*& p, const byte* end)
+        {
+            uint64_t value = 0;
+            for (unsigned shift = 0; ; shift += 7)
+            {
+                if (p == end)
+                    premature_end();
+
+                auto b = uint8_t(*p++);
+                if (shift == 63 ? (b & 0x7E) != 0 : shift > 63)
+                    throw stream_error("varint out of range");
+
+                value |= uint64_t(b & 0x7F) << shift;
+                if ((b & 0x80) == 0)
+                    return value;
+            }
+        }
+
+        struct block_header
+        {
+            unsigned width;
+            uint64_t reference;
+        };
+
+        // Encodes one full block: header byte, varint reference, packed residuals.  The
+        // residuals are split into low and high 32-bit halves so that widths up to 64 bits are
+        // served by the 32-bit kernels.
+        template <typename T>
+        byte* encode_block(const T* src, size_t block, uint64_t& previous, bitpack_encoding encoding, byte* out) noexcept
+        {
+            uint64_t residuals[max_block];
+            uint64_t reference;
+            if (encoding == bitpack_encoding::delta)
+            {
+                auto last = previous;
+                int64_t min_delta = INT64_MAX;
+                for (size_t n = 0; n != block; ++n)
+                {
+                    residuals[n] = uint64_t(src[n]) - last;
+                    last = uint64_t(src[n]);
+                    min_delta = std::min(min_delta, int64_t(residuals[n]));
+                }
+                previous = last;
+                reference = uint64_t(min_delta);
+            }
+            else
+            {
+                reference = UINT64_MAX;
+                for (size_t n = 0; n != block; ++n)
+                {
+                    residuals[n] = uint64_t(src[n]);
+                    reference = std::min(reference, residuals[n]);
+                }
+            }
+
+            uint64_t all = 0;
+            for (size_t n = 0; n != block; ++n)
+            {
+                residuals[n] -= reference;
+                all |= residuals[n];
+            }
+            auto width = bit_width(all);
+
+            *out++ = byte(width);
+            out = put_varint(out, encoding == bitpack_encoding::delta ? zigzag_encode(int64_t(reference)) : reference);
+
+            auto& table = block == 128 ? pack128 : pack256;
+            uint32_t low[max_block];
+            uint32_t packed[max_block];
+            for (size_t n = 0; n != block; ++n)
+                low[n] = uint32_t(residuals[n]);
+            table[std::min(width, 32u)](low, packed);
+            store_words(out, packed, block / 32 * std::min(width, 32u));
+            out += block / 8 * std::min(width, 32u);
+
+            if (width > 32)
+            {
+                uint32_t high[max_block];
+                for (size_t n = 0; n != block; ++n)
+                    high[n] = uint32_t(residuals[n] >> 32);
+                table[width - 32](high, packed);
+                store_words(out, packed, block / 32 * (width - 32));
+                out += block / 8 * (width - 32);
+            }
+
+            return out;
+        }
+
+        constexpr size_t payload_size(size_t block, unsigned width) noexcept
+        {
+            return block / 8 * width;
+        }
+
+        template <typename T>
+        void decode_payload(const block_header& header, const byte* payload, size_t block, uint64_t& previous,
+            bitpack_encoding encoding, T* dst) noexcept
+        {
+            auto& table = block == 128 ? unpack128 : unpack256;
+            auto low_width = std::min(header.width, 32u);
+
+            uint32_t words[max_block];
+            uint32_t low[max_block];
+            load_words(words, payload, block / 32 * low_width);
+            table[low_width](words, low);
+
+            uint32_t high[max_block];
+            if (header.width > 32)
+            {
+                load_words(words, payload + payload_size(block, low_width), block / 32 * (header.width - 32));
+                table[header.width - 32](words, high);
+            }
+            else
+                std::memset(high, 0, block * sizeof(uint32_t));
+
+            if (encoding == bitpack_encoding::delta)
+            {
+                auto value = previous;
+                for (size_t n = 0; n != block; ++n)
+                {
+                    value += header.reference + (uint64_t(high[n]) << 32 | low[n]);
+                    dst[n] = T(value);
+                }
+                previous = value;
+            }
+            else
+            {
+                for (size_t n = 0; n != block; ++n)
+                    dst[n] = T(header.reference + (uint64_t(high[n]) << 32 | low[n]));
+            }
+        }
+
+        block_header make_header(uint8_t width, uint64_t reference, bitpack_encoding encoding)
+        {
+            if (width > 64)
+                throw stream_error("invalid bit-packed block");
+            if (encoding == bitpack_encoding::delta)
+                reference = uint64_t(zigzag_decode(reference));
+            return { width, reference };
+        }
+
+        uint64_t tail_value(uint64_t value, uint64_t& previous, bitpack_encoding encoding) noexcept
+        {
+            if (encoding != bitpack_encoding::delta)
+                return value;
+
+            auto delta = value - previous;
+            previous = value;
+            return zigzag_encode(int64_t(delta));
+        }
+
+        uint64_t untail_value(uint64_t value, uint64_t& previous, bitpack_encoding encoding) noexcept
+        {
+            if (encoding != bitpack_encoding::delta)
+                return value;
+
+            previous += uint64_t(zigzag_decode(value));
+            return previous;
+        }
+
+        template <typename T>
+        size_t encode(const T* src, size_t count, byte* dst, bitpack_encoding encoding, bitpack_block_size block_size) noexcept
+        {
+            auto block = size_t(block_size);
+            auto out = dst;
+            uint64_t previous = 0;
+
+            size_t n = 0;
+            for (; count - n >= block; n += block)
+                out = encode_block(src + n, block, previous, encoding, out);
+            for (; n != count; ++n)
+                out = put_varint(out, tail_value(uint64_t(src[n]), previous, encoding));
+
+            return size_t(out - dst);
+        }
+
+        template <typename T>
+        size_t decode(const byte* src, size_t size, T* dst, size_t count, bitpack_encoding encoding, bitpack_block_size block_size)
+        {
+            auto block = size_t(block_size);
+            auto p = src;
+            auto end = src + size;
+            uint64_t previous = 0;
+
+            size_t n = 0;
+            for (; count - n >= block; n += block)
+            {
+                if (p == end)
+                    premature_end();
+                auto width = uint8_t(*p++);
+                auto reference = get_varint(p, end);
+                auto header = make_header(width, reference, encoding);
+
+                auto payload = payload_size(block, header.width);
+                if (size_t(end - p) < payload)
+                    premature_end();
+                decode_payload(header, p, block, previous, encoding, dst + n);
+                p += payload;
+            }
+
+            for (; n != count; ++n)
+                dst[n] = T(untail_value(get_varint(p, end), previous, encoding));
+
+            return size_t(p - src);
+        }
+
+        template <typename T>
+        void write_blocks(output_stream& s, const T* src, size_t count, bitpack_encoding encoding, bitpack_block_size block_size)
+        {
+            auto block = size_t(block_size);
+            uint64_t previous = 0;
+            byte buffer[std::max(max_header + max_block * sizeof(uint64_t), (max_block - 1) * max_varint_size<uint64_t>)];
+
+            size_t n = 0;
+            for (; count - n >= block; n += block)
+            {
+                auto end = encode_block(src + n, block, previous, encoding, buffer);
+                s.write_all(buffer, size_t(end - buffer));
+            }
+
+            // Trailing values are gathered so that they are written with a single call.
+            auto out = buffer;
+            for (; n != count; ++n)
+                out = put_varint(out, tail_value(uint64_t(src[n]), previous, encoding));
+            if (out != buffer)
+                s.write_all(buffer, size_t(out - buffer));
+        }
+
+        template <typename T>
+        void read_blocks(input_stream& s, T* dst, size_t count, bitpack_encoding encoding, bitpack_block_size block_size)
+        {
+            auto block = size_t(block_size);
+            uint64_t previous = 0;
+            byte payload[max_block * sizeof(uint64_t)];
+
+            size_t n = 0;
+            for (; count - n >= block; n += block)
+            {
+                auto width = s.read<uint8_t>();
+                auto reference = read_varint<uint64_t>(s);
+                auto header = make_header(width, reference, encoding);
+
+                s.read_all(payload, payload_size(block, header.width));
+                decode_payload(header, payload, block, previous, encoding, dst + n);
+            }
+
+            for (; n != count; ++n)
+                dst[n] = T(untail_value(read_varint<uint64_t>(s), previous, encoding));
+        }
+    }
+
+    size_t bitpack_encode(array_view<const uint32_t> src, span<byte> dst, bitpack_encoding encoding, bitpack_block_size block_size) noexcept
+    {
+        assert(dst.size() >= bitpack_max_size(src.size(), block_size));
+        return encode(src.data(), src.size(), dst.data(), encoding, block_size);
+    }
+
+    size_t bitpack_encode(array_view<const uint64_t> src, span<byte> dst, bitpack_encoding encoding, bitpack_block_size block_size) noexcept
+    {
+        assert(dst.size() >= bitpack_max_size(src.size(), block_size));
+        return encode(src.data(), src.size(), dst.data(), encoding, block_size);
+    }
+
+    size_t bitpack_decode(array_view<const byte> src, span<uint32_t> dst, bitpack_encoding encoding, bitpack_block_size block_size)
+    {
+        return decode(src.data(), src.size(), dst.data(), dst.size(), encoding, block_size);
+    }
+
+    size_t bitpack_decode(array_view<const byte> src, span<uint64_t> dst, bitpack_encoding encoding, bitpack_block_size block_size)
+    {
+        return decode(src.data(), src.size(), dst.data(), dst.size(), encoding, block_size);
+    }
+
+    void write_bitpacked(output_stream& s, array_view<const uint32_t> values, bitpack_encoding encoding, bitpack_block_size block_size)
+    {
+        write_blocks(s, values.data(), values.size(), encoding, block_size);
+    }
+
+    void write_bitpacked(output_stream& s, array_view<const uint64_t> values, bitpack_encoding encoding, bitpack_block_size block_size)
+    {
+        write_blocks(s, values.data(), values.size(), encoding, block_size);
+    }
+
+    void read_bitpacked(input_stream& s, span<uint32_t> values, bitpack_encoding encoding, bitpack_block_size block_size)
+    {
+        read_blocks(s, values.data(), values.size(), encoding, block_size);
+    }
+
+    void read_bitpacked(input_stream& s, span<uint64_t> values, bitpack_encoding encoding, bitpack_block_size block_size)
+    {
+        read_blocks(s, values.data(), values.size(), encoding, block_size);
+    }
+}
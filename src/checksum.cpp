@@ -0,0 +1,394 @@
+#include <stdext/checksum.h>
+
+#include "cpu.h"
+
+#include <array>
+
+#include <cstring>
+
+
+namespace stdext
+{
+    namespace
+    {
+        using _private::load32;
+        using _private::load64;
+
+        constexpr uint32_t crc32c_polynomial = 0x82F63B78;  // reflected
+
+        using crc32c_table_t = std::array<std::array<uint32_t, 256>, 8>;
+
+        constexpr crc32c_table_t make_crc32c_table() noexcept
+        {
+            crc32c_table_t table = { };
+            for (uint32_t n = 0; n != 256; ++n)
+            {
+                auto crc = n;
+                for (unsigned k = 0; k != 8; ++k)
+                    crc = crc & 1 ? crc >> 1 ^ crc32c_polynomial : crc >> 1;
+                table[0][n] = crc;
+            }
+
+            for (uint32_t n = 0; n != 256; ++n)
+            {
+                for (size_t k = 1; k != table.size(); ++k)
+                    table[k][n] = table[k - 1][n] >> 8 ^ table[0][table[k - 1][n] & 0xFF];
+            }
+
+            return table;
+        }
+
+        constexpr crc32c_table_t crc32c_table = make_crc32c_table();
+
+        // Slicing-by-8.  Operates on the raw CRC register (no pre- or post-inversion).
+        uint32_t crc32c_sw(uint32_t crc, const byte* p, size_t size) noexcept
+        {
+            for (; size != 0 && reinterpret_cast<uintptr_t>(p) % 8 != 0; --size)
+                crc = crc >> 8 ^ crc32c_table[0][(crc ^ uint8_t(*p++)) & 0xFF];
+
+            for (; size >= 8; size -= 8, p += 8)
+            {
+                auto v = load64(p) ^ crc;
+                crc = crc32c_table[7][v & 0xFF]
+                    ^ crc32c_table[6][v >> 8 & 0xFF]
+                    ^ crc32c_table[5][v >> 16 & 0xFF]
+                    ^ crc32c_table[4][v >> 24 & 0xFF]
+                    ^ crc32c_table[3][v >> 32 & 0xFF]
+                    ^ crc32c_table[2][v >> 40 & 0xFF]
+                    ^ crc32c_table[1][v >> 48 & 0xFF]
+                    ^ crc32c_table[0][v >> 56];
+            }
+
+            for (; size != 0; --size)
+                crc = crc >> 8 ^ crc32c_table[0][(crc ^ uint8_t(*p++)) & 0xFF];
+
+            return crc;
+        }
+
+#if STDEXT_ARCH_X86_64
+        // Returns x^(8 * bytes - 33) mod P in reflected form.  Carry-less multiplication of a CRC
+        // register by this constant, followed by a 64-bit crc32 reduction, is equivalent to
+        // feeding the register through the given number of zero bytes.
+        constexpr uint32_t crc32c_shift_constant(size_t bytes) noexcept
+        {
+            uint32_t k = 0x80000000;
+            for (size_t n = 8 * bytes - 33; n != 0; --n)
+                k = k & 1 ? k >> 1 ^ crc32c_polynomial : k >> 1;
+            return k;
+        }
+
+        // The three streams are processed in lock-step so that the three-cycle latency of the
+        // crc32 instruction is hidden.  Long buffers use large blocks to amortize the cost of
+        // combining; the short block size keeps moderately sized buffers on the fast path.
+        constexpr size_t crc32c_long_block = 8192;
+        constexpr size_t crc32c_short_block = 256;
+        constexpr uint32_t crc32c_long_shift = crc32c_shift_constant(crc32c_long_block);
+        constexpr uint32_t crc32c_short_shift = crc32c_shift_constant(crc32c_short_block);
+
+        STDEXT_TARGET("sse4.2,pclmul")
+        uint32_t crc32c_shift(uint32_t crc, uint32_t k) noexcept
+        {
+            auto product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(int(crc)), _mm_cvtsi32_si128(int(k)), 0);
+            return uint32_t(_mm_crc32_u64(0, uint64_t(_mm_cvtsi128_si64(product))));
+        }
+
+        STDEXT_TARGET("sse4.2,pclmul")
+        const byte* crc32c_interleaved(uint32_t& crc, const byte* p, size_t& size, size_t block, uint32_t k) noexcept
+        {
+            uint64_t crc0 = crc;
+            for (; size >= 3 * block; size -= 3 * block)
+            {
+                uint64_t crc1 = 0;
+                uint64_t crc2 = 0;
+                for (auto end = p + block; p != end; p += 8)
+                {
+                    crc0 = _mm_crc32_u64(crc0, load64(p));
+                    crc1 = _mm_crc32_u64(crc1, load64(p + block));
+                    crc2 = _mm_crc32_u64(crc2, load64(p + 2 * block));
+                }
+                p += 2 * block;
+
+                crc0 = crc32c_shift(uint32_t(crc0), k) ^ crc1;
+                crc0 = crc32c_shift(uint32_t(crc0), k) ^ crc2;
+            }
+
+            crc = uint32_t(crc0);
+            return p;
+        }
+
+        STDEXT_TARGET("sse4.2,pclmul")
+        uint32_t crc32c_hw(uint32_t crc, const byte* p, size_t size) noexcept
+        {
+            for (; size != 0 && reinterpret_cast<uintptr_t>(p) % 8 != 0; --size)
+                crc = _mm_crc32_u8(crc, uint8_t(*p++));
+
+            p = crc32c_interleaved(crc, p, size, crc32c_long_block, crc32c_long_shift);
+            p = crc32c_interleaved(crc, p, size, crc32c_short_block, crc32c_short_shift);
+
+            uint64_t crc64 = crc;
+            for (; size >= 8; size -= 8, p += 8)
+                crc64 = _mm_crc32_u64(crc64, load64(p));
+            crc = uint32_t(crc64);
+
+            for (; size != 0; --size)
+                crc = _mm_crc32_u8(crc, uint8_t(*p++));
+
+            return crc;
+        }
+#endif
+
+        constexpr uint32_t xxh32_prime1 = 0x9E3779B1;
+        constexpr uint32_t xxh32_prime2 = 0x85EBCA77;
+        constexpr uint32_t xxh32_prime3 = 0xC2B2AE3D;
+        constexpr uint32_t xxh32_prime4 = 0x27D4EB2F;
+        constexpr uint32_t xxh32_prime5 = 0x165667B1;
+
+        constexpr uint32_t rotl32(uint32_t v, unsigned n) noexcept
+        {
+            return v << n | v >> (32 - n);
+        }
+
+        constexpr uint32_t xxh32_round(uint32_t acc, uint32_t input) noexcept
+        {
+            acc += input * xxh32_prime2;
+            acc = rotl32(acc, 13);
+            return acc * xxh32_prime1;
+        }
+
+        const byte* xxh32_stripes(uint32_t (&acc)[4], const byte* p, size_t stripes) noexcept
+        {
+            for (; stripes != 0; --stripes, p += 16)
+            {
+                acc[0] = xxh32_round(acc[0], load32(p));
+                acc[1] = xxh32_round(acc[1], load32(p + 4));
+                acc[2] = xxh32_round(acc[2], load32(p + 8));
+                acc[3] = xxh32_round(acc[3], load32(p + 12));
+            }
+            return p;
+        }
+
+        uint32_t xxh32_finish(const uint32_t (&acc)[4], uint32_t seed, uint64_t total, const byte* p, size_t size) noexcept
+        {
+            uint32_t h = total >= 16
+                ? rotl32(acc[0], 1) + rotl32(acc[1], 7) + rotl32(acc[2], 12) + rotl32(acc[3], 18)
+                : seed + xxh32_prime5;
+
+            h += uint32_t(total);
+
+            for (; size >= 4; size -= 4, p += 4)
+            {
+                h += load32(p) * xxh32_prime3;
+                h = rotl32(h, 17) * xxh32_prime4;
+            }
+
+            for (; size != 0; --size)
+            {
+                h += uint8_t(*p++) * xxh32_prime5;
+                h = rotl32(h, 11) * xxh32_prime1;
+            }
+
+            h ^= h >> 15;
+            h *= xxh32_prime2;
+            h ^= h >> 13;
+            h *= xxh32_prime3;
+            h ^= h >> 16;
+            return h;
+        }
+
+        constexpr uint64_t xxh64_prime1 = 0x9E3779B185EBCA87;
+        constexpr uint64_t xxh64_prime2 = 0xC2B2AE3D27D4EB4F;
+        constexpr uint64_t xxh64_prime3 = 0x165667B19E3779F9;
+        constexpr uint64_t xxh64_prime4 = 0x85EBCA77C2B2AE63;
+        constexpr uint64_t xxh64_prime5 = 0x27D4EB2F165667C5;
+
+        constexpr uint64_t rotl64(uint64_t v, unsigned n) noexcept
+        {
+            return v << n | v >> (64 - n);
+        }
+
+        constexpr uint64_t xxh64_round(uint64_t acc, uint64_t input) noexcept
+        {
+            acc += input * xxh64_prime2;
+            acc = rotl64(acc, 31);
+            return acc * xxh64_prime1;
+        }
+
+        constexpr uint64_t xxh64_merge(uint64_t acc, uint64_t v) noexcept
+        {
+            acc ^= xxh64_round(0, v);
+            return acc * xxh64_prime1 + xxh64_prime4;
+        }
+
+        const byte* xxh64_stripes(uint64_t (&acc)[4], const byte* p, size_t stripes) noexcept
+        {
+            for (; stripes != 0; --stripes, p += 32)
+            {
+                acc[0] = xxh64_round(acc[0], load64(p));
+                acc[1] = xxh64_round(acc[1], load64(p + 8));
+                acc[2] = xxh64_round(acc[2], load64(p + 16));
+                acc[3] = xxh64_round(acc[3], load64(p + 24));
+            }
+            return p;
+        }
+
+        uint64_t xxh64_finish(const uint64_t (&acc)[4], uint64_t seed, uint64_t total, const byte* p, size_t size) noexcept
+        {
+            uint64_t h;
+            if (total >= 32)
+            {
+                h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+                h = xxh64_merge(h, acc[0]);
+                h = xxh64_merge(h, acc[1]);
+                h = xxh64_merge(h, acc[2]);
+                h = xxh64_merge(h, acc[3]);
+            }
+            else
+                h = seed + xxh64_prime5;
+
+            h += total;
+
+            for (; size >= 8; size -= 8, p += 8)
+            {
+                h ^= xxh64_round(0, load64(p));
+                h = rotl64(h, 27) * xxh64_prime1 + xxh64_prime4;
+            }
+
+            if (size >= 4)
+            {
+                h ^= load32(p) * xxh64_prime1;
+                h = rotl64(h, 23) * xxh64_prime2 + xxh64_prime3;
+                size -= 4;
+                p += 4;
+            }
+
+            for (; size != 0; --size)
+            {
+                h ^= uint8_t(*p++) * xxh64_prime5;
+                h = rotl64(h, 11) * xxh64_prime1;
+            }
+
+            h ^= h >> 33;
+            h *= xxh64_prime2;
+            h ^= h >> 29;
+            h *= xxh64_prime3;
+            h ^= h >> 32;
+            return h;
+        }
+    }
+
+    uint32_t crc32c(array_view<const byte> data, uint32_t crc) noexcept
+    {
+        crc = ~crc;
+#if STDEXT_ARCH_X86_64
+        if (_private::cpu().sse42 && _private::cpu().pclmul)
+            return ~crc32c_hw(crc, data.data(), data.size());
+#endif
+        return ~crc32c_sw(crc, data.data(), data.size());
+    }
+
+    uint32_t xxhash32(array_view<const byte> data, uint32_t seed) noexcept
+    {
+        xxhash32_state state(seed);
+        state.update(data);
+        return state.value();
+    }
+
+    uint64_t xxhash64(array_view<const byte> data, uint64_t seed) noexcept
+    {
+        xxhash64_state state(seed);
+        state.update(data);
+        return state.value();
+    }
+
+    void xxhash32_state::reset(uint32_t seed) noexcept
+    {
+        _acc[0] = seed + xxh32_prime1 + xxh32_prime2;
+        _acc[1] = seed + xxh32_prime2;
+        _acc[2] = seed;
+        _acc[3] = seed - xxh32_prime1;
+        _seed = seed;
+        _total = 0;
+        _buffered = 0;
+    }
+
+    void xxhash32_state::update(array_view<const byte> data) noexcept
+    {
+        // An empty view may have a null pointer, which memcpy doesn't accept.
+        auto p = data.data();
+        auto size = data.size();
+        if (size == 0)
+            return;
+        _total += size;
+
+        if (_buffered != 0)
+        {
+            auto count = std::min(size, sizeof(_buffer) - _buffered);
+            std::memcpy(_buffer + _buffered, p, count);
+            _buffered += count;
+            p += count;
+            size -= count;
+            if (_buffered != sizeof(_buffer))
+                return;
+
+            xxh32_stripes(_acc, _buffer, 1);
+            _buffered = 0;
+        }
+
+        p = xxh32_stripes(_acc, p, size / 16);
+        size %= 16;
+
+        std::memcpy(_buffer, p, size);
+        _buffered = size;
+    }
+
+    uint32_t xxhash32_state::value() const noexcept
+    {
+        return xxh32_finish(_acc, _seed, _total, _buffer, _buffered);
+    }
+
+    void xxhash64_state::reset(uint64_t seed) noexcept
+    {
+        _acc[0] = seed + xxh64_prime1 + xxh64_prime2;
+        _acc[1] = seed + xxh64_prime2;
+        _acc[2] = seed;
+        _acc[3] = seed - xxh64_prime1;
+        _seed = seed;
+        _total = 0;
+        _buffered = 0;
+    }
+
+    void xxhash64_state::update(array_view<const byte> data) noexcept
+    {
+        // An empty view may have a null pointer, which memcpy doesn't accept.
+        auto p = data.data();
+        auto size = data.size();
+        if (size == 0)
+            return;
+        _total += size;
+
+        if (_buffered != 0)
+        {
+            auto count = std::min(size, sizeof(_buffer) - _buffered);
+            std::memcpy(_buffer + _buffered, p, count);
+            _buffered += count;
+            p += count;
+            size -= count;
+            if (_buffered != sizeof(_buffer))
+                return;
+
+            xxh64_stripes(_acc, _buffer, 1);
+            _buffered = 0;
+        }
+
+        p = xxh64_stripes(_acc, p, size / 32);
+        size %= 32;
+
+        std::memcpy(_buffer, p, size);
+        _buffered = size;
+    }
+
+    uint64_t xxhash64_state::value() const noexcept
+    {
+        return xxh64_finish(_acc, _seed, _total, _buffer, _buffered);
+    }
+}
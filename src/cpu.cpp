@@ -0,0 +1,61 @@
+#include "cpu.h"
+
+#if STDEXT_ARCH_X86 && STDEXT_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+
+namespace stdext
+{
+    namespace _private
+    {
+        namespace
+        {
+            cpu_features detect_cpu_features() noexcept
+            {
+                cpu_features features;
+
+#if STDEXT_ARCH_X86 && STDEXT_COMPILER_GCC
+                __builtin_cpu_init();
+                features.ssse3 = __builtin_cpu_supports("ssse3");
+                features.sse41 = __builtin_cpu_supports("sse4.1");
+                features.sse42 = __builtin_cpu_supports("sse4.2");
+                features.pclmul = __builtin_cpu_supports("pclmul");
+                features.avx2 = __builtin_cpu_supports("avx2");
+                features.avx512bw = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#elif STDEXT_ARCH_X86 && STDEXT_COMPILER_MSVC
+                int info[4];
+                __cpuid(info, 0);
+                int max_leaf = info[0];
+
+                __cpuid(info, 1);
+                features.ssse3 = (info[2] & (1 << 9)) != 0;
+                features.sse41 = (info[2] & (1 << 19)) != 0;
+                features.sse42 = (info[2] & (1 << 20)) != 0;
+                features.pclmul = (info[2] & (1 << 1)) != 0;
+
+                // AVX state must be enabled by the operating system before it can be used.
+                bool osxsave = (info[2] & (1 << 27)) != 0;
+                auto xcr0 = osxsave ? _xgetbv(0) : 0;
+                bool avx_state = (xcr0 & 0x06) == 0x06;
+                bool avx512_state = (xcr0 & 0xE6) == 0xE6;
+
+                if (max_leaf >= 7)
+                {
+                    __cpuidex(info, 7, 0);
+                    features.avx2 = avx_state && (info[1] & (1 << 5)) != 0;
+                    features.avx512bw = avx512_state && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+                }
+#endif
+
+                return features;
+            }
+        }
+
+        const cpu_features& cpu() noexcept
+        {
+            static const cpu_features features = detect_cpu_features();
+            return features;
+        }
+    }
+}
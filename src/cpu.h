@@ -0,0 +1,115 @@
+#ifndef STDEXT_IMPL_CPU_INCLUDED
+#define STDEXT_IMPL_CPU_INCLUDED
+#pragma once
+
+#include <stdext/_impl/config.h>
+
+#include <cstdint>
+#include <cstring>
+
+#if STDEXT_ARCH_X86
+#include <immintrin.h>
+#endif
+#if STDEXT_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+
+// Instruction set extensions are selected at run time so that the library can be built for a
+// baseline target and still take advantage of newer processors.  Functions that use extended
+// instructions must be declared with STDEXT_TARGET so that GCC and Clang will accept the
+// intrinsics; MSVC accepts them unconditionally.
+#if STDEXT_COMPILER_GCC
+#define STDEXT_TARGET(...) __attribute__((target(__VA_ARGS__)))
+#else
+#define STDEXT_TARGET(...)
+#endif
+
+namespace stdext
+{
+    namespace _private
+    {
+        struct cpu_features
+        {
+            bool ssse3 = false;
+            bool sse41 = false;
+            bool sse42 = false;
+            bool pclmul = false;
+            bool avx2 = false;
+            bool avx512bw = false;
+        };
+
+        const cpu_features& cpu() noexcept;
+
+        // The index of the lowest set bit of v, which must not be zero.
+        inline unsigned count_trailing_zeros(uint32_t v) noexcept
+        {
+#if STDEXT_COMPILER_GCC
+            return unsigned(__builtin_ctz(v));
+#elif STDEXT_COMPILER_MSVC
+            unsigned long index;
+            _BitScanForward(&index, v);
+            return unsigned(index);
+#else
+            unsigned n = 0;
+            for (; (v & 1) == 0; v >>= 1)
+                ++n;
+            return n;
+#endif
+        }
+
+        inline unsigned count_trailing_zeros(uint64_t v) noexcept
+        {
+#if STDEXT_COMPILER_GCC
+            return unsigned(__builtin_ctzll(v));
+#elif STDEXT_COMPILER_MSVC && (STDEXT_ARCH_X86_64 || STDEXT_ARCH_ARM64)
+            unsigned long index;
+            _BitScanForward64(&index, v);
+            return unsigned(index);
+#else
+            auto low = uint32_t(v);
+            return low != 0 ? count_trailing_zeros(low) : 32 + count_trailing_zeros(uint32_t(v >> 32));
+#endif
+        }
+
+        // The index of the highest set bit of v, which must not be zero.
+        inline unsigned highest_bit(uint32_t v) noexcept
+        {
+#if STDEXT_COMPILER_GCC
+            return 31 - unsigned(__builtin_clz(v));
+#elif STDEXT_COMPILER_MSVC
+            unsigned long index;
+            _BitScanReverse(&index, v);
+            return unsigned(index);
+#else
+            unsigned n = 0;
+            while (v >>= 1)
+                ++n;
+            return n;
+#endif
+        }
+
+        // Unaligned little-endian loads.
+        inline uint32_t load32(const void* p) noexcept
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+#if STDEXT_BIG_ENDIAN
+            v = __builtin_bswap32(v);
+#endif
+            return v;
+        }
+
+        inline uint64_t load64(const void* p) noexcept
+        {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+#if STDEXT_BIG_ENDIAN
+            v = __builtin_bswap64(v);
+#endif
+            return v;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdext/endian.h>
+
+#include "cpu.h"
+
+#if STDEXT_ARCH_ARM64
+#include <arm_neon.h>
+#endif
+
+#include <utility>
+
+#include <cassert>
+#include <cstring>
+
+
+namespace stdext
+{
+    namespace
+    {
+        using swap_kernel = void (*)(const byte* src, byte* dst, size_t count) noexcept;
+
+        template <size_t Size>
+        void byte_swap_scalar(const byte* src, byte* dst, size_t count) noexcept
+        {
+            using sized_t = _private::make_sized_integral_type_t<Size, false>;
+            for (size_t n = 0; n != count; ++n, src += Size, dst += Size)
+            {
+                sized_t v;
+                std::memcpy(&v, src, Size);
+#if STDEXT_COMPILER_GCC
+                if constexpr (Size == 2)
+                    v = __builtin_bswap16(v);
+                else if constexpr (Size == 4)
+                    v = __builtin_bswap32(v);
+                else
+                    v = __builtin_bswap64(v);
+#else
+                byte bytes[Size];
+                std::memcpy(bytes, &v, Size);
+                for (size_t b = 0; b != Size / 2; ++b)
+                    std::swap(bytes[b], bytes[Size - 1 - b]);
+                std::memcpy(&v, bytes, Size);
+#endif
+                std::memcpy(dst, &v, Size);
+            }
+        }
+
+#if STDEXT_ARCH_X86
+        // Shuffle masks that reverse each element of the given size within a 32-byte vector.
+        template <size_t Size>
+        struct alignas(32) byte_swap_mask
+        {
+            uint8_t indices[32];
+
+            constexpr byte_swap_mask() noexcept : indices()
+            {
+                for (size_t n = 0; n != 32; ++n)
+                    indices[n] = uint8_t(n % 16 / Size * Size + Size - 1 - n % Size);
+            }
+        };
+
+        template <size_t Size>
+        constexpr byte_swap_mask<Size> swap_mask;
+
+        template <size_t Size>
+        STDEXT_TARGET("ssse3")
+        void byte_swap_ssse3(const byte* src, byte* dst, size_t count) noexcept
+        {
+            auto mask = _mm_load_si128(reinterpret_cast<const __m128i*>(swap_mask<Size>.indices));
+            auto size = count * Size;
+            size_t n = 0;
+            for (; size - n >= 32; n += 32)
+            {
+                auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+                auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n + 16));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_shuffle_epi8(a, mask));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n + 16), _mm_shuffle_epi8(b, mask));
+            }
+            for (; size - n >= 16; n += 16)
+            {
+                auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_shuffle_epi8(a, mask));
+            }
+            byte_swap_scalar<Size>(src + n, dst + n, (size - n) / Size);
+        }
+
+        template <size_t Size>
+        STDEXT_TARGET("avx2")
+        void byte_swap_avx2(const byte* src, byte* dst, size_t count) noexcept
+        {
+            auto mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(swap_mask<Size>.indices));
+            auto size = count * Size;
+            size_t n = 0;
+            for (; size - n >= 64; n += 64)
+            {
+                auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+                auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n + 32));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), _mm256_shuffle_epi8(a, mask));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n + 32), _mm256_shuffle_epi8(b, mask));
+            }
+
+            // Leave the upper halves clean before the SSE tail to avoid the AVX-SSE transition penalty.
+            _mm256_zeroupper();
+            byte_swap_ssse3<Size>(src + n, dst + n, (size - n) / Size);
+        }
+#endif
+
+#if STDEXT_ARCH_ARM64
+        template <size_t Size>
+        uint8x16_t byte_swap_neon(uint8x16_t v) noexcept
+        {
+            if constexpr (Size == 2)
+                return vrev16q_u8(v);
+            else if constexpr (Size == 4)
+                return vrev32q_u8(v);
+            else
+                return vrev64q_u8(v);
+        }
+
+        template <size_t Size>
+        void byte_swap_neon(const byte* src, byte* dst, size_t count) noexcept
+        {
+            auto in = reinterpret_cast<const uint8_t*>(src);
+            auto out = reinterpret_cast<uint8_t*>(dst);
+            auto size = count * Size;
+            size_t n = 0;
+            for (; size - n >= 32; n += 32)
+            {
+                auto a = vld1q_u8(in + n);
+                auto b = vld1q_u8(in + n + 16);
+                vst1q_u8(out + n, byte_swap_neon<Size>(a));
+                vst1q_u8(out + n + 16, byte_swap_neon<Size>(b));
+            }
+            for (; size - n >= 16; n += 16)
+                vst1q_u8(out + n, byte_swap_neon<Size>(vld1q_u8(in + n)));
+            byte_swap_scalar<Size>(src + n, dst + n, (size - n) / Size);
+        }
+#endif
+
+        struct swap_kernels
+        {
+            swap_kernel swap16;
+            swap_kernel swap32;
+            swap_kernel swap64;
+        };
+
+        swap_kernels select_swap_kernels() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return { byte_swap_avx2<2>, byte_swap_avx2<4>, byte_swap_avx2<8> };
+            if (_private::cpu().ssse3)
+                return { byte_swap_ssse3<2>, byte_swap_ssse3<4>, byte_swap_ssse3<8> };
+#endif
+#if STDEXT_ARCH_ARM64
+            return { byte_swap_neon<2>, byte_swap_neon<4>, byte_swap_neon<8> };
+#else
+            return { byte_swap_scalar<2>, byte_swap_scalar<4>, byte_swap_scalar<8> };
+#endif
+        }
+    }
+
+    namespace _private
+    {
+        void byte_swap(const void* src, void* dst, size_t count, size_t size) noexcept
+        {
+            static const swap_kernels kernels = select_swap_kernels();
+
+            auto in = static_cast<const byte*>(src);
+            auto out = static_cast<byte*>(dst);
+            switch (size)
+            {
+            case 2:
+                kernels.swap16(in, out, count);
+                break;
+            case 4:
+                kernels.swap32(in, out, count);
+                break;
+            case 8:
+                kernels.swap64(in, out, count);
+                break;
+            default:
+                assert(size == 1);
+                if (src != dst && count != 0)
+                    std::memmove(dst, src, count);
+                break;
+            }
+        }
+    }
+}
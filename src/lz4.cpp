@@ -0,0 +1,700 @@
+#include <stdext/lz4.h>
+
+#include "cpu.h"
+
+#include <cstring>
+
+
+namespace stdext
+{
+    namespace _private
+    {
+        // Hash chain match finder.  Positions are recorded as 32-bit stream offsets; the head
+        // table maps a hash of four bytes to the most recent position with that hash, and the
+        // chain table maps each position (modulo the window size) to the distance to the
+        // previous position with the same hash.  Entries are never cleared: every candidate is
+        // range-checked against the current window and verified byte-by-byte before use, so
+        // stale entries cost a comparison but cannot produce an incorrect match.
+        struct lz4_matcher
+        {
+            static constexpr unsigned hash_log = 16;
+            static constexpr size_t window_size = 0x10000;
+
+            uint32_t head[size_t(1) << hash_log] = { };
+            uint16_t chain[window_size] = { };
+        };
+    }
+
+    namespace
+    {
+        constexpr size_t min_match = 4;
+        constexpr size_t last_literals = 5;
+        constexpr size_t mf_limit = 12;
+        constexpr size_t max_distance = 0xFFFF;
+        constexpr unsigned max_attempts = 16;
+        constexpr unsigned skip_strength = 6;
+
+        constexpr uint32_t frame_magic = 0x184D2204;
+        constexpr uint32_t skippable_magic = 0x184D2A50;
+        constexpr uint32_t skippable_mask = 0xFFFFFFF0;
+        constexpr uint32_t uncompressed_flag = 0x80000000;
+
+        constexpr uint8_t flg_version = 0x40;
+        constexpr uint8_t flg_version_mask = 0xC0;
+        constexpr uint8_t flg_independent = 0x20;
+        constexpr uint8_t flg_block_checksum = 0x10;
+        constexpr uint8_t flg_content_size = 0x08;
+        constexpr uint8_t flg_content_checksum = 0x04;
+        constexpr uint8_t flg_reserved = 0x02;
+        constexpr uint8_t flg_dict_id = 0x01;
+
+        size_t block_capacity(lz4_block_size size) noexcept
+        {
+            return size_t(1) << (2 * unsigned(size) + 8);
+        }
+
+        using _private::count_trailing_zeros;
+        using _private::load32;
+        using _private::load64;
+
+        void copy8(byte* dst, const byte* src) noexcept
+        {
+            std::memcpy(dst, src, 8);
+        }
+
+        void copy16(byte* dst, const byte* src) noexcept
+        {
+            std::memcpy(dst, src, 16);
+        }
+
+        // Returns the number of leading bytes at p that match those at match, without reading
+        // at or beyond limit.
+        size_t count_match(const byte* p, const byte* match, const byte* limit) noexcept
+        {
+            auto start = p;
+            while (limit - p >= 8)
+            {
+                // The loads are little-endian, so the first mismatching byte is the lowest set byte
+                // of the difference.
+                auto diff = load64(p) ^ load64(match);
+                if (diff != 0)
+                    return size_t(p - start) + count_trailing_zeros(diff) / 8;
+                p += 8;
+                match += 8;
+            }
+
+            while (p != limit && *p == *match)
+            {
+                ++p;
+                ++match;
+            }
+
+            return size_t(p - start);
+        }
+
+        uint32_t hash4(const byte* p) noexcept
+        {
+            return load32(p) * 2654435761u >> (32 - _private::lz4_matcher::hash_log);
+        }
+
+        byte* write_length(byte* op, size_t length) noexcept
+        {
+            for (; length >= 255; length -= 255)
+                *op++ = byte(255);
+            *op++ = byte(length);
+            return op;
+        }
+
+        // Compresses [src, src + size) into dst.  Matches may refer back as far as window, which
+        // must precede src in the same buffer; position is the stream offset of src and is used
+        // to key the match finder's tables.  Returns zero if the output would exceed capacity.
+        size_t compress(_private::lz4_matcher& matcher, const byte* window, const byte* src, size_t size,
+            uint32_t position, byte* dst, size_t capacity) noexcept
+        {
+            auto ip = src;
+            auto anchor = src;
+            auto iend = src + size;
+            auto op = dst;
+            auto oend = dst + capacity;
+
+            if (size > mf_limit)
+            {
+                auto mflimit = iend - mf_limit;
+                auto matchlimit = iend - last_literals;
+                auto next_insert = src;
+                unsigned misses = 0;
+
+                auto offset_of = [&](const byte* p) noexcept { return position + uint32_t(p - src); };
+
+                while (ip < mflimit)
+                {
+                    for (; next_insert <= ip; ++next_insert)
+                    {
+                        auto h = hash4(next_insert);
+                        auto pos = offset_of(next_insert);
+                        auto delta = pos - matcher.head[h];
+                        matcher.chain[pos & (_private::lz4_matcher::window_size - 1)] = uint16_t(delta > max_distance ? 0 : delta);
+                        matcher.head[h] = pos;
+                    }
+
+                    auto current = offset_of(ip);
+                    const byte* best = nullptr;
+                    size_t best_length = min_match - 1;
+
+                    // The head entry for ip is ip itself; start from its predecessor.
+                    auto candidate = current;
+                    for (unsigned attempts = 0; attempts != max_attempts; ++attempts)
+                    {
+                        auto step = matcher.chain[candidate & (_private::lz4_matcher::window_size - 1)];
+                        if (step == 0)
+                            break;
+                        candidate -= step;
+                        auto distance = current - candidate;
+                        if (distance == 0 || distance > max_distance || distance > size_t(ip - window))
+                            break;
+
+                        auto match = ip - distance;
+                        if (match[best_length] != ip[best_length] || load32(match) != load32(ip))
+                            continue;
+
+                        auto length = min_match + count_match(ip + min_match, match + min_match, matchlimit);
+                        if (length > best_length)
+                        {
+                            best = match;
+                            best_length = length;
+                            if (ip + length == matchlimit)
+                                break;
+                        }
+                    }
+
+                    if (best == nullptr)
+                    {
+                        ip += std::min(size_t(1 + (++misses >> skip_strength)), size_t(mflimit - ip));
+                        continue;
+                    }
+                    misses = 0;
+
+                    auto match_start = ip;
+                    while (match_start > anchor && best > window && match_start[-1] == best[-1])
+                    {
+                        --match_start;
+                        --best;
+                        ++best_length;
+                    }
+
+                    auto literals = size_t(match_start - anchor);
+                    auto match_code = best_length - min_match;
+                    if (size_t(oend - op) < 1 + literals / 255 + 1 + literals + 2 + match_code / 255 + 1 + 1 + last_literals)
+                        return 0;
+
+                    auto token = op++;
+                    *token = byte((std::min(literals, size_t(15)) << 4) | std::min(match_code, size_t(15)));
+                    if (literals >= 15)
+                        op = write_length(op, literals - 15);
+                    std::memcpy(op, anchor, literals);
+                    op += literals;
+
+                    auto offset = uint16_t(match_start - best);
+                    *op++ = byte(offset & 0xFF);
+                    *op++ = byte(offset >> 8);
+                    if (match_code >= 15)
+                        op = write_length(op, match_code - 15);
+
+                    ip = match_start + best_length;
+                    anchor = ip;
+                }
+            }
+
+            auto literals = size_t(iend - anchor);
+            if (size_t(oend - op) < 1 + literals / 255 + 1 + literals)
+                return 0;
+
+            *op++ = byte(std::min(literals, size_t(15)) << 4);
+            if (literals >= 15)
+                op = write_length(op, literals - 15);
+            if (literals != 0)
+                std::memcpy(op, anchor, literals);
+            op += literals;
+
+            return size_t(op - dst);
+        }
+
+        // For overlapping matches with an offset under eight, the smallest multiple of the offset
+        // that is at least eight.
+        constexpr uint8_t pattern_distance[8] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+
+        [[noreturn]] void corrupt()
+        {
+            throw lz4_error("corrupt LZ4 block");
+        }
+
+        size_t read_length(const byte*& ip, const byte* iend)
+        {
+            size_t length = 0;
+            uint8_t b;
+            do
+            {
+                if (ip == iend)
+                    corrupt();
+                b = uint8_t(*ip++);
+                length += b;
+            } while (b == 255);
+            return length;
+        }
+
+        // Decompresses [src, src + size) into dst.  Matches may refer back as far as window, which
+        // must precede dst in the same buffer.  Literal runs and non-overlapping matches are copied
+        // in whole 16- and 8-byte chunks whenever there is room, so up to 15 bytes past the end of
+        // the result may be overwritten.
+        size_t decompress(const byte* src, size_t size, const byte* window, byte* dst, size_t capacity)
+        {
+            auto ip = src;
+            auto iend = src + size;
+            auto op = dst;
+            auto oend = dst + capacity;
+
+            if (size == 0)
+                corrupt();
+
+            while (true)
+            {
+                auto token = uint8_t(*ip++);
+
+                size_t literals = token >> 4;
+                if (literals == 15)
+                    literals += read_length(ip, iend);
+
+                if (literals > size_t(iend - ip) || literals > size_t(oend - op))
+                    corrupt();
+
+                if (size_t(iend - ip) >= literals + 16 && size_t(oend - op) >= literals + 16)
+                {
+                    auto end = op + literals;
+                    auto s = ip;
+                    for (auto d = op; d < end; d += 16, s += 16)
+                        copy16(d, s);
+                }
+                else if (literals != 0)
+                    std::memcpy(op, ip, literals);
+
+                ip += literals;
+                op += literals;
+
+                if (ip == iend)
+                    break;
+
+                if (iend - ip < 2)
+                    corrupt();
+                size_t offset = size_t(uint8_t(ip[0])) | size_t(uint8_t(ip[1])) << 8;
+                ip += 2;
+                if (offset == 0 || offset > size_t(op - window))
+                    corrupt();
+
+                size_t length = token & 15;
+                if (length == 15)
+                    length += read_length(ip, iend);
+                length += min_match;
+
+                if (length > size_t(oend - op))
+                    corrupt();
+
+                auto match = op - offset;
+                auto end = op + length;
+                if (size_t(oend - op) >= length + 8)
+                {
+                    if (offset < 8)
+                    {
+                        // Write the first eight bytes one at a time, then continue from an
+                        // earlier repetition of the pattern that is at least eight bytes back.
+                        for (size_t n = 0; n != 8; ++n)
+                            op[n] = match[n];
+                        op += 8;
+                        match = op - pattern_distance[offset];
+                    }
+
+                    for (; op < end; op += 8, match += 8)
+                        copy8(op, match);
+                }
+                else
+                {
+                    for (; op != end; ++op, ++match)
+                        *op = *match;
+                }
+                op = end;
+
+                if (ip == iend)
+                    corrupt();
+            }
+
+            return size_t(op - dst);
+        }
+
+        // Frame fields are little-endian.
+        template <typename T>
+        T read_le(const byte* p) noexcept
+        {
+            T value = 0;
+            for (size_t n = 0; n != sizeof(T); ++n)
+                value |= T(uint8_t(p[n])) << (8 * n);
+            return value;
+        }
+
+        template <typename T>
+        void write_le(byte* p, T value) noexcept
+        {
+            for (size_t n = 0; n != sizeof(T); ++n)
+                p[n] = byte(value >> (8 * n));
+        }
+
+        template <typename T>
+        T read_le(input_stream& stream)
+        {
+            byte bytes[sizeof(T)];
+            stream.read_all(bytes);
+            return read_le<T>(bytes);
+        }
+
+        uint8_t header_checksum(const byte* descriptor, size_t size) noexcept
+        {
+            return uint8_t(xxhash32({ descriptor, size }) >> 8);
+        }
+    }
+
+    size_t lz4_compress_block(array_view<const byte> src, span<byte> dst)
+    {
+        auto matcher = std::make_unique<_private::lz4_matcher>();
+        return compress(*matcher, src.data(), src.data(), src.size(), 0, dst.data(), dst.size());
+    }
+
+    size_t lz4_decompress_block(array_view<const byte> src, span<byte> dst)
+    {
+        return decompress(src.data(), src.size(), dst.data(), dst.data(), dst.size());
+    }
+
+    lz4_output_stream::lz4_output_stream(output_stream& stream, lz4_block_size block_size, flags<lz4_frame_options> options)
+        : _stream(&stream), _options(options), _block_size(block_size), _block_capacity(block_capacity(block_size)),
+        _matcher(std::make_unique<_private::lz4_matcher>())
+    {
+        auto history = _options.test_any(lz4_frame_options::linked_blocks) ? _private::lz4_matcher::window_size : 0;
+        _buffer = std::make_unique<byte[]>(history + _block_capacity);
+        _compressed = std::make_unique<byte[]>(4 + _block_capacity + 4);
+    }
+
+    lz4_output_stream::~lz4_output_stream()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void lz4_output_stream::finish()
+    {
+        if (_finished)
+            return;
+
+        if (!_started)
+            write_header();
+        if (_pending != 0)
+            write_block();
+
+        byte trailer[8];
+        size_t size = 4;
+        write_le(trailer, uint32_t(0));
+        if (_options.test_any(lz4_frame_options::content_checksum))
+        {
+            write_le(trailer + 4, _content_checksum.value());
+            size += 4;
+        }
+        _stream->write_all(trailer, size);
+        _finished = true;
+    }
+
+    size_t lz4_output_stream::do_write(const byte* buffer, size_t size)
+    {
+        if (_finished)
+            throw stream_error("write to finished LZ4 frame");
+
+        if (!_started)
+            write_header();
+
+        auto remaining = size;
+        while (remaining != 0)
+        {
+            auto count = std::min(remaining, _block_capacity - _pending);
+            std::memcpy(_buffer.get() + _history + _pending, buffer, count);
+            _pending += count;
+            buffer += count;
+            remaining -= count;
+
+            if (_pending == _block_capacity)
+                write_block();
+        }
+
+        return size;
+    }
+
+    void lz4_output_stream::write_header()
+    {
+        byte header[7];
+        write_le(header, frame_magic);
+
+        uint8_t flg = flg_version;
+        if (!_options.test_any(lz4_frame_options::linked_blocks))
+            flg |= flg_independent;
+        if (_options.test_any(lz4_frame_options::block_checksum))
+            flg |= flg_block_checksum;
+        if (_options.test_any(lz4_frame_options::content_checksum))
+            flg |= flg_content_checksum;
+        header[4] = byte(flg);
+        header[5] = byte(unsigned(_block_size) << 4);
+        header[6] = byte(header_checksum(header + 4, 2));
+
+        _stream->write_all(header, sizeof(header));
+        _started = true;
+    }
+
+    void lz4_output_stream::write_block()
+    {
+        auto data = _buffer.get() + _history;
+        auto window = _options.test_any(lz4_frame_options::linked_blocks) ? _buffer.get() : data;
+
+        if (_options.test_any(lz4_frame_options::content_checksum))
+            _content_checksum.update({ data, _pending });
+
+        auto out = _compressed.get();
+        auto size = compress(*_matcher, window, data, _pending, uint32_t(_position), out + 4, _pending - 1);
+        if (size != 0)
+            write_le(out, uint32_t(size));
+        else
+        {
+            size = _pending;
+            std::memcpy(out + 4, data, size);
+            write_le(out, uint32_t(size) | uncompressed_flag);
+        }
+
+        auto total = 4 + size;
+        if (_options.test_any(lz4_frame_options::block_checksum))
+        {
+            write_le(out + total, xxhash32({ out + 4, size }));
+            total += 4;
+        }
+        _stream->write_all(out, total);
+
+        _position += _pending;
+        if (_options.test_any(lz4_frame_options::linked_blocks))
+        {
+            auto end = data + _pending;
+            _history = std::min(size_t(end - _buffer.get()), size_t(_private::lz4_matcher::window_size));
+            std::memmove(_buffer.get(), end - _history, _history);
+        }
+        _pending = 0;
+    }
+
+    lz4_input_stream::lz4_input_stream(input_stream& stream)
+        : _stream(&stream)
+    {
+    }
+
+    lz4_input_stream::~lz4_input_stream() = default;
+
+    size_t lz4_input_stream::direct_read(std::function<size_t(const byte* buffer, size_t size)> read)
+    {
+        if (_current == _last && !fill())
+            return read(_current, 0);
+
+        auto size = read(_current, size_t(_last - _current));
+        _current += size;
+        return size;
+    }
+
+    size_t lz4_input_stream::do_read(byte* buffer, size_t size)
+    {
+        size_t total = 0;
+        while (total != size)
+        {
+            if (_current == _last && !fill())
+                break;
+
+            auto count = std::min(size - total, size_t(_last - _current));
+            std::memcpy(buffer + total, _current, count);
+            _current += count;
+            total += count;
+        }
+        return total;
+    }
+
+    size_t lz4_input_stream::do_skip(size_t size)
+    {
+        size_t total = 0;
+        while (total != size)
+        {
+            if (_current == _last && !fill())
+                break;
+
+            auto count = std::min(size - total, size_t(_last - _current));
+            _current += count;
+            total += count;
+        }
+        return total;
+    }
+
+    // Makes more decoded data available.  Returns false at the end of the underlying stream.
+    bool lz4_input_stream::fill()
+    {
+        while (_current == _last)
+        {
+            if (!_in_frame && !read_header())
+                return false;
+            read_block();
+        }
+        return true;
+    }
+
+    bool lz4_input_stream::read_header()
+    {
+        while (true)
+        {
+            if (_eof)
+                return false;
+
+            byte magic_bytes[4];
+            auto bytes = _stream->read(magic_bytes, 4);
+            if (bytes == 0)
+            {
+                _eof = true;
+                return false;
+            }
+            if (bytes != 4)
+                throw lz4_error("truncated LZ4 frame header");
+
+            auto magic = read_le<uint32_t>(magic_bytes);
+            if ((magic & skippable_mask) == skippable_magic)
+            {
+                auto size = read_le<uint32_t>(*_stream);
+                _stream->skip_all<byte>(size);
+                continue;
+            }
+            if (magic != frame_magic)
+                throw lz4_error("invalid LZ4 frame magic number");
+
+            byte descriptor[11];
+            _stream->read_all(descriptor, 2);
+            auto flg = uint8_t(descriptor[0]);
+            auto bd = uint8_t(descriptor[1]);
+            if ((flg & flg_version_mask) != flg_version || (flg & flg_reserved) != 0 || (bd & 0x8F) != 0)
+                throw lz4_error("unsupported LZ4 frame descriptor");
+            if (flg & flg_dict_id)
+                throw lz4_error("LZ4 dictionaries are not supported");
+
+            auto size_code = unsigned(bd >> 4 & 0x07);
+            if (size_code < unsigned(lz4_block_size::max_64kb))
+                throw lz4_error("invalid LZ4 block size");
+
+            size_t descriptor_size = 2;
+            if (flg & flg_content_size)
+            {
+                _stream->read_all(descriptor + 2, 8);
+                _content_size = read_le<uint64_t>(descriptor + 2);
+                descriptor_size += 8;
+            }
+
+            if (uint8_t(_stream->read<byte>()) != header_checksum(descriptor, descriptor_size))
+                throw lz4_error("LZ4 frame header checksum mismatch");
+
+            _linked = (flg & flg_independent) == 0;
+            _block_checksum = (flg & flg_block_checksum) != 0;
+            _has_content_checksum = (flg & flg_content_checksum) != 0;
+            _has_content_size = (flg & flg_content_size) != 0;
+            _block_capacity = block_capacity(lz4_block_size(size_code));
+            _content_read = 0;
+            _content_checksum.reset();
+
+            // Decoded blocks are preceded by up to 64 KiB of history when blocks are linked.
+            // The extra slack accommodates the decompressor's wild copies.
+            auto buffer_capacity = (_linked ? _private::lz4_matcher::window_size : 0) + _block_capacity + 16;
+            if (buffer_capacity > _buffer_capacity)
+            {
+                _buffer = std::make_unique<byte[]>(buffer_capacity);
+                _buffer_capacity = buffer_capacity;
+            }
+            if (_block_capacity > _compressed_capacity)
+            {
+                _compressed = std::make_unique<byte[]>(_block_capacity);
+                _compressed_capacity = _block_capacity;
+            }
+
+            _current = _last = _buffer.get();
+            _in_frame = true;
+            return true;
+        }
+    }
+
+    void lz4_input_stream::read_block()
+    {
+        auto header = read_le<uint32_t>(*_stream);
+        if (header == 0)
+        {
+            finish_frame();
+            return;
+        }
+
+        auto size = size_t(header & ~uncompressed_flag);
+        if (size > _block_capacity)
+            throw lz4_error("LZ4 block exceeds maximum block size");
+
+        _stream->read_all(_compressed.get(), size);
+        if (_block_checksum)
+        {
+            auto checksum = read_le<uint32_t>(*_stream);
+            if (checksum != xxhash32({ _compressed.get(), size }))
+                throw lz4_error("LZ4 block checksum mismatch");
+        }
+
+        auto base = _buffer.get();
+        auto dst = base;
+        if (_linked)
+        {
+            auto history = std::min(size_t(_last - base), size_t(_private::lz4_matcher::window_size));
+            std::memmove(base, _last - history, history);
+            dst = base + history;
+        }
+
+        auto capacity = size_t(_buffer_capacity - (dst - base));
+        size_t decoded;
+        if (header & uncompressed_flag)
+        {
+            std::memcpy(dst, _compressed.get(), size);
+            decoded = size;
+        }
+        else
+            decoded = decompress(_compressed.get(), size, base, dst, capacity);
+        if (decoded > _block_capacity)
+            throw lz4_error("LZ4 block exceeds maximum block size");
+
+        if (_has_content_checksum)
+            _content_checksum.update({ dst, decoded });
+        _content_read += decoded;
+
+        _current = dst;
+        _last = dst + decoded;
+    }
+
+    void lz4_input_stream::finish_frame()
+    {
+        if (_has_content_checksum)
+        {
+            auto checksum = read_le<uint32_t>(*_stream);
+            if (checksum != _content_checksum.value())
+                throw lz4_error("LZ4 content checksum mismatch");
+        }
+        if (_has_content_size && _content_read != _content_size)
+            throw lz4_error("LZ4 content size mismatch");
+
+        _current = _last = _buffer.get();
+        _in_frame = false;
+    }
+}
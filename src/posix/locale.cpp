@@ -0,0 +1,18 @@
+#include <stdext/string.h>
+
+#include <cstring>
+
+#include <langinfo.h>
+
+
+namespace stdext
+{
+    namespace _private
+    {
+        bool locale_is_utf8() noexcept
+        {
+            auto codeset = nl_langinfo(CODESET);
+            return std::strcmp(codeset, "UTF-8") == 0 || std::strcmp(codeset, "utf8") == 0;
+        }
+    }
+}
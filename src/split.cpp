@@ -0,0 +1,143 @@
+#include <stdext/split.h>
+
+#include "cpu.h"
+
+#include <algorithm>
+
+#include <cstring>
+
+
+namespace stdext
+{
+    namespace
+    {
+        using _private::count_trailing_zeros;
+
+        // Checks the next block of str, starting at scan, for delimiters.  Whole blocks of 64 bytes
+        // use the vector kernel; the remainder is checked a byte at a time.
+        void scan_block(const char* str, size_t size, size_t& scan, size_t& mask_base, uint64_t& mask, const _private::byte_set& delimiters) noexcept
+        {
+            mask_base = scan;
+            if (size - scan >= 64)
+            {
+                mask = _private::byte_set_mask(str + scan, delimiters);
+                scan += 64;
+            }
+            else
+            {
+                mask = 0;
+                for (unsigned i = 0; scan != size; ++i, ++scan)
+                    mask |= uint64_t(delimiters.contains(uint8_t(str[scan]))) << i;
+            }
+        }
+
+        // Takes the next delimiter from mask.
+        size_t take_delimiter(size_t mask_base, uint64_t& mask) noexcept
+        {
+            auto pos = mask_base + count_trailing_zeros(mask);
+            mask &= mask - 1;
+            return pos;
+        }
+    }
+
+    split_generator::split_generator(string_view str, const _private::byte_set& delimiters) noexcept
+        : _delimiters(delimiters), _str(str), _done(false)
+    {
+        next();
+    }
+
+    void split_generator::next() noexcept
+    {
+        assert(!_done);
+
+        auto data = _str.data();
+        auto size = _str.size();
+        while (_mask == 0)
+        {
+            if (_scan == size)
+            {
+                // No delimiters remain; the rest of the string, if any, is the last token.
+                if (_next == size)
+                {
+                    _done = true;
+                    _token = string_view();
+                }
+                else
+                {
+                    _token = string_view(data + _next, size - _next);
+                    _next = size;
+                }
+                return;
+            }
+
+            scan_block(data, size, _scan, _mask_base, _mask, _delimiters);
+        }
+
+        auto pos = take_delimiter(_mask_base, _mask);
+        _token = string_view(data + _next, pos - _next);
+        _next = pos + 1;
+    }
+
+    stream_split_generator::stream_split_generator(input_stream& stream, const _private::byte_set& delimiters, size_t block_size)
+        : _state(std::make_shared<state>())
+    {
+        assert(block_size != 0);
+        _state->stream = &stream;
+        _state->delimiters = delimiters;
+        _state->buffer.reset(new char[block_size]);
+        _state->capacity = block_size;
+        next();
+    }
+
+    void stream_split_generator::next()
+    {
+        assert(_state);
+
+        auto& s = *_state;
+        while (s.mask == 0)
+        {
+            if (s.scan != s.size)
+            {
+                scan_block(s.buffer.get(), s.size, s.scan, s.mask_base, s.mask, s.delimiters);
+                continue;
+            }
+
+            if (s.eof)
+            {
+                if (s.next == s.size)
+                    _state.reset();
+                else
+                {
+                    s.token = string_view(s.buffer.get() + s.next, s.size - s.next);
+                    s.next = s.size;
+                }
+                return;
+            }
+
+            // Keep the unfinished token, moving it to the front of the buffer (or to a larger
+            // buffer, if it fills this one), and read more after it.
+            auto partial = s.size - s.next;
+            if (partial == s.capacity)
+            {
+                auto capacity = s.capacity * 2;
+                std::unique_ptr<char[]> buffer(new char[capacity]);
+                std::memcpy(buffer.get(), s.buffer.get(), partial);
+                s.buffer = stdext::move(buffer);
+                s.capacity = capacity;
+            }
+            else if (s.next != 0)
+                std::memmove(s.buffer.get(), s.buffer.get() + s.next, partial);
+
+            s.size = s.scan = partial;
+            s.next = 0;
+            auto count = s.stream->read(s.buffer.get() + s.size, s.capacity - s.size);
+            if (count == 0)
+                s.eof = true;
+            s.size += count;
+        }
+
+        auto pos = take_delimiter(s.mask_base, s.mask);
+        s.token = string_view(s.buffer.get() + s.next, pos - s.next);
+        s.next = pos + 1;
+    }
+}
@@ -7,35 +7,541 @@
 //
 
 #include <stdext/string.h>
+#include <stdext/unicode.h>
 
-#include <stdexcept>
+#include <algorithm>
 
 #include <cwchar>
 
 
 namespace stdext
 {
+    namespace
+    {
+        enum class block_status
+        {
+            ok,
+            partial_read,
+            partial_write,
+            error
+        };
+
+        // The result of a block conversion.  On partial_read, the input ends partway through a
+        // character; on error, it contains an invalid sequence.  In both cases, consumed is the
+        // offset of the character, which is not consumed.
+        struct block_result
+        {
+            block_status status;
+            size_t consumed;
+            size_t produced;
+        };
+
+        [[noreturn]] void throw_invalid_sequence()
+        {
+            throw std::system_error(EILSEQ, std::generic_category());
+        }
+
+        template <typename Char>
+        array_view<const Char> advance(array_view<const Char> in, size_t count) noexcept
+        {
+            return array_view<const Char>(in.data() + count, in.size() - count);
+        }
+
+        string_conversion_result make_result(block_status status, size_t consumed, size_t produced) noexcept
+        {
+            switch (status)
+            {
+            case block_status::ok:
+                return { string_conversion_status::ok, consumed, produced };
+            case block_status::partial_write:
+                return { string_conversion_status::partial_write, consumed, produced };
+            default:
+                return { string_conversion_status::error, consumed, produced };
+            }
+        }
+
+        // Conversion with the C library, a code unit at a time.
+        template <typename Char>
+        block_result to_multibyte_c(array_view<const Char> in, char* out, size_t size, std::mbstate_t& state)
+        {
+            size_t consumed = 0;
+            size_t produced = 0;
+            for (; consumed != in.size(); ++consumed)
+            {
+                if (size - produced < MB_LEN_MAX)
+                    return { block_status::partial_write, consumed, produced };
+                auto length = _private::to_mb(out + produced, in.data()[consumed], &state);
+                if (length == size_t(-1))
+                    return { block_status::error, consumed, produced };
+                produced += length;
+            }
+            return { block_status::ok, consumed, produced };
+        }
+
+        // Returns state to the initial shift state, as wcsrtombs does at the end of its input, and
+        // returns the number of bytes of the shift sequence written to out, which must have room
+        // for MB_LEN_MAX bytes.  The terminating null that wcrtomb writes after it isn't counted.
+        size_t end_shift_state(char* out, std::mbstate_t& state) noexcept
+        {
+            if (std::mbsinit(&state))
+                return 0;
+            auto length = std::wcrtomb(out, L'\0', &state);
+            return length == size_t(-1) ? 0 : length - 1;
+        }
+
+        // UTF-16 or UTF-32 to UTF-8, a code point at a time, with the same results as the C library
+        // in a UTF-8 locale: noncharacters are accepted.
+        template <typename Char>
+        block_result to_utf8_units(array_view<const Char> in, char* out, size_t size)
+        {
+            auto src = in.data();
+            auto end = src + in.size();
+            size_t produced = 0;
+            for (; src != end; )
+            {
+                auto first = src;
+                if (size - produced < 4)
+                    return { block_status::partial_write, size_t(first - in.data()), produced };
+
+                char32_t code;
+                if constexpr (sizeof(Char) == sizeof(char16_t))
+                {
+                    code = char16_t(*src++);
+                    if (code >= 0xD800 && code < 0xDC00)
+                    {
+                        if (src == end)
+                            return { block_status::partial_read, size_t(first - in.data()), produced };
+                        auto trail = char16_t(*src++);
+                        if (trail < 0xDC00 || trail > 0xDFFF)
+                            return { block_status::error, size_t(first - in.data()), produced };
+                        code = 0x10000 + ((code - 0xD800) << 10) + (trail - 0xDC00);
+                    }
+                }
+                else
+                    code = char32_t(*src++);
+
+                if (code < 0x80)
+                {
+                    out[produced++] = char(code);
+                    continue;
+                }
+
+                auto length = _private::encode_utf8(out + produced, code);
+                if (length == size_t(-1))
+                    return { block_status::error, size_t(first - in.data()), produced };
+                produced += length;
+            }
+            return { block_status::ok, in.size(), produced };
+        }
+
+        // wchar_t and char16_t are distinct types even where they have the same size, so UTF-16
+        // wchar_t text can't be handed to the transcoder in place; it's copied through a buffer of
+        // char16_t instead, a block at a time.
+        constexpr size_t wchar16_block_size = 256;
+
+        template <typename Char>
+        utf_transcode_result transcode_utf16(array_view<const Char> in, span<char> out)
+        {
+            if constexpr (std::is_same_v<Char, char16_t>)
+                return transcode(in, out);
+            else
+            {
+                char16_t units[wchar16_block_size];
+                auto count = std::min(in.size(), wchar16_block_size);
+                std::transform(in.data(), in.data() + count, units, [](Char c) { return char16_t(c); });
+                return transcode(array_view<const char16_t>(units, count), out);
+            }
+        }
+
+        // Reports a full block as ok, so that the caller continues with the next one.
+        utf_transcode_result transcode_wchar16(array_view<const char> in, wchar_t* out, size_t size)
+        {
+            char16_t units[wchar16_block_size];
+            auto result = transcode(in, span<char16_t>(units, std::min(size, wchar16_block_size)));
+            std::transform(units, units + result.produced, out, [](char16_t c) { return wchar_t(c); });
+            if (result.result == utf_result::partial_write && size > wchar16_block_size)
+                result.result = utf_result::ok;
+            return result;
+        }
+
+        // UTF-16 to UTF-8.  Most text goes through the bulk transcoder.  It stops at noncharacters,
+        // which the C library accepts, and at errors; these are converted a code point at a time.
+        template <typename Char>
+        block_result utf16_to_utf8(array_view<const Char> in, char* out, size_t size)
+        {
+            size_t consumed = 0;
+            size_t produced = 0;
+            while (true)
+            {
+                auto result = transcode_utf16(advance(in, consumed), span<char>(out + produced, size - produced));
+                consumed += result.consumed;
+                produced += result.produced;
+                if (result.result == utf_result::ok)
+                {
+                    if (consumed == in.size())
+                        return { block_status::ok, consumed, produced };
+                    continue;
+                }
+                if (result.result == utf_result::partial_write)
+                    return { block_status::partial_write, consumed, produced };
+
+                auto rest = advance(in, consumed);
+                size_t units = is_leading_surrogate(char16_t(rest.front())) && rest.size() > 1 ? 2 : 1;
+                auto single = to_utf8_units(array_view<const Char>(rest.data(), units), out + produced, size - produced);
+                consumed += single.consumed;
+                produced += single.produced;
+                if (single.status != block_status::ok)
+                    return { single.status, consumed, produced };
+                if (consumed == in.size())
+                    return { block_status::ok, consumed, produced };
+            }
+        }
+
+        // Converts as much of in as possible, leaving fewer than MB_LEN_MAX bytes of out unused.
+        template <typename Char>
+        block_result to_multibyte_block(array_view<const Char> in, char* out, size_t size, std::mbstate_t& state, bool utf8)
+        {
+            if (!utf8)
+                return to_multibyte_c(in, out, size, state);
+            if constexpr (sizeof(Char) == sizeof(char16_t))
+                return utf16_to_utf8(in, out, size);
+            else
+                return to_utf8_units(in, out, size);
+        }
+
+        // Converts the first character of in, which must not be empty.
+        template <typename Char>
+        block_result to_multibyte_char(array_view<const Char> in, char* out, std::mbstate_t& state, bool utf8)
+        {
+            size_t units = 1;
+            if constexpr (sizeof(Char) == sizeof(char16_t))
+            {
+                if (is_leading_surrogate(char16_t(in.front())) && in.size() > 1)
+                    units = 2;
+            }
+            return to_multibyte_block(array_view<const Char>(in.data(), units), out, MB_LEN_MAX, state, utf8);
+        }
+
+        // UTF-8 to UTF-16 or UTF-32, a code point at a time.
+        block_result utf8_to_wchar_units(array_view<const char> in, wchar_t* out, size_t size)
+        {
+            auto src = in.data();
+            auto end = src + in.size();
+            size_t produced = 0;
+            while (src != end)
+            {
+                auto first = src;
+                if (size - produced < 2)
+                    return { block_status::partial_write, size_t(first - in.data()), produced };
+
+                auto lead = static_cast<unsigned char>(*src++);
+                if (lead < 0x80)
+                {
+                    out[produced++] = wchar_t(lead);
+                    continue;
+                }
+
+                bool truncated = false;
+                auto code = _private::decode_utf8(lead, [&](unsigned char& byte)
+                {
+                    if (src == end)
+                    {
+                        truncated = true;
+                        return false;
+                    }
+                    byte = static_cast<unsigned char>(*src++);
+                    return true;
+                });
+                if (code == char32_t(-1))
+                    return { truncated ? block_status::partial_read : block_status::error, size_t(first - in.data()), produced };
+
+                if (sizeof(wchar_t) == sizeof(char16_t) && code >= 0x10000)
+                {
+                    out[produced++] = wchar_t(0xD800 + ((code - 0x10000) >> 10));
+                    out[produced++] = wchar_t(0xDC00 + (code & 0x3FF));
+                }
+                else
+                    out[produced++] = wchar_t(code);
+            }
+            return { block_status::ok, in.size(), produced };
+        }
+
+        // UTF-8 to UTF-16 wchar_t, through the bulk transcoder as for utf16_to_utf8.
+        block_result utf8_to_wchar16(array_view<const char> in, wchar_t* out, size_t size)
+        {
+            size_t consumed = 0;
+            size_t produced = 0;
+            while (true)
+            {
+                auto result = transcode_wchar16(advance(in, consumed), out + produced, size - produced);
+                consumed += result.consumed;
+                produced += result.produced;
+                if (result.result == utf_result::ok)
+                {
+                    if (consumed == in.size())
+                        return { block_status::ok, consumed, produced };
+                    continue;
+                }
+                if (result.result == utf_result::partial_write)
+                    return { block_status::partial_write, consumed, produced };
+
+                // A single code point needs at most four bytes of input.
+                auto rest = advance(in, consumed);
+                auto single = utf8_to_wchar_units(array_view<const char>(rest.data(), std::min<size_t>(rest.size(), 4)), out + produced, size - produced);
+                if (single.consumed == 0)
+                    return { single.status, consumed, produced };
+                consumed += single.consumed;
+                produced += single.produced;
+                if (consumed == in.size())
+                    return { block_status::ok, consumed, produced };
+            }
+        }
+
+        // Converts as much of in as possible, leaving fewer than two wide characters of out unused.
+        block_result to_wchar_block(array_view<const char> in, wchar_t* out, size_t size, std::mbstate_t& state, bool utf8)
+        {
+            if (utf8)
+            {
+                if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+                    return utf8_to_wchar16(in, out, size);
+                else
+                    return utf8_to_wchar_units(in, out, size);
+            }
+
+            auto src = in.data();
+            auto end = src + in.size();
+            size_t produced = 0;
+            for (; src != end; ++produced)
+            {
+                if (produced == size)
+                    return { block_status::partial_write, size_t(src - in.data()), produced };
+                auto length = std::mbrtowc(out + produced, src, size_t(end - src), &state);
+                if (length == size_t(-1))
+                    return { block_status::error, size_t(src - in.data()), produced };
+                if (length == size_t(-2))
+                    return { block_status::partial_read, size_t(src - in.data()), produced };
+                src += length == 0 ? 1 : length;
+            }
+            return { block_status::ok, in.size(), produced };
+        }
+
+        // Converts the first character of in, which must not be empty.
+        block_result to_wchar_char(array_view<const char> in, wchar_t* out, std::mbstate_t& state, bool utf8)
+        {
+            // Both conversions stop after a single character with this much room.
+            return to_wchar_block(in, out, utf8 ? 2 : 1, state, utf8);
+        }
+
+        // Converts in into out.  The block conversion stops short of the end of out, so the
+        // remainder is converted a character at a time through a temporary buffer, until the next
+        // character doesn't fit.
+        template <typename OutChar, typename InChar, typename Convert, typename ConvertChar>
+        string_conversion_result convert_to_span(array_view<const InChar> in, span<OutChar> out, Convert&& convert, ConvertChar&& convert_char)
+        {
+            auto result = convert(in, out.data(), out.size());
+            size_t consumed = result.consumed;
+            size_t produced = result.produced;
+            auto status = result.status;
+            while (status == block_status::partial_write)
+            {
+                OutChar buffer[MB_LEN_MAX];
+                result = convert_char(advance(in, consumed), buffer);
+                if (result.consumed == 0)
+                {
+                    status = result.status;
+                    break;
+                }
+                if (result.produced > out.size() - produced)
+                    break;
+
+                std::copy_n(buffer, result.produced, out.data() + produced);
+                consumed += result.consumed;
+                produced += result.produced;
+                if (consumed == in.size())
+                    status = block_status::ok;
+            }
+            return make_result(status, consumed, produced);
+        }
+
+        // Converts in, appending to buf a block at a time.
+        template <typename OutChar, typename InChar, typename Convert>
+        string_conversion_result convert_to_buffer(array_view<const InChar> in, basic_stringbuf<OutChar>& buf, Convert&& convert)
+        {
+            OutChar buffer[256];
+            size_t consumed = 0;
+            size_t produced = 0;
+            while (true)
+            {
+                auto result = convert(advance(in, consumed), buffer, std::size(buffer));
+                buf(basic_string_view<OutChar>(buffer, result.produced));
+                consumed += result.consumed;
+                produced += result.produced;
+                if (result.status != block_status::partial_write)
+                    return make_result(result.status, consumed, produced);
+            }
+        }
+
+        // Converts in to a new string, growing it as needed.  Throws conversion_error for input that
+        // cannot be converted.
+        template <typename OutChar, typename InChar, typename Convert>
+        std::basic_string<OutChar> convert_to_string(array_view<const InChar> in, size_t estimate, Convert&& convert)
+        {
+            std::basic_string<OutChar> str(estimate, OutChar());
+            size_t consumed = 0;
+            size_t produced = 0;
+            while (true)
+            {
+                auto result = convert(advance(in, consumed), str.data() + produced, str.size() - produced);
+                consumed += result.consumed;
+                produced += result.produced;
+                if (result.status == block_status::ok)
+                    break;
+                if (result.status != block_status::partial_write)
+                    throw conversion_error(consumed);
+                str.resize(str.size() * 2);
+            }
+            str.resize(produced);
+            return str;
+        }
+    }
+
+    namespace _private
+    {
+#if STDEXT_HAS_C_UNICODE
+        size_t to_multibyte(array_view<const char16_t>& in, char* out, size_t size, std::mbstate_t& state, bool utf8)
+        {
+            // A leading surrogate at the end of the input, which c16rtomb would hold until a
+            // trailing surrogate arrives, is dropped.
+            auto result = to_multibyte_block(in, out, size, state, utf8);
+            if (result.status == block_status::error)
+                throw_invalid_sequence();
+            in = advance(in, result.status == block_status::partial_read ? in.size() : result.consumed);
+            return result.produced;
+        }
+
+        size_t to_multibyte(array_view<const char32_t>& in, char* out, size_t size, std::mbstate_t& state, bool utf8)
+        {
+            auto result = to_multibyte_block(in, out, size, state, utf8);
+            if (result.status == block_status::error)
+                throw_invalid_sequence();
+            in = advance(in, result.consumed);
+            return result.produced;
+        }
+#endif
+
+        size_t to_multibyte(array_view<const wchar_t>& in, char* out, size_t size, std::mbstate_t& state, bool utf8)
+        {
+            auto result = to_multibyte_block(in, out, size, state, utf8);
+            if (result.status == block_status::error)
+                throw_invalid_sequence();
+            in = advance(in, result.status == block_status::partial_read ? in.size() : result.consumed);
+            return result.produced;
+        }
+
+        size_t to_wchar(array_view<const char>& in, wchar_t* out, size_t size, std::mbstate_t& state, bool utf8)
+        {
+            auto result = to_wchar_block(in, out, size, state, utf8);
+            if (result.status == block_status::error || result.status == block_status::partial_read)
+                throw_invalid_sequence();
+            in = advance(in, result.consumed);
+            return result.produced;
+        }
+    }
+
     std::string to_mbstring(const wchar_t* str)
     {
-        std::mbstate_t state = {};
-        auto length = std::wcsrtombs(nullptr, &str, 0, &state);
-        if (length == size_t(-1))
-            throw std::runtime_error("Character encoding conversion error");
+        return to_mbstring(wstring_view(str));
+    }
 
-        std::string result(length, '\0');
-        std::wcsrtombs(result.data(), &str, length, &state);
+    std::string to_mbstring(wstring_view str)
+    {
+        std::mbstate_t state = { };
+        bool utf8 = _private::locale_is_utf8();
+        auto result = convert_to_string<char>(str, str.size() + MB_LEN_MAX, [&](array_view<const wchar_t> in, char* out, size_t size)
+        {
+            return to_multibyte_block(in, out, size, state, utf8);
+        });
+        if (!utf8)
+        {
+            auto size = result.size();
+            result.resize(size + MB_LEN_MAX);
+            result.resize(size + end_shift_state(result.data() + size, state));
+        }
         return result;
     }
 
     std::wstring to_wstring(const char* str)
     {
-        std::mbstate_t state = {};
-        auto length = std::mbsrtowcs(nullptr, &str, 0, &state);
-        if (length == size_t(-1))
-            throw std::runtime_error("Character encoding conversion error");
+        return to_wstring(string_view(str));
+    }
+
+    std::wstring to_wstring(string_view str)
+    {
+        // Each character takes at least one byte, so the result never needs to grow.
+        std::mbstate_t state = { };
+        bool utf8 = _private::locale_is_utf8();
+        return convert_to_string<wchar_t>(str, str.size() + 2, [&](array_view<const char> in, wchar_t* out, size_t size)
+        {
+            return to_wchar_block(in, out, size, state, utf8);
+        });
+    }
+
+    string_conversion_result to_mbstring(wstring_view str, span<char> out)
+    {
+        std::mbstate_t state = { };
+        bool utf8 = _private::locale_is_utf8();
+        auto result = convert_to_span(array_view<const wchar_t>(str), out,
+            [&](array_view<const wchar_t> in, char* dest, size_t size) { return to_multibyte_block(in, dest, size, state, utf8); },
+            [&](array_view<const wchar_t> in, char* dest) { return to_multibyte_char(in, dest, state, utf8); });
+        if (!utf8 && result.status == string_conversion_status::ok)
+        {
+            char buffer[MB_LEN_MAX];
+            auto length = end_shift_state(buffer, state);
+            if (length > out.size() - result.produced)
+                result.status = string_conversion_status::partial_write;
+            else
+            {
+                std::copy_n(buffer, length, out.data() + result.produced);
+                result.produced += length;
+            }
+        }
+        return result;
+    }
 
-        std::wstring result(length, '\0');
-        std::mbsrtowcs(result.data(), &str, length, &state);
+    string_conversion_result to_mbstring(wstring_view str, stringbuf& buf)
+    {
+        std::mbstate_t state = { };
+        bool utf8 = _private::locale_is_utf8();
+        auto result = convert_to_buffer(array_view<const wchar_t>(str), buf, [&](array_view<const wchar_t> in, char* out, size_t size)
+        {
+            return to_multibyte_block(in, out, size, state, utf8);
+        });
+        if (!utf8 && result.status == string_conversion_status::ok)
+        {
+            char buffer[MB_LEN_MAX];
+            auto length = end_shift_state(buffer, state);
+            buf(string_view(buffer, length));
+            result.produced += length;
+        }
         return result;
     }
+
+    string_conversion_result to_wstring(string_view str, span<wchar_t> out)
+    {
+        std::mbstate_t state = { };
+        bool utf8 = _private::locale_is_utf8();
+        return convert_to_span(array_view<const char>(str), out,
+            [&](array_view<const char> in, wchar_t* dest, size_t size) { return to_wchar_block(in, dest, size, state, utf8); },
+            [&](array_view<const char> in, wchar_t* dest) { return to_wchar_char(in, dest, state, utf8); });
+    }
+
+    string_conversion_result to_wstring(string_view str, wstringbuf& buf)
+    {
+        std::mbstate_t state = { };
+        bool utf8 = _private::locale_is_utf8();
+        return convert_to_buffer(array_view<const char>(str), buf, [&](array_view<const char> in, wchar_t* out, size_t size)
+        {
+            return to_wchar_block(in, out, size, state, utf8);
+        });
+    }
 }
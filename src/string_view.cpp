@@ -1,7 +1,10 @@
 #include <stdext/string_view.h>
 #include <stdext/scope_guard.h>
 
+#include "cpu.h"
+
 #include <cctype>
+#include <cstring>
 
 
 namespace stdext
@@ -145,4 +148,471 @@ namespace stdext
         return stox<long double>(str, idx);
     }
 #endif
+
+    namespace
+    {
+        using _private::byte_set;
+        using _private::count_trailing_zeros;
+        using _private::highest_bit;
+
+        constexpr auto npos = size_t(-1);
+
+        // Crochemore and Perrin's Two-Way algorithm, which finds a needle in linear time whatever
+        // its structure, with a bad-character shift on the last byte of the window.  This is the
+        // fallback for needles that defeat the candidate filters below.
+        std::pair<size_t, size_t> maximal_suffix(const uint8_t* n, size_t m, bool reversed) noexcept
+        {
+            size_t ip = npos, jp = 0, k = 1, p = 1;
+            while (jp + k < m)
+            {
+                auto a = n[ip + k];
+                auto b = n[jp + k];
+                if (a == b)
+                {
+                    if (k == p)
+                    {
+                        jp += p;
+                        k = 1;
+                    }
+                    else
+                        ++k;
+                }
+                else if (reversed ? a < b : a > b)
+                {
+                    jp += k;
+                    k = 1;
+                    p = jp - ip;
+                }
+                else
+                {
+                    ip = jp++;
+                    k = p = 1;
+                }
+            }
+            return { ip, p };
+        }
+
+        size_t two_way_find(const uint8_t* h, size_t size, const uint8_t* n, size_t m) noexcept
+        {
+            if (m > size)
+                return npos;
+
+            // Find the critical factorization n = n[0..ms] n[ms+1..m) and the period p of the needle.
+            // ms may be npos, standing for -1; the arithmetic below wraps accordingly.
+            auto [ms, p] = maximal_suffix(n, m, false);
+            auto [ms2, p2] = maximal_suffix(n, m, true);
+            if (ms2 + 1 > ms + 1)
+            {
+                ms = ms2;
+                p = p2;
+            }
+
+            // For a periodic needle, a mismatch in the left half shifts by the period and remembers
+            // how much of the needle is already known to match.
+            size_t mem0;
+            if (std::memcmp(n, n + p, ms + 1) != 0)
+            {
+                mem0 = 0;
+                p = std::max(ms, m - ms - 1) + 1;
+            }
+            else
+                mem0 = m - p;
+
+            size_t shift[256] = { };
+            for (size_t i = 0; i != m; ++i)
+                shift[n[i]] = i + 1;
+
+            size_t mem = 0;
+            for (size_t i = 0; size - i >= m; )
+            {
+                auto last = shift[h[i + m - 1]];
+                if (last == 0)
+                {
+                    i += m;
+                    mem = 0;
+                    continue;
+                }
+                if (last != m)
+                {
+                    i += std::max(m - last, mem);
+                    mem = 0;
+                    continue;
+                }
+
+                auto k = std::max(ms + 1, mem);
+                while (k < m && n[k] == h[i + k])
+                    ++k;
+                if (k < m)
+                {
+                    i += k - ms;
+                    mem = 0;
+                    continue;
+                }
+
+                for (k = ms + 1; k > mem && n[k - 1] == h[i + k - 1]; --k)
+                    ;
+                if (k <= mem)
+                    return i;
+                i += p;
+                mem = mem0;
+            }
+            return npos;
+        }
+
+        // The filters below look for windows whose first and last bytes match the needle's, and
+        // compare the rest only there.  This is fast for typical text, but a needle like "aaab"
+        // in a run of a's makes every window a candidate.  Once the comparisons have cost more than
+        // a few passes over the text, the search is handed over to Two-Way.
+        bool too_many_candidates(size_t work, size_t pos, size_t m) noexcept
+        {
+            return work > pos + 4 * m;
+        }
+
+        size_t find_rest(const uint8_t* h, size_t size, size_t pos, const uint8_t* n, size_t m) noexcept
+        {
+            auto result = two_way_find(h + pos, size - pos, n, m);
+            return result == npos ? npos : pos + result;
+        }
+
+        size_t find_filtered_scalar(const uint8_t* h, size_t size, const uint8_t* n, size_t m) noexcept
+        {
+            size_t work = 0;
+            auto last = size - m;
+            for (size_t i = 0; i <= last; ++i)
+            {
+                auto p = static_cast<const uint8_t*>(std::memchr(h + i, n[0], last - i + 1));
+                if (p == nullptr)
+                    break;
+
+                i = size_t(p - h);
+                if (h[i + m - 1] == n[m - 1])
+                {
+                    if (std::memcmp(h + i + 1, n + 1, m - 2) == 0)
+                        return i;
+                    if (too_many_candidates(work += m, i, m))
+                        return find_rest(h, size, i + 1, n, m);
+                }
+            }
+            return npos;
+        }
+
+        using find_kernel = size_t (*)(const uint8_t* h, size_t size, const uint8_t* n, size_t m) noexcept;
+
+#if STDEXT_ARCH_X86
+        STDEXT_TARGET("avx2")
+        size_t find_filtered_avx2(const uint8_t* h, size_t size, const uint8_t* n, size_t m) noexcept
+        {
+            auto first = _mm256_set1_epi8(char(n[0]));
+            auto last = _mm256_set1_epi8(char(n[m - 1]));
+            size_t work = 0;
+            size_t i = 0;
+            for (; size - i >= m - 1 + 32; i += 32)
+            {
+                auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+                auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+                auto candidates = uint32_t(_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+                for (; candidates != 0; candidates &= candidates - 1)
+                {
+                    auto k = i + count_trailing_zeros(candidates);
+                    if (std::memcmp(h + k + 1, n + 1, m - 2) == 0)
+                        return k;
+                    if (too_many_candidates(work += m, k, m))
+                    {
+                        _mm256_zeroupper();
+                        return find_rest(h, size, k + 1, n, m);
+                    }
+                }
+            }
+            _mm256_zeroupper();
+
+            if (size - i < m)
+                return npos;
+            auto result = find_filtered_scalar(h + i, size - i, n, m);
+            return result == npos ? npos : i + result;
+        }
+#endif
+
+        find_kernel select_find_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return find_filtered_avx2;
+#endif
+            return find_filtered_scalar;
+        }
+
+        size_t find_first_of_scalar(const uint8_t* str, size_t size, size_t pos, const byte_set& set, bool match) noexcept
+        {
+            for (; pos != size; ++pos)
+            {
+                if (set.contains(str[pos]) == match)
+                    return pos;
+            }
+            return npos;
+        }
+
+        // Searches str[0..end) backward.
+        size_t find_last_of_scalar(const uint8_t* str, size_t end, const byte_set& set, bool match) noexcept
+        {
+            while (end-- != 0)
+            {
+                if (set.contains(str[end]) == match)
+                    return end;
+            }
+            return npos;
+        }
+
+        uint64_t byte_set_mask_scalar(const uint8_t* str, const byte_set& set) noexcept
+        {
+            uint64_t mask = 0;
+            for (unsigned i = 0; i != 64; ++i)
+                mask |= uint64_t(set.contains(str[i])) << i;
+            return mask;
+        }
+
+        using find_first_of_kernel = size_t (*)(const uint8_t* str, size_t size, size_t pos, const byte_set& set, bool match) noexcept;
+        using find_last_of_kernel = size_t (*)(const uint8_t* str, size_t end, const byte_set& set, bool match) noexcept;
+        using byte_set_mask_kernel = uint64_t (*)(const uint8_t* str, const byte_set& set) noexcept;
+
+#if STDEXT_ARCH_X86
+        struct byte_set_ssse3
+        {
+            __m128i low0;
+            __m128i low1;
+            __m128i high;
+
+            STDEXT_TARGET("ssse3")
+            explicit byte_set_ssse3(const byte_set& set) noexcept
+                : low0(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.low[0]))),
+                low1(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.low[1]))),
+                high(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128))
+            {
+            }
+
+            // Returns a bit for each of 16 bytes, set for the bytes in the set.
+            STDEXT_TARGET("ssse3")
+            uint32_t classify(const uint8_t* str) const noexcept
+            {
+                auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+                auto low = _mm_or_si128(_mm_shuffle_epi8(low0, input), _mm_shuffle_epi8(low1, _mm_xor_si128(input, _mm_set1_epi8(-128))));
+                auto bit = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(input, 4), _mm_set1_epi8(0x0F)));
+                return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(low, bit), bit)));
+            }
+        };
+
+        STDEXT_TARGET("ssse3")
+        size_t find_first_of_ssse3(const uint8_t* str, size_t size, size_t pos, const byte_set& set, bool match) noexcept
+        {
+            byte_set_ssse3 tables(set);
+            uint32_t invert = match ? 0 : 0xFFFF;
+            for (; size - pos >= 16; pos += 16)
+            {
+                auto found = tables.classify(str + pos) ^ invert;
+                if (found != 0)
+                    return pos + count_trailing_zeros(found);
+            }
+            return find_first_of_scalar(str, size, pos, set, match);
+        }
+
+        STDEXT_TARGET("ssse3")
+        size_t find_last_of_ssse3(const uint8_t* str, size_t end, const byte_set& set, bool match) noexcept
+        {
+            byte_set_ssse3 tables(set);
+            uint32_t invert = match ? 0 : 0xFFFF;
+            for (; end >= 16; end -= 16)
+            {
+                auto found = tables.classify(str + end - 16) ^ invert;
+                if (found != 0)
+                    return end - 16 + highest_bit(found);
+            }
+            return find_last_of_scalar(str, end, set, match);
+        }
+
+        STDEXT_TARGET("ssse3")
+        uint64_t byte_set_mask_ssse3(const uint8_t* str, const byte_set& set) noexcept
+        {
+            byte_set_ssse3 tables(set);
+            return uint64_t(tables.classify(str)) | uint64_t(tables.classify(str + 16)) << 16
+                | uint64_t(tables.classify(str + 32)) << 32 | uint64_t(tables.classify(str + 48)) << 48;
+        }
+
+        struct byte_set_avx2
+        {
+            __m256i low0;
+            __m256i low1;
+            __m256i high;
+
+            STDEXT_TARGET("avx2")
+            explicit byte_set_avx2(const byte_set& set) noexcept
+                : low0(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.low[0])))),
+                low1(_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(set.low[1])))),
+                high(_mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128))
+            {
+            }
+
+            // Returns a bit for each of 32 bytes, set for the bytes in the set.
+            STDEXT_TARGET("avx2")
+            uint32_t classify(const uint8_t* str) const noexcept
+            {
+                auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str));
+                auto low = _mm256_or_si256(_mm256_shuffle_epi8(low0, input), _mm256_shuffle_epi8(low1, _mm256_xor_si256(input, _mm256_set1_epi8(-128))));
+                auto bit = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(input, 4), _mm256_set1_epi8(0x0F)));
+                return uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(low, bit), bit)));
+            }
+        };
+
+        STDEXT_TARGET("avx2")
+        size_t find_first_of_avx2(const uint8_t* str, size_t size, size_t pos, const byte_set& set, bool match) noexcept
+        {
+            size_t result = npos;
+            {
+                byte_set_avx2 tables(set);
+                uint32_t invert = match ? 0 : 0xFFFFFFFF;
+                for (; size - pos >= 32; pos += 32)
+                {
+                    auto found = tables.classify(str + pos) ^ invert;
+                    if (found != 0)
+                    {
+                        result = pos + count_trailing_zeros(found);
+                        break;
+                    }
+                }
+            }
+            _mm256_zeroupper();
+            return result != npos ? result : find_first_of_scalar(str, size, pos, set, match);
+        }
+
+        STDEXT_TARGET("avx2")
+        size_t find_last_of_avx2(const uint8_t* str, size_t end, const byte_set& set, bool match) noexcept
+        {
+            size_t result = npos;
+            {
+                byte_set_avx2 tables(set);
+                uint32_t invert = match ? 0 : 0xFFFFFFFF;
+                for (; end >= 32; end -= 32)
+                {
+                    auto found = tables.classify(str + end - 32) ^ invert;
+                    if (found != 0)
+                    {
+                        result = end - 32 + highest_bit(found);
+                        break;
+                    }
+                }
+            }
+            _mm256_zeroupper();
+            return result != npos ? result : find_last_of_scalar(str, end, set, match);
+        }
+
+        STDEXT_TARGET("avx2")
+        uint64_t byte_set_mask_avx2(const uint8_t* str, const byte_set& set) noexcept
+        {
+            uint64_t mask;
+            {
+                byte_set_avx2 tables(set);
+                mask = uint64_t(tables.classify(str)) | uint64_t(tables.classify(str + 32)) << 32;
+            }
+            _mm256_zeroupper();
+            return mask;
+        }
+#endif
+
+        find_first_of_kernel select_find_first_of_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return find_first_of_avx2;
+            if (_private::cpu().ssse3)
+                return find_first_of_ssse3;
+#endif
+            return find_first_of_scalar;
+        }
+
+        find_last_of_kernel select_find_last_of_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return find_last_of_avx2;
+            if (_private::cpu().ssse3)
+                return find_last_of_ssse3;
+#endif
+            return find_last_of_scalar;
+        }
+
+        byte_set_mask_kernel select_byte_set_mask_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return byte_set_mask_avx2;
+            if (_private::cpu().ssse3)
+                return byte_set_mask_ssse3;
+#endif
+            return byte_set_mask_scalar;
+        }
+    }
+
+    namespace _private
+    {
+        byte_set make_byte_set(const char* set, size_t n) noexcept
+        {
+            byte_set result = { };
+            for (size_t i = 0; i != n; ++i)
+            {
+                auto c = uint8_t(set[i]);
+                result.bits[c >> 6] |= uint64_t(1) << (c & 63);
+                result.low[c >> 7][c & 15] |= uint8_t(1 << (c >> 4 & 7));
+            }
+            return result;
+        }
+
+        uint64_t byte_set_mask(const char* str, const byte_set& set) noexcept
+        {
+            static const byte_set_mask_kernel kernel = select_byte_set_mask_kernel();
+            return kernel(reinterpret_cast<const uint8_t*>(str), set);
+        }
+
+        size_t string_find(const char* str, size_t size, size_t pos, const char* s, size_t n) noexcept
+        {
+            static const find_kernel kernel = select_find_kernel();
+
+            if (pos > size || n > size - pos)
+                return npos;
+            if (n == 0)
+                return pos;
+
+            if (n == 1)
+            {
+                auto p = static_cast<const char*>(std::memchr(str + pos, s[0], size - pos));
+                return p == nullptr ? npos : size_t(p - str);
+            }
+
+            auto result = kernel(reinterpret_cast<const uint8_t*>(str) + pos, size - pos, reinterpret_cast<const uint8_t*>(s), n);
+            return result == npos ? npos : pos + result;
+        }
+
+        size_t string_find_first_of(const char* str, size_t size, size_t pos, const char* set, size_t n, bool match) noexcept
+        {
+            static const find_first_of_kernel kernel = select_find_first_of_kernel();
+
+            if (pos >= size)
+                return npos;
+            if (n == 1 && match)
+            {
+                auto p = static_cast<const char*>(std::memchr(str + pos, set[0], size - pos));
+                return p == nullptr ? npos : size_t(p - str);
+            }
+
+            return kernel(reinterpret_cast<const uint8_t*>(str), size, pos, make_byte_set(set, n), match);
+        }
+
+        size_t string_find_last_of(const char* str, size_t size, size_t pos, const char* set, size_t n, bool match) noexcept
+        {
+            static const find_last_of_kernel kernel = select_find_last_of_kernel();
+
+            if (size == 0)
+                return npos;
+            return kernel(reinterpret_cast<const uint8_t*>(str), std::min(pos, size - 1) + 1, make_byte_set(set, n), match);
+        }
+    }
 }
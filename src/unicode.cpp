@@ -1,50 +1,144 @@
 #include <stdext/unicode.h>
 
+#include <stdext/checksum.h>
+#include <stdext/endian.h>
+#include <stdext/scope_guard.h>
+
+#include "cpu.h"
+#include "unicode_tables.h"
+
+#include <atomic>
+#include <thread>
+
+#include <cassert>
+#include <cstring>
+
 
 namespace stdext
 {
     namespace
     {
-        bool utf8_decode_first(uint8_t code, utfstate_t& state);
-        bool utf8_validate_second(uint8_t code, utfstate_t& state);
-        bool utf8_decode_trailing(uint8_t code, utfstate_t& state);
+        // Table-driven UTF-8 decoding.  Each byte is mapped to one of twelve character classes,
+        // and the class selects a transition from the current state of the automaton:
+        //   accept    at a code point boundary
+        //   reject    the input is invalid
+        //   tail1-3   one, two, or three continuation bytes (80-BF) remain
+        //   e0        after E0; the next byte must be A0-BF (no overlong forms)
+        //   ed        after ED; the next byte must be 80-9F (no surrogates)
+        //   f0        after F0; the next byte must be 90-BF (no overlong forms)
+        //   f4        after F4; the next byte must be 80-8F (nothing above U+10FFFF)
+        // Between calls, the automaton state is kept in the otherwise unused high bits of
+        // utfstate_t::code; consumed and remaining are maintained as before.
+        enum utf8_dfa_state : uint8_t
+        {
+            utf8_accept, utf8_reject, utf8_tail1, utf8_tail2, utf8_tail3, utf8_e0, utf8_ed, utf8_f0, utf8_f4
+        };
+
+        constexpr unsigned utf8_dfa_class_count = 12;
+        constexpr unsigned utf8_dfa_state_shift = 20;
+
+        struct utf8_dfa_table
+        {
+            // 00-7F, 80-8F, 90-9F, A0-BF, C0-C1 F5-FF, C2-DF, E0, E1-EC EE-EF, ED, F0, F1-F3, F4
+            uint8_t classes[256];
+            uint8_t lead_mask[utf8_dfa_class_count];
+            uint8_t remaining[9];
+            uint8_t transitions[9][utf8_dfa_class_count];
+
+            constexpr utf8_dfa_table() noexcept : classes(), lead_mask(), remaining(), transitions()
+            {
+                for (unsigned n = 0; n != 256; ++n)
+                {
+                    classes[n] = uint8_t(n < 0x80 ? 0 : n < 0x90 ? 1 : n < 0xA0 ? 2 : n < 0xC0 ? 3
+                        : n < 0xC2 ? 4 : n < 0xE0 ? 5 : n == 0xE0 ? 6 : n == 0xED ? 8 : n < 0xF0 ? 7
+                        : n == 0xF0 ? 9 : n < 0xF4 ? 10 : n == 0xF4 ? 11 : 4);
+                }
+
+                const uint8_t masks[utf8_dfa_class_count] = { 0x7F, 0x3F, 0x3F, 0x3F, 0, 0x1F, 0x0F, 0x0F, 0x0F, 0x07, 0x07, 0x07 };
+                for (unsigned n = 0; n != utf8_dfa_class_count; ++n)
+                    lead_mask[n] = masks[n];
+
+                const uint8_t left[9] = { 0, 0, 1, 2, 3, 2, 2, 3, 3 };
+                for (unsigned n = 0; n != 9; ++n)
+                    remaining[n] = left[n];
+
+                for (auto& row : transitions)
+                {
+                    for (auto& next : row)
+                        next = utf8_reject;
+                }
+
+                transitions[utf8_accept][0] = utf8_accept;
+                transitions[utf8_accept][5] = utf8_tail1;
+                transitions[utf8_accept][6] = utf8_e0;
+                transitions[utf8_accept][7] = utf8_tail2;
+                transitions[utf8_accept][8] = utf8_ed;
+                transitions[utf8_accept][9] = utf8_f0;
+                transitions[utf8_accept][10] = utf8_tail3;
+                transitions[utf8_accept][11] = utf8_f4;
+                for (unsigned n = 1; n != 4; ++n)
+                {
+                    transitions[utf8_tail1][n] = utf8_accept;
+                    transitions[utf8_tail2][n] = utf8_tail1;
+                    transitions[utf8_tail3][n] = utf8_tail2;
+                }
+                transitions[utf8_e0][3] = utf8_tail1;
+                transitions[utf8_ed][1] = utf8_tail1;
+                transitions[utf8_ed][2] = utf8_tail1;
+                transitions[utf8_f0][2] = utf8_tail2;
+                transitions[utf8_f0][3] = utf8_tail2;
+                transitions[utf8_f4][1] = utf8_tail2;
+            }
+        };
+
+        constexpr utf8_dfa_table utf8_dfa;
     }
 
     std::pair<utf_result, char32_t> to_utf32(char in, utfstate_t& state)
     {
-        switch (state.consumed)
+        auto byte = uint8_t(in);
+        if (byte < 0x80 && state.consumed == 0)
         {
-        case 0:
-            if (!utf8_decode_first(in, state))
-                return { utf_result::error, char32_t() };
-
-            if (state.remaining == 0)
-                return { utf_result::ok, char32_t(state.code) };
+            // ASCII is by far the most common input; skip the automaton.
+            auto updated = state;
+            updated.code = byte;
+            updated.remaining = 0;
+            state = updated;
+            return { utf_result::ok, char32_t(byte) };
+        }
 
-            state.consumed = 1;
-            return { utf_result::partial_read, char32_t() };
+        auto type = utf8_dfa.classes[byte];
 
-        case 1:
-            if (!utf8_validate_second(in, state))
-                return { utf_result::error, char32_t() };
+        // The stored automaton state is meaningful only partway through a sequence.
+        uint32_t continuing = state.consumed != 0;
+        auto current = (state.code >> utf8_dfa_state_shift) & (0u - continuing);
+        auto next = utf8_dfa.transitions[current][type];
+        if (next == utf8_reject)
+            return { utf_result::error, char32_t() };
 
-        // fall through
-        default:
-            if (state.remaining != 0)
-            {
-                if (!utf8_decode_trailing(in, state))
-                    return { utf_result::error, char32_t() };
+        auto code = continuing
+            ? (state.code & ((1u << utf8_dfa_state_shift) - 1)) << 6 | (byte & 0x3F)
+            : byte & utf8_dfa.lead_mask[type];
 
-                ++state.consumed;
-                if (--state.remaining != 0)
-                    return { utf_result::partial_read, char32_t() };
-            }
+        // Update a copy so that the state is written with a single store; separate stores to
+        // the bit-fields defeat store forwarding on the next call.
+        auto updated = state;
+        if (next != utf8_accept)
+        {
+            updated.code = next << utf8_dfa_state_shift | code;
+            updated.consumed = state.consumed + 1;
+            updated.remaining = utf8_dfa.remaining[next];
+            state = updated;
+            return { utf_result::partial_read, char32_t() };
         }
 
-        state.consumed = 0;
-        if (is_noncharacter(state.code))
+        updated.code = code;
+        updated.consumed = 0;
+        updated.remaining = 0;
+        state = updated;
+        if (is_noncharacter(code))
             return { utf_result::error, char32_t() };
-        return { utf_result::ok, char32_t(state.code) };
+        return { utf_result::ok, char32_t(code) };
     }
 
     std::pair<utf_result, char32_t> to_utf32(char16_t in, utfstate_t& state)
@@ -210,60 +304,545 @@ namespace stdext
 
     namespace
     {
-        bool utf8_decode_first(uint8_t code, utfstate_t& state)
+        // UTF-8 validation.  The vector kernels test 64-byte blocks for errors using the lookup
+        // tables of Keiser and Lemire ("Validating UTF-8 In Less Than One Instruction Per Byte"),
+        // which classify each byte by the high and low nibbles of the preceding byte and the high
+        // nibble of the byte itself.  Noncharacters cannot be identified from byte pairs alone, so
+        // the kernels flag the byte patterns that may begin one (EF B7 for U+FDD0-U+FDEF, and BF
+        // followed by BE or BF for U+xFFFE and U+xFFFF).  These are rare in practice.  A flagged
+        // block is re-examined by the scalar validator, which determines the exact result.
+        constexpr size_t utf8_block_size = 64;
+
+        using utf8_validate_kernel = size_t (*)(const uint8_t* str, size_t size, size_t pos) noexcept;
+
+        // Validates the sequences beginning in [pos, end), stopping at the first error.  Returns
+        // the position following the last sequence validated.
+        std::pair<utf_result, size_t> utf8_validate_scalar(const uint8_t* str, size_t size, size_t pos, size_t end) noexcept
         {
-            if ((code & 0x80) == 0x00)
+            while (pos < end)
             {
-                state.code = code;
-                state.remaining = 0;
+                // Skip ASCII eight bytes at a time.
+                if (end - pos >= 8)
+                {
+                    uint64_t chunk;
+                    std::memcpy(&chunk, str + pos, sizeof(chunk));
+                    if ((chunk & 0x80808080'80808080) == 0)
+                    {
+                        pos += 8;
+                        continue;
+                    }
+                }
+
+                auto lead = str[pos];
+                if (lead < 0x80)
+                {
+                    ++pos;
+                    continue;
+                }
+
+                size_t length;
+                char32_t code;
+                uint8_t low = 0x80;
+                uint8_t high = 0xBF;
+                if (lead < 0xC2)
+                    return { utf_result::error, pos };
+                else if (lead < 0xE0)
+                {
+                    length = 2;
+                    code = lead & 0x1F;
+                }
+                else if (lead < 0xF0)
+                {
+                    length = 3;
+                    code = lead & 0x0F;
+                    if (lead == 0xE0)
+                        low = 0xA0;
+                    else if (lead == 0xED)
+                        high = 0x9F;
+                }
+                else if (lead < 0xF5)
+                {
+                    length = 4;
+                    code = lead & 0x07;
+                    if (lead == 0xF0)
+                        low = 0x90;
+                    else if (lead == 0xF4)
+                        high = 0x8F;
+                }
+                else
+                    return { utf_result::error, pos };
+
+                for (size_t n = 1; n != length; ++n)
+                {
+                    if (pos + n == size)
+                        return { utf_result::partial_read, pos };
+
+                    auto trail = str[pos + n];
+                    if (trail < low || trail > high)
+                        return { utf_result::error, pos };
+                    low = 0x80;
+                    high = 0xBF;
+                    code = code << 6 | (trail & 0x3F);
+                }
+
+                if (is_noncharacter(code))
+                    return { utf_result::error, pos };
+                pos += length;
             }
-            else if ((code & 0xE0) == 0xC0)
+
+            return { utf_result::ok, pos };
+        }
+
+        size_t utf8_validate_blocks_scalar(const uint8_t*, size_t, size_t pos) noexcept
+        {
+            return pos;
+        }
+
+#if STDEXT_ARCH_X86
+        namespace utf8_lookup
+        {
+            constexpr uint8_t too_short = 1 << 0;       // 11______ 0_______, 11______ 11______
+            constexpr uint8_t too_long = 1 << 1;        // 0_______ 10______
+            constexpr uint8_t overlong_3 = 1 << 2;      // 11100000 100_____
+            constexpr uint8_t too_large = 1 << 3;       // 11110100 1001____, 11110100 101_____, 11110101+
+            constexpr uint8_t surrogate = 1 << 4;       // 11101101 101_____
+            constexpr uint8_t overlong_2 = 1 << 5;      // 1100000_ 10______
+            constexpr uint8_t too_large_1000 = 1 << 6;  // 11110101+ 1000____
+            constexpr uint8_t overlong_4 = 1 << 6;      // 11110000 1000____
+            constexpr uint8_t two_conts = 1 << 7;       // 10______ 10______
+            constexpr uint8_t carry = too_short | too_long | two_conts;
+
+            alignas(16) constexpr uint8_t byte_1_high[16] = {
+                too_long, too_long, too_long, too_long,
+                too_long, too_long, too_long, too_long,
+                two_conts, two_conts, two_conts, two_conts,
+                too_short | overlong_2,
+                too_short,
+                too_short | overlong_3 | surrogate,
+                too_short | too_large | too_large_1000 | overlong_4
+            };
+
+            alignas(16) constexpr uint8_t byte_1_low[16] = {
+                carry | overlong_3 | overlong_2 | overlong_4,
+                carry | overlong_2,
+                carry,
+                carry,
+                carry | too_large,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000 | surrogate,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000
+            };
+
+            alignas(16) constexpr uint8_t byte_2_high[16] = {
+                too_short, too_short, too_short, too_short,
+                too_short, too_short, too_short, too_short,
+                too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+                too_long | overlong_2 | two_conts | overlong_3 | too_large,
+                too_long | overlong_2 | two_conts | surrogate | too_large,
+                too_long | overlong_2 | two_conts | surrogate | too_large,
+                too_short, too_short, too_short, too_short
+            };
+
+            // Subtracted from the last three bytes of a block; a nonzero result means that the
+            // block ends partway through a sequence.
+            alignas(16) constexpr uint8_t incomplete[16] = {
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+            };
+        }
+
+        struct utf8_tables_sse
+        {
+            __m128i byte_1_high;
+            __m128i byte_1_low;
+            __m128i byte_2_high;
+        };
+
+        // Returns a vector that is nonzero wherever input, preceded by prev_input, is invalid or
+        // may contain a noncharacter.
+        STDEXT_TARGET("sse4.1")
+        __m128i utf8_check_sse41(const utf8_tables_sse& tables, __m128i input, __m128i prev_input) noexcept
+        {
+            auto nibble = _mm_set1_epi8(0x0F);
+            auto prev1 = _mm_alignr_epi8(input, prev_input, 15);
+            auto prev2 = _mm_alignr_epi8(input, prev_input, 14);
+            auto prev3 = _mm_alignr_epi8(input, prev_input, 13);
+
+            auto special = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_shuffle_epi8(tables.byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                    _mm_shuffle_epi8(tables.byte_1_low, _mm_and_si128(prev1, nibble))),
+                _mm_shuffle_epi8(tables.byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+            auto must23 = _mm_or_si128(
+                _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xE0 - 0x80))),
+                _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xF0 - 0x80))));
+            auto error = _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8(char(0x80))), special);
+
+            auto nonchar = _mm_or_si128(
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(prev1, _mm_set1_epi8(char(0xBF))),
+                    _mm_cmpeq_epi8(_mm_or_si128(input, _mm_set1_epi8(1)), _mm_set1_epi8(char(0xBF)))),
+                _mm_and_si128(
+                    _mm_cmpeq_epi8(prev2, _mm_set1_epi8(char(0xEF))),
+                    _mm_cmpeq_epi8(prev1, _mm_set1_epi8(char(0xB7)))));
+
+            return _mm_or_si128(error, nonchar);
+        }
+
+        // Returns the position of the first block that may contain an error, or the position of
+        // the first unexamined byte if fewer than utf8_block_size bytes remain.
+        STDEXT_TARGET("sse4.1")
+        size_t utf8_validate_blocks_sse41(const uint8_t* str, size_t size, size_t pos) noexcept
+        {
+            utf8_tables_sse tables = {
+                _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_1_high)),
+                _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_1_low)),
+                _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_2_high))
+            };
+            auto incomplete = _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::incomplete));
+            auto high_bits = _mm_set1_epi8(char(0x80));
+
+            auto prev_input = pos >= 16 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + pos - 16)) : _mm_setzero_si128();
+            for (; size - pos >= utf8_block_size; pos += utf8_block_size)
             {
-                if (code < 0xC2)
-                    return false;
+                auto p = reinterpret_cast<const __m128i*>(str + pos);
+                auto in0 = _mm_loadu_si128(p);
+                auto in1 = _mm_loadu_si128(p + 1);
+                auto in2 = _mm_loadu_si128(p + 2);
+                auto in3 = _mm_loadu_si128(p + 3);
 
-                state.code = code & 0x1F;
-                state.remaining = 1;
+                auto any = _mm_or_si128(_mm_or_si128(in0, in1), _mm_or_si128(in2, in3));
+                __m128i error;
+                if (_mm_testz_si128(any, high_bits))
+                    error = _mm_subs_epu8(prev_input, incomplete);
+                else
+                {
+                    error = _mm_or_si128(
+                        _mm_or_si128(utf8_check_sse41(tables, in0, prev_input), utf8_check_sse41(tables, in1, in0)),
+                        _mm_or_si128(utf8_check_sse41(tables, in2, in1), utf8_check_sse41(tables, in3, in2)));
+                }
+
+                if (!_mm_testz_si128(error, error))
+                    return pos;
+                prev_input = in3;
             }
-            else if ((code & 0xF0) == 0xE0)
+
+            return pos;
+        }
+
+        struct utf8_tables_avx2
+        {
+            __m256i byte_1_high;
+            __m256i byte_1_low;
+            __m256i byte_2_high;
+        };
+
+        STDEXT_TARGET("avx2")
+        __m256i utf8_check_avx2(const utf8_tables_avx2& tables, __m256i input, __m256i prev_input) noexcept
+        {
+            auto nibble = _mm256_set1_epi8(0x0F);
+            auto shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+            auto prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            auto prev2 = _mm256_alignr_epi8(input, shifted, 14);
+            auto prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+            auto special = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(tables.byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                    _mm256_shuffle_epi8(tables.byte_1_low, _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(tables.byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+            auto must23 = _mm256_or_si256(
+                _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xE0 - 0x80))),
+                _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xF0 - 0x80))));
+            auto error = _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8(char(0x80))), special);
+
+            auto nonchar = _mm256_or_si256(
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8(char(0xBF))),
+                    _mm256_cmpeq_epi8(_mm256_or_si256(input, _mm256_set1_epi8(1)), _mm256_set1_epi8(char(0xBF)))),
+                _mm256_and_si256(
+                    _mm256_cmpeq_epi8(prev2, _mm256_set1_epi8(char(0xEF))),
+                    _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8(char(0xB7)))));
+
+            return _mm256_or_si256(error, nonchar);
+        }
+
+        STDEXT_TARGET("avx2")
+        size_t utf8_validate_blocks_avx2(const uint8_t* str, size_t size, size_t pos) noexcept
+        {
+            utf8_tables_avx2 tables = {
+                _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_1_high))),
+                _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_1_low))),
+                _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_2_high)))
+            };
+            auto incomplete = _mm256_inserti128_si256(_mm256_set1_epi8(char(0xFF)),
+                _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::incomplete)), 1);
+
+            auto prev_input = pos >= 32 ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + pos - 32)) : _mm256_setzero_si256();
+            for (; size - pos >= utf8_block_size; pos += utf8_block_size)
             {
-                state.code = code & 0x0F;
-                state.remaining = 2;
+                auto p = reinterpret_cast<const __m256i*>(str + pos);
+                auto in0 = _mm256_loadu_si256(p);
+                auto in1 = _mm256_loadu_si256(p + 1);
+
+                __m256i error;
+                if (_mm256_movemask_epi8(_mm256_or_si256(in0, in1)) == 0)
+                    error = _mm256_subs_epu8(prev_input, incomplete);
+                else
+                    error = _mm256_or_si256(utf8_check_avx2(tables, in0, prev_input), utf8_check_avx2(tables, in1, in0));
+
+                if (!_mm256_testz_si256(error, error))
+                    return pos;
+                prev_input = in1;
             }
-            else if ((code & 0xF8) == 0xF0)
+
+            return pos;
+        }
+
+        struct utf8_tables_avx512
+        {
+            __m512i byte_1_high;
+            __m512i byte_1_low;
+            __m512i byte_2_high;
+        };
+
+        STDEXT_TARGET("avx512f,avx512bw")
+        bool utf8_check_avx512(const utf8_tables_avx512& tables, __m512i input, __m512i prev_input) noexcept
+        {
+            auto nibble = _mm512_set1_epi8(0x0F);
+            auto shifted = _mm512_permutex2var_epi64(prev_input, _mm512_setr_epi64(6, 7, 8, 9, 10, 11, 12, 13), input);
+            auto prev1 = _mm512_alignr_epi8(input, shifted, 15);
+            auto prev2 = _mm512_alignr_epi8(input, shifted, 14);
+            auto prev3 = _mm512_alignr_epi8(input, shifted, 13);
+
+            auto special = _mm512_and_si512(
+                _mm512_and_si512(
+                    _mm512_shuffle_epi8(tables.byte_1_high, _mm512_and_si512(_mm512_srli_epi16(prev1, 4), nibble)),
+                    _mm512_shuffle_epi8(tables.byte_1_low, _mm512_and_si512(prev1, nibble))),
+                _mm512_shuffle_epi8(tables.byte_2_high, _mm512_and_si512(_mm512_srli_epi16(input, 4), nibble)));
+
+            auto must23 = _mm512_or_si512(
+                _mm512_subs_epu8(prev2, _mm512_set1_epi8(char(0xE0 - 0x80))),
+                _mm512_subs_epu8(prev3, _mm512_set1_epi8(char(0xF0 - 0x80))));
+            auto error = _mm512_xor_si512(_mm512_and_si512(must23, _mm512_set1_epi8(char(0x80))), special);
+
+            auto nonchar =
+                (_mm512_cmpeq_epi8_mask(prev1, _mm512_set1_epi8(char(0xBF)))
+                    & _mm512_cmpeq_epi8_mask(_mm512_or_si512(input, _mm512_set1_epi8(1)), _mm512_set1_epi8(char(0xBF))))
+                | (_mm512_cmpeq_epi8_mask(prev2, _mm512_set1_epi8(char(0xEF)))
+                    & _mm512_cmpeq_epi8_mask(prev1, _mm512_set1_epi8(char(0xB7))));
+
+            return (_mm512_test_epi8_mask(error, error) | nonchar) != 0;
+        }
+
+        STDEXT_TARGET("avx512f,avx512bw")
+        size_t utf8_validate_blocks_avx512(const uint8_t* str, size_t size, size_t pos) noexcept
+        {
+            utf8_tables_avx512 tables = {
+                _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_1_high))),
+                _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_1_low))),
+                _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::byte_2_high)))
+            };
+            auto incomplete = _mm512_inserti32x4(_mm512_set1_epi8(char(0xFF)),
+                _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_lookup::incomplete)), 3);
+
+            auto prev_input = pos >= 64 ? _mm512_loadu_si512(str + pos - 64) : _mm512_setzero_si512();
+            for (; size - pos >= utf8_block_size; pos += utf8_block_size)
             {
-                if (code >= 0xF5)
-                    return false;
+                auto input = _mm512_loadu_si512(str + pos);
+
+                bool error;
+                if (_mm512_movepi8_mask(input) == 0)
+                {
+                    auto tail = _mm512_subs_epu8(prev_input, incomplete);
+                    error = _mm512_test_epi8_mask(tail, tail) != 0;
+                }
+                else
+                    error = utf8_check_avx512(tables, input, prev_input);
 
-                state.code = code & 0x07;
-                state.remaining = 3;
+                if (error)
+                    return pos;
+                prev_input = input;
             }
-            else
-                return false;
 
-            return true;
+            return pos;
         }
+#endif
 
-        bool utf8_validate_second(uint8_t code, utfstate_t& state)
+        utf8_validate_kernel select_utf8_validate_kernel() noexcept
         {
-            switch (state.remaining)
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx512bw)
+                return utf8_validate_blocks_avx512;
+            if (_private::cpu().avx2)
+                return utf8_validate_blocks_avx2;
+            if (_private::cpu().sse41)
+                return utf8_validate_blocks_sse41;
+#endif
+            return utf8_validate_blocks_scalar;
+        }
+    }
+
+    std::pair<utf_result, size_t> utf8_validate(array_view<const char> str) noexcept
+    {
+        static const utf8_validate_kernel kernel = select_utf8_validate_kernel();
+
+        auto data = reinterpret_cast<const uint8_t*>(str.data());
+        auto size = str.size();
+        size_t pos = 0;
+        while (true)
+        {
+            pos = kernel(data, size, pos);
+            auto end = size - pos >= utf8_block_size ? pos + utf8_block_size : size;
+
+            // A sequence that begins before pos and ends within the block has not been checked.
+            auto start = pos;
+            for (size_t n = 1; n <= 3 && n <= pos; ++n)
             {
-            case 1:
-                if (state.code < 2)
-                    return false;
-                break;
-            case 2:
-                if ((state.code == 0x00 && code < 0xA0)
-                    || (state.code == 0x0D && code >= 0xA0))
+                auto code = data[pos - n];
+                if (code < 0x80)
+                    break;
+                if (code >= 0xC0)
+                {
+                    start = pos - n;
+                    break;
+                }
+            }
+
+            auto result = utf8_validate_scalar(data, size, start, end);
+            if (result.first != utf_result::ok || end == size)
+                return result;
+            pos = end;
+        }
+    }
+
+    namespace
+    {
+        using _private::count_trailing_zeros;
+
+        // Converts a single code point with the code-unit-at-a-time functions, following the
+        // protocol of _private::to_utf.  The bulk transcoders use this at chunk boundaries, when
+        // the output is nearly full, and for malformed input, so that their results and states
+        // are exactly those of the code-unit-at-a-time conversion.  Returns utf_result::ok when a
+        // code point boundary is reached.  On an unsanitized error, in is reset to the start of
+        // the invalid sequence, or to first if the sequence began in an earlier chunk.
+        template <typename OutChar, typename InChar>
+        utf_result transcode_code_point(const InChar* first, const InChar*& in, const InChar* in_end,
+            OutChar*& out, OutChar* out_end, utfstate_t& state, bool sanitize) noexcept
+        {
+            auto start = state.consumed == 0 && state.produced == 0 ? in : first;
+            while (true)
+            {
+                // Finishing a replacement character; there is no input code unit to consume.
+                if (state.error)
+                {
+                    if (out == out_end)
+                        return utf_result::partial_write;
+
+                    auto result = _private::to_utf<OutChar>(UNICODE_REPLACEMENT_CHARACTER, state);
+                    *out++ = result.second;
+                    if (result.first == utf_result::ok)
+                    {
+                        state.error = 0;
+                        return utf_result::ok;
+                    }
+                    continue;
+                }
+
+                if (in == in_end)
+                    return utf_result::partial_read;
+                if (out == out_end)
+                    return utf_result::partial_write;
+
+                auto result = _private::to_utf<OutChar>(*in, state);
+                switch (result.first)
+                {
+                case utf_result::ok:
+                    ++in;
+                    *out++ = result.second;
+                    return utf_result::ok;
+
+                case utf_result::partial_read:
+                    ++in;
+                    continue;
+
+                case utf_result::partial_write:
+                    *out++ = result.second;
+                    continue;
+
+                case utf_result::error:
+                    if (!sanitize)
+                    {
+                        in = start;
+                        state = { };
+                        return utf_result::error;
+                    }
+
+                    if (state.consumed == 0)
+                        ++in;
+                    state = { };
+                    result = _private::to_utf<OutChar>(UNICODE_REPLACEMENT_CHARACTER, state);
+                    *out++ = result.second;
+                    if (result.first == utf_result::ok)
+                        return utf_result::ok;
+                    state.error = 1;
+                    continue;
+                }
+            }
+        }
+
+        // Converts complete input with the stateful transcoder, without leaving a partial code
+        // point in either buffer.
+        template <typename OutChar, typename InChar>
+        utf_transcode_result transcode_complete(array_view<const InChar> in, span<OutChar> out, flags<utf_conversion_options> options) noexcept
+        {
+            utfstate_t state;
+            auto result = transcode(in, out, state, options);
+            switch (result.result)
+            {
+            case utf_result::partial_read:
+                // The input ends partway through a code point.
+                if (options.test_any(utf_conversion_options::sanitize))
                 {
-                    return false;
+                    constexpr size_t replacement_size = sizeof(OutChar) == 1 ? 3 : 1;
+                    if (out.size() - result.produced < replacement_size)
+                        return { utf_result::partial_write, result.consumed - state.consumed, result.produced };
+
+                    state = { };
+                    std::pair<utf_result, OutChar> code;
+                    do
+                    {
+                        code = _private::to_utf<OutChar>(UNICODE_REPLACEMENT_CHARACTER, state);
+                        out[result.produced++] = code.second;
+                    } while (code.first == utf_result::partial_write);
+                    result.result = utf_result::ok;
                 }
+                else
+                    result.consumed -= state.consumed;
                 break;
-            case 3:
-                if ((state.code == 0x00 && code < 0x90)
-                    || (state.code == 0x04 && code >= 0x90))
+
+            case utf_result::partial_write:
+                // Back out a partially written code point; the remainder can't be recovered
+                // without state.  Its final input code unit has not yet been consumed.
+                if (state.produced != 0)
                 {
-                    return false;
+                    result.produced -= state.produced;
+                    if (state.error)
+                        result.consumed -= 1;
+                    else if constexpr (sizeof(InChar) == 1)
+                        result.consumed -= state.code < 0x800 ? 1 : state.code < 0x10000 ? 2 : 3;
+                    else
+                        result.consumed -= state.code < 0x10000 ? 0 : 1;
                 }
                 break;
 
@@ -271,17 +850,1915 @@ namespace stdext
                 break;
             }
 
-            return true;
+            return result;
+        }
+
+        // Bulk kernels convert a prefix of the input that consists of complete, valid sequences
+        // and stop at anything else, leaving it to the scalar loop.
+        using utf8_to_utf16_kernel = void (*)(const uint8_t*& in, const uint8_t* in_end, char16_t*& out, char16_t* out_end) noexcept;
+
+        void utf8_to_utf16_scalar(const uint8_t*&, const uint8_t*, char16_t*&, char16_t*) noexcept
+        {
+        }
+
+#if STDEXT_ARCH_X86
+        // Converts one step of at least one code point from a sixteen-byte block: a run of ASCII,
+        // of two-byte sequences, or of three-byte sequences.  Requires sixteen bytes of input and
+        // room for sixteen code units.  Returns false if the block begins with anything else.
+        STDEXT_TARGET("sse4.1")
+        bool utf8_to_utf16_step_sse41(const uint8_t*& in, char16_t*& out) noexcept
+        {
+            auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            auto ascii = unsigned(_mm_movemask_epi8(input));
+            if ((ascii & 1) == 0)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvtepu8_epi16(input));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_cvtepu8_epi16(_mm_srli_si128(input, 8)));
+                auto count = ascii == 0 ? 16 : count_trailing_zeros(ascii);
+                in += count;
+                out += count;
+                return true;
+            }
+
+            // Two-byte sequences, viewed as sixteen-bit lanes: 110xxxxx 10yyyyyy.
+            auto code2 = _mm_or_si128(
+                _mm_slli_epi16(_mm_and_si128(input, _mm_set1_epi16(0x1F)), 6),
+                _mm_and_si128(_mm_srli_epi16(input, 8), _mm_set1_epi16(0x3F)));
+            auto valid2 = _mm_and_si128(
+                _mm_cmpeq_epi16(_mm_and_si128(input, _mm_set1_epi16(short(0xC0E0))), _mm_set1_epi16(short(0x80C0))),
+                _mm_cmpgt_epi16(code2, _mm_set1_epi16(0x7F)));
+            auto count2 = count_trailing_zeros(~unsigned(_mm_movemask_epi8(valid2)) | 0x10000) / 2;
+            if (count2 != 0)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), code2);
+                in += 2 * count2;
+                out += count2;
+                return true;
+            }
+
+            // Three-byte sequences, gathered into 32-bit lanes: 1110xxxx 10yyyyyy 10zzzzzz.
+            auto lanes = _mm_shuffle_epi8(input, _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1));
+            auto code3 = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_and_si128(_mm_srli_epi32(lanes, 4), _mm_set1_epi32(0xF000)),
+                    _mm_and_si128(_mm_srli_epi32(lanes, 2), _mm_set1_epi32(0x0FC0))),
+                _mm_and_si128(lanes, _mm_set1_epi32(0x3F)));
+            auto valid3 = _mm_and_si128(
+                _mm_cmpeq_epi32(_mm_and_si128(lanes, _mm_set1_epi32(0xF0C0C0)), _mm_set1_epi32(0xE08080)),
+                _mm_cmpgt_epi32(code3, _mm_set1_epi32(0x7FF)));
+            auto invalid3 = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi32(_mm_and_si128(code3, _mm_set1_epi32(0xF800)), _mm_set1_epi32(0xD800)),
+                    _mm_cmpeq_epi32(_mm_and_si128(code3, _mm_set1_epi32(0xFFFE)), _mm_set1_epi32(0xFFFE))),
+                _mm_and_si128(
+                    _mm_cmpgt_epi32(code3, _mm_set1_epi32(0xFDCF)),
+                    _mm_cmplt_epi32(code3, _mm_set1_epi32(0xFDF0))));
+            valid3 = _mm_andnot_si128(invalid3, valid3);
+            auto count3 = count_trailing_zeros(~unsigned(_mm_movemask_ps(_mm_castsi128_ps(valid3))) | 0x10);
+            if (count3 != 0)
+            {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi32(code3, code3));
+                in += 3 * count3;
+                out += count3;
+                return true;
+            }
+
+            return false;
+        }
+
+        STDEXT_TARGET("sse4.1")
+        void utf8_to_utf16_sse41(const uint8_t*& in, const uint8_t* in_end, char16_t*& out, char16_t* out_end) noexcept
+        {
+            while (in_end - in >= 16 && out_end - out >= 16)
+            {
+                if (!utf8_to_utf16_step_sse41(in, out))
+                    break;
+            }
+        }
+
+        STDEXT_TARGET("avx2")
+        void utf8_to_utf16_avx2(const uint8_t*& in, const uint8_t* in_end, char16_t*& out, char16_t* out_end) noexcept
+        {
+            while (in_end - in >= 16 && out_end - out >= 16)
+            {
+                if (in_end - in >= 32 && out_end - out >= 32)
+                {
+                    auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+                    if (_mm256_movemask_epi8(input) == 0)
+                    {
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(input)));
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(input, 1)));
+                        in += 32;
+                        out += 32;
+                        continue;
+                    }
+                }
+
+                // The step is compiled without VEX encoding; clear the upper halves of the ymm registers
+                // first, or every legacy SSE instruction in it stalls on the dirty upper state.
+                _mm256_zeroupper();
+                if (!utf8_to_utf16_step_sse41(in, out))
+                    break;
+            }
+        }
+#endif
+
+        utf8_to_utf16_kernel select_utf8_to_utf16_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return utf8_to_utf16_avx2;
+            if (_private::cpu().sse41)
+                return utf8_to_utf16_sse41;
+#endif
+            return utf8_to_utf16_scalar;
+        }
+    }
+
+    utf_transcode_result transcode(array_view<const char> in, span<char16_t> out, utfstate_t& state, flags<utf_conversion_options> options) noexcept
+    {
+        static const utf8_to_utf16_kernel kernel = select_utf8_to_utf16_kernel();
+
+        bool sanitize = options.test_any(utf_conversion_options::sanitize);
+        auto first = in.data();
+        auto src = first;
+        auto src_end = first + in.size();
+        auto dst = out.data();
+        auto dst_end = dst + out.size();
+
+        auto result = utf_result::ok;
+        if (state.consumed != 0 || state.produced != 0 || state.error)
+            result = transcode_code_point(first, src, src_end, dst, dst_end, state, sanitize);
+
+        while (result == utf_result::ok && src != src_end)
+        {
+            auto p = reinterpret_cast<const uint8_t*>(src);
+            kernel(p, reinterpret_cast<const uint8_t*>(src_end), dst, dst_end);
+            src = reinterpret_cast<const char*>(p);
+            if (src == src_end)
+                break;
+
+            // Decode one code point; anything unusual goes through the slow path.
+            auto lead = uint8_t(*src);
+            auto available = size_t(src_end - src);
+            if (lead < 0x80 && dst != dst_end)
+            {
+                *dst++ = char16_t(lead);
+                ++src;
+                continue;
+            }
+
+            if (lead >= 0xC2 && lead < 0xE0 && available >= 2 && dst != dst_end)
+            {
+                auto trail = uint8_t(src[1]);
+                if ((trail & 0xC0) == 0x80)
+                {
+                    *dst++ = char16_t((lead & 0x1F) << 6 | (trail & 0x3F));
+                    src += 2;
+                    continue;
+                }
+            }
+            else if (lead >= 0xE0 && lead < 0xF0 && available >= 3 && dst != dst_end)
+            {
+                auto t1 = uint8_t(src[1]);
+                auto t2 = uint8_t(src[2]);
+                auto code = char32_t((lead & 0x0F) << 12 | (t1 & 0x3F) << 6 | (t2 & 0x3F));
+                if ((t1 & 0xC0) == 0x80 && (t2 & 0xC0) == 0x80
+                    && code >= 0x800 && !is_surrogate(char16_t(code)) && !is_noncharacter(code))
+                {
+                    *dst++ = char16_t(code);
+                    src += 3;
+                    continue;
+                }
+            }
+            else if (lead >= 0xF0 && lead < 0xF5 && available >= 4 && dst_end - dst >= 2)
+            {
+                auto t1 = uint8_t(src[1]);
+                auto t2 = uint8_t(src[2]);
+                auto t3 = uint8_t(src[3]);
+                auto code = char32_t((lead & 0x07) << 18 | (t1 & 0x3F) << 12 | (t2 & 0x3F) << 6 | (t3 & 0x3F));
+                if ((t1 & 0xC0) == 0x80 && (t2 & 0xC0) == 0x80 && (t3 & 0xC0) == 0x80
+                    && code >= 0x10000 && code < 0x110000 && !is_noncharacter(code))
+                {
+                    dst[0] = char16_t(0xD7C0 + (code >> 10));
+                    dst[1] = char16_t(0xDC00 | (code & 0x3FF));
+                    dst += 2;
+                    src += 4;
+                    continue;
+                }
+            }
+
+            result = transcode_code_point(first, src, src_end, dst, dst_end, state, sanitize);
+        }
+
+        return { result, size_t(src - first), size_t(dst - out.data()) };
+    }
+
+    utf_transcode_result transcode(array_view<const char> in, span<char16_t> out, flags<utf_conversion_options> options) noexcept
+    {
+        return transcode_complete(in, out, options);
+    }
+
+    namespace
+    {
+        // UTF-16 to UTF-8.  Sequences are expanded in 32-bit lanes and then compacted with a
+        // shuffle selected by the encoded lengths of four code units, two bits per unit.
+        using utf16_to_utf8_kernel = void (*)(const char16_t*& in, const char16_t* in_end, char*& out, char* out_end) noexcept;
+
+        void utf16_to_utf8_scalar(const char16_t*&, const char16_t*, char*&, char*) noexcept
+        {
+        }
+
+#if STDEXT_ARCH_X86
+        struct utf8_compact_table
+        {
+            alignas(16) uint8_t shuffle[256][16];
+            uint8_t size[256];
+
+            constexpr utf8_compact_table() noexcept : shuffle(), size()
+            {
+                for (unsigned index = 0; index != 256; ++index)
+                {
+                    unsigned pos = 0;
+                    for (unsigned lane = 0; lane != 4; ++lane)
+                    {
+                        auto length = (index >> 2 * lane) & 3;
+                        for (unsigned n = 0; n != length; ++n)
+                            shuffle[index][pos++] = uint8_t(4 * lane + n);
+                    }
+                    size[index] = uint8_t(pos);
+                    while (pos != 16)
+                        shuffle[index][pos++] = 0x80;
+                }
+            }
+        };
+
+        constexpr utf8_compact_table utf8_compact;
+
+        // Spreads the low four bits of mask to the even bits of the result.
+        constexpr unsigned spread_lanes(unsigned mask) noexcept
+        {
+            return (mask & 1) | (mask & 2) << 1 | (mask & 4) << 2 | (mask & 8) << 3;
         }
 
-        bool utf8_decode_trailing(uint8_t code, utfstate_t& state)
+        // Converts a step of at least one code point from an eight-unit block: a run of ASCII,
+        // up to four BMP code units, or up to four surrogate pairs.  Requires eight units of input
+        // and room for sixteen bytes of output.  Returns false if the block begins with anything
+        // else.
+        STDEXT_TARGET("sse4.1")
+        bool utf16_to_utf8_step_sse41(const char16_t*& in, const char16_t* in_end, char*& out) noexcept
         {
-            if ((code & 0xC0) != 0x80)
+            auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            if (_mm_testz_si128(input, _mm_set1_epi16(short(0xFF80))))
+            {
+                if (in_end - in >= 16)
+                {
+                    auto next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 8));
+                    if (_mm_testz_si128(next, _mm_set1_epi16(short(0xFF80))))
+                    {
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(input, next));
+                        in += 16;
+                        out += 16;
+                        return true;
+                    }
+                }
+
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(input, input));
+                in += 8;
+                out += 8;
+                return true;
+            }
+
+            // Surrogates and noncharacters (U+FDD0-U+FDEF, U+FFFE, U+FFFF) need special handling.
+            auto surrogate = _mm_cmpeq_epi16(_mm_and_si128(input, _mm_set1_epi16(short(0xF800))), _mm_set1_epi16(short(0xD800)));
+            auto offset = _mm_sub_epi16(input, _mm_set1_epi16(short(0xFDD0)));
+            auto nonchar = _mm_or_si128(
+                _mm_cmpeq_epi16(_mm_min_epu16(offset, _mm_set1_epi16(0x1F)), offset),
+                _mm_cmpeq_epi16(_mm_max_epu16(input, _mm_set1_epi16(short(0xFFFE))), input));
+            auto special = unsigned(_mm_movemask_epi8(_mm_packs_epi16(_mm_or_si128(surrogate, nonchar), _mm_setzero_si128())));
+            auto count = std::min(count_trailing_zeros(special | 0x100), 4u);
+            if (count != 0)
+            {
+                auto units = _mm_cvtepu16_epi32(input);
+                auto low6 = _mm_and_si128(units, _mm_set1_epi32(0x3F));
+                auto mid6 = _mm_and_si128(_mm_srli_epi32(units, 6), _mm_set1_epi32(0x3F));
+                auto two = _mm_or_si128(
+                    _mm_or_si128(_mm_srli_epi32(units, 6), _mm_set1_epi32(0x80C0)),
+                    _mm_slli_epi32(low6, 8));
+                auto three = _mm_or_si128(
+                    _mm_or_si128(_mm_srli_epi32(units, 12), _mm_set1_epi32(0x8080E0)),
+                    _mm_or_si128(_mm_slli_epi32(mid6, 8), _mm_slli_epi32(low6, 16)));
+                auto over7f = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x7F));
+                auto over7ff = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x7FF));
+                auto encoded = _mm_blendv_epi8(units, _mm_blendv_epi8(two, three, over7ff), over7f);
+
+                auto index = 0x55 + spread_lanes(unsigned(_mm_movemask_ps(_mm_castsi128_ps(over7f))))
+                    + spread_lanes(unsigned(_mm_movemask_ps(_mm_castsi128_ps(over7ff))));
+                index &= (1u << 2 * count) - 1;
+                auto shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(utf8_compact.shuffle[index]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(encoded, shuffle));
+                in += count;
+                out += utf8_compact.size[index];
+                return true;
+            }
+
+            // Surrogate pairs, viewed as 32-bit lanes.
+            auto valid = _mm_cmpeq_epi32(_mm_and_si128(input, _mm_set1_epi32(int(0xFC00FC00))), _mm_set1_epi32(int(0xDC00D800)));
+            auto code = _mm_or_si128(
+                _mm_slli_epi32(_mm_add_epi32(_mm_and_si128(input, _mm_set1_epi32(0x3FF)), _mm_set1_epi32(0x40)), 10),
+                _mm_and_si128(_mm_srli_epi32(input, 16), _mm_set1_epi32(0x3FF)));
+            valid = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(code, _mm_set1_epi32(0xFFFE)), _mm_set1_epi32(0xFFFE)), valid);
+            auto pairs = count_trailing_zeros(~unsigned(_mm_movemask_ps(_mm_castsi128_ps(valid))) | 0x10);
+            if (pairs == 0)
                 return false;
 
-            state.code <<= 6;
-            state.code |= code & 0x3F;
+            auto encoded = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_srli_epi32(code, 18),
+                    _mm_and_si128(_mm_srli_epi32(code, 4), _mm_set1_epi32(0x3F00))),
+                _mm_or_si128(
+                    _mm_and_si128(_mm_slli_epi32(code, 10), _mm_set1_epi32(0x3F0000)),
+                    _mm_and_si128(_mm_slli_epi32(code, 24), _mm_set1_epi32(0x3F000000))));
+            encoded = _mm_or_si128(encoded, _mm_set1_epi32(int(0x808080F0)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), encoded);
+            in += 2 * pairs;
+            out += 4 * pairs;
             return true;
         }
-    }
-}
+
+        STDEXT_TARGET("sse4.1")
+        void utf16_to_utf8_sse41(const char16_t*& in, const char16_t* in_end, char*& out, char* out_end) noexcept
+        {
+            while (in_end - in >= 8 && out_end - out >= 16)
+            {
+                if (!utf16_to_utf8_step_sse41(in, in_end, out))
+                    break;
+            }
+        }
+
+        STDEXT_TARGET("avx2")
+        void utf16_to_utf8_avx2(const char16_t*& in, const char16_t* in_end, char*& out, char* out_end) noexcept
+        {
+            while (in_end - in >= 8 && out_end - out >= 16)
+            {
+                if (in_end - in >= 32 && out_end - out >= 32)
+                {
+                    auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+                    auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 16));
+                    if (_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_set1_epi16(short(0xFF80))))
+                    {
+                        auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+                        in += 32;
+                        out += 32;
+                        continue;
+                    }
+                }
+
+                _mm256_zeroupper();
+                if (!utf16_to_utf8_step_sse41(in, in_end, out))
+                    break;
+            }
+        }
+#endif
+
+        utf16_to_utf8_kernel select_utf16_to_utf8_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return utf16_to_utf8_avx2;
+            if (_private::cpu().sse41)
+                return utf16_to_utf8_sse41;
+#endif
+            return utf16_to_utf8_scalar;
+        }
+    }
+
+    utf_transcode_result transcode(array_view<const char16_t> in, span<char> out, utfstate_t& state, flags<utf_conversion_options> options) noexcept
+    {
+        static const utf16_to_utf8_kernel kernel = select_utf16_to_utf8_kernel();
+
+        bool sanitize = options.test_any(utf_conversion_options::sanitize);
+        auto first = in.data();
+        auto src = first;
+        auto src_end = first + in.size();
+        auto dst = out.data();
+        auto dst_end = dst + out.size();
+
+        auto result = utf_result::ok;
+        if (state.consumed != 0 || state.produced != 0 || state.error)
+            result = transcode_code_point(first, src, src_end, dst, dst_end, state, sanitize);
+
+        while (result == utf_result::ok && src != src_end)
+        {
+            kernel(src, src_end, dst, dst_end);
+            if (src == src_end)
+                break;
+
+            // Encode one code point; anything unusual goes through the slow path.
+            auto unit = *src;
+            auto room = dst_end - dst;
+            if (unit < 0x80 && room >= 1)
+            {
+                *dst++ = char(unit);
+                ++src;
+                continue;
+            }
+
+            if (unit < 0x800 && room >= 2)
+            {
+                dst[0] = char(0xC0 | unit >> 6);
+                dst[1] = char(0x80 | (unit & 0x3F));
+                dst += 2;
+                ++src;
+                continue;
+            }
+
+            if (unit >= 0x800 && !is_surrogate(unit) && !is_noncharacter(unit) && room >= 3)
+            {
+                dst[0] = char(0xE0 | unit >> 12);
+                dst[1] = char(0x80 | ((unit >> 6) & 0x3F));
+                dst[2] = char(0x80 | (unit & 0x3F));
+                dst += 3;
+                ++src;
+                continue;
+            }
+
+            if (is_leading_surrogate(unit) && src_end - src >= 2 && is_trailing_surrogate(src[1]) && room >= 4)
+            {
+                auto code = char32_t((unit & 0x3FF) + 0x40) << 10 | (src[1] & 0x3FF);
+                if (!is_noncharacter(code))
+                {
+                    dst[0] = char(0xF0 | code >> 18);
+                    dst[1] = char(0x80 | ((code >> 12) & 0x3F));
+                    dst[2] = char(0x80 | ((code >> 6) & 0x3F));
+                    dst[3] = char(0x80 | (code & 0x3F));
+                    dst += 4;
+                    src += 2;
+                    continue;
+                }
+            }
+
+            result = transcode_code_point(first, src, src_end, dst, dst_end, state, sanitize);
+        }
+
+        return { result, size_t(src - first), size_t(dst - out.data()) };
+    }
+
+    utf_transcode_result transcode(array_view<const char16_t> in, span<char> out, flags<utf_conversion_options> options) noexcept
+    {
+        return transcode_complete(in, out, options);
+    }
+
+    namespace
+    {
+        // UTF-16 validation.  The vector kernels pass over blocks in which every leading surrogate
+        // is immediately followed by a trailing surrogate and no code unit could be part of a
+        // noncharacter; any other block is examined by the scalar validator.
+        constexpr size_t utf16_block_size = 32;
+
+        using utf16_validate_kernel = size_t (*)(const char16_t* str, size_t size, size_t pos) noexcept;
+
+        // Validates the code points beginning in [pos, end), stopping at the first error.  Returns
+        // the position following the last code point validated.
+        std::pair<utf_result, size_t> utf16_validate_scalar(const char16_t* str, size_t size, size_t pos, size_t end) noexcept
+        {
+            while (pos < end)
+            {
+                auto code = str[pos];
+                if (!is_surrogate(code))
+                {
+                    if (is_noncharacter(code))
+                        return { utf_result::error, pos };
+                    ++pos;
+                    continue;
+                }
+
+                if (is_trailing_surrogate(code))
+                    return { utf_result::error, pos };
+                if (pos + 1 == size)
+                    return { utf_result::partial_read, pos };
+                if (!is_trailing_surrogate(str[pos + 1]))
+                    return { utf_result::error, pos };
+                if (is_noncharacter(char32_t((code & 0x3FF) + 0x40) << 10 | (str[pos + 1] & 0x3FF)))
+                    return { utf_result::error, pos };
+                pos += 2;
+            }
+
+            return { utf_result::ok, pos };
+        }
+
+        // Returns true if a block with the given masks of leading surrogates, trailing surrogates,
+        // and possible noncharacters needs no further examination.
+        constexpr bool utf16_block_is_valid(uint32_t leading, uint32_t trailing, uint32_t suspect) noexcept
+        {
+            return suspect == 0 && trailing == leading << 1 && (leading & 0x80000000) == 0;
+        }
+
+        size_t utf16_validate_blocks_scalar(const char16_t*, size_t, size_t pos) noexcept
+        {
+            return pos;
+        }
+
+#if STDEXT_ARCH_X86
+        // Masks of leading surrogates, trailing surrogates, and code units that may be part of a
+        // noncharacter (U+FDD0-U+FDEF, U+FFFE, U+FFFF, and trailing surrogates DFFE and DFFF).
+        STDEXT_TARGET("sse4.1")
+        void utf16_classify_sse41(__m128i input, __m128i& leading, __m128i& trailing, __m128i& suspect) noexcept
+        {
+            auto surrogate = _mm_and_si128(input, _mm_set1_epi16(short(0xFC00)));
+            leading = _mm_cmpeq_epi16(surrogate, _mm_set1_epi16(short(0xD800)));
+            trailing = _mm_cmpeq_epi16(surrogate, _mm_set1_epi16(short(0xDC00)));
+            auto offset = _mm_sub_epi16(input, _mm_set1_epi16(short(0xFDD0)));
+            suspect = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi16(_mm_min_epu16(offset, _mm_set1_epi16(0x1F)), offset),
+                    _mm_cmpeq_epi16(_mm_max_epu16(input, _mm_set1_epi16(short(0xFFFE))), input)),
+                _mm_cmpeq_epi16(_mm_or_si128(input, _mm_set1_epi16(1)), _mm_set1_epi16(short(0xDFFF))));
+        }
+
+        STDEXT_TARGET("sse4.1")
+        uint32_t utf16_mask_sse41(__m128i a, __m128i b, __m128i c, __m128i d) noexcept
+        {
+            return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(a, b)))
+                | uint32_t(_mm_movemask_epi8(_mm_packs_epi16(c, d))) << 16;
+        }
+
+        STDEXT_TARGET("sse4.1")
+        size_t utf16_validate_blocks_sse41(const char16_t* str, size_t size, size_t pos) noexcept
+        {
+            for (; size - pos >= utf16_block_size; pos += utf16_block_size)
+            {
+                __m128i leading[4], trailing[4], suspect[4];
+                for (size_t n = 0; n != 4; ++n)
+                {
+                    auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + pos + 8 * n));
+                    utf16_classify_sse41(input, leading[n], trailing[n], suspect[n]);
+                }
+
+                if (!utf16_block_is_valid(
+                    utf16_mask_sse41(leading[0], leading[1], leading[2], leading[3]),
+                    utf16_mask_sse41(trailing[0], trailing[1], trailing[2], trailing[3]),
+                    utf16_mask_sse41(suspect[0], suspect[1], suspect[2], suspect[3])))
+                {
+                    break;
+                }
+            }
+            return pos;
+        }
+
+        STDEXT_TARGET("avx2")
+        void utf16_classify_avx2(__m256i input, __m256i& leading, __m256i& trailing, __m256i& suspect) noexcept
+        {
+            auto surrogate = _mm256_and_si256(input, _mm256_set1_epi16(short(0xFC00)));
+            leading = _mm256_cmpeq_epi16(surrogate, _mm256_set1_epi16(short(0xD800)));
+            trailing = _mm256_cmpeq_epi16(surrogate, _mm256_set1_epi16(short(0xDC00)));
+            auto offset = _mm256_sub_epi16(input, _mm256_set1_epi16(short(0xFDD0)));
+            suspect = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi16(_mm256_min_epu16(offset, _mm256_set1_epi16(0x1F)), offset),
+                    _mm256_cmpeq_epi16(_mm256_max_epu16(input, _mm256_set1_epi16(short(0xFFFE))), input)),
+                _mm256_cmpeq_epi16(_mm256_or_si256(input, _mm256_set1_epi16(1)), _mm256_set1_epi16(short(0xDFFF))));
+        }
+
+        STDEXT_TARGET("avx2")
+        uint32_t utf16_mask_avx2(__m256i a, __m256i b) noexcept
+        {
+            // Packing interleaves the 128-bit halves; restore the original order.
+            return uint32_t(_mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8)));
+        }
+
+        STDEXT_TARGET("avx2")
+        size_t utf16_validate_blocks_avx2(const char16_t* str, size_t size, size_t pos) noexcept
+        {
+            for (; size - pos >= utf16_block_size; pos += utf16_block_size)
+            {
+                __m256i leading[2], trailing[2], suspect[2];
+                for (size_t n = 0; n != 2; ++n)
+                {
+                    auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + pos + 16 * n));
+                    utf16_classify_avx2(input, leading[n], trailing[n], suspect[n]);
+                }
+
+                if (!utf16_block_is_valid(
+                    utf16_mask_avx2(leading[0], leading[1]),
+                    utf16_mask_avx2(trailing[0], trailing[1]),
+                    utf16_mask_avx2(suspect[0], suspect[1])))
+                {
+                    break;
+                }
+            }
+            return pos;
+        }
+#endif
+
+        utf16_validate_kernel select_utf16_validate_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return utf16_validate_blocks_avx2;
+            if (_private::cpu().sse41)
+                return utf16_validate_blocks_sse41;
+#endif
+            return utf16_validate_blocks_scalar;
+        }
+    }
+
+    std::pair<utf_result, size_t> utf16_validate(array_view<const char16_t> str) noexcept
+    {
+        static const utf16_validate_kernel kernel = select_utf16_validate_kernel();
+
+        auto data = str.data();
+        auto size = str.size();
+        size_t pos = 0;
+        while (true)
+        {
+            // Blocks passed over by the kernel end on code point boundaries.
+            pos = kernel(data, size, pos);
+            auto end = size - pos >= utf16_block_size ? pos + utf16_block_size : size;
+            auto result = utf16_validate_scalar(data, size, pos, end);
+            if (result.first != utf_result::ok || result.second >= size)
+                return result;
+            pos = result.second;
+        }
+    }
+
+    namespace
+    {
+        // Length computation.  For well-formed input, the length of the output in any encoding
+        // follows from a few counts over the input code units:
+        //   UTF-8 to UTF-32: the number of lead bytes (bytes other than 10xxxxxx);
+        //   UTF-8 to UTF-16: the same, plus the number of four-byte lead bytes (11110xxx);
+        //   UTF-16 to UTF-32: the number of code units that are not trailing surrogates;
+        //   UTF-16 to UTF-8: three per code unit, less one for each code unit below U+0080, one
+        //     for each below U+0800, and one for each surrogate.
+        // Input is validated in chunks small enough to remain in cache while they are counted.
+        // Invalid sequences are counted with the code-unit-at-a-time functions.
+        constexpr size_t utf_length_chunk_size = 16384;
+
+        struct utf8_counts
+        {
+            size_t leads = 0;
+            size_t leads4 = 0;
+        };
+
+        struct utf16_counts
+        {
+            size_t units = 0;
+            size_t ascii = 0;
+            size_t two_byte = 0;            // code units below U+0800, including ASCII
+            size_t surrogates = 0;
+        };
+
+        using utf8_count_kernel = void (*)(const uint8_t* str, size_t size, utf8_counts& counts) noexcept;
+        using utf16_count_kernel = void (*)(const char16_t* str, size_t size, utf16_counts& counts) noexcept;
+
+        void utf8_count_scalar(const uint8_t* str, size_t size, utf8_counts& counts) noexcept
+        {
+            for (size_t n = 0; n != size; ++n)
+            {
+                counts.leads += int8_t(str[n]) > -65;
+                counts.leads4 += str[n] >= 0xF0;
+            }
+        }
+
+        void utf16_count_scalar(const char16_t* str, size_t size, utf16_counts& counts) noexcept
+        {
+            counts.units += size;
+            for (size_t n = 0; n != size; ++n)
+            {
+                counts.ascii += str[n] < 0x80;
+                counts.two_byte += str[n] < 0x800;
+                counts.surrogates += is_surrogate(str[n]);
+            }
+        }
+
+#if STDEXT_ARCH_X86
+        STDEXT_TARGET("sse4.1")
+        size_t horizontal_sum_epi32(__m128i v) noexcept
+        {
+            return size_t(uint32_t(_mm_extract_epi32(v, 0))) + uint32_t(_mm_extract_epi32(v, 1))
+                + uint32_t(_mm_extract_epi32(v, 2)) + uint32_t(_mm_extract_epi32(v, 3));
+        }
+
+        STDEXT_TARGET("sse4.1")
+        void utf8_count_sse41(const uint8_t* str, size_t size, utf8_counts& counts) noexcept
+        {
+            size_t n = 0;
+            while (size - n >= 16)
+            {
+                // Eight-bit counters, flushed before they can overflow.
+                auto leads = _mm_setzero_si128();
+                auto leads4 = _mm_setzero_si128();
+                auto blocks = std::min((size - n) / 16, size_t(255));
+                for (size_t b = 0; b != blocks; ++b, n += 16)
+                {
+                    auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + n));
+                    leads = _mm_sub_epi8(leads, _mm_cmpgt_epi8(input, _mm_set1_epi8(-65)));
+                    leads4 = _mm_sub_epi8(leads4, _mm_cmpeq_epi8(_mm_max_epu8(input, _mm_set1_epi8(char(0xF0))), input));
+                }
+                counts.leads += horizontal_sum_epi32(_mm_sad_epu8(leads, _mm_setzero_si128()));
+                counts.leads4 += horizontal_sum_epi32(_mm_sad_epu8(leads4, _mm_setzero_si128()));
+            }
+            utf8_count_scalar(str + n, size - n, counts);
+        }
+
+        STDEXT_TARGET("sse4.1")
+        void utf16_count_sse41(const char16_t* str, size_t size, utf16_counts& counts) noexcept
+        {
+            size_t n = 0;
+            while (size - n >= 8)
+            {
+                // Sixteen-bit counters, flushed before they can overflow.
+                auto ascii = _mm_setzero_si128();
+                auto two_byte = _mm_setzero_si128();
+                auto surrogates = _mm_setzero_si128();
+                auto blocks = std::min((size - n) / 8, size_t(4096));
+                for (size_t b = 0; b != blocks; ++b, n += 8)
+                {
+                    auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + n));
+                    ascii = _mm_sub_epi16(ascii, _mm_cmpeq_epi16(_mm_and_si128(input, _mm_set1_epi16(short(0xFF80))), _mm_setzero_si128()));
+                    auto high = _mm_and_si128(input, _mm_set1_epi16(short(0xF800)));
+                    two_byte = _mm_sub_epi16(two_byte, _mm_cmpeq_epi16(high, _mm_setzero_si128()));
+                    surrogates = _mm_sub_epi16(surrogates, _mm_cmpeq_epi16(high, _mm_set1_epi16(short(0xD800))));
+                }
+                counts.units += blocks * 8;
+                counts.ascii += horizontal_sum_epi32(_mm_madd_epi16(ascii, _mm_set1_epi16(1)));
+                counts.two_byte += horizontal_sum_epi32(_mm_madd_epi16(two_byte, _mm_set1_epi16(1)));
+                counts.surrogates += horizontal_sum_epi32(_mm_madd_epi16(surrogates, _mm_set1_epi16(1)));
+            }
+            utf16_count_scalar(str + n, size - n, counts);
+        }
+
+        STDEXT_TARGET("avx2")
+        size_t horizontal_sum_epi32(__m256i v) noexcept
+        {
+            auto sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+            return uint32_t(_mm_cvtsi128_si32(sum));
+        }
+
+        STDEXT_TARGET("avx2")
+        void utf8_count_avx2(const uint8_t* str, size_t size, utf8_counts& counts) noexcept
+        {
+            size_t n = 0;
+            while (size - n >= 32)
+            {
+                auto leads = _mm256_setzero_si256();
+                auto leads4 = _mm256_setzero_si256();
+                auto blocks = std::min((size - n) / 32, size_t(255));
+                for (size_t b = 0; b != blocks; ++b, n += 32)
+                {
+                    auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + n));
+                    leads = _mm256_sub_epi8(leads, _mm256_cmpgt_epi8(input, _mm256_set1_epi8(-65)));
+                    leads4 = _mm256_sub_epi8(leads4, _mm256_cmpeq_epi8(_mm256_max_epu8(input, _mm256_set1_epi8(char(0xF0))), input));
+                }
+                counts.leads += horizontal_sum_epi32(_mm256_sad_epu8(leads, _mm256_setzero_si256()));
+                counts.leads4 += horizontal_sum_epi32(_mm256_sad_epu8(leads4, _mm256_setzero_si256()));
+            }
+            utf8_count_sse41(str + n, size - n, counts);
+        }
+
+        STDEXT_TARGET("avx2")
+        void utf16_count_avx2(const char16_t* str, size_t size, utf16_counts& counts) noexcept
+        {
+            size_t n = 0;
+            while (size - n >= 16)
+            {
+                auto ascii = _mm256_setzero_si256();
+                auto two_byte = _mm256_setzero_si256();
+                auto surrogates = _mm256_setzero_si256();
+                auto blocks = std::min((size - n) / 16, size_t(4096));
+                for (size_t b = 0; b != blocks; ++b, n += 16)
+                {
+                    auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + n));
+                    ascii = _mm256_sub_epi16(ascii, _mm256_cmpeq_epi16(_mm256_and_si256(input, _mm256_set1_epi16(short(0xFF80))), _mm256_setzero_si256()));
+                    auto high = _mm256_and_si256(input, _mm256_set1_epi16(short(0xF800)));
+                    two_byte = _mm256_sub_epi16(two_byte, _mm256_cmpeq_epi16(high, _mm256_setzero_si256()));
+                    surrogates = _mm256_sub_epi16(surrogates, _mm256_cmpeq_epi16(high, _mm256_set1_epi16(short(0xD800))));
+                }
+                counts.units += blocks * 16;
+                counts.ascii += horizontal_sum_epi32(_mm256_madd_epi16(ascii, _mm256_set1_epi16(1)));
+                counts.two_byte += horizontal_sum_epi32(_mm256_madd_epi16(two_byte, _mm256_set1_epi16(1)));
+                counts.surrogates += horizontal_sum_epi32(_mm256_madd_epi16(surrogates, _mm256_set1_epi16(1)));
+            }
+            utf16_count_sse41(str + n, size - n, counts);
+        }
+#endif
+
+        utf8_count_kernel select_utf8_count_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return utf8_count_avx2;
+            if (_private::cpu().sse41)
+                return utf8_count_sse41;
+#endif
+            return utf8_count_scalar;
+        }
+
+        utf16_count_kernel select_utf16_count_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return utf16_count_avx2;
+            if (_private::cpu().sse41)
+                return utf16_count_sse41;
+#endif
+            return utf16_count_scalar;
+        }
+
+        void utf_count(const char* str, size_t size, utf8_counts& counts) noexcept
+        {
+            static const utf8_count_kernel kernel = select_utf8_count_kernel();
+            kernel(reinterpret_cast<const uint8_t*>(str), size, counts);
+        }
+
+        void utf_count(const char16_t* str, size_t size, utf16_counts& counts) noexcept
+        {
+            static const utf16_count_kernel kernel = select_utf16_count_kernel();
+            kernel(str, size, counts);
+        }
+
+        std::pair<utf_result, size_t> utf_validate(array_view<const char> str) noexcept
+        {
+            return utf8_validate(str);
+        }
+
+        std::pair<utf_result, size_t> utf_validate(array_view<const char16_t> str) noexcept
+        {
+            return utf16_validate(str);
+        }
+
+        template <typename OutChar>
+        size_t utf_length(const utf8_counts& counts, size_t units) noexcept
+        {
+            if constexpr (std::is_same_v<OutChar, char>)
+                return units;
+            else if constexpr (std::is_same_v<OutChar, char16_t>)
+                return counts.leads + counts.leads4;
+            else
+                return counts.leads;
+        }
+
+        template <typename OutChar>
+        size_t utf_length(const utf16_counts& counts, size_t) noexcept
+        {
+            if constexpr (std::is_same_v<OutChar, char>)
+                return 3 * counts.units - counts.ascii - counts.two_byte - counts.surrogates;
+            else if constexpr (std::is_same_v<OutChar, char16_t>)
+                return counts.units;
+            else
+                return counts.units - counts.surrogates / 2;
+        }
+
+        template <typename OutChar, typename InChar>
+        std::pair<utf_result, size_t> utf_length(array_view<const InChar> in, flags<utf_conversion_options> options) noexcept
+        {
+            using counts_type = std::conditional_t<std::is_same_v<InChar, char>, utf8_counts, utf16_counts>;
+
+            auto data = in.data();
+            auto size = in.size();
+            if (options.test_any(utf_conversion_options::assume_valid))
+            {
+                counts_type counts;
+                utf_count(data, size, counts);
+                return { utf_result::ok, utf_length<OutChar>(counts, size) };
+            }
+
+            bool sanitize = options.test_any(utf_conversion_options::sanitize);
+            size_t length = 0;
+            size_t pos = 0;
+            while (pos != size)
+            {
+                auto end = size - pos > utf_length_chunk_size ? pos + utf_length_chunk_size : size;
+                auto [result, valid] = utf_validate(array_view<const InChar>(data + pos, end - pos));
+
+                counts_type counts;
+                utf_count(data + pos, valid, counts);
+                length += utf_length<OutChar>(counts, valid);
+                pos += valid;
+
+                // A sequence that continues into the next chunk is validated with that chunk.
+                if (result == utf_result::ok || (result == utf_result::partial_read && end != size))
+                    continue;
+                if (result == utf_result::partial_read || !sanitize)
+                    return { result, length };
+
+                // Count the replacement for the invalid sequence.
+                OutChar buffer[8];
+                auto out = buffer;
+                auto next = data + pos;
+                utfstate_t state;
+                transcode_code_point(next, next, data + size, out, buffer + std::size(buffer), state, true);
+                length += size_t(out - buffer);
+                pos = size_t(next - data);
+            }
+
+            return { utf_result::ok, length };
+        }
+    }
+
+    std::pair<utf_result, size_t> to_utf8_length(array_view<const char> in, flags<utf_conversion_options> options) noexcept
+    {
+        return utf_length<char>(in, options);
+    }
+
+    std::pair<utf_result, size_t> to_utf8_length(array_view<const char16_t> in, flags<utf_conversion_options> options) noexcept
+    {
+        return utf_length<char>(in, options);
+    }
+
+    std::pair<utf_result, size_t> to_utf16_length(array_view<const char> in, flags<utf_conversion_options> options) noexcept
+    {
+        return utf_length<char16_t>(in, options);
+    }
+
+    std::pair<utf_result, size_t> to_utf16_length(array_view<const char16_t> in, flags<utf_conversion_options> options) noexcept
+    {
+        return utf_length<char16_t>(in, options);
+    }
+
+    std::pair<utf_result, size_t> to_utf32_length(array_view<const char> in, flags<utf_conversion_options> options) noexcept
+    {
+        return utf_length<char32_t>(in, options);
+    }
+
+    std::pair<utf_result, size_t> to_utf32_length(array_view<const char16_t> in, flags<utf_conversion_options> options) noexcept
+    {
+        return utf_length<char32_t>(in, options);
+    }
+
+    namespace
+    {
+        // Input is not split into chunks smaller than this.
+        constexpr size_t parallel_chunk_size = size_t(1) << 20;
+
+        // Chunks per thread, so that a thread given easy chunks can help with the rest.
+        constexpr size_t parallel_chunks_per_thread = 4;
+
+        unsigned thread_count(unsigned threads) noexcept
+        {
+            if (threads == 0)
+                threads = std::thread::hardware_concurrency();
+            return std::max(threads, 1u);
+        }
+
+        // Returns the boundaries of the chunks of str, each of which begins at the first byte at
+        // or after its nominal position that is not a trailing byte.  A chunk that ends partway
+        // through a sequence is therefore followed by a byte that cannot complete it.
+        std::vector<size_t> split_utf8(array_view<const char> str, unsigned threads)
+        {
+            auto count = std::clamp(str.size() / parallel_chunk_size, size_t(1), size_t(threads) * parallel_chunks_per_thread);
+            if (threads == 1)
+                count = 1;
+
+            std::vector<size_t> bounds;
+            bounds.reserve(count + 1);
+            bounds.push_back(0);
+            for (size_t n = 1; n != count; ++n)
+            {
+                auto pos = std::max(bounds.back(), str.size() / count * n);
+                while (pos != str.size() && utf8_is_trailing(str[pos]))
+                    ++pos;
+                if (pos != bounds.back() && pos != str.size())
+                    bounds.push_back(pos);
+            }
+            bounds.push_back(str.size());
+            return bounds;
+        }
+
+        // Calls f(n) for each n in [0, count) on up to the given number of threads, including the
+        // calling thread.  f must not throw.
+        template <typename F>
+        void parallel_for(size_t count, unsigned threads, F&& f)
+        {
+            std::atomic<size_t> next(0);
+            auto work = [&]
+            {
+                for (size_t n; (n = next++) < count; )
+                    f(n);
+            };
+
+            std::vector<std::thread> workers;
+            workers.reserve(threads - 1);
+            at_scope_exit([&]
+            {
+                for (auto& worker : workers)
+                    worker.join();
+            });
+
+            for (size_t n = 1; n < std::min(count, size_t(threads)); ++n)
+                workers.emplace_back(work);
+            work();
+        }
+    }
+
+    std::pair<utf_result, size_t> utf8_validate_parallel(array_view<const char> str, unsigned threads)
+    {
+        threads = thread_count(threads);
+        auto bounds = split_utf8(str, threads);
+        auto chunks = bounds.size() - 1;
+        if (chunks == 1)
+            return utf8_validate(str);
+
+        std::vector<std::pair<utf_result, size_t>> results(chunks);
+        parallel_for(chunks, threads, [&](size_t n)
+        {
+            results[n] = utf8_validate(array_view<const char>(str.data() + bounds[n], bounds[n + 1] - bounds[n]));
+        });
+
+        for (size_t n = 0; n != chunks; ++n)
+        {
+            auto [result, pos] = results[n];
+            if (result == utf_result::ok)
+                continue;
+
+            // A sequence cut short by the end of a chunk is cut short in the whole.
+            if (n != chunks - 1)
+                result = utf_result::error;
+            return { result, bounds[n] + pos };
+        }
+        return { utf_result::ok, str.size() };
+    }
+
+    std::pair<utf_result, size_t> to_utf16_length_parallel(array_view<const char> in, flags<utf_conversion_options> options, unsigned threads)
+    {
+        threads = thread_count(threads);
+        auto bounds = split_utf8(in, threads);
+        auto chunks = bounds.size() - 1;
+        if (chunks == 1)
+            return to_utf16_length(in, options);
+
+        std::vector<std::pair<utf_result, size_t>> results(chunks);
+        parallel_for(chunks, threads, [&](size_t n)
+        {
+            results[n] = to_utf16_length(array_view<const char>(in.data() + bounds[n], bounds[n + 1] - bounds[n]), options);
+        });
+
+        bool sanitize = options.test_any(utf_conversion_options::sanitize);
+        size_t length = 0;
+        for (size_t n = 0; n != chunks; ++n)
+        {
+            auto [result, count] = results[n];
+            length += count;
+            if (result == utf_result::ok)
+                continue;
+
+            if (n != chunks - 1)
+            {
+                // A sequence cut short by the end of a chunk is replaced by a single U+FFFD.
+                if (sanitize)
+                {
+                    ++length;
+                    continue;
+                }
+                result = utf_result::error;
+            }
+            return { result, length };
+        }
+        return { utf_result::ok, length };
+    }
+
+    utf_transcode_result transcode_parallel(array_view<const char> in, span<char16_t> out, flags<utf_conversion_options> options, unsigned threads)
+    {
+        threads = thread_count(threads);
+        auto bounds = split_utf8(in, threads);
+        auto chunks = bounds.size() - 1;
+        if (chunks == 1)
+            return transcode(in, out, options);
+
+        bool sanitize = options.test_any(utf_conversion_options::sanitize);
+        flags<utf_conversion_options> convert_options = sanitize ? utf_conversion_options::sanitize : utf_conversion_options::none;
+        auto chunk = [&](size_t n) { return array_view<const char>(in.data() + bounds[n], bounds[n + 1] - bounds[n]); };
+
+        std::vector<std::pair<utf_result, size_t>> lengths(chunks);
+        parallel_for(chunks, threads, [&](size_t n)
+        {
+            lengths[n] = to_utf16_length(chunk(n), convert_options);
+        });
+
+        // Each chunk is converted into the output following that of the previous chunk.  Only
+        // the chunks up to the first one that is invalid or does not fit are converted; the last
+        // of these is given the rest of the output, and determines the result.
+        std::vector<size_t> offsets(chunks + 1);
+        auto count = chunks;
+        for (size_t n = 0; n != chunks; ++n)
+        {
+            auto [result, length] = lengths[n];
+            if (result == utf_result::partial_read && sanitize)
+                ++length;
+            offsets[n + 1] = offsets[n] + length;
+            if ((result != utf_result::ok && !sanitize && n != chunks - 1) || result == utf_result::error || offsets[n + 1] > out.size())
+            {
+                count = n + 1;
+                break;
+            }
+        }
+
+        std::vector<utf_transcode_result> results(count);
+        parallel_for(count, threads, [&](size_t n)
+        {
+            auto end = n == count - 1 ? out.size() : offsets[n + 1];
+            results[n] = transcode(chunk(n), span<char16_t>(out.data() + offsets[n], end - offsets[n]), convert_options);
+        });
+
+        auto result = results[count - 1];
+        if (result.result == utf_result::partial_read && count != chunks)
+            result.result = utf_result::error;
+        return { result.result, bounds[count - 1] + result.consumed, offsets[count - 1] + result.produced };
+    }
+
+    namespace
+    {
+        unsigned count_bits(uint64_t v) noexcept
+        {
+#if STDEXT_COMPILER_GCC
+            return unsigned(__builtin_popcountll(v));
+#else
+            v -= v >> 1 & 0x5555555555555555;
+            v = (v & 0x3333333333333333) + (v >> 2 & 0x3333333333333333);
+            v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0F;
+            return unsigned(v * 0x0101010101010101 >> 56);
+#endif
+        }
+
+        // Returns the position of the nth set bit of v, which must have more than n set bits.
+        unsigned select_bit(uint64_t v, size_t n) noexcept
+        {
+            for (; n != 0; --n)
+                v &= v - 1;
+            return count_trailing_zeros(v);
+        }
+
+        // The index classifies text 64 bytes at a time, producing a mask with a bit set for each
+        // byte that begins a code point.
+        using utf8_lead_mask_kernel = void (*)(const uint8_t* str, size_t blocks, uint64_t* masks) noexcept;
+
+        uint64_t utf8_lead_mask(const uint8_t* str, size_t size) noexcept
+        {
+            uint64_t mask = 0;
+            for (size_t n = 0; n != size; ++n)
+                mask |= uint64_t(int8_t(str[n]) > -65) << n;
+            return mask;
+        }
+
+        void utf8_lead_masks_scalar(const uint8_t* str, size_t blocks, uint64_t* masks) noexcept
+        {
+            for (size_t b = 0; b != blocks; ++b)
+                masks[b] = utf8_lead_mask(str + b * 64, 64);
+        }
+
+#if STDEXT_ARCH_X86
+        STDEXT_TARGET("sse4.1")
+        void utf8_lead_masks_sse41(const uint8_t* str, size_t blocks, uint64_t* masks) noexcept
+        {
+            auto limit = _mm_set1_epi8(-65);
+            for (size_t b = 0; b != blocks; ++b, str += 64)
+            {
+                uint64_t mask = 0;
+                for (int n = 0; n != 4; ++n)
+                {
+                    auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + 16 * n));
+                    mask |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpgt_epi8(input, limit)))) << 16 * n;
+                }
+                masks[b] = mask;
+            }
+        }
+
+        STDEXT_TARGET("avx2")
+        void utf8_lead_masks_avx2(const uint8_t* str, size_t blocks, uint64_t* masks) noexcept
+        {
+            auto limit = _mm256_set1_epi8(-65);
+            for (size_t b = 0; b != blocks; ++b, str += 64)
+            {
+                auto low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str));
+                auto high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + 32));
+                masks[b] = uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpgt_epi8(low, limit))))
+                    | uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpgt_epi8(high, limit)))) << 32;
+            }
+        }
+#endif
+
+        utf8_lead_mask_kernel select_utf8_lead_mask_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return utf8_lead_masks_avx2;
+            if (_private::cpu().sse41)
+                return utf8_lead_masks_sse41;
+#endif
+            return utf8_lead_masks_scalar;
+        }
+
+        void utf8_lead_masks(const uint8_t* str, size_t blocks, uint64_t* masks) noexcept
+        {
+            static const utf8_lead_mask_kernel kernel = select_utf8_lead_mask_kernel();
+            kernel(str, blocks, masks);
+        }
+
+        // Indexes one segment in a single pass, returning the number of code points in it.
+        size_t utf8_index_segment(const uint8_t* str, size_t size, std::vector<uint32_t>& offsets, std::vector<uint32_t>& counts)
+        {
+            constexpr size_t interval = utf8_index::checkpoint_interval;
+            static_assert(interval % 64 == 0);
+
+            offsets.clear();
+            counts.clear();
+            offsets.reserve(size / interval + 1);
+            counts.reserve(size / interval + 1);
+
+            size_t code_points = 0;
+            size_t next = 0;
+            uint64_t masks[64];
+            for (size_t pos = 0; pos != size; )
+            {
+                auto blocks = std::min((size - pos) / 64, std::size(masks));
+                auto bytes = blocks * 64;
+                if (blocks != 0)
+                    utf8_lead_masks(str + pos, blocks, masks);
+                else
+                {
+                    masks[0] = utf8_lead_mask(str + pos, size - pos);
+                    blocks = 1;
+                    bytes = size - pos;
+                }
+
+                for (size_t b = 0; b != blocks; ++b)
+                {
+                    auto block = pos + b * 64;
+                    if (block % interval == 0)
+                        counts.push_back(uint32_t(code_points));
+
+                    auto count = count_bits(masks[b]);
+                    for (; next < code_points + count; next += interval)
+                        offsets.push_back(uint32_t(block + select_bit(masks[b], next - code_points)));
+                    code_points += count;
+                }
+                pos += bytes;
+            }
+            return code_points;
+        }
+
+        // Returns the offset of the nth code point to begin in str, which must have more than n.
+        size_t utf8_find_code_point(const uint8_t* str, size_t size, size_t n) noexcept
+        {
+            size_t pos = 0;
+            uint64_t masks[16];
+            while (size - pos >= 64)
+            {
+                auto blocks = std::min((size - pos) / 64, std::size(masks));
+                utf8_lead_masks(str + pos, blocks, masks);
+                for (size_t b = 0; b != blocks; ++b, pos += 64)
+                {
+                    auto count = count_bits(masks[b]);
+                    if (n < count)
+                        return pos + select_bit(masks[b], n);
+                    n -= count;
+                }
+            }
+            return pos + select_bit(utf8_lead_mask(str + pos, size - pos), n);
+        }
+    }
+
+    void utf8_index::update(array_view<const char> str, size_t offset, size_t erased, size_t inserted)
+    {
+        assert(offset + erased <= size_bytes());
+        assert(str.size() == size_bytes() - erased + inserted);
+
+        // Find the segments touched by the edit, including a neighbor if they would end up small.
+        auto count = _segments.size();
+        size_t first = 0;
+        size_t last = 0;
+        if (count != 0)
+        {
+            auto find = [&](size_t pos)
+            {
+                auto s = size_t(std::upper_bound(_byte_starts.begin(), _byte_starts.end(), pos) - _byte_starts.begin()) - 1;
+                return std::min(s, count - 1);
+            };
+            first = find(offset);
+            last = (erased == 0 ? first : find(offset + erased - 1)) + 1;
+        }
+
+        auto start = _byte_starts[first];
+        auto end = _byte_starts[last] - erased + inserted;
+        if (end - start < segment_size / 2)
+        {
+            if (last != count)
+            {
+                ++last;
+                end = _byte_starts[last] - erased + inserted;
+            }
+            else if (first != 0)
+                start = _byte_starts[--first];
+        }
+
+        // Reindex the text between start and end in roughly equal pieces.
+        auto data = reinterpret_cast<const uint8_t*>(str.data());
+        auto length = end - start;
+        auto pieces = (length + segment_size - 1) / segment_size;
+        std::vector<segment> segments(pieces);
+        std::vector<size_t> byte_starts(_byte_starts.begin(), _byte_starts.begin() + first + 1);
+        std::vector<size_t> code_point_starts(_code_point_starts.begin(), _code_point_starts.begin() + first + 1);
+        byte_starts.reserve(count - (last - first) + pieces + 1);
+        code_point_starts.reserve(count - (last - first) + pieces + 1);
+        for (size_t n = 0; n != pieces; ++n)
+        {
+            auto piece_start = start + length * n / pieces;
+            auto piece_end = start + length * (n + 1) / pieces;
+            auto code_points = utf8_index_segment(data + piece_start, piece_end - piece_start, segments[n].offsets, segments[n].counts);
+            byte_starts.push_back(piece_end);
+            code_point_starts.push_back(code_point_starts.back() + code_points);
+        }
+
+        // The segments after the edit are unchanged, but for their position.
+        auto byte_shift = byte_starts.back() - _byte_starts[last];
+        auto code_point_shift = code_point_starts.back() - _code_point_starts[last];
+        for (auto n = last + 1; n <= count; ++n)
+        {
+            byte_starts.push_back(_byte_starts[n] + byte_shift);
+            code_point_starts.push_back(_code_point_starts[n] + code_point_shift);
+        }
+
+        _segments.erase(_segments.begin() + first, _segments.begin() + last);
+        _segments.insert(_segments.begin() + first, std::make_move_iterator(segments.begin()), std::make_move_iterator(segments.end()));
+        _byte_starts = std::move(byte_starts);
+        _code_point_starts = std::move(code_point_starts);
+    }
+
+    size_t utf8_index::byte_offset(array_view<const char> str, size_t index) const noexcept
+    {
+        assert(str.size() == size_bytes());
+        assert(index <= size());
+        if (index == size())
+            return size_bytes();
+
+        auto s = size_t(std::upper_bound(_code_point_starts.begin(), _code_point_starts.end(), index) - _code_point_starts.begin()) - 1;
+        auto& seg = _segments[s];
+        auto local = index - _code_point_starts[s];
+        auto pos = _byte_starts[s] + seg.offsets[local / checkpoint_interval];
+        auto data = reinterpret_cast<const uint8_t*>(str.data());
+        return pos + utf8_find_code_point(data + pos, _byte_starts[s + 1] - pos, local % checkpoint_interval);
+    }
+
+    size_t utf8_index::code_point_index(array_view<const char> str, size_t offset) const noexcept
+    {
+        assert(str.size() == size_bytes());
+        assert(offset <= size_bytes());
+        if (offset == size_bytes())
+            return size();
+
+        auto s = size_t(std::upper_bound(_byte_starts.begin(), _byte_starts.end(), offset) - _byte_starts.begin()) - 1;
+        auto local = offset - _byte_starts[s];
+        auto checkpoint = local / checkpoint_interval;
+
+        utf8_counts counts;
+        utf_count(str.data() + _byte_starts[s] + checkpoint * checkpoint_interval, local % checkpoint_interval, counts);
+        return _code_point_starts[s] + _segments[s].counts[checkpoint] + counts.leads;
+    }
+
+    namespace
+    {
+        constexpr size_t transcoding_buffer_size = 16384;
+
+        // Reads at least this large are converted directly into the caller's buffer.
+        constexpr size_t direct_transcode_threshold = 64;
+
+        constexpr size_t code_unit_size(utf_encoding encoding) noexcept
+        {
+            switch (encoding)
+            {
+            case utf_encoding::utf8:
+                return 1;
+            case utf_encoding::utf16le:
+            case utf_encoding::utf16be:
+                return 2;
+            default:
+                return 4;
+            }
+        }
+
+        constexpr bool is_native_order(utf_encoding encoding) noexcept
+        {
+            switch (encoding)
+            {
+            case utf_encoding::utf16le:
+            case utf_encoding::utf32le:
+                return byte_order::native_endian == byte_order::little_endian;
+            case utf_encoding::utf16be:
+            case utf_encoding::utf32be:
+                return byte_order::native_endian == byte_order::big_endian;
+            default:
+                return true;
+            }
+        }
+
+        // Recognizes a byte order mark, returning its length and the encoding it indicates.
+        std::pair<size_t, utf_encoding> detect_bom(const byte* data, size_t size) noexcept
+        {
+            auto b = [&](size_t n) { return n < size ? unsigned(data[n]) : 0x100u; };
+            if (b(0) == 0xEF && b(1) == 0xBB && b(2) == 0xBF)
+                return { 3, utf_encoding::utf8 };
+            if (b(0) == 0xFF && b(1) == 0xFE)
+            {
+                if (b(2) == 0 && b(3) == 0)
+                    return { 4, utf_encoding::utf32le };
+                return { 2, utf_encoding::utf16le };
+            }
+            if (b(0) == 0xFE && b(1) == 0xFF)
+                return { 2, utf_encoding::utf16be };
+            if (b(0) == 0 && b(1) == 0 && b(2) == 0xFE && b(3) == 0xFF)
+                return { 4, utf_encoding::utf32be };
+            return { 0, utf_encoding::utf8 };
+        }
+
+        std::pair<utf_result, size_t> utf_validate(array_view<const char32_t> str) noexcept
+        {
+            size_t n = 0;
+            while (n != str.size() && utf32_is_valid(str[n]))
+                ++n;
+            return { n == str.size() ? utf_result::ok : utf_result::error, n };
+        }
+
+        // Stateful conversion between any pair of encodings.  UTF-8 and UTF-16 are converted to
+        // each other with the bulk transcoders, and text already in the target encoding is
+        // validated and copied a block at a time; anything else goes a code point at a time.
+        template <typename OutChar, typename InChar>
+        utf_transcode_result transcode_units(array_view<const InChar> in, span<OutChar> out, utfstate_t& state, bool sanitize) noexcept
+        {
+            if constexpr (!std::is_same_v<OutChar, InChar> && sizeof(OutChar) <= 2 && sizeof(InChar) <= 2)
+                return transcode(in, out, state, sanitize ? utf_conversion_options::sanitize : utf_conversion_options::none);
+            else
+            {
+                auto first = in.data();
+                auto src = first;
+                auto src_end = first + in.size();
+                auto dst = out.data();
+                auto dst_end = dst + out.size();
+
+                auto result = utf_result::ok;
+                if (state.consumed != 0 || state.produced != 0 || state.error)
+                    result = transcode_code_point(first, src, src_end, dst, dst_end, state, sanitize);
+
+                while (result == utf_result::ok && src != src_end)
+                {
+                    if constexpr (std::is_same_v<OutChar, InChar>)
+                    {
+                        auto count = std::min(size_t(src_end - src), size_t(dst_end - dst));
+                        auto valid = utf_validate(array_view<const InChar>(src, count)).second;
+                        std::memcpy(dst, src, valid * sizeof(InChar));
+                        src += valid;
+                        dst += valid;
+                        if (src == src_end)
+                            break;
+                    }
+
+                    result = transcode_code_point(first, src, src_end, dst, dst_end, state, sanitize);
+                }
+
+                return { result, size_t(src - first), size_t(dst - out.data()) };
+            }
+        }
+
+        template <typename OutChar>
+        utf_transcode_result transcode_units(utf_encoding from, const byte* in, size_t count, byte* out, size_t capacity,
+            utfstate_t& state, bool sanitize) noexcept
+        {
+            span<OutChar> dst(reinterpret_cast<OutChar*>(out), capacity);
+            switch (code_unit_size(from))
+            {
+            case 1:
+                return transcode_units(array_view<const char>(reinterpret_cast<const char*>(in), count), dst, state, sanitize);
+            case 2:
+                return transcode_units(array_view<const char16_t>(reinterpret_cast<const char16_t*>(in), count), dst, state, sanitize);
+            default:
+                return transcode_units(array_view<const char32_t>(reinterpret_cast<const char32_t*>(in), count), dst, state, sanitize);
+            }
+        }
+    }
+
+    utf_transcoding_input_stream::utf_transcoding_input_stream(input_stream& stream, utf_encoding from, utf_encoding to,
+        flags<utf_stream_options> options)
+        : _stream(&stream),
+        _input(std::make_unique<char32_t[]>(transcoding_buffer_size / sizeof(char32_t))),
+        _output(std::make_unique<char32_t[]>(transcoding_buffer_size / sizeof(char32_t))),
+        _from(from), _to(to),
+        _sanitize(options.test_any(utf_stream_options::sanitize)),
+        _detect_bom(options.test_any(utf_stream_options::detect_bom))
+    {
+    }
+
+    utf_transcoding_input_stream::~utf_transcoding_input_stream() = default;
+
+    utf_encoding utf_transcoding_input_stream::source_encoding()
+    {
+        if (!_started)
+            start();
+        return _from;
+    }
+
+    size_t utf_transcoding_input_stream::direct_read(std::function<size_t(const byte* buffer, size_t size)> read)
+    {
+        auto base = reinterpret_cast<const byte*>(_output.get());
+        if (_output_first == _output_last && !fill())
+            return read(base, 0);
+
+        auto size = read(base + _output_first, _output_last - _output_first);
+        _output_first += size;
+        return size;
+    }
+
+    size_t utf_transcoding_input_stream::do_read(byte* buffer, size_t size)
+    {
+        auto unit = code_unit_size(_to);
+        size_t total = 0;
+        while (total != size)
+        {
+            if (_output_first == _output_last)
+            {
+                // Large reads bypass the output buffer when they can take whole code units.
+                auto remaining = size - total;
+                if (remaining >= direct_transcode_threshold && reinterpret_cast<uintptr_t>(buffer + total) % unit == 0)
+                {
+                    auto bytes = convert(buffer + total, remaining - remaining % unit);
+                    if (bytes == 0)
+                        break;
+                    total += bytes;
+                    continue;
+                }
+
+                if (!fill())
+                    break;
+            }
+
+            auto count = std::min(size - total, _output_last - _output_first);
+            std::memcpy(buffer + total, reinterpret_cast<const byte*>(_output.get()) + _output_first, count);
+            _output_first += count;
+            total += count;
+        }
+        return total;
+    }
+
+    size_t utf_transcoding_input_stream::do_skip(size_t size)
+    {
+        size_t total = 0;
+        while (total != size)
+        {
+            if (_output_first == _output_last && !fill())
+                break;
+
+            auto count = std::min(size - total, _output_last - _output_first);
+            _output_first += count;
+            total += count;
+        }
+        return total;
+    }
+
+    void utf_transcoding_input_stream::start()
+    {
+        _started = true;
+        if (!_detect_bom)
+            return;
+
+        // Read enough to recognize any byte order mark.
+        auto base = reinterpret_cast<byte*>(_input.get());
+        while (_input_last < 4)
+        {
+            auto bytes = _stream->read(base + _input_last, transcoding_buffer_size - _input_last);
+            if (bytes == 0)
+            {
+                _eof = true;
+                break;
+            }
+            _input_last += bytes;
+        }
+
+        auto [length, encoding] = detect_bom(base, _input_last);
+        if (length != 0)
+        {
+            _from = encoding;
+            _input_first = length;
+        }
+
+        if (!is_native_order(_from))
+        {
+            auto unit = code_unit_size(_from);
+            _private::byte_swap(base + _input_first, base + _input_first, (_input_last - _input_first) / unit, unit);
+        }
+    }
+
+    // Makes more converted data available.  Returns false at the end of the text.
+    bool utf_transcoding_input_stream::fill()
+    {
+        _output_first = 0;
+        _output_last = convert(reinterpret_cast<byte*>(_output.get()), transcoding_buffer_size);
+        return _output_last != 0;
+    }
+
+    // Replaces the consumed input with more from the underlying stream, keeping any incomplete
+    // code unit.  Returns false at the end of the underlying stream.
+    bool utf_transcoding_input_stream::read_input()
+    {
+        auto base = reinterpret_cast<byte*>(_input.get());
+        auto remaining = _input_last - _input_first;
+        std::memmove(base, base + _input_first, remaining);
+        _input_first = 0;
+        _input_last = remaining;
+
+        auto bytes = _stream->read(base + remaining, transcoding_buffer_size - remaining);
+        if (bytes == 0)
+        {
+            _eof = true;
+            return false;
+        }
+        _input_last += bytes;
+
+        if (!is_native_order(_from))
+        {
+            auto unit = code_unit_size(_from);
+            _private::byte_swap(base, base, _input_last / unit, unit);
+        }
+        return true;
+    }
+
+    // Converts into buffer, which must be aligned for the target code units, and returns the
+    // number of bytes produced; zero only at the end of the text.  Invalid or truncated input
+    // throws stream_error unless sanitizing.
+    size_t utf_transcoding_input_stream::convert(byte* buffer, size_t size)
+    {
+        if (!_started)
+            start();
+
+        auto in_unit = code_unit_size(_from);
+        auto out_unit = code_unit_size(_to);
+        auto capacity = size / out_unit;
+        auto base = reinterpret_cast<const byte*>(_input.get());
+
+        size_t produced = 0;
+        while (produced == 0)
+        {
+            auto count = (_input_last - _input_first) / in_unit;
+            if (count == 0 && !_eof && read_input())
+                continue;
+
+            if (count == 0 && !_state.error)
+            {
+                // A code point or code unit left incomplete at the end of the stream is truncated.
+                if (_state.consumed == 0 && _input_first == _input_last)
+                    return 0;
+                if (!_sanitize)
+                    throw stream_error("truncated UTF sequence");
+
+                _input_first = _input_last;
+                _state = { };
+                _state.error = 1;
+            }
+
+            utf_transcode_result result;
+            switch (out_unit)
+            {
+            case 1:
+                result = transcode_units<char>(_from, base + _input_first, count, buffer, capacity, _state, _sanitize);
+                break;
+            case 2:
+                result = transcode_units<char16_t>(_from, base + _input_first, count, buffer, capacity, _state, _sanitize);
+                break;
+            default:
+                result = transcode_units<char32_t>(_from, base + _input_first, count, buffer, capacity, _state, _sanitize);
+                break;
+            }
+
+            _input_first += result.consumed * in_unit;
+            produced = result.produced;
+            if (result.result == utf_result::error && produced == 0)
+                throw stream_error("invalid UTF sequence");
+        }
+
+        if (!is_native_order(_to))
+            _private::byte_swap(buffer, buffer, produced, out_unit);
+        return produced * out_unit;
+    }
+
+    namespace
+    {
+        template <typename Stage1, size_t Size1, typename Stage2, size_t Size2>
+        auto property_lookup(const Stage1 (&stage1)[Size1], const Stage2 (&stage2)[Size2], unsigned shift, char32_t code) noexcept
+        {
+            auto block = size_t(stage1[code >> shift]);
+            return stage2[block << shift | (code & ((char32_t(1) << shift) - 1))];
+        }
+
+        constexpr char ascii_fold(char c) noexcept
+        {
+            return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c;
+        }
+
+        // Decodes the code point at str, advancing past it.  An invalid or truncated sequence
+        // yields U+FFFD.
+        char32_t utf8_decode(const char*& str, const char* end) noexcept
+        {
+            if (!(*str & 0x80))
+                return char32_t(*str++);
+
+            char32_t code;
+            auto out = &code;
+            utfstate_t state;
+            if (transcode_code_point(str, str, end, out, out + 1, state, true) != utf_result::ok)
+            {
+                str = end;
+                return UNICODE_REPLACEMENT_CHARACTER;
+            }
+            return code;
+        }
+
+        size_t utf8_encode(char32_t code, char* out) noexcept
+        {
+            if (code < 0x80)
+            {
+                out[0] = char(code);
+                return 1;
+            }
+            if (code < 0x800)
+            {
+                out[0] = char(0xC0 | code >> 6);
+                out[1] = char(0x80 | (code & 0x3F));
+                return 2;
+            }
+            if (code < 0x10000)
+            {
+                out[0] = char(0xE0 | code >> 12);
+                out[1] = char(0x80 | (code >> 6 & 0x3F));
+                out[2] = char(0x80 | (code & 0x3F));
+                return 3;
+            }
+            out[0] = char(0xF0 | code >> 18);
+            out[1] = char(0x80 | (code >> 12 & 0x3F));
+            out[2] = char(0x80 | (code >> 6 & 0x3F));
+            out[3] = char(0x80 | (code & 0x3F));
+            return 4;
+        }
+
+        // Case-insensitive operations handle runs of ASCII a block at a time.  The prefix kernel
+        // returns the length of the longest prefix over which lhs and rhs are ASCII and equal
+        // when folded; the copy kernel folds str into out up to the first byte that is not ASCII,
+        // returning the number of bytes folded.
+        using ascii_fold_prefix_kernel = size_t (*)(const char* lhs, const char* rhs, size_t size) noexcept;
+        using ascii_fold_copy_kernel = size_t (*)(const char* str, size_t size, char* out) noexcept;
+
+        size_t ascii_fold_prefix_scalar(const char* lhs, const char* rhs, size_t size) noexcept
+        {
+            size_t n = 0;
+            while (n != size && !((lhs[n] | rhs[n]) & 0x80) && ascii_fold(lhs[n]) == ascii_fold(rhs[n]))
+                ++n;
+            return n;
+        }
+
+        size_t ascii_fold_copy_scalar(const char* str, size_t size, char* out) noexcept
+        {
+            size_t n = 0;
+            for (; n != size && !(str[n] & 0x80); ++n)
+                out[n] = ascii_fold(str[n]);
+            return n;
+        }
+
+#if STDEXT_ARCH_X86
+        STDEXT_TARGET("sse4.1")
+        __m128i ascii_fold_sse41(__m128i input) noexcept
+        {
+            // Bytes above 7F are negative, and so are never taken to be uppercase.
+            auto upper = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), input));
+            return _mm_or_si128(input, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        }
+
+        STDEXT_TARGET("sse4.1")
+        size_t ascii_fold_prefix_sse41(const char* lhs, const char* rhs, size_t size) noexcept
+        {
+            size_t n = 0;
+            for (; size - n >= 16; n += 16)
+            {
+                auto l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + n));
+                auto r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + n));
+                auto equal = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(ascii_fold_sse41(l), ascii_fold_sse41(r))));
+                auto ascii = ~uint32_t(_mm_movemask_epi8(_mm_or_si128(l, r)));
+                auto mask = equal & ascii & 0xFFFF;
+                if (mask != 0xFFFF)
+                    return n + count_trailing_zeros(~mask);
+            }
+            return n + ascii_fold_prefix_scalar(lhs + n, rhs + n, size - n);
+        }
+
+        STDEXT_TARGET("sse4.1")
+        size_t ascii_fold_copy_sse41(const char* str, size_t size, char* out) noexcept
+        {
+            size_t n = 0;
+            for (; size - n >= 16; n += 16)
+            {
+                auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + n));
+                if (_mm_movemask_epi8(input) != 0)
+                    break;
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + n), ascii_fold_sse41(input));
+            }
+            return n + ascii_fold_copy_scalar(str + n, size - n, out + n);
+        }
+#endif
+
+        ascii_fold_prefix_kernel select_ascii_fold_prefix_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().sse41)
+                return ascii_fold_prefix_sse41;
+#endif
+            return ascii_fold_prefix_scalar;
+        }
+
+        ascii_fold_copy_kernel select_ascii_fold_copy_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().sse41)
+                return ascii_fold_copy_sse41;
+#endif
+            return ascii_fold_copy_scalar;
+        }
+
+        size_t ascii_fold_prefix(const char* lhs, const char* rhs, size_t size) noexcept
+        {
+            static const ascii_fold_prefix_kernel kernel = select_ascii_fold_prefix_kernel();
+            return kernel(lhs, rhs, size);
+        }
+
+        size_t ascii_fold_copy(const char* str, size_t size, char* out) noexcept
+        {
+            static const ascii_fold_copy_kernel kernel = select_ascii_fold_copy_kernel();
+            return kernel(str, size, out);
+        }
+    }
+
+    unicode_general_category general_category(char32_t code) noexcept
+    {
+        if (code >= 0x110000)
+            return unicode_general_category::unassigned;
+        return unicode_general_category(property_lookup(_private::category_stage1, _private::category_stage2, _private::category_shift, code));
+    }
+
+    char32_t simple_casefold(char32_t code) noexcept
+    {
+        if (code >= 0x110000)
+            return code;
+        auto delta = _private::casefold_deltas[property_lookup(_private::casefold_stage1, _private::casefold_stage2, _private::casefold_shift, code)];
+        return char32_t(int32_t(code) + delta);
+    }
+
+    int utf8_casefold_compare(array_view<const char> lhs, array_view<const char> rhs) noexcept
+    {
+        auto l = lhs.data();
+        auto l_end = l + lhs.size();
+        auto r = rhs.data();
+        auto r_end = r + rhs.size();
+        while (true)
+        {
+            auto n = ascii_fold_prefix(l, r, std::min(size_t(l_end - l), size_t(r_end - r)));
+            l += n;
+            r += n;
+            if (l == l_end || r == r_end)
+                return int(l != l_end) - int(r != r_end);
+
+            // Text other than ASCII may fold to ASCII; U+212A KELVIN SIGN folds to k.
+            auto lcode = simple_casefold(utf8_decode(l, l_end));
+            auto rcode = simple_casefold(utf8_decode(r, r_end));
+            if (lcode != rcode)
+                return lcode < rcode ? -1 : 1;
+        }
+    }
+
+    size_t utf8_casefold_hash(array_view<const char> str) noexcept
+    {
+        // The hash is that of the folded text in UTF-8, which is assembled in a buffer.
+        xxhash64_state state;
+        char buffer[256];
+        size_t used = 0;
+        auto flush = [&]
+        {
+            state.update(array_view<const byte>(reinterpret_cast<const byte*>(buffer), used));
+            used = 0;
+        };
+
+        auto pos = str.data();
+        auto end = pos + str.size();
+        while (pos != end)
+        {
+            auto n = ascii_fold_copy(pos, std::min(size_t(end - pos), std::size(buffer) - used), buffer + used);
+            pos += n;
+            used += n;
+            if (std::size(buffer) - used < 4)
+                flush();
+
+            if (pos != end && (*pos & 0x80))
+                used += utf8_encode(simple_casefold(utf8_decode(pos, end)), buffer + used);
+        }
+        flush();
+        return size_t(state.value());
+    }
+}
+
@@ -0,0 +1,320 @@
+#include <stdext/varint.h>
+
+#include "cpu.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <cassert>
+#include <cstring>
+
+
+namespace stdext
+{
+    namespace
+    {
+        [[noreturn]] void premature_end()
+        {
+            throw stream_error("premature end of stream");
+        }
+
+        [[noreturn]] void out_of_range()
+        {
+            throw stream_error("varint out of range");
+        }
+
+        using _private::count_trailing_zeros;
+        using _private::load64;
+
+        template <typename T>
+        size_t leb128_encode_impl(const T* src, size_t count, byte* dst) noexcept
+        {
+            auto p = dst;
+            for (size_t n = 0; n != count; ++n)
+            {
+                auto value = src[n];
+                for (; value >= 0x80; value >>= 7)
+                    *p++ = byte(value | 0x80);
+                *p++ = byte(value);
+            }
+            return size_t(p - dst);
+        }
+
+        template <typename T>
+        T leb128_decode_one(const byte*& p, const byte* end)
+        {
+            constexpr unsigned bits = sizeof(T) * 8;
+
+            T value = 0;
+            for (unsigned shift = 0; ; shift += 7)
+            {
+                if (p == end)
+                    premature_end();
+
+                auto b = uint8_t(*p++);
+                if (shift + 7 > bits && (shift >= bits || (b & 0x7F) >> (bits - shift) != 0))
+                    out_of_range();
+
+                value |= T(b & 0x7F) << shift;
+                if ((b & 0x80) == 0)
+                    return value;
+            }
+        }
+
+        // Gathers the low seven bits of each byte of v into a contiguous 56-bit value.
+        constexpr uint64_t leb128_compact(uint64_t v) noexcept
+        {
+            v = (v & 0x007F007F'007F007F) | (v & 0x7F007F00'7F007F00) >> 1;
+            v = (v & 0x00003FFF'00003FFF) | (v & 0x3FFF0000'3FFF0000) >> 2;
+            v = (v & 0x00000000'0FFFFFFF) | (v & 0x0FFFFFFF'00000000) >> 4;
+            return v;
+        }
+
+        // While at least eight bytes remain, the terminating byte of the next value is located
+        // by masking the high bits of an eight-byte word, and the value is assembled with a
+        // handful of shifts rather than a loop.  A run of eight single-byte values, which is
+        // common in delta-coded data, is expanded directly.
+        template <typename T>
+        size_t leb128_decode_impl(const byte* src, size_t size, T* dst, size_t count)
+        {
+            constexpr uint64_t continuation_bits = 0x80808080'80808080;
+            constexpr size_t max_fast_length = std::min(max_varint_size<T>, size_t(8));
+
+            auto p = src;
+            auto end = src + size;
+            size_t n = 0;
+
+            while (n != count)
+            {
+                if (end - p >= 8)
+                {
+                    auto word = load64(p);
+                    auto stops = ~word & continuation_bits;
+
+                    if (stops == continuation_bits && count - n >= 8)
+                    {
+                        for (size_t k = 0; k != 8; ++k)
+                            dst[n + k] = T(uint8_t(p[k]));
+                        p += 8;
+                        n += 8;
+                        continue;
+                    }
+
+                    if (stops != 0)
+                    {
+                        size_t length = count_trailing_zeros(stops) / 8 + 1;
+                        if (length <= max_fast_length)
+                        {
+                            auto bits = length == 8 ? word : word & ((uint64_t(1) << (8 * length)) - 1);
+                            auto value = leb128_compact(bits);
+                            if (value > std::numeric_limits<T>::max())
+                                out_of_range();
+
+                            dst[n++] = T(value);
+                            p += length;
+                            continue;
+                        }
+                    }
+                }
+
+                dst[n++] = leb128_decode_one<T>(p, end);
+            }
+
+            return size_t(p - src);
+        }
+
+        struct streamvbyte_tables
+        {
+            // Shuffle masks that expand the data bytes described by a control byte into four
+            // 32-bit lanes; 0xFF clears a lane byte.
+            alignas(16) uint8_t shuffle[256][16];
+            // Total data length described by a control byte.
+            uint8_t length[256];
+        };
+
+        constexpr streamvbyte_tables make_streamvbyte_tables() noexcept
+        {
+            streamvbyte_tables tables = { };
+            for (unsigned c = 0; c != 256; ++c)
+            {
+                unsigned pos = 0;
+                for (unsigned k = 0; k != 4; ++k)
+                {
+                    unsigned length = (c >> (2 * k) & 3) + 1;
+                    for (unsigned b = 0; b != 4; ++b)
+                        tables.shuffle[c][4 * k + b] = uint8_t(b < length ? pos + b : 0xFF);
+                    pos += length;
+                }
+                tables.length[c] = uint8_t(pos);
+            }
+            return tables;
+        }
+
+        constexpr streamvbyte_tables streamvbyte = make_streamvbyte_tables();
+
+        constexpr unsigned streamvbyte_code(uint32_t v) noexcept
+        {
+            return v < 0x100 ? 0 : v < 0x10000 ? 1 : v < 0x1000000 ? 2 : 3;
+        }
+
+        // Decodes count values, one at a time.
+        const byte* streamvbyte_decode_scalar(const byte* ctrl, const byte* data, uint32_t* dst, size_t count) noexcept
+        {
+            for (size_t n = 0; n != count; ++n)
+            {
+                auto length = unsigned(uint8_t(ctrl[n / 4]) >> (2 * (n % 4)) & 3) + 1;
+                uint32_t value = 0;
+                for (unsigned b = 0; b != length; ++b)
+                    value |= uint32_t(uint8_t(data[b])) << (8 * b);
+                dst[n] = value;
+                data += length;
+            }
+            return data;
+        }
+
+        using streamvbyte_kernel = const byte* (*)(const byte*& ctrl, const byte* data, const byte* end, uint32_t*& dst, size_t& groups) noexcept;
+
+        const byte* streamvbyte_groups_scalar(const byte*& ctrl, const byte* data, const byte*, uint32_t*& dst, size_t& groups) noexcept
+        {
+            data = streamvbyte_decode_scalar(ctrl, data, dst, 4 * groups);
+            ctrl += groups;
+            dst += 4 * groups;
+            groups = 0;
+            return data;
+        }
+
+#if STDEXT_ARCH_X86
+        // Each group of four values needs a sixteen-byte load, so the kernels stop short of the
+        // end of the input and leave the last few groups to the scalar decoder.
+        STDEXT_TARGET("ssse3")
+        const byte* streamvbyte_groups_ssse3(const byte*& ctrl, const byte* data, const byte* end, uint32_t*& dst, size_t& groups) noexcept
+        {
+            for (; groups != 0 && end - data >= 16; --groups)
+            {
+                auto c = uint8_t(*ctrl++);
+                auto in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+                auto mask = _mm_load_si128(reinterpret_cast<const __m128i*>(streamvbyte.shuffle[c]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(in, mask));
+                data += streamvbyte.length[c];
+                dst += 4;
+            }
+            return data;
+        }
+
+        STDEXT_TARGET("avx2")
+        const byte* streamvbyte_groups_avx2(const byte*& ctrl, const byte* data, const byte* end, uint32_t*& dst, size_t& groups) noexcept
+        {
+            for (; groups >= 2 && end - data >= 32; groups -= 2)
+            {
+                auto c0 = uint8_t(ctrl[0]);
+                auto c1 = uint8_t(ctrl[1]);
+                ctrl += 2;
+
+                auto second = data + streamvbyte.length[c0];
+                auto in = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(second)), 1);
+                auto mask = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(streamvbyte.shuffle[c0]))),
+                    _mm_load_si128(reinterpret_cast<const __m128i*>(streamvbyte.shuffle[c1])), 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_shuffle_epi8(in, mask));
+
+                data = second + streamvbyte.length[c1];
+                dst += 8;
+            }
+
+            // The SSSE3 tail is compiled without VEX encoding; clear the upper ymm state first.
+            _mm256_zeroupper();
+            return streamvbyte_groups_ssse3(ctrl, data, end, dst, groups);
+        }
+#endif
+
+        streamvbyte_kernel select_streamvbyte_kernel() noexcept
+        {
+#if STDEXT_ARCH_X86
+            if (_private::cpu().avx2)
+                return streamvbyte_groups_avx2;
+            if (_private::cpu().ssse3)
+                return streamvbyte_groups_ssse3;
+#endif
+            return streamvbyte_groups_scalar;
+        }
+    }
+
+    size_t leb128_encode(array_view<const uint32_t> src, span<byte> dst) noexcept
+    {
+        assert(dst.size() >= src.size() * max_varint_size<uint32_t>);
+        return leb128_encode_impl(src.data(), src.size(), dst.data());
+    }
+
+    size_t leb128_encode(array_view<const uint64_t> src, span<byte> dst) noexcept
+    {
+        assert(dst.size() >= src.size() * max_varint_size<uint64_t>);
+        return leb128_encode_impl(src.data(), src.size(), dst.data());
+    }
+
+    size_t leb128_decode(array_view<const byte> src, span<uint32_t> dst)
+    {
+        return leb128_decode_impl(src.data(), src.size(), dst.data(), dst.size());
+    }
+
+    size_t leb128_decode(array_view<const byte> src, span<uint64_t> dst)
+    {
+        return leb128_decode_impl(src.data(), src.size(), dst.data(), dst.size());
+    }
+
+    size_t streamvbyte_encode(array_view<const uint32_t> src, span<byte> dst) noexcept
+    {
+        auto count = src.size();
+        assert(dst.size() >= streamvbyte_max_size(count));
+
+        auto ctrl = dst.data();
+        auto data = ctrl + (count + 3) / 4;
+        std::fill(ctrl, data, byte(0));
+
+        for (size_t n = 0; n != count; ++n)
+        {
+            auto value = src[n];
+            auto code = streamvbyte_code(value);
+            ctrl[n / 4] |= byte(code << (2 * (n % 4)));
+            for (unsigned b = 0; b <= code; ++b)
+                data[b] = byte(value >> (8 * b));
+            data += code + 1;
+        }
+
+        return size_t(data - dst.data());
+    }
+
+    size_t streamvbyte_decode(array_view<const byte> src, span<uint32_t> dst)
+    {
+        static const streamvbyte_kernel kernel = select_streamvbyte_kernel();
+
+        auto count = dst.size();
+        auto ctrl_size = (count + 3) / 4;
+        if (src.size() < ctrl_size)
+            premature_end();
+
+        // Validate the total length up front so that the kernels need not check each group.
+        auto ctrl = src.data();
+        auto groups = count / 4;
+        size_t data_size = 0;
+        for (size_t n = 0; n != groups; ++n)
+            data_size += streamvbyte.length[uint8_t(ctrl[n])];
+        for (size_t n = 4 * groups; n != count; ++n)
+            data_size += (uint8_t(ctrl[n / 4]) >> (2 * (n % 4)) & 3) + 1;
+
+        if (src.size() - ctrl_size < data_size)
+            premature_end();
+
+        auto data = ctrl + ctrl_size;
+        auto end = data + data_size;
+        auto out = dst.data();
+
+        data = kernel(ctrl, data, end, out, groups);
+        data = streamvbyte_groups_scalar(ctrl, data, end, out, groups);
+        data = streamvbyte_decode_scalar(ctrl, data, out, count % 4);
+
+        assert(data == end);
+        return size_t(end - src.data());
+    }
+}
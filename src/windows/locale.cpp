@@ -0,0 +1,17 @@
+#include <stdext/string.h>
+
+#include "platform.h"
+
+#include <clocale>
+
+
+namespace stdext
+{
+    namespace _private
+    {
+        bool locale_is_utf8() noexcept
+        {
+            return ___lc_codepage_func() == CP_UTF8;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#include <stdext/bitpack.h>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        // Sorted values with gaps of up to max_gap.
+        std::vector<uint64_t> make_sorted(size_t count, uint64_t start, uint64_t max_gap)
+        {
+            std::vector<uint64_t> values(count);
+            uint64_t x = 0x9E3779B97F4A7C15;
+            auto v = start;
+            for (auto& value : values)
+            {
+                x = x * 6364136223846793005 + 1442695040888963407;
+                v += (x >> 33) % (max_gap + 1);
+                value = v;
+            }
+            return values;
+        }
+
+        std::vector<uint64_t> make_random(size_t count, unsigned bits)
+        {
+            std::vector<uint64_t> values(count);
+            uint64_t x = 0x0123456789ABCDEF;
+            for (auto& value : values)
+            {
+                x = x * 6364136223846793005 + 1442695040888963407;
+                auto r = x ^ x >> 29;
+                value = bits == 0 ? 0 : bits == 64 ? r : r & ((uint64_t(1) << bits) - 1);
+            }
+            return values;
+        }
+
+        template <typename T>
+        void check_round_trip(const std::vector<T>& values, stdext::bitpack_encoding encoding, stdext::bitpack_block_size block_size)
+        {
+            std::vector<std::byte> encoded(stdext::bitpack_max_size(values.size(), block_size));
+            auto size = stdext::bitpack_encode({ values.data(), values.size() }, encoded, encoding, block_size);
+
+            std::vector<T> decoded(values.size());
+            CHECK(stdext::bitpack_decode({ encoded.data(), size }, decoded, encoding, block_size) == size);
+            CHECK(decoded == values);
+
+            std::vector<std::byte> streamed(encoded.size() + 1);
+            stdext::memory_output_stream out(streamed.data(), streamed.size());
+            stdext::write_bitpacked(out, { values.data(), values.size() }, encoding, block_size);
+            REQUIRE(size_t(out.position()) == size);
+            CHECK(std::equal(encoded.begin(), encoded.begin() + ptrdiff_t(size), streamed.begin()));
+
+            stdext::memory_input_stream in(streamed.data(), size);
+            std::vector<T> read(values.size());
+            stdext::read_bitpacked(in, read, encoding, block_size);
+            CHECK(read == values);
+        }
+    }
+
+    TEST_CASE("bitpack widths", "[bitpack]")
+    {
+        using stdext::bitpack_block_size;
+        using stdext::bitpack_encoding;
+
+        for (unsigned bits = 0; bits <= 64; ++bits)
+        {
+            auto values = make_random(1000, bits);
+            check_round_trip(values, bitpack_encoding::frame_of_reference, bitpack_block_size::values_128);
+            check_round_trip(values, bitpack_encoding::frame_of_reference, bitpack_block_size::values_256);
+            check_round_trip(values, bitpack_encoding::delta, bitpack_block_size::values_128);
+        }
+
+        for (unsigned bits : { 0, 1, 7, 17, 31, 32 })
+        {
+            auto wide = make_random(700, bits);
+            std::vector<uint32_t> values(wide.begin(), wide.end());
+            check_round_trip(values, bitpack_encoding::frame_of_reference, bitpack_block_size::values_128);
+            check_round_trip(values, bitpack_encoding::delta, bitpack_block_size::values_256);
+        }
+    }
+
+    TEST_CASE("bitpack sorted", "[bitpack]")
+    {
+        using stdext::bitpack_block_size;
+        using stdext::bitpack_encoding;
+
+        // Timestamps: a large base with small increments packs to a few bits per value.
+        auto timestamps = make_sorted(10000, 1'600'000'000'000'000, 1000);
+        std::vector<std::byte> encoded(stdext::bitpack_max_size(timestamps.size()));
+        auto size = stdext::bitpack_encode({ timestamps.data(), timestamps.size() }, encoded);
+        CHECK(size < timestamps.size() * sizeof(uint64_t) / 4);
+        check_round_trip(timestamps, bitpack_encoding::delta, bitpack_block_size::values_128);
+        check_round_trip(timestamps, bitpack_encoding::delta, bitpack_block_size::values_256);
+        check_round_trip(timestamps, bitpack_encoding::frame_of_reference, bitpack_block_size::values_256);
+
+        // Decreasing runs produce negative deltas.
+        std::vector<uint64_t> values(timestamps.rbegin(), timestamps.rend());
+        values.insert(values.end(), timestamps.begin(), timestamps.end());
+        check_round_trip(values, bitpack_encoding::delta, bitpack_block_size::values_128);
+
+        // Only a tail.
+        check_round_trip(std::vector<uint64_t>{ 5, 3, UINT64_MAX, 0 }, bitpack_encoding::delta, bitpack_block_size::values_128);
+        check_round_trip(std::vector<uint64_t>{ }, bitpack_encoding::delta, bitpack_block_size::values_128);
+
+        // Truncated input.
+        std::vector<uint64_t> decoded(timestamps.size());
+        CHECK_THROWS_AS(stdext::bitpack_decode({ encoded.data(), size - 1 }, decoded), stdext::stream_error);
+        CHECK_THROWS_AS(stdext::bitpack_decode({ encoded.data(), 100 }, decoded), stdext::stream_error);
+    }
+}
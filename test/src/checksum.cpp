@@ -0,0 +1,140 @@
+#include <stdext/checksum.h>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        stdext::array_view<const std::byte> as_bytes(const char* str)
+        {
+            return { reinterpret_cast<const std::byte*>(str), std::char_traits<char>::length(str) };
+        }
+
+        std::vector<std::byte> make_data(size_t size)
+        {
+            std::vector<std::byte> data(size);
+            uint32_t x = 0x12345678;
+            for (auto& b : data)
+            {
+                x = x * 1103515245 + 12345;
+                b = std::byte(x >> 24);
+            }
+            return data;
+        }
+
+        uint32_t crc32c_bitwise(stdext::array_view<const std::byte> data)
+        {
+            uint32_t crc = ~uint32_t(0);
+            for (auto b : data)
+            {
+                crc ^= uint8_t(b);
+                for (int k = 0; k != 8; ++k)
+                    crc = crc & 1 ? crc >> 1 ^ 0x82F63B78 : crc >> 1;
+            }
+            return ~crc;
+        }
+    }
+
+    TEST_CASE("crc32c", "[checksum]")
+    {
+        CHECK(stdext::crc32c(as_bytes("")) == 0);
+        CHECK(stdext::crc32c(as_bytes("123456789")) == 0xE3069283);
+        CHECK(stdext::crc32c(as_bytes("The quick brown fox jumps over the lazy dog")) == 0x22620404);
+
+        auto data = make_data(100000);
+        for (size_t size : { 1, 7, 8, 255, 768, 769, 3 * 8192, 3 * 8192 + 771, 100000 })
+        {
+            stdext::array_view<const std::byte> view(data.data(), size);
+            CHECK(stdext::crc32c(view) == crc32c_bitwise(view));
+        }
+
+        // Incremental computation with misaligned split points.
+        stdext::array_view<const std::byte> all(data.data(), data.size());
+        uint32_t crc = 0;
+        for (size_t offset = 0, step = 1; offset < data.size(); offset += step, step = step * 3 + 1)
+        {
+            auto count = std::min(step, data.size() - offset);
+            crc = stdext::crc32c({ data.data() + offset, count }, crc);
+        }
+        CHECK(crc == stdext::crc32c(all));
+    }
+
+    TEST_CASE("xxhash32", "[checksum]")
+    {
+        CHECK(stdext::xxhash32(as_bytes("")) == 0x02CC5D05);
+        CHECK(stdext::xxhash32(as_bytes("a")) == 0x550D7456);
+        CHECK(stdext::xxhash32(as_bytes("abc")) == 0x32D153FF);
+
+        auto data = make_data(10000);
+        stdext::array_view<const std::byte> all(data.data(), data.size());
+        auto expected = stdext::xxhash32(all, 1729);
+
+        for (size_t step : { 1, 5, 15, 16, 17, 1000 })
+        {
+            stdext::xxhash32_state state(1729);
+            for (size_t offset = 0; offset < data.size(); offset += step)
+                state.update({ data.data() + offset, std::min(step, data.size() - offset) });
+            CHECK(state.value() == expected);
+        }
+    }
+
+    TEST_CASE("xxhash64", "[checksum]")
+    {
+        CHECK(stdext::xxhash64(as_bytes("")) == 0xEF46DB3751D8E999);
+        CHECK(stdext::xxhash64(as_bytes("a")) == 0xD24EC4F1A98C6E5B);
+        CHECK(stdext::xxhash64(as_bytes("abc")) == 0x44BC2CF5AD770999);
+
+        auto data = make_data(10000);
+        stdext::array_view<const std::byte> all(data.data(), data.size());
+        auto expected = stdext::xxhash64(all, 1729);
+
+        for (size_t step : { 1, 5, 31, 32, 33, 1000 })
+        {
+            stdext::xxhash64_state state(1729);
+            for (size_t offset = 0; offset < data.size(); offset += step)
+                state.update({ data.data() + offset, std::min(step, data.size() - offset) });
+            CHECK(state.value() == expected);
+        }
+    }
+
+    TEST_CASE("checksum_input_stream", "[checksum]")
+    {
+        auto data = make_data(5000);
+        stdext::array_view<const std::byte> all(data.data(), data.size());
+
+        stdext::memory_input_stream source(data.data(), data.size());
+        stdext::checksum_input_stream in(source);
+
+        std::byte buffer[1000];
+        REQUIRE(in.read(buffer, 100) == 100);
+        REQUIRE(in.skip<std::byte>(1500) == 1500);
+        while (in.read(buffer, std::size(buffer)) != 0)
+            ;
+        CHECK(in.value() == stdext::crc32c(all));
+
+        source.reset(data.data(), data.size());
+        stdext::checksum_input_stream<stdext::xxhash64_state> hashed(source);
+        while (hashed.read(buffer, 333) != 0)
+            ;
+        CHECK(hashed.value() == stdext::xxhash64(all));
+    }
+
+    TEST_CASE("checksum_output_stream", "[checksum]")
+    {
+        auto data = make_data(5000);
+        stdext::array_view<const std::byte> all(data.data(), data.size());
+
+        std::vector<std::byte> buffer(data.size());
+        stdext::memory_output_stream sink(buffer.data(), buffer.size());
+        stdext::checksum_output_stream out(sink);
+        for (size_t offset = 0; offset < data.size(); offset += 777)
+            out.write_all(data.data() + offset, std::min(size_t(777), data.size() - offset));
+
+        CHECK(out.value() == stdext::crc32c(all));
+        CHECK(buffer == data);
+    }
+}
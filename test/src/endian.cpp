@@ -0,0 +1,175 @@
+#include <stdext/endian.h>
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        template <typename T>
+        std::vector<T> make_values(size_t count)
+        {
+            std::vector<T> values(count);
+            uint64_t x = 0x0123456789ABCDEF;
+            for (auto& v : values)
+            {
+                x = x * 6364136223846793005 + 1442695040888963407;
+                v = T(x >> 7);
+            }
+            return values;
+        }
+
+        template <typename T>
+        void check_swap(size_t count)
+        {
+            using stdext::byte_order;
+
+            auto values = make_values<T>(count);
+            std::vector<T> swapped(count);
+            stdext::endian_swap<byte_order::big_endian>(values.data(), swapped.data(), count);
+            for (size_t n = 0; n != count; ++n)
+                CHECK(swapped[n] == stdext::endian_swap<byte_order::big_endian>(values[n]));
+
+            // In place, swapping twice restores the original values.
+            stdext::endian_swap<byte_order::little_endian>(swapped.data(), swapped.data(), count);
+            stdext::endian_swap<byte_order::big_endian>(swapped.data(), swapped.data(), count);
+            stdext::endian_swap<byte_order::little_endian>(swapped.data(), swapped.data(), count);
+            CHECK(swapped == values);
+
+            stdext::endian_swap<byte_order::pdp_endian>(values.data(), swapped.data(), count);
+            for (size_t n = 0; n != count; ++n)
+                CHECK(swapped[n] == stdext::endian_swap<byte_order::pdp_endian>(values[n]));
+        }
+
+        template <typename T>
+        void check_stream(size_t count)
+        {
+            using stdext::byte_order;
+
+            auto values = make_values<T>(count);
+            std::vector<std::byte> buffer(count * sizeof(T));
+            stdext::memory_output_stream out(buffer.data(), buffer.size());
+            CHECK(stdext::write<byte_order::big_endian>(out, values.data(), count) == count);
+            CHECK(stdext::write<byte_order::big_endian>(out, values.data(), count) == 0);
+
+            for (size_t n = 0; n != count; ++n)
+            {
+                auto v = values[n];
+                for (size_t b = sizeof(T); b-- != 0; v = T(uint64_t(v) >> 8))
+                {
+                    if (buffer[n * sizeof(T) + b] != std::byte(v))
+                    {
+                        FAIL("mismatch at element " << n);
+                        return;
+                    }
+                }
+            }
+
+            stdext::memory_input_stream in(buffer.data(), buffer.size());
+            std::vector<T> read(count + 1);
+            CHECK(stdext::read<byte_order::big_endian>(in, read.data(), read.size()) == count);
+            read.pop_back();
+            CHECK(read == values);
+
+            // A short write stops at the end of the stream.
+            std::vector<std::byte> small(sizeof(T) * 5);
+            stdext::memory_output_stream small_out(small.data(), small.size());
+            CHECK(stdext::write<byte_order::little_endian>(small_out, values.data(), count) == std::min(count, size_t(5)));
+        }
+    }
+
+    TEST_CASE("endian array swap", "[endian]")
+    {
+        for (size_t count : { 0, 1, 3, 7, 8, 15, 16, 17, 33, 100, 1000 })
+        {
+            check_swap<uint16_t>(count);
+            check_swap<int32_t>(count);
+            check_swap<uint64_t>(count);
+        }
+    }
+
+    TEST_CASE("endian array stream", "[endian]")
+    {
+        for (size_t count : { 0, 1, 5, 100, 3000 })
+        {
+            check_stream<uint8_t>(count);
+            check_stream<int16_t>(count);
+            check_stream<uint32_t>(count);
+            check_stream<int64_t>(count);
+        }
+    }
+
+    TEST_CASE("endian array view", "[endian]")
+    {
+        using stdext::byte_order;
+
+        // Sorted big-endian table at an odd offset.
+        std::vector<uint32_t> values(1000);
+        for (size_t n = 0; n != values.size(); ++n)
+            values[n] = uint32_t(n * 7919 + (n << 20));
+        std::vector<std::byte> bytes(1 + values.size() * sizeof(uint32_t));
+        for (size_t n = 0; n != values.size(); ++n)
+        {
+            for (size_t b = 0; b != 4; ++b)
+                bytes[1 + 4 * n + b] = std::byte(values[n] >> (24 - 8 * b));
+        }
+
+        stdext::endian_array_view<uint32_t, byte_order::big_endian> view(stdext::array_view<const std::byte>(bytes.data() + 1, bytes.size() - 1));
+        static_assert(stdext::is_random_access_range<decltype(view)>::value);
+        REQUIRE(view.size() == values.size());
+        CHECK(view[0] == values[0]);
+        CHECK(view[999] == values[999]);
+        CHECK(view.front() == values.front());
+        CHECK(view.back() == values.back());
+        CHECK_THROWS_AS(view.at(1000), std::out_of_range);
+        CHECK(std::equal(view.begin(), view.end(), values.begin(), values.end()));
+        CHECK(std::equal(view.rbegin(), view.rend(), values.rbegin(), values.rend()));
+
+        auto it = std::lower_bound(view.begin(), view.end(), values[321]);
+        CHECK(it - view.begin() == 321);
+        CHECK(*it == values[321]);
+        CHECK(std::binary_search(view.begin(), view.end(), values[999]));
+        CHECK_FALSE(std::binary_search(view.begin(), view.end(), values[999] + 1));
+
+        // Range protocol.
+        auto pos = view.begin_pos();
+        stdext::advance_pos(view, pos, 10);
+        CHECK(view.at_pos(pos) == values[10]);
+        CHECK(stdext::distance(view, view.begin_pos(), view.end_pos()) == 1000);
+        auto rest = view;
+        stdext::drop_first(rest, 990);
+        CHECK(rest.size() == 10);
+        CHECK(rest[0] == values[990]);
+
+        std::vector<uint32_t> decoded(values.size());
+        CHECK(view.decode_to(decoded) == values.size());
+        CHECK(decoded == values);
+
+        auto sub = view.subview(3, 17);
+        std::vector<uint32_t> sub_decoded(17);
+        CHECK(sub.decode_to(sub_decoded) == 17);
+        CHECK(std::equal(sub_decoded.begin(), sub_decoded.end(), values.begin() + 3));
+
+        // Other widths and byte orders.
+        std::vector<uint16_t> native16 = { 1, 2, 0x1234, 0xFFFF };
+        stdext::endian_array_view<uint16_t, byte_order::native_endian> native_view(
+            reinterpret_cast<const std::byte*>(native16.data()), native16.size());
+        std::vector<uint16_t> native_decoded(native16.size());
+        CHECK(native_view.decode_to(native_decoded) == native16.size());
+        CHECK(native_decoded == native16);
+
+        std::vector<int64_t> signed64 = { -1, -2, 3, INT64_MIN, INT64_MAX };
+        std::vector<int64_t> swapped64(signed64.size());
+        stdext::endian_swap<byte_order::pdp_endian>(signed64.data(), swapped64.data(), signed64.size());
+        stdext::endian_array_view<int64_t, byte_order::pdp_endian> pdp_view(
+            reinterpret_cast<const std::byte*>(swapped64.data()), swapped64.size());
+        CHECK(std::equal(pdp_view.begin(), pdp_view.end(), signed64.begin(), signed64.end()));
+        std::vector<int64_t> pdp_decoded(signed64.size());
+        CHECK(pdp_view.decode_to(pdp_decoded) == signed64.size());
+        CHECK(pdp_decoded == signed64);
+    }
+}
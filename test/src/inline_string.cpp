@@ -0,0 +1,120 @@
+#include <stdext/format.h>
+#include <stdext/inline_string.h>
+#include <stdext/stream.h>
+#include <stdext/unicode.h>
+
+#include <catch2/catch.hpp>
+
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_set>
+
+
+namespace test
+{
+    using key = stdext::inline_string<23>;
+    using truncating_key = stdext::inline_string<8, char, stdext::inline_string_overflow::truncate>;
+
+    static_assert(std::is_trivially_copyable_v<key>);
+    static_assert(sizeof(key) == 25);
+    static_assert(sizeof(stdext::inline_string<300>) == 304);
+    static_assert(stdext::is_consumer_v<key, char>);
+    static_assert(stdext::is_consumer_v<key, stdext::string_view>);
+
+    TEST_CASE("Inline string", "[inline_string]")
+    {
+        SECTION("Basics")
+        {
+            key empty;
+            CHECK(empty.empty());
+            CHECK(empty.c_str()[0] == '\0');
+
+            key k("symbol_name");
+            CHECK(k.size() == 11);
+            CHECK(k == stdext::string_view("symbol_name"));
+            CHECK(k != stdext::string_view("symbol"));
+            CHECK(std::string(k.c_str()) == "symbol_name");
+            CHECK(k.back() == 'e');
+            CHECK_THROWS_AS(k.at(11), std::out_of_range);
+
+            stdext::string_view view = k;
+            CHECK(view.data() == k.data());
+            CHECK(view.size() == k.size());
+
+            k.pop_back();
+            k += '!';
+            k += stdext::string_view("?");
+            CHECK(k == stdext::string_view("symbol_nam!?"));
+
+            auto copy = k;
+            CHECK(copy == k);
+            CHECK(key("abc") < key("abd"));
+            CHECK(key("ab") < key("abc"));
+            CHECK(!(key("abc") < key("abc")));
+
+            k.clear();
+            CHECK(k.empty());
+            CHECK(k.c_str()[0] == '\0');
+        }
+
+        SECTION("Overflow")
+        {
+            key k("abcdefghijklmnopqrstuvw");
+            CHECK(k.size() == 23);
+            CHECK_THROWS_AS(k.push_back('x'), std::length_error);
+            CHECK_THROWS_AS(key("abcdefghijklmnopqrstuvwx"), std::length_error);
+            k.pop_back();
+            CHECK_THROWS_AS(k.append("xy"), std::length_error);
+            CHECK(k == stdext::string_view("abcdefghijklmnopqrstuv"));
+
+            truncating_key t("overflowing");
+            CHECK(t == stdext::string_view("overflow"));
+            CHECK(!t.push_back('x'));
+
+            truncating_key u("abc");
+            CHECK(!u.append("defghijk"));
+            CHECK(u == stdext::string_view("abcdefgh"));
+        }
+
+        SECTION("Consumer")
+        {
+            key k;
+            REQUIRE(stdext::format(k, "$0_$1", "node", 42));
+            CHECK(k == stdext::string_view("node_42"));
+
+            truncating_key t;
+            CHECK(!stdext::format(t, "$0_$1", "a_long_prefix", 42));
+            CHECK(t == stdext::string_view("a_long_p"));
+
+            key utf8;
+            CHECK(stdext::to_utf8(u"café", utf8) == stdext::utf_result::ok);
+            CHECK(utf8 == stdext::string_view("caf\xC3\xA9"));
+        }
+
+        SECTION("Containers")
+        {
+            std::unordered_set<key> set = { key("alpha"), key("beta"), key("gamma") };
+            CHECK(set.count(key("beta")) == 1);
+            CHECK(set.count(key("delta")) == 0);
+
+            std::map<key, int> map = { { key("b"), 2 }, { key("a"), 1 } };
+            CHECK(map.begin()->second == 1);
+        }
+
+        SECTION("Streams")
+        {
+            key keys[] = { key("first"), key("second") };
+            stdext::byte buffer[sizeof(keys)];
+
+            stdext::memory_output_stream out(buffer, sizeof(buffer));
+            REQUIRE(out.write(keys) == std::size(keys));
+
+            stdext::memory_input_stream in(buffer, sizeof(buffer));
+            auto first = in.read<key>();
+            auto second = in.read<key>();
+            CHECK(first == keys[0]);
+            CHECK(second == stdext::string_view("second"));
+        }
+    }
+}
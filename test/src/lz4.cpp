@@ -0,0 +1,209 @@
+#include <stdext/lz4.h>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        std::vector<std::byte> make_bytes(std::initializer_list<int> values)
+        {
+            std::vector<std::byte> bytes;
+            for (auto v : values)
+                bytes.push_back(std::byte(v));
+            return bytes;
+        }
+
+        // Mostly repetitive text with a little noise, typical of spill files.
+        std::vector<std::byte> make_data(size_t size)
+        {
+            static constexpr char words[][9] = { "alpha ", "beta ", "gamma ", "delta ", "epsilon ", "\n" };
+            std::vector<std::byte> data;
+            data.reserve(size);
+            uint32_t x = 0x2468ACE0;
+            while (data.size() < size)
+            {
+                x = x * 1103515245 + 12345;
+                const char* word = words[(x >> 16) % std::size(words)];
+                for (; *word != '\0' && data.size() < size; ++word)
+                    data.push_back(std::byte(*word));
+                if ((x >> 8) % 17 == 0 && data.size() < size)
+                    data.push_back(std::byte(x >> 24));
+            }
+            return data;
+        }
+
+        std::vector<std::byte> make_random(size_t size)
+        {
+            std::vector<std::byte> data(size);
+            uint32_t x = 0x13579BDF;
+            for (auto& b : data)
+            {
+                x = x * 1103515245 + 12345;
+                b = std::byte(x >> 24);
+            }
+            return data;
+        }
+
+        std::vector<std::byte> compress(const std::vector<std::byte>& data, stdext::lz4_block_size block_size,
+            stdext::flags<stdext::lz4_frame_options> options)
+        {
+            std::vector<std::byte> buffer(stdext::lz4_compress_bound(data.size()) + 1024);
+            stdext::memory_output_stream sink(buffer.data(), buffer.size());
+            {
+                stdext::lz4_output_stream out(sink, block_size, options);
+                for (size_t offset = 0; offset < data.size(); offset += 10000)
+                    out.write_all(data.data() + offset, std::min(size_t(10000), data.size() - offset));
+                out.finish();
+            }
+            buffer.resize(size_t(sink.position()));
+            return buffer;
+        }
+
+        std::vector<std::byte> decompress(const std::vector<std::byte>& frame)
+        {
+            stdext::memory_input_stream source(frame.data(), frame.size());
+            stdext::lz4_input_stream in(source);
+            std::vector<std::byte> result;
+            std::byte buffer[3000];
+            while (auto count = in.read(buffer, std::size(buffer)))
+                result.insert(result.end(), buffer, buffer + count);
+            return result;
+        }
+    }
+
+    TEST_CASE("lz4 block round trip", "[lz4]")
+    {
+        for (size_t size : { 0, 1, 12, 13, 100, 65536, 300000 })
+        {
+            auto data = make_data(size);
+            std::vector<std::byte> compressed(stdext::lz4_compress_bound(size));
+            auto compressed_size = stdext::lz4_compress_block({ data.data(), data.size() }, compressed);
+            REQUIRE(compressed_size != 0);
+            if (size > 1000)
+                CHECK(compressed_size < size / 2);
+
+            std::vector<std::byte> decompressed(size);
+            auto decompressed_size = stdext::lz4_decompress_block({ compressed.data(), compressed_size }, decompressed);
+            CHECK(decompressed_size == size);
+            CHECK(decompressed == data);
+        }
+
+        auto data = make_random(10000);
+        std::vector<std::byte> compressed(stdext::lz4_compress_bound(data.size()));
+        auto compressed_size = stdext::lz4_compress_block({ data.data(), data.size() }, compressed);
+        REQUIRE(compressed_size != 0);
+        std::vector<std::byte> decompressed(data.size());
+        CHECK(stdext::lz4_decompress_block({ compressed.data(), compressed_size }, decompressed) == data.size());
+        CHECK(decompressed == data);
+
+        // A destination that is too small is reported rather than overrun.
+        std::vector<std::byte> small(100);
+        CHECK(stdext::lz4_compress_block({ data.data(), data.size() }, small) == 0);
+    }
+
+    TEST_CASE("lz4 block decoding", "[lz4]")
+    {
+        // One literal followed by an overlapping match of 24 bytes at offset 1, then five literals.
+        auto block = make_bytes({ 0x1F, 'a', 0x01, 0x00, 0x05, 0x50, 'a', 'a', 'a', 'a', 'a' });
+        std::vector<std::byte> output(64);
+        auto size = stdext::lz4_decompress_block({ block.data(), block.size() }, output);
+        REQUIRE(size == 30);
+        for (size_t n = 0; n != size; ++n)
+            CHECK(output[n] == std::byte('a'));
+
+        // Offset pointing before the start of the output.
+        auto bad_offset = make_bytes({ 0x10, 'a', 0x02, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' });
+        CHECK_THROWS_AS(stdext::lz4_decompress_block({ bad_offset.data(), bad_offset.size() }, output), stdext::lz4_error);
+
+        // Literal run extending past the end of the input.
+        auto truncated = make_bytes({ 0x50, 'a', 'a' });
+        CHECK_THROWS_AS(stdext::lz4_decompress_block({ truncated.data(), truncated.size() }, output), stdext::lz4_error);
+
+        // Output does not fit.
+        std::vector<std::byte> tiny(10);
+        CHECK_THROWS_AS(stdext::lz4_decompress_block({ block.data(), block.size() }, tiny), stdext::lz4_error);
+    }
+
+    TEST_CASE("lz4 frame format", "[lz4]")
+    {
+        // The frame produced by the reference implementation for empty input.
+        auto empty = make_bytes({ 0x04, 0x22, 0x4D, 0x18, 0x64, 0x40, 0xA7, 0x00, 0x00, 0x00, 0x00, 0x05, 0x5D, 0xCC, 0x02 });
+        CHECK(compress({ }, stdext::lz4_block_size::max_64kb, stdext::lz4_output_stream::default_options) == empty);
+        CHECK(decompress(empty).empty());
+
+        // Two linked blocks; the second refers back into the first.
+        auto header = make_bytes({ 0x04, 0x22, 0x4D, 0x18, 0x40, 0x40 });
+        auto hc = stdext::xxhash32({ header.data() + 4, 2 }) >> 8 & 0xFF;
+        auto frame = header;
+        frame.push_back(std::byte(hc));
+        for (auto block : { make_bytes({ 0x06, 0x00, 0x00, 0x00, 0x50, 'h', 'e', 'l', 'l', 'o' }),
+            make_bytes({ 0x09, 0x00, 0x00, 0x00, 0x01, 0x05, 0x00, 0x50, 'w', 'o', 'r', 'l', 'd' }),
+            make_bytes({ 0x00, 0x00, 0x00, 0x00 }) })
+            frame.insert(frame.end(), block.begin(), block.end());
+
+        auto decoded = decompress(frame);
+        std::string text(reinterpret_cast<const char*>(decoded.data()), decoded.size());
+        CHECK(text == "hellohelloworld");
+
+        // Skippable frames and concatenated frames.
+        auto skippable = make_bytes({ 0x5A, 0x2A, 0x4D, 0x18, 0x03, 0x00, 0x00, 0x00, 1, 2, 3 });
+        auto combined = skippable;
+        combined.insert(combined.end(), frame.begin(), frame.end());
+        combined.insert(combined.end(), empty.begin(), empty.end());
+        combined.insert(combined.end(), frame.begin(), frame.end());
+        decoded = decompress(combined);
+        text.assign(reinterpret_cast<const char*>(decoded.data()), decoded.size());
+        CHECK(text == "hellohelloworldhellohelloworld");
+
+        // Corrupted header checksum.
+        auto bad = empty;
+        bad[6] ^= std::byte(1);
+        CHECK_THROWS_AS(decompress(bad), stdext::lz4_error);
+    }
+
+    TEST_CASE("lz4 stream round trip", "[lz4]")
+    {
+        using stdext::lz4_frame_options;
+
+        auto data = make_data(700000);
+        auto random = make_random(200000);
+        data.insert(data.end(), random.begin(), random.end());
+
+        for (auto options : { stdext::flags<lz4_frame_options>(lz4_frame_options::none),
+            stdext::lz4_output_stream::default_options,
+            stdext::flags<lz4_frame_options>(lz4_frame_options::linked_blocks, lz4_frame_options::block_checksum, lz4_frame_options::content_checksum) })
+        {
+            for (auto block_size : { stdext::lz4_block_size::max_64kb, stdext::lz4_block_size::max_1mb })
+            {
+                auto frame = compress(data, block_size, options);
+                CHECK(frame.size() < data.size() * 3 / 4);
+                CHECK(decompress(frame) == data);
+            }
+        }
+
+        auto frame = compress(data, stdext::lz4_block_size::max_64kb, stdext::lz4_output_stream::default_options);
+
+        // Corrupting the content must be detected by the content checksum or the decoder.
+        auto bad = frame;
+        bad[bad.size() / 2] ^= std::byte(0x40);
+        CHECK_THROWS_AS(decompress(bad), stdext::stream_error);
+
+        // Skipping and direct reads.
+        stdext::memory_input_stream source(frame.data(), frame.size());
+        stdext::lz4_input_stream in(source);
+        REQUIRE(in.skip<std::byte>(100000) == 100000);
+        std::vector<std::byte> rest;
+        while (in.direct_read([&](const std::byte* buffer, size_t size)
+        {
+            rest.insert(rest.end(), buffer, buffer + size);
+            return size;
+        }) != 0)
+            ;
+        CHECK(std::equal(rest.begin(), rest.end(), data.begin() + 100000, data.end()));
+        CHECK(rest.size() == data.size() - 100000);
+    }
+}
@@ -0,0 +1,206 @@
+#include <stdext/record.h>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        struct native_record
+        {
+            uint32_t id;
+            uint16_t kind;
+            uint16_t flags;
+            int64_t value;
+        };
+
+        using native_layout = stdext::record_layout<native_record,
+            stdext::record_field<&native_record::id>,
+            stdext::record_field<&native_record::kind>,
+            stdext::record_field<&native_record::flags>,
+            stdext::record_field<&native_record::value>>;
+
+        using big_endian_layout = stdext::record_layout<native_record,
+            stdext::record_field<&native_record::id, stdext::byte_order::big_endian>,
+            stdext::record_field<&native_record::kind, stdext::byte_order::big_endian>,
+            stdext::record_field<&native_record::flags, stdext::byte_order::big_endian>,
+            stdext::record_field<&native_record::value, stdext::byte_order::big_endian>>;
+
+        // Fields out of order relative to the struct.
+        using reordered_layout = stdext::record_layout<native_record,
+            stdext::record_field<&native_record::value>,
+            stdext::record_field<&native_record::id>>;
+
+        enum class color : uint8_t { red, green, blue };
+
+        struct padded_record
+        {
+            color tint;
+            uint32_t size;
+            char name[3];
+            stdext::endian_int<uint16_t, stdext::byte_order::big_endian> port;
+            float scale;
+        };
+
+        using padded_layout = stdext::record_layout<padded_record,
+            stdext::record_field<&padded_record::tint>,
+            stdext::record_field<&padded_record::size, stdext::byte_order::little_endian>,
+            stdext::record_field<&padded_record::name>,
+            stdext::record_field<&padded_record::port>,
+            stdext::record_field<&padded_record::scale, stdext::byte_order::big_endian>>;
+
+        bool operator == (const native_record& a, const native_record& b)
+        {
+            return a.id == b.id && a.kind == b.kind && a.flags == b.flags && a.value == b.value;
+        }
+
+        std::vector<native_record> make_records(size_t count)
+        {
+            std::vector<native_record> records(count);
+            uint64_t x = 0x0123456789ABCDEF;
+            for (auto& record : records)
+            {
+                x = x * 6364136223846793005 + 1442695040888963407;
+                record = { uint32_t(x >> 32), uint16_t(x >> 16), uint16_t(x), int64_t(x ^ x << 13) };
+            }
+            return records;
+        }
+    }
+
+    TEST_CASE("record layout", "[record]")
+    {
+        CHECK(native_layout::wire_size == 16);
+        CHECK(native_layout::wire_offsets[3] == 8);
+        CHECK(native_layout::is_identity() == (stdext::byte_order::native_endian == stdext::byte_order::little_endian
+            || stdext::byte_order::native_endian == stdext::byte_order::big_endian));
+        CHECK(big_endian_layout::is_identity() == (stdext::byte_order::native_endian == stdext::byte_order::big_endian));
+        CHECK_FALSE(reordered_layout::is_identity());
+        CHECK(reordered_layout::wire_size == 12);
+        CHECK_FALSE(padded_layout::is_identity());
+        CHECK(padded_layout::wire_size == 1 + 4 + 3 + 2 + 4);
+    }
+
+    TEST_CASE("record encode", "[record]")
+    {
+        const native_record record = { 0x01020304, 0x0506, 0x0708, -2 };
+        std::byte buffer[16];
+        big_endian_layout::encode(record, buffer);
+        const std::byte expected[] = {
+            std::byte(0x01), std::byte(0x02), std::byte(0x03), std::byte(0x04),
+            std::byte(0x05), std::byte(0x06), std::byte(0x07), std::byte(0x08),
+            std::byte(0xFF), std::byte(0xFF), std::byte(0xFF), std::byte(0xFF),
+            std::byte(0xFF), std::byte(0xFF), std::byte(0xFF), std::byte(0xFE)
+        };
+        CHECK(std::equal(std::begin(expected), std::end(expected), buffer));
+
+        native_record decoded = { };
+        big_endian_layout::decode(buffer, decoded);
+        CHECK(decoded == record);
+
+        std::byte reordered[12];
+        reordered_layout::encode(record, reordered);
+        native_record partial = { };
+        reordered_layout::decode(reordered, partial);
+        CHECK(partial.id == record.id);
+        CHECK(partial.value == record.value);
+        CHECK(partial.kind == 0);
+
+        padded_record padded = { color::blue, 0x11223344, { 'a', 'b', 'c' }, uint16_t(8080), 1.0f };
+        std::byte padded_buffer[padded_layout::wire_size];
+        padded_layout::encode(padded, padded_buffer);
+        const std::byte padded_expected[] = {
+            std::byte(2),
+            std::byte(0x44), std::byte(0x33), std::byte(0x22), std::byte(0x11),
+            std::byte('a'), std::byte('b'), std::byte('c'),
+            std::byte(0x1F), std::byte(0x90),
+            std::byte(0x3F), std::byte(0x80), std::byte(0x00), std::byte(0x00)
+        };
+        CHECK(std::equal(std::begin(padded_expected), std::end(padded_expected), padded_buffer));
+
+        padded_record padded_decoded = { };
+        padded_layout::decode(padded_buffer, padded_decoded);
+        CHECK(padded_decoded.tint == color::blue);
+        CHECK(padded_decoded.size == 0x11223344);
+        CHECK(std::equal(std::begin(padded.name), std::end(padded.name), padded_decoded.name));
+        CHECK(padded_decoded.port.get() == 8080);
+        CHECK(padded_decoded.scale == 1.0f);
+    }
+
+    TEST_CASE("record stream", "[record]")
+    {
+        auto records = make_records(1000);
+
+        std::vector<std::byte> native(records.size() * 16);
+        stdext::memory_output_stream native_out(native.data(), native.size());
+        native_layout::write(native_out, records.data(), records.size());
+        CHECK(size_t(native_out.position()) == native.size());
+
+        std::vector<std::byte> big(records.size() * 16 + 16);
+        stdext::memory_output_stream big_out(big.data(), big.size());
+        big_endian_layout::write(big_out, records.data(), records.size());
+        big_endian_layout::write(big_out, records[0]);
+        CHECK(size_t(big_out.position()) == big.size());
+
+        // The bulk encoding matches per-record encoding.
+        std::byte buffer[16];
+        big_endian_layout::encode(records[999], buffer);
+        CHECK(std::equal(std::begin(buffer), std::end(buffer), big.begin() + 999 * 16));
+
+        std::vector<std::byte> encoded(big.size());
+        CHECK(big_endian_layout::encode({ records.data(), records.size() }, encoded) == records.size() * 16);
+        CHECK(std::equal(encoded.begin(), encoded.begin() + ptrdiff_t(records.size() * 16), big.begin()));
+
+        stdext::memory_input_stream native_in(native.data(), native.size());
+        std::vector<native_record> read(records.size());
+        native_layout::read(native_in, read.data(), read.size());
+        CHECK(read == records);
+
+        stdext::memory_input_stream big_in(big.data(), big.size());
+        std::vector<native_record> big_read(records.size());
+        big_endian_layout::read(big_in, big_read.data(), big_read.size());
+        CHECK(big_read == records);
+        CHECK(big_endian_layout::read(big_in) == records[0]);
+        CHECK_THROWS_AS(big_endian_layout::read(big_in), stdext::stream_error);
+
+        std::vector<native_record> decoded(records.size());
+        CHECK(big_endian_layout::decode({ big.data(), big.size() }, decoded) == records.size() * 16);
+        CHECK(decoded == records);
+        CHECK(native_layout::decode({ native.data(), native.size() }, decoded) == records.size() * 16);
+        CHECK(decoded == records);
+        CHECK_THROWS_AS(native_layout::decode({ native.data(), native.size() - 1 }, decoded), stdext::stream_error);
+    }
+
+    TEST_CASE("record columns", "[record]")
+    {
+        auto records = make_records(1000);
+        std::vector<std::byte> big(records.size() * 16);
+        CHECK(big_endian_layout::encode({ records.data(), records.size() }, big) == big.size());
+
+        std::vector<uint32_t> ids(records.size());
+        std::vector<uint16_t> kinds(records.size());
+        std::vector<int64_t> values(records.size());
+        CHECK(big_endian_layout::decode_columns({ big.data(), big.size() }, records.size(),
+            ids.data(), kinds.data(), nullptr, values.data()) == big.size());
+        for (size_t n = 0; n != records.size(); ++n)
+        {
+            CHECK(ids[n] == records[n].id);
+            CHECK(kinds[n] == records[n].kind);
+            CHECK(values[n] == records[n].value);
+        }
+        CHECK_THROWS_AS(big_endian_layout::decode_columns({ big.data(), big.size() - 1 }, records.size(),
+            ids.data(), kinds.data(), nullptr, values.data()), stdext::stream_error);
+
+        std::vector<uint16_t> flags(records.size());
+        std::fill(values.begin(), values.end(), 0);
+        stdext::memory_input_stream in(big.data(), big.size());
+        big_endian_layout::read_columns(in, records.size(), nullptr, nullptr, flags.data(), values.data());
+        for (size_t n = 0; n != records.size(); ++n)
+        {
+            CHECK(flags[n] == records[n].flags);
+            CHECK(values[n] == records[n].value);
+        }
+    }
+}
@@ -0,0 +1,193 @@
+#include <stdext/rope.h>
+#include <stdext/string.h>
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <string>
+
+
+namespace test
+{
+    namespace
+    {
+        std::string text(size_t size)
+        {
+            std::string result;
+            result.reserve(size);
+            for (size_t n = 0; n != size; ++n)
+                result.push_back(n % 61 == 60 ? '\n' : char('a' + n % 26));
+            return result;
+        }
+    }
+
+    TEST_CASE("Rope", "[rope]")
+    {
+        SECTION("Construction")
+        {
+            stdext::rope empty;
+            CHECK(empty.empty());
+            CHECK(empty.size() == 0);
+            CHECK(empty.str().empty());
+            CHECK(empty.newline_count() == 0);
+
+            stdext::rope small("hello\nworld");
+            CHECK(small.size() == 11);
+            CHECK(small.newline_count() == 1);
+            CHECK(small.str() == "hello\nworld");
+            CHECK(small[6] == 'w');
+            CHECK_THROWS_AS(small.at(11), std::out_of_range);
+
+            auto s = text(100000);
+            stdext::rope large(s);
+            CHECK(large.size() == s.size());
+            CHECK(large.str() == s);
+            CHECK(large.newline_count() == s.size() / 61);
+            CHECK(large[54321] == s[54321]);
+        }
+
+        SECTION("Editing")
+        {
+            auto s = text(20000);
+            stdext::rope r(s);
+
+            r.insert(12345, stdext::string_view("inserted"));
+            s.insert(12345, "inserted");
+            CHECK(r.str() == s);
+
+            r.erase(1000, 5000);
+            s.erase(1000, 5000);
+            CHECK(r.str() == s);
+
+            r.insert(0, r.substr(3000, 4000));
+            s.insert(0, s.substr(3000, 4000));
+            CHECK(r.str() == s);
+
+            r.erase(s.size() - 10);
+            s.erase(s.size() - 10);
+            CHECK(r.str() == s);
+            CHECK(r.newline_count() == size_t(std::count(s.begin(), s.end(), '\n')));
+
+            CHECK(r.substr(500, 100).str() == s.substr(500, 100));
+            CHECK_THROWS_AS(r.substr(s.size() + 1), std::out_of_range);
+
+            r.clear();
+            CHECK(r.empty());
+        }
+
+        SECTION("Random edits")
+        {
+            std::string s;
+            stdext::rope r;
+            uint32_t x = 12345;
+            auto next = [&] { return x = x * 1664525 + 1013904223; };
+
+            for (int n = 0; n != 2000; ++n)
+            {
+                auto op = next() >> 24 & 3;
+                if (op != 0 || s.empty())
+                {
+                    auto pos = next() % (s.size() + 1);
+                    auto str = text(next() % 3000);
+                    r.insert(pos, stdext::string_view(str));
+                    s.insert(pos, str);
+                }
+                else
+                {
+                    auto pos = next() % s.size();
+                    auto count = next() % 2000;
+                    r.erase(pos, count);
+                    s.erase(pos, count);
+                }
+                REQUIRE(r.size() == s.size());
+            }
+            CHECK(r.str() == s);
+            CHECK(r == stdext::rope(s));
+        }
+
+        SECTION("Appending")
+        {
+            stdext::rope r;
+            std::string s;
+            for (int n = 0; n != 10000; ++n)
+            {
+                auto piece = std::to_string(n) + (n % 10 == 9 ? "\n" : " ");
+                r += piece;
+                s += piece;
+            }
+            CHECK(r.str() == s);
+            CHECK(r.newline_count() == 1000);
+
+            // Appending to a copy leaves the original alone.
+            auto copy = r;
+            copy += stdext::string_view("more");
+            CHECK(r.str() == s);
+            CHECK(copy.str() == s + "more");
+            CHECK(copy != r);
+
+            auto joined = r + copy;
+            CHECK(joined.str() == s + s + "more");
+        }
+
+        SECTION("Lines")
+        {
+            stdext::rope r;
+            for (int n = 0; n != 5000; ++n)
+                r += "line " + std::to_string(n) + "\n";
+
+            CHECK(r.newline_count() == 5000);
+            CHECK(r.line_offset(0) == 0);
+            for (size_t line : { 1, 7, 100, 2500, 4999, 5000 })
+            {
+                auto offset = r.line_offset(line);
+                REQUIRE(offset != stdext::rope::npos);
+                CHECK(r[offset - 1] == '\n');
+                if (line != 5000)
+                    CHECK(r.substr(offset, 5 + std::to_string(line).size()).str() == "line " + std::to_string(line));
+            }
+            CHECK(r.line_offset(5001) == stdext::rope::npos);
+        }
+
+        SECTION("Range")
+        {
+            auto s = text(10000);
+            stdext::rope r(s);
+
+            CHECK(std::string(r.begin(), r.end()) == s);
+
+            auto pos = r.begin_pos();
+            stdext::advance_pos(r, pos, 7777);
+            CHECK(r.at_pos(pos) == s[7777]);
+            stdext::advance_pos(r, pos, -7000);
+            CHECK(r.at_pos(pos) == s[777]);
+            r.dec_pos(pos);
+            CHECK(r.at_pos(pos) == s[776]);
+            CHECK(r.distance(r.begin_pos(), pos) == 776);
+
+            auto end = r.end_pos();
+            CHECK(r.is_end_pos(end));
+            r.dec_pos(end);
+            CHECK(r.at_pos(end) == s.back());
+
+            std::string reversed;
+            for (auto i = r.end(); i != r.begin(); )
+                reversed.push_back(*--i);
+            CHECK(std::string(reversed.rbegin(), reversed.rend()) == s);
+        }
+
+        SECTION("Generator")
+        {
+            auto s = text(50000);
+            stdext::rope r(s);
+
+            stdext::stringbuf buf;
+            REQUIRE(r >> buf);
+            CHECK(buf.extract() == s);
+
+            std::string chars;
+            auto out = [&](char c) { chars.push_back(c); return true; };
+            REQUIRE(stdext::rope("abc\ndef") >> out);
+            CHECK(chars == "abc\ndef");
+        }
+    }
+}
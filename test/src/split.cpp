@@ -0,0 +1,134 @@
+#include <stdext/split.h>
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        // The tokens of str, split as getline would.
+        std::vector<std::string> reference_split(const std::string& str, const std::string& delimiters)
+        {
+            std::vector<std::string> result;
+            size_t start = 0;
+            while (start != str.size())
+            {
+                auto end = str.find_first_of(delimiters, start);
+                if (end == std::string::npos)
+                {
+                    result.push_back(str.substr(start));
+                    break;
+                }
+                result.push_back(str.substr(start, end - start));
+                start = end + 1;
+            }
+            return result;
+        }
+
+        template <typename Generator>
+        std::vector<std::string> tokens(Generator&& gen)
+        {
+            std::vector<std::string> result;
+            for (; gen; ++gen)
+                result.emplace_back(gen->data(), gen->size());
+            return result;
+        }
+
+        std::vector<std::string> stream_tokens(const std::string& str, char delimiter, size_t block_size)
+        {
+            stdext::memory_input_stream stream(reinterpret_cast<const stdext::byte*>(str.data()), str.size());
+            return tokens(stdext::split(stream, delimiter, block_size));
+        }
+
+        std::string random_text(uint32_t& x, size_t size, const char* alphabet, size_t alphabet_size)
+        {
+            std::string result(size, ' ');
+            for (auto& c : result)
+            {
+                x = x * 1664525 + 1013904223;
+                c = alphabet[(x >> 16) % alphabet_size];
+            }
+            return result;
+        }
+    }
+
+    TEST_CASE("Split", "[split]")
+    {
+        SECTION("Views")
+        {
+            using tokens_t = std::vector<std::string>;
+            CHECK(tokens(stdext::split("", '\n')).empty());
+            CHECK(tokens(stdext::split("\n", '\n')) == tokens_t{ "" });
+            CHECK(tokens(stdext::split("a\n\nb\n", '\n')) == tokens_t{ "a", "", "b" });
+            CHECK(tokens(stdext::split("a\n\nb", '\n')) == tokens_t{ "a", "", "b" });
+            CHECK(tokens(stdext::split_any("key=value; other=1", "=; ")) == tokens_t{ "key", "value", "", "other", "1" });
+
+            std::string str = "one two three";
+            auto gen = stdext::split(str, ' ');
+            CHECK(gen->data() == str.data());
+            ++gen;
+            CHECK(gen->data() == str.data() + 4);
+
+            auto copy = gen;
+            CHECK(copy == gen);
+            ++copy;
+            CHECK(copy != gen);
+            ++copy;
+            CHECK(!copy);
+            CHECK(copy == stdext::split_generator());
+        }
+
+        SECTION("Random views")
+        {
+            uint32_t x = 1;
+            const char alphabet[] = "ab,;\n\x80\xFF";
+            for (int n = 0; n != 500; ++n)
+            {
+                auto str = random_text(x, x % 1000, alphabet, n % 2 == 0 ? 3 : sizeof(alphabet) - 1);
+                CHECK(tokens(stdext::split(str, ',')) == reference_split(str, ","));
+                CHECK(tokens(stdext::split_any(str, ";\n\xFF")) == reference_split(str, ";\n\xFF"));
+            }
+        }
+
+        SECTION("Streams")
+        {
+            uint32_t x = 7;
+            const char alphabet[] = "abcdefgh\n";
+            for (size_t block_size : { 1, 3, 64, 100, 4096 })
+            {
+                for (int n = 0; n != 50; ++n)
+                {
+                    auto str = random_text(x, x % 3000, alphabet, n % 5 == 0 ? 8 : 9);
+                    CHECK(stream_tokens(str, '\n', block_size) == reference_split(str, "\n"));
+                }
+            }
+
+            std::string lines = "first line\nsecond line\r\nthird";
+            stdext::memory_input_stream stream(reinterpret_cast<const stdext::byte*>(lines.data()), lines.size());
+            CHECK(tokens(stdext::split_any(stream, "\r\n", 8)) == std::vector<std::string>{ "first line", "second line", "", "third" });
+        }
+
+        SECTION("Consumers")
+        {
+            std::string text;
+            for (int n = 0; n != 1000; ++n)
+                text += "line " + std::to_string(n) + "\n";
+
+            size_t count = 0;
+            size_t length = 0;
+            auto out = [&](stdext::string_view line)
+            {
+                ++count;
+                length += line.size();
+                return true;
+            };
+            REQUIRE(stdext::split(text, '\n') >> out);
+            CHECK(count == 1000);
+            CHECK(length == text.size() - 1000);
+        }
+    }
+}
@@ -0,0 +1,408 @@
+#include <stdext/scope_guard.h>
+#include <stdext/string.h>
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+#include <clocale>
+#include <cuchar>
+#include <cwchar>
+
+
+namespace test
+{
+    namespace
+    {
+        bool set_utf8_locale()
+        {
+            for (auto name : { "C.UTF-8", "en_US.UTF-8", ".UTF-8" })
+            {
+                if (std::setlocale(LC_ALL, name) != nullptr)
+                    return true;
+            }
+            return false;
+        }
+
+        // Selects a locale with a stateful multibyte encoding, whose shift sequences must be
+        // terminated.
+        bool set_stateful_locale()
+        {
+            for (auto name : { "ja_JP.ISO-2022-JP", "ja_JP.iso2022jp", "ja_JP.ISO2022JP" })
+            {
+                if (std::setlocale(LC_ALL, name) != nullptr)
+                    return true;
+            }
+            return false;
+        }
+
+        // Converts str with the block conversion if contiguous, and a code unit at a time if not.
+        template <typename Char>
+        std::string to_multibyte(const std::basic_string<Char>& str, bool contiguous)
+        {
+            stdext::stringbuf buf;
+            stdext::basic_string_view<Char> view(str);
+            if (contiguous)
+                view >> stdext::to_multibyte() >> buf;
+            else
+                stdext::make_cstring_generator(str.c_str()) >> stdext::to_multibyte() >> buf;
+            return buf.extract();
+        }
+
+        std::wstring to_wchar(const std::string& str, bool contiguous)
+        {
+            stdext::wstringbuf buf;
+            stdext::string_view view(str);
+            if (contiguous)
+                view >> stdext::to_wchar() >> buf;
+            else
+                stdext::make_cstring_generator(str.c_str()) >> stdext::to_wchar() >> buf;
+            return buf.extract();
+        }
+
+        // The C library conversions, for comparison.
+        template <typename Char>
+        std::string c_to_multibyte(const std::basic_string<Char>& str)
+        {
+            std::mbstate_t state = { };
+            std::string result;
+            char buffer[MB_LEN_MAX];
+            for (auto c : str)
+            {
+                size_t length;
+                if constexpr (std::is_same_v<Char, char16_t>)
+                    length = std::c16rtomb(buffer, c, &state);
+                else if constexpr (std::is_same_v<Char, char32_t>)
+                    length = std::c32rtomb(buffer, c, &state);
+                else
+                    length = std::wcrtomb(buffer, c, &state);
+                REQUIRE(length != size_t(-1));
+                result.append(buffer, length);
+            }
+            return result;
+        }
+
+        std::wstring c_to_wchar(const std::string& str)
+        {
+            std::mbstate_t state = { };
+            std::wstring result;
+            for (size_t pos = 0; pos != str.size(); )
+            {
+                wchar_t c;
+                auto length = std::mbrtowc(&c, str.data() + pos, str.size() - pos, &state);
+                REQUIRE(length < str.size() - pos + 1);
+                result += c;
+                pos += length == 0 ? 1 : length;
+            }
+            return result;
+        }
+
+        template <typename Char>
+        std::basic_string<Char> repeat(const std::basic_string<Char>& str, size_t count)
+        {
+            std::basic_string<Char> result;
+            for (size_t n = 0; n != count; ++n)
+                result += str;
+            return result;
+        }
+    }
+
+    TEST_CASE("Multibyte conversion", "[string]")
+    {
+        std::string saved = std::setlocale(LC_ALL, nullptr);
+        at_scope_exit([&] { std::setlocale(LC_ALL, saved.c_str()); });
+
+        SECTION("C locale")
+        {
+            std::setlocale(LC_ALL, "C");
+            for (bool contiguous : { true, false })
+            {
+                CHECK(to_multibyte(std::wstring(L"Hello, world!"), contiguous) == "Hello, world!");
+                CHECK(to_multibyte(repeat(std::wstring(L"0123456789"), 1000), contiguous) == repeat(std::string("0123456789"), 1000));
+                CHECK(to_wchar(std::string("Hello, world!"), contiguous) == L"Hello, world!");
+                CHECK(to_wchar(repeat(std::string("0123456789"), 1000), contiguous) == repeat(std::wstring(L"0123456789"), 1000));
+            }
+        }
+
+        SECTION("UTF-8 locale")
+        {
+            if (!set_utf8_locale())
+            {
+                WARN("No UTF-8 locale is available");
+                return;
+            }
+
+            // Repeated text of odd length, so that code points straddle the block boundaries.
+            std::string utf8 = "h\xC3\xA9llo, \xE4\xB8\x96\xE7\x95\x8C \xF0\x9F\x98\x80 \xEF\xBF\xBE";
+            std::u16string utf16 = u"h\u00E9llo, \u4E16\u754C \U0001F600 \uFFFE";
+            std::u32string utf32 = U"h\u00E9llo, \u4E16\u754C \U0001F600 \uFFFE";
+            std::wstring wide = L"h\u00E9llo, \u4E16\u754C \U0001F600 \uFFFE";
+            for (size_t count : { 1, 100 })
+            {
+                auto u8 = repeat(utf8, count);
+                auto u16 = repeat(utf16, count);
+                auto u32 = repeat(utf32, count);
+                auto w = repeat(wide, count);
+                for (bool contiguous : { true, false })
+                {
+                    CHECK(to_multibyte(u16, contiguous) == u8);
+                    CHECK(to_multibyte(u32, contiguous) == u8);
+                    CHECK(to_multibyte(w, contiguous) == u8);
+                    CHECK(to_wchar(u8, contiguous) == w);
+                }
+                CHECK(c_to_multibyte(u16) == u8);
+                CHECK(c_to_multibyte(u32) == u8);
+                CHECK(c_to_multibyte(w) == u8);
+                CHECK(c_to_wchar(u8) == w);
+            }
+
+            for (bool contiguous : { true, false })
+            {
+                CHECK_THROWS_AS(to_multibyte(std::u16string(u"a\xDC00" "b"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_multibyte(std::u16string(u"a\xD800" "b"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_multibyte(std::u32string(U"a\x110000"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_multibyte(std::u32string(U"a\xDFFF"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_wchar(std::string("a\xC0\x80"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_wchar(std::string("a\xED\xA0\x80"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_wchar(std::string("a\xF4\x90\x80\x80"), contiguous), std::system_error);
+                CHECK_THROWS_AS(to_wchar(std::string("a\xE4\xB8"), contiguous), std::system_error);
+            }
+        }
+    }
+
+    TEST_CASE("String conversion", "[string]")
+    {
+        std::string saved = std::setlocale(LC_ALL, nullptr);
+        at_scope_exit([&] { std::setlocale(LC_ALL, saved.c_str()); });
+
+        SECTION("C locale")
+        {
+            std::setlocale(LC_ALL, "C");
+            CHECK(stdext::to_mbstring(L"Hello, world!") == "Hello, world!");
+            CHECK(stdext::to_wstring("Hello, world!") == L"Hello, world!");
+            CHECK(stdext::to_mbstring(std::wstring()) == "");
+            CHECK(stdext::to_wstring(std::string()) == L"");
+            CHECK(stdext::to_mbstring(repeat(std::wstring(L"0123456789"), 1000)) == repeat(std::string("0123456789"), 1000));
+            CHECK(stdext::to_wstring(repeat(std::string("0123456789"), 1000)) == repeat(std::wstring(L"0123456789"), 1000));
+        }
+
+        SECTION("UTF-8 locale")
+        {
+            if (!set_utf8_locale())
+            {
+                WARN("No UTF-8 locale is available");
+                return;
+            }
+
+            std::string utf8 = "h\xC3\xA9llo, \xE4\xB8\x96\xE7\x95\x8C \xF0\x9F\x98\x80 \xEF\xBF\xBE";
+            std::wstring wide = L"h\u00E9llo, \u4E16\u754C \U0001F600 \uFFFE";
+            for (size_t count : { 1, 100 })
+            {
+                auto u8 = repeat(utf8, count);
+                auto w = repeat(wide, count);
+                CHECK(stdext::to_mbstring(w) == u8);
+                CHECK(stdext::to_mbstring(w.c_str()) == u8);
+                CHECK(stdext::to_wstring(u8) == w);
+                CHECK(stdext::to_wstring(u8.c_str()) == w);
+
+                stdext::stringbuf buf;
+                auto result = stdext::to_mbstring(w, buf);
+                CHECK(result.status == stdext::string_conversion_status::ok);
+                CHECK(result.consumed == w.size());
+                CHECK(result.produced == u8.size());
+                CHECK(buf.extract() == u8);
+
+                stdext::wstringbuf wbuf;
+                result = stdext::to_wstring(u8, wbuf);
+                CHECK(result.status == stdext::string_conversion_status::ok);
+                CHECK(result.consumed == u8.size());
+                CHECK(result.produced == w.size());
+                CHECK(wbuf.extract() == w);
+            }
+
+            // Every output size, so that each character in turn is the first not to fit.
+            for (size_t size = 0; size <= utf8.size() + 1; ++size)
+            {
+                std::string out(size, '\0');
+                auto result = stdext::to_mbstring(wide, out);
+                CHECK(result.status == (size < utf8.size() ? stdext::string_conversion_status::partial_write : stdext::string_conversion_status::ok));
+                CHECK(size - result.produced < 4);
+                CHECK(std::string(out.data(), result.produced) == stdext::to_mbstring(wide.substr(0, result.consumed)));
+            }
+            for (size_t size = 0; size <= wide.size() + 1; ++size)
+            {
+                std::wstring out(size, L'\0');
+                auto result = stdext::to_wstring(utf8, out);
+                CHECK(result.status == (size < wide.size() ? stdext::string_conversion_status::partial_write : stdext::string_conversion_status::ok));
+                CHECK(std::wstring(out.data(), result.produced) == stdext::to_wstring(utf8.substr(0, result.consumed)));
+            }
+
+            auto error_position = [](auto&& str)
+            {
+                try
+                {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(str)>, std::string>)
+                        stdext::to_wstring(str);
+                    else
+                        stdext::to_mbstring(str);
+                }
+                catch (const stdext::conversion_error& e)
+                {
+                    CHECK(e.code() == std::errc::illegal_byte_sequence);
+                    return e.position();
+                }
+                return size_t(-1);
+            };
+            CHECK(error_position(std::wstring(L"ab") + wchar_t(0xDFFF)) == 2);
+            CHECK(error_position(repeat(wide, 10) + wchar_t(0xDFFF) + L"a") == wide.size() * 10);
+            CHECK(error_position(std::wstring(L"a") + wchar_t(WCHAR_MAX > 0xFFFF ? 0x110000 : 0xD800) + L"b") == 1);
+            CHECK(error_position(std::string("ab\xC0\x80")) == 2);
+            CHECK(error_position(repeat(utf8, 10) + "\xED\xA0\x80") == utf8.size() * 10);
+            CHECK(error_position(std::string("a\xE4\xB8")) == 1);
+
+            char out[16];
+            auto result = stdext::to_mbstring(std::wstring(L"abc") + wchar_t(0xDFFF), out);
+            CHECK(result.status == stdext::string_conversion_status::error);
+            CHECK(result.consumed == 3);
+            CHECK(result.produced == 3);
+
+            stdext::wstringbuf wbuf;
+            result = stdext::to_wstring(repeat(utf8, 100) + "\xFF", wbuf);
+            CHECK(result.status == stdext::string_conversion_status::error);
+            CHECK(result.consumed == utf8.size() * 100);
+            CHECK(wbuf.extract() == repeat(wide, 100));
+        }
+
+        SECTION("Stateful locale")
+        {
+            if (!set_stateful_locale())
+            {
+                WARN("No stateful locale is available");
+                return;
+            }
+
+            // Text ending in a shifted state must be followed by the sequence that leaves it.
+            std::wstring wide = L"abc\u3042\u3044";
+            const wchar_t* src = wide.c_str();
+            std::mbstate_t state = { };
+            std::string expected(std::wcsrtombs(nullptr, &src, 0, &state), '\0');
+            REQUIRE(expected.size() != size_t(-1));
+            std::wcsrtombs(expected.data(), &src, expected.size(), &state);
+
+            CHECK(stdext::to_mbstring(wide) == expected);
+            CHECK(stdext::to_mbstring(wide.c_str()) == expected);
+
+            stdext::stringbuf buf;
+            auto result = stdext::to_mbstring(wide, buf);
+            CHECK(result.status == stdext::string_conversion_status::ok);
+            CHECK(result.produced == expected.size());
+            CHECK(buf.extract() == expected);
+
+            std::string out(expected.size(), '\0');
+            result = stdext::to_mbstring(wide, out);
+            CHECK(result.status == stdext::string_conversion_status::ok);
+            CHECK(out == expected);
+
+            // Reading the output back, without its terminating null, ends in the initial state.
+            std::mbstate_t end_state = { };
+            for (size_t pos = 0; pos != expected.size(); )
+            {
+                wchar_t c;
+                auto length = std::mbrtowc(&c, expected.data() + pos, expected.size() - pos, &end_state);
+                REQUIRE(length != size_t(-1));
+                if (length == size_t(-2))
+                    break;      // A trailing shift sequence, consumed without producing a character
+                pos += length == 0 ? 1 : length;
+            }
+            CHECK(std::mbsinit(&end_state));
+        }
+    }
+
+    TEST_CASE("String builder", "[string]")
+    {
+        stdext::basic_string_builder<char, 16> buf;
+        CHECK(buf.empty());
+        CHECK(buf.capacity() == 16);
+
+        SECTION("Inline storage")
+        {
+            CHECK(buf('a'));
+            CHECK(buf(stdext::string_view("bcdefghijklmnop")));
+            CHECK(buf.str() == "abcdefghijklmnop");
+            CHECK(buf.capacity() == 16);
+            CHECK(buf.extract() == "abcdefghijklmnop");
+            CHECK(buf.empty());
+        }
+
+        SECTION("Growth")
+        {
+            std::string expected;
+            for (int n = 0; n != 1000; ++n)
+            {
+                char c = char('a' + n % 26);
+                CHECK(buf(c));
+                expected += c;
+            }
+            CHECK(buf.str() == expected);
+            CHECK(buf.capacity() >= 1000);
+
+            // Capacity is kept across extract and reset.
+            auto capacity = buf.capacity();
+            auto data = buf.data();
+            CHECK(buf.extract() == expected);
+            CHECK(buf(stdext::string_view(expected)));
+            buf.reset();
+            CHECK(buf.empty());
+            CHECK(buf.capacity() == capacity);
+            CHECK(buf.data() == data);
+        }
+
+        SECTION("Reserve")
+        {
+            buf.reserve(8);
+            CHECK(buf.capacity() == 16);
+            buf.reserve(100);
+            CHECK(buf.capacity() == 100);
+        }
+
+        SECTION("Prepare and commit")
+        {
+            CHECK(buf(stdext::string_view("x = ")));
+            auto space = buf.prepare(4);
+            CHECK(space.size() >= 4);
+            std::copy_n("1234", 4, space.data());
+            buf.commit(4);
+            space = buf.prepare(100);
+            CHECK(space.size() >= 100);
+            std::fill_n(space.data(), 100, '5');
+            buf.commit(2);
+            CHECK(buf.str() == "x = 123455");
+        }
+
+        SECTION("Copy and move")
+        {
+            for (auto text : { stdext::string_view("short"), stdext::string_view("a string too long for inline storage") })
+            {
+                buf.reset();
+                buf(text);
+
+                auto copy = buf;
+                CHECK(copy.str() == buf.str());
+                CHECK(copy.data() != buf.data());
+
+                auto moved = std::move(copy);
+                CHECK(moved.str() == std::string(text.data(), text.size()));
+                CHECK(copy.empty());
+
+                stdext::basic_string_builder<char, 16> assigned;
+                assigned('z');
+                assigned = std::move(moved);
+                CHECK(assigned.str() == std::string(text.data(), text.size()));
+                CHECK(moved.empty());
+
+                assigned = buf;
+                CHECK(assigned.str() == std::string(text.data(), text.size()));
+            }
+        }
+    }
+}
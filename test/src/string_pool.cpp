@@ -0,0 +1,156 @@
+#include <stdext/string.h>
+#include <stdext/string_pool.h>
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        std::string identifier(size_t n)
+        {
+            return "identifier_" + std::to_string(n);
+        }
+    }
+
+    TEST_CASE("String pool", "[string_pool]")
+    {
+        stdext::string_pool pool;
+        CHECK(pool.empty());
+        CHECK(pool.find("missing") == stdext::string_pool::no_symbol);
+
+        SECTION("Interning")
+        {
+            std::string first = "first";
+            std::string second = "second";
+            auto a = pool.intern(first);
+            auto b = pool.intern(second);
+            CHECK(a == 0);
+            CHECK(b == 1);
+            CHECK(pool.intern(std::string("first")) == a);
+            CHECK(pool.intern(stdext::string_view("second")) == b);
+            CHECK(pool.size() == 2);
+            CHECK(pool.find("first") == a);
+            CHECK(pool.find("firs") == stdext::string_pool::no_symbol);
+
+            // Pooled strings are copies, and compare equal as views exactly when they're the same string.
+            CHECK(pool.str(a).data() != first.data());
+            CHECK(pool.intern_view(first) == pool.str(a));
+            CHECK(pool.intern_view(std::string("second")) == pool.str(b));
+            CHECK(pool.str(a) != pool.str(b));
+        }
+
+        SECTION("Null termination")
+        {
+            auto empty = pool.intern("");
+            auto id = pool.intern(stdext::string_view("abcdef", 3));
+            CHECK(pool.str(empty).empty());
+            CHECK(*pool.c_str(empty) == '\0');
+            CHECK(std::string(pool.c_str(id)) == "abc");
+
+            stdext::stringbuf buf;
+            stdext::make_cstring_generator(pool.c_str(id)) >> buf;
+            CHECK(buf.extract() == "abc");
+        }
+
+        SECTION("Many strings")
+        {
+            // Enough strings to fill several blocks and rehash the table repeatedly.
+            std::vector<stdext::string_view> views;
+            for (size_t n = 0; n != 20000; ++n)
+            {
+                auto id = pool.intern(identifier(n));
+                CHECK(id == n);
+                views.push_back(pool.str(id));
+            }
+            CHECK(pool.size() == 20000);
+
+            for (size_t n = 0; n != 20000; ++n)
+            {
+                auto str = identifier(n);
+                CHECK(pool.intern(str) == n);
+                CHECK(pool.find(str) == n);
+                CHECK(pool.str(stdext::string_pool::symbol(n)) == views[n]);
+                CHECK(std::string(pool.c_str(stdext::string_pool::symbol(n))) == str);
+            }
+            CHECK(pool.size() == 20000);
+        }
+
+        SECTION("Large strings")
+        {
+            stdext::string_pool small(64);
+            std::string large(1000, 'x');
+            auto a = small.intern("a");
+            auto b = small.intern(large);
+            auto c = small.intern("c");
+            CHECK(std::string(small.c_str(a)) == "a");
+            CHECK(std::string(small.c_str(b)) == large);
+            CHECK(std::string(small.c_str(c)) == "c");
+            CHECK(small.c_str(c) == small.c_str(a) + 2);
+        }
+
+        SECTION("Move and clear")
+        {
+            auto id = pool.intern("moved");
+            auto view = pool.str(id);
+            stdext::string_pool moved = std::move(pool);
+            CHECK(moved.str(id) == view);
+            CHECK(pool.empty());
+            CHECK(pool.intern("new") == 0);
+
+            moved.clear();
+            CHECK(moved.empty());
+            CHECK(moved.find("moved") == stdext::string_pool::no_symbol);
+            CHECK(moved.intern("moved") == 0);
+        }
+
+        SECTION("Wide strings")
+        {
+            stdext::wstring_pool wpool;
+            auto id = wpool.intern(L"wide");
+            CHECK(wpool.intern(std::wstring(L"wide")) == id);
+            CHECK(std::wstring(wpool.c_str(id)) == L"wide");
+        }
+    }
+
+    TEST_CASE("Concurrent string pool", "[string_pool]")
+    {
+        stdext::concurrent_string_pool pool;
+        constexpr size_t count = 5000;
+        constexpr size_t thread_count = 4;
+
+        // Each thread interns the same strings, in a different order.
+        std::vector<std::vector<stdext::concurrent_string_pool::symbol>> ids(thread_count, std::vector<stdext::concurrent_string_pool::symbol>(count));
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t != thread_count; ++t)
+        {
+            threads.emplace_back([&, t]
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    auto n = t % 2 == 0 ? i : count - 1 - i;
+                    ids[t][n] = pool.intern(identifier(n));
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        CHECK(pool.size() == count);
+        for (size_t n = 0; n != count; ++n)
+        {
+            auto id = ids[0][n];
+            for (size_t t = 1; t != thread_count; ++t)
+                CHECK(ids[t][n] == id);
+            CHECK(pool.find(identifier(n)) == id);
+            CHECK(std::string(pool.c_str(id)) == identifier(n));
+            CHECK(pool.intern_view(identifier(n)) == pool.str(id));
+        }
+        CHECK(pool.find("missing") == stdext::concurrent_string_pool::no_symbol);
+    }
+}
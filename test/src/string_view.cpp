@@ -0,0 +1,127 @@
+#include <stdext/string_view.h>
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+
+namespace test
+{
+    constexpr stdext::u16string_view constant_view(u"key=value; other");
+    static_assert(constant_view.find(u"value") == 4);
+    static_assert(constant_view.find(u'=') == 3);
+    static_assert(constant_view.rfind(u'e') == 14);
+    static_assert(constant_view.find_first_of(u";=") == 3);
+    static_assert(constant_view.find_last_of(u";=") == 9);
+    static_assert(constant_view.find_first_not_of(u"key") == 3);
+    static_assert(constant_view.find_last_not_of(u"other") == 10);
+    static_assert(stdext::string_view("abcabc").rfind("bc") == 4);
+
+    namespace
+    {
+        // Compares every search of a string_view with the same search of a std::string.
+        template <typename Char>
+        void check_searches(const std::basic_string<Char>& str, const std::basic_string<Char>& arg, size_t pos)
+        {
+            stdext::basic_string_view<Char> view(str);
+            stdext::basic_string_view<Char> argv(arg);
+
+            CHECK(view.find(argv, pos) == str.find(arg, pos));
+            CHECK(view.rfind(argv, pos) == str.rfind(arg, pos));
+            CHECK(view.find_first_of(argv, pos) == str.find_first_of(arg, pos));
+            CHECK(view.find_last_of(argv, pos) == str.find_last_of(arg, pos));
+            CHECK(view.find_first_not_of(argv, pos) == str.find_first_not_of(arg, pos));
+            CHECK(view.find_last_not_of(argv, pos) == str.find_last_not_of(arg, pos));
+
+            CHECK(view.find_last_of(arg.data(), pos, arg.size()) == str.find_last_of(arg.data(), pos, arg.size()));
+            CHECK(view.find_last_not_of(arg.data(), pos, arg.size()) == str.find_last_not_of(arg.data(), pos, arg.size()));
+
+            if (!arg.empty())
+            {
+                CHECK(view.find(arg[0], pos) == str.find(arg[0], pos));
+                CHECK(view.rfind(arg[0], pos) == str.rfind(arg[0], pos));
+                CHECK(view.find_last_of(arg[0], pos) == str.find_last_of(arg[0], pos));
+                CHECK(view.find_first_not_of(arg[0], pos) == str.find_first_not_of(arg[0], pos));
+                CHECK(view.find_last_not_of(arg[0], pos) == str.find_last_not_of(arg[0], pos));
+            }
+        }
+
+        template <typename Char>
+        std::basic_string<Char> random_string(uint32_t& x, size_t size, unsigned alphabet)
+        {
+            std::basic_string<Char> result(size, Char());
+            for (auto& c : result)
+            {
+                x = x * 1664525 + 1013904223;
+                c = Char('a' + (x >> 16) % alphabet);
+            }
+            return result;
+        }
+    }
+
+    TEST_CASE("String view searches", "[string_view]")
+    {
+        SECTION("Fixed")
+        {
+            const std::string str = "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n";
+            for (const char* arg : { "", "H", "HTTP", "\r\n", "\r\n\r\n", "xyz", "com\r\n\r\n", " :/", "GET" })
+            {
+                for (size_t pos : { size_t(0), size_t(1), size_t(5), size_t(20), str.size() - 1, str.size(), str.size() + 1, std::string::npos })
+                    check_searches<char>(str, arg, pos);
+            }
+
+            stdext::string_view view(str);
+            CHECK(view.find_last_of(stdext::string_view(":")) == str.find(':'));
+            CHECK(view.find_first_not_of(stdext::string_view("GET ")) == 4);
+        }
+
+        SECTION("Random")
+        {
+            uint32_t x = 1;
+            for (int n = 0; n != 2000; ++n)
+            {
+                auto alphabet = 1 + n % 4;
+                auto str = random_string<char>(x, x % 300, alphabet);
+                auto arg = random_string<char>(x, x % 10, alphabet + 1);
+                x = x * 1664525 + 1013904223;
+                if (str.size() > arg.size() && x % 2 == 0)
+                    str.replace(x % (str.size() - arg.size()), arg.size(), arg);
+                check_searches(str, arg, x % 3 == 0 ? x % (str.size() + 2) : 0);
+                check_searches(str, arg, std::string::npos);
+            }
+        }
+
+        SECTION("Periodic needles")
+        {
+            std::string str(100000, 'a');
+            std::string arg(1000, 'a');
+            arg.back() = 'b';
+            check_searches(str, arg, 0);
+            str.replace(70000, arg.size(), arg);
+            check_searches(str, arg, 0);
+            check_searches(str, arg, 70001);
+        }
+
+        SECTION("Non-ASCII sets")
+        {
+            std::string str;
+            for (int c = 0; c != 256; ++c)
+                str.push_back(char(c));
+            check_searches<char>(str, "\x80\xFF\x7F\x01", 0);
+            check_searches<char>(str, std::string("\0\xC3", 2), 0);
+            check_searches<char>(str + str, std::string("\x90\xA0\xB0\xC0\xD0\xE0\xF0", 7), 100);
+        }
+
+        SECTION("Wide strings")
+        {
+            uint32_t x = 7;
+            for (int n = 0; n != 200; ++n)
+            {
+                auto str = random_string<char16_t>(x, x % 100, 3);
+                auto arg = random_string<char16_t>(x, x % 5, 3);
+                check_searches(str, arg, x % 3 == 0 ? x % (str.size() + 2) : 0);
+                check_searches(str, arg, std::u16string::npos);
+            }
+        }
+    }
+}
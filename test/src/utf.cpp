@@ -1,3 +1,4 @@
+#include <stdext/endian.h>
 #include <stdext/file.h>
 #include <stdext/stream.h>
 #include <stdext/unicode.h>
@@ -5,11 +6,329 @@
 #include <catch2/catch.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <vector>
 
 
 namespace test
 {
+    namespace
+    {
+        std::string read_file(const stdext::path_char* path)
+        {
+            stdext::file_input_stream file(path);
+            std::string str(size_t(file.end_position()), '\0');
+            file.read_all(str.data(), str.size());
+            return str;
+        }
+
+        // Reference validator built on the code-unit-at-a-time decoder.
+        std::pair<stdext::utf_result, size_t> validate_utf8(const std::string& str)
+        {
+            stdext::utfstate_t state;
+            size_t start = 0;
+            for (size_t n = 0; n != str.size(); ++n)
+            {
+                if (state.consumed == 0)
+                    start = n;
+                if (stdext::to_utf32(str[n], state).first == stdext::utf_result::error)
+                    return { stdext::utf_result::error, start };
+            }
+
+            if (state.consumed != 0)
+                return { stdext::utf_result::partial_read, start };
+            return { stdext::utf_result::ok, str.size() };
+        }
+
+        // Random text with a mix of encoded lengths, punctuated by boundary cases.
+        std::string random_utf8(size_t count, uint64_t& x)
+        {
+            static constexpr char32_t special[] = {
+                0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFDCF, 0xFDF0, 0xFFFD, 0x10000, 0x10FFFD
+            };
+
+            std::string str;
+            for (size_t n = 0; n != count; ++n)
+            {
+                x = x * 6364136223846793005 + 1442695040888963407;
+                auto r = x >> 33;
+                char32_t code;
+                switch (r % 8)
+                {
+                case 0: case 1: case 2: case 3:
+                    code = char32_t(r >> 3) % 0x80;
+                    break;
+                case 4:
+                    code = 0x80 + char32_t(r >> 3) % 0x780;
+                    break;
+                case 5:
+                    code = 0x800 + char32_t(r >> 3) % 0xD000;
+                    break;
+                case 6:
+                    code = 0x10000 + char32_t(r >> 3) % 0x100000;
+                    break;
+                default:
+                    code = special[(r >> 3) % std::size(special)];
+                    break;
+                }
+                if (!stdext::utf32_is_valid(code))
+                    code = U'?';
+
+                stdext::utfstate_t state;
+                std::pair<stdext::utf_result, char> result;
+                do
+                {
+                    result = stdext::to_utf8(code, state);
+                    str.push_back(result.second);
+                } while (result.first == stdext::utf_result::partial_write);
+            }
+            return str;
+        }
+
+        // The branching decoder that preceded the table-driven one, kept as a reference.
+        std::pair<stdext::utf_result, char32_t> reference_to_utf32(char in, stdext::utfstate_t& state)
+        {
+            using stdext::utf_result;
+
+            auto code = uint8_t(in);
+            if (state.consumed == 0)
+            {
+                if (code < 0x80)
+                {
+                    state.code = code;
+                    return { utf_result::ok, code };
+                }
+
+                if (code >= 0xC2 && code < 0xE0)
+                    state.code = code & 0x1F, state.remaining = 1;
+                else if ((code & 0xF0) == 0xE0)
+                    state.code = code & 0x0F, state.remaining = 2;
+                else if (code >= 0xF0 && code < 0xF5)
+                    state.code = code & 0x07, state.remaining = 3;
+                else
+                    return { utf_result::error, char32_t() };
+
+                state.consumed = 1;
+                return { utf_result::partial_read, char32_t() };
+            }
+
+            if (state.consumed == 1
+                && ((state.remaining == 2 && state.code == 0x00 && code < 0xA0)
+                    || (state.remaining == 2 && state.code == 0x0D && code >= 0xA0)
+                    || (state.remaining == 3 && state.code == 0x00 && code < 0x90)
+                    || (state.remaining == 3 && state.code == 0x04 && code >= 0x90)))
+            {
+                return { utf_result::error, char32_t() };
+            }
+
+            if ((code & 0xC0) != 0x80)
+                return { utf_result::error, char32_t() };
+
+            state.code = state.code << 6 | (code & 0x3F);
+            ++state.consumed;
+            if (--state.remaining != 0)
+                return { utf_result::partial_read, char32_t() };
+
+            state.consumed = 0;
+            if (stdext::is_noncharacter(state.code))
+                return { utf_result::error, char32_t() };
+            return { utf_result::ok, char32_t(state.code) };
+        }
+
+        // Decodes str with the given function, resynchronizing after errors as the conversion
+        // functions do, and returns a checksum of the results.
+        template <typename Decode>
+        uint64_t decode_utf8(const std::string& str, Decode&& decode)
+        {
+            uint64_t sum = 0;
+            stdext::utfstate_t state;
+            for (size_t n = 0; n != str.size(); )
+            {
+                auto result = decode(str[n], state);
+                sum = sum * 31 + uint64_t(result.first) * 0x110000 + result.second;
+                if (result.first != stdext::utf_result::error || state.consumed == 0)
+                    ++n;
+                if (result.first == stdext::utf_result::error)
+                    state = { };
+            }
+            return sum;
+        }
+
+        std::u16string read_file_utf16(const stdext::path_char* path)
+        {
+            auto bytes = read_file(path);
+            std::u16string str(bytes.size() / sizeof(char16_t), u'\0');
+            std::copy(bytes.begin(), bytes.end(), reinterpret_cast<char*>(str.data()));
+            return str;
+        }
+
+        void append_replacement(std::string& str)
+        {
+            str += "\xEF\xBF\xBD";
+        }
+
+        void append_replacement(std::u16string& str)
+        {
+            str += u'\xFFFD';
+        }
+
+        // Sanitized conversion with the code-unit-at-a-time functions, replacing a truncated final
+        // sequence as the bulk transcoders do.
+        template <typename OutChar, typename InChar>
+        std::basic_string<OutChar> reference_transcode(const std::basic_string<InChar>& str)
+        {
+            std::pair<stdext::utf_result, std::basic_string<OutChar>> result;
+            if constexpr (std::is_same_v<OutChar, char>)
+                result = stdext::to_u8string(stdext::make_generator(str), stdext::utf_conversion_options::sanitize);
+            else
+                result = stdext::to_u16string(stdext::make_generator(str), stdext::utf_conversion_options::sanitize);
+
+            if (result.first == stdext::utf_result::partial_read)
+                append_replacement(result.second);
+            return result.second;
+        }
+
+        // Feeds str to the stateful transcoder in_chunk code units at a time, with room for only
+        // out_chunk code units of output per call.
+        template <typename OutChar, typename InChar>
+        std::basic_string<OutChar> transcode_chunked(const std::basic_string<InChar>& str, size_t in_chunk, size_t out_chunk)
+        {
+            std::basic_string<OutChar> converted;
+            std::basic_string<OutChar> buffer(out_chunk, OutChar());
+            stdext::utfstate_t state;
+            for (size_t pos = 0; pos != str.size() || state.produced != 0; )
+            {
+                auto size = std::min(in_chunk, str.size() - pos);
+                auto result = stdext::transcode({ str.data() + pos, size }, { buffer.data(), buffer.size() },
+                    state, stdext::utf_conversion_options::sanitize);
+                REQUIRE(result.result != stdext::utf_result::error);
+                REQUIRE(result.consumed <= size);
+                if (result.result != stdext::utf_result::partial_write)
+                    REQUIRE(result.consumed == size);
+                converted.append(buffer.data(), result.produced);
+                pos += result.consumed;
+            }
+
+            if (state.consumed != 0)
+                append_replacement(converted);
+            return converted;
+        }
+
+        // Random UTF-16 text, punctuated by unpaired surrogates and noncharacters.
+        std::u16string random_utf16(size_t count, uint64_t& x)
+        {
+            static constexpr char16_t special[] = { 0xD800, 0xDBFF, 0xDC00, 0xDFFF, 0xFDD0, 0xFDEF, 0xFFFE, 0xFFFF };
+
+            auto utf8 = random_utf8(count, x);
+            auto str = stdext::to_u16string(stdext::make_generator(utf8)).second;
+            x = x * 6364136223846793005 + 1442695040888963407;
+            auto r = x >> 33;
+            switch (r % 4)
+            {
+            case 0:
+                break;
+            case 1:
+                if (!str.empty())
+                    str[(r >> 2) % str.size()] = char16_t(r >> 16);
+                break;
+            case 2:
+                str.insert((r >> 2) % (str.size() + 1), 1, special[(r >> 20) % std::size(special)]);
+                break;
+            case 3:
+                str.resize((r >> 2) % (str.size() + 1));
+                break;
+            }
+            return str;
+        }
+
+        std::pair<stdext::utf_result, size_t> validate_utf16(const std::u16string& str)
+        {
+            stdext::utfstate_t state;
+            size_t start = 0;
+            for (size_t n = 0; n != str.size(); ++n)
+            {
+                if (state.consumed == 0)
+                    start = n;
+                if (stdext::to_utf32(str[n], state).first == stdext::utf_result::error)
+                    return { stdext::utf_result::error, start };
+            }
+
+            if (state.consumed != 0)
+                return { stdext::utf_result::partial_read, start };
+            return { stdext::utf_result::ok, str.size() };
+        }
+
+        // Converts text in native byte order to the given encoding by reversing each code unit
+        // where necessary.
+        std::string encode_units(std::string str, stdext::utf_encoding encoding)
+        {
+            size_t unit = 1;
+            bool big = false;
+            switch (encoding)
+            {
+            case stdext::utf_encoding::utf8:
+                break;
+            case stdext::utf_encoding::utf16le:
+            case stdext::utf_encoding::utf16be:
+                unit = 2;
+                big = encoding == stdext::utf_encoding::utf16be;
+                break;
+            default:
+                unit = 4;
+                big = encoding == stdext::utf_encoding::utf32be;
+                break;
+            }
+
+            if (big != (stdext::byte_order::native_endian == stdext::byte_order::big_endian))
+            {
+                for (size_t n = 0; n + unit <= str.size(); n += unit)
+                    std::reverse(str.begin() + n, str.begin() + n + unit);
+            }
+            return str;
+        }
+
+        // Limits each read of the underlying memory to a few bytes.
+        class trickle_stream : public stdext::input_stream
+        {
+        public:
+            trickle_stream(const std::string& str, size_t limit)
+                : stream(reinterpret_cast<const std::byte*>(str.data()), str.size()), limit(limit)
+            {
+            }
+
+        private:
+            size_t do_read(std::byte* buffer, size_t size) override
+            {
+                return stream.read(buffer, std::min(size, limit));
+            }
+
+            size_t do_skip(size_t size) override
+            {
+                return stream.skip<std::byte>(std::min(size, limit));
+            }
+
+        private:
+            stdext::memory_input_stream stream;
+            size_t limit;
+        };
+
+        // Reads the entire stream, chunk bytes at a time.
+        std::string read_stream(stdext::input_stream& stream, size_t chunk)
+        {
+            std::string str;
+            std::string buffer(chunk, '\0');
+            while (true)
+            {
+                auto size = stream.read(reinterpret_cast<std::byte*>(buffer.data()), chunk);
+                str.append(buffer.data(), size);
+                if (size != chunk)
+                    return str;
+            }
+        }
+    }
+
     TEST_CASE("Unicode conversion UTF-8 to UTF-8", "[unicode]")
     {
         stdext::file_input_stream infile(PATH_STR("UTF-8-test.txt"));
@@ -252,4 +571,842 @@ namespace test
             REQUIRE(std::equal(buffer.get(), buffer.get() + buffer_size, stdext::input_stream_iterator<std::byte>(testfile)));
         }
     }
+
+    TEST_CASE("UTF-8 validation", "[unicode]")
+    {
+        using stdext::utf_result;
+
+        CHECK(stdext::utf8_validate({ "", 0 }) == std::make_pair(utf_result::ok, size_t(0)));
+
+        auto post = read_file(PATH_STR("UTF-8-post.txt"));
+        CHECK(stdext::utf8_validate({ post.data(), post.size() }) == std::make_pair(utf_result::ok, post.size()));
+
+        // Every line of the stress test, and the file as a whole.
+        auto test = read_file(PATH_STR("UTF-8-test.txt"));
+        CHECK(stdext::utf8_validate({ test.data(), test.size() }) == validate_utf8(test));
+        for (size_t first = 0, last; first < test.size(); first = last + 1)
+        {
+            last = std::min(test.find('\n', first), test.size());
+            auto line = test.substr(first, last - first);
+            CHECK(stdext::utf8_validate({ line.data(), line.size() }) == validate_utf8(line));
+        }
+
+        const std::string malformed[] = {
+            "\xC0\x80", "\xC1\xBF", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80",
+            "\xF5\x80\x80\x80", "\xFF", "\x80", "\xC2\x41", "\xE2\x82", "\xF0\x9F\x98",
+            "\xEF\xBF\xBE", "\xEF\xBF\xBF", "\xEF\xB7\x90", "\xEF\xB7\xAF", "\xF0\x9F\xBF\xBE", "\xF4\x8F\xBF\xBF"
+        };
+
+        // Errors at every position relative to the vector blocks.
+        uint64_t x = 0x0123456789ABCDEF;
+        for (size_t n = 0; n != 4000; ++n)
+        {
+            auto str = random_utf8(n % 150, x);
+            x = x * 6364136223846793005 + 1442695040888963407;
+            auto r = x >> 33;
+            switch (r % 4)
+            {
+            case 0:
+                break;
+            case 1:
+                if (!str.empty())
+                    str[(r >> 2) % str.size()] = char(r >> 20);
+                break;
+            case 2:
+                str.insert((r >> 2) % (str.size() + 1), malformed[(r >> 20) % std::size(malformed)]);
+                break;
+            case 3:
+                str.resize((r >> 2) % (str.size() + 1));
+                break;
+            }
+
+            INFO("case " << n);
+            CHECK(stdext::utf8_validate({ str.data(), str.size() }) == validate_utf8(str));
+        }
+    }
+
+    TEST_CASE("UTF-8 to UTF-16 transcoding", "[unicode]")
+    {
+        using stdext::utf_result;
+
+        auto test = read_file(PATH_STR("UTF-8-test.txt"));
+        auto post = read_file_utf16(PATH_STR("UTF-16-post.txt"));
+
+        std::u16string buffer(post.size(), u'\0');
+        auto result = stdext::transcode({ test.data(), test.size() }, { buffer.data(), buffer.size() },
+            stdext::utf_conversion_options::sanitize);
+        CHECK(result.result == utf_result::ok);
+        CHECK(result.consumed == test.size());
+        CHECK(result.produced == post.size());
+        CHECK(buffer == post);
+
+        for (size_t in_chunk : { 1, 3, 7, 64, 1000 })
+        {
+            for (size_t out_chunk : { 1, 2, 17, 4096 })
+            {
+                INFO("chunks " << in_chunk << ", " << out_chunk);
+                CHECK(transcode_chunked<char16_t>(test, in_chunk, out_chunk) == post);
+            }
+        }
+
+        // Running out of room doesn't split a surrogate pair.
+        const std::string emoji = "ab\xF0\x9F\x98\x80";
+        char16_t pair[3];
+        result = stdext::transcode({ emoji.data(), emoji.size() }, pair);
+        CHECK(result.result == utf_result::partial_write);
+        CHECK(result.consumed == 2);
+        CHECK(result.produced == 2);
+
+        // Long runs of a single encoded length, with an invalid sequence at each position.
+        for (const std::string unit : { "a", "\xCE\xB1", "\xE4\xB8\xAD", "\xEF\xB7\x8F", "\xED\x9F\xBF", "\xF0\x9F\x98\x80" })
+        {
+            std::string run;
+            for (size_t n = 0; n != 60; ++n)
+                run += unit;
+            for (size_t pos = 0; pos <= run.size(); ++pos)
+            {
+                auto str = run;
+                str.insert(pos, pos % 2 == 0 ? "\xEF\xBF\xBF" : "\xC1");
+                auto expected = reference_transcode<char16_t>(str);
+                std::u16string converted(expected.size(), u'\0');
+                result = stdext::transcode({ str.data(), str.size() }, { converted.data(), converted.size() },
+                    stdext::utf_conversion_options::sanitize);
+                CHECK(result.result == utf_result::ok);
+                CHECK(converted == expected);
+            }
+        }
+
+        const std::string malformed[] = {
+            "\xC0\x80", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xFF", "\x80",
+            "\xC2\x41", "\xE2\x82", "\xEF\xBF\xBE", "\xEF\xB7\x90", "\xF0\x9F\xBF\xBE"
+        };
+
+        uint64_t x = 0xFEDCBA9876543210;
+        for (size_t n = 0; n != 2000; ++n)
+        {
+            auto str = random_utf8(n % 200, x);
+            x = x * 6364136223846793005 + 1442695040888963407;
+            auto r = x >> 33;
+            switch (r % 4)
+            {
+            case 0:
+                break;
+            case 1:
+                if (!str.empty())
+                    str[(r >> 2) % str.size()] = char(r >> 20);
+                break;
+            case 2:
+                str.insert((r >> 2) % (str.size() + 1), malformed[(r >> 20) % std::size(malformed)]);
+                break;
+            case 3:
+                str.resize((r >> 2) % (str.size() + 1));
+                break;
+            }
+
+            INFO("case " << n);
+            auto expected = reference_transcode<char16_t>(str);
+            std::u16string converted(expected.size(), u'\0');
+            result = stdext::transcode({ str.data(), str.size() }, { converted.data(), converted.size() },
+                stdext::utf_conversion_options::sanitize);
+            CHECK(result.result == utf_result::ok);
+            CHECK(result.produced == expected.size());
+            CHECK(converted == expected);
+            CHECK(transcode_chunked<char16_t>(str, 1 + (r >> 24) % 40, 1 + (r >> 28) % 40) == expected);
+
+            // Without sanitizing, conversion stops at the first invalid sequence.
+            auto [status, valid] = validate_utf8(str);
+            result = stdext::transcode({ str.data(), str.size() }, { converted.data(), converted.size() });
+            CHECK(result.result == status);
+            CHECK(result.consumed == valid);
+            auto prefix = reference_transcode<char16_t>(str.substr(0, valid));
+            CHECK(result.produced == prefix.size());
+            CHECK(std::equal(prefix.begin(), prefix.end(), converted.begin()));
+        }
+    }
+
+    TEST_CASE("UTF-16 to UTF-8 transcoding", "[unicode]")
+    {
+        using stdext::utf_result;
+
+        auto test = read_file_utf16(PATH_STR("UTF-16-post.txt"));
+        auto post = read_file(PATH_STR("UTF-8-post.txt"));
+
+        std::string buffer(post.size(), '\0');
+        auto result = stdext::transcode({ test.data(), test.size() }, { buffer.data(), buffer.size() });
+        CHECK(result.result == utf_result::ok);
+        CHECK(result.consumed == test.size());
+        CHECK(result.produced == post.size());
+        CHECK(buffer == post);
+
+        for (size_t in_chunk : { 1, 3, 7, 64, 1000 })
+        {
+            for (size_t out_chunk : { 1, 2, 17, 4096 })
+            {
+                INFO("chunks " << in_chunk << ", " << out_chunk);
+                CHECK(transcode_chunked<char>(test, in_chunk, out_chunk) == post);
+            }
+        }
+
+        // The generic entry points use the bulk transcoder for contiguous input.
+        CHECK(stdext::to_u8string(test) == std::make_pair(utf_result::ok, post));
+        std::string consumed;
+        stdext::utfstate_t state;
+        CHECK(stdext::to_utf8(test, stdext::make_consumer<char>(std::back_inserter(consumed)), state) == utf_result::ok);
+        CHECK(consumed == post);
+
+        // Running out of room doesn't split a sequence.
+        const std::u16string bmp = u"ab\u20AC";
+        char partial[4];
+        result = stdext::transcode({ bmp.data(), bmp.size() }, partial);
+        CHECK(result.result == utf_result::partial_write);
+        CHECK(result.consumed == 2);
+        CHECK(result.produced == 2);
+        const std::u16string lone = u"ab\xD800";
+        result = stdext::transcode({ lone.data(), lone.size() }, partial, stdext::utf_conversion_options::sanitize);
+        CHECK(result.result == utf_result::partial_write);
+        CHECK(result.consumed == 2);
+        CHECK(result.produced == 2);
+
+        // Long runs of a single encoded length, with an invalid sequence at each position.
+        for (const std::u16string unit : { u"a", u"\u03B1", u"\u4E2D", u"\uFDCF", u"\uD7FF", u"\U0001F600" })
+        {
+            std::u16string run;
+            for (size_t n = 0; n != 60; ++n)
+                run += unit;
+            for (size_t pos = 0; pos <= run.size(); ++pos)
+            {
+                auto str = run;
+                str.insert(pos, 1, pos % 3 == 0 ? u'\xFFFF' : pos % 3 == 1 ? u'\xDC00' : u'\xFDE0');
+                auto expected = reference_transcode<char>(str);
+                std::string converted(expected.size(), '\0');
+                result = stdext::transcode({ str.data(), str.size() }, { converted.data(), converted.size() },
+                    stdext::utf_conversion_options::sanitize);
+                CHECK(result.result == utf_result::ok);
+                CHECK(converted == expected);
+            }
+        }
+
+        uint64_t x = 0x0F1E2D3C4B5A6978;
+        for (size_t n = 0; n != 2000; ++n)
+        {
+            auto str = random_utf16(n % 200, x);
+            auto r = x >> 33;
+
+            INFO("case " << n);
+            auto expected = reference_transcode<char>(str);
+            std::string converted(expected.size(), '\0');
+            result = stdext::transcode({ str.data(), str.size() }, { converted.data(), converted.size() },
+                stdext::utf_conversion_options::sanitize);
+            CHECK(result.result == utf_result::ok);
+            CHECK(result.produced == expected.size());
+            CHECK(converted == expected);
+            CHECK(transcode_chunked<char>(str, 1 + (r >> 24) % 40, 1 + (r >> 28) % 40) == expected);
+
+            // Without sanitizing, conversion stops at the first invalid sequence.
+            auto [status, valid] = validate_utf16(str);
+            result = stdext::transcode({ str.data(), str.size() }, { converted.data(), converted.size() });
+            CHECK(result.result == status);
+            CHECK(result.consumed == valid);
+            auto prefix = reference_transcode<char>(str.substr(0, valid));
+            CHECK(result.produced == prefix.size());
+            CHECK(std::equal(prefix.begin(), prefix.end(), converted.begin()));
+        }
+    }
+
+    TEST_CASE("UTF-16 validation", "[unicode]")
+    {
+        using stdext::utf_result;
+
+        CHECK(stdext::utf16_validate({ u"", 0 }) == std::make_pair(utf_result::ok, size_t(0)));
+
+        auto post = read_file_utf16(PATH_STR("UTF-16-post.txt"));
+        CHECK(stdext::utf16_validate({ post.data(), post.size() }) == std::make_pair(utf_result::ok, post.size()));
+
+        uint64_t x = 0x1122334455667788;
+        for (size_t n = 0; n != 4000; ++n)
+        {
+            auto str = random_utf16(n % 150, x);
+            INFO("case " << n);
+            CHECK(stdext::utf16_validate({ str.data(), str.size() }) == validate_utf16(str));
+        }
+    }
+
+    TEST_CASE("UTF length computation", "[unicode]")
+    {
+        using stdext::utf_result;
+        constexpr auto sanitize = stdext::utf_conversion_options::sanitize;
+
+        auto test = read_file(PATH_STR("UTF-8-test.txt"));
+        CHECK(stdext::to_utf16_length(test, sanitize) == stdext::to_utf16_length(stdext::make_generator(test), sanitize));
+        CHECK(stdext::to_utf16_length(test) == stdext::to_utf16_length(stdext::make_generator(test)));
+
+        auto post8 = read_file(PATH_STR("UTF-8-post.txt"));
+        auto post16 = read_file_utf16(PATH_STR("UTF-16-post.txt"));
+        const stdext::utf_conversion_options options[] = { stdext::utf_conversion_options::none, stdext::utf_conversion_options::assume_valid };
+        for (auto option : options)
+        {
+            CHECK(stdext::to_utf8_length(post8, option) == std::make_pair(utf_result::ok, post8.size()));
+            CHECK(stdext::to_utf16_length(post8, option) == std::make_pair(utf_result::ok, post16.size()));
+            CHECK(stdext::to_utf32_length(post8, option) == stdext::to_utf32_length(stdext::make_generator(post8)));
+            CHECK(stdext::to_utf8_length(post16, option) == std::make_pair(utf_result::ok, post8.size()));
+            CHECK(stdext::to_utf16_length(post16, option) == std::make_pair(utf_result::ok, post16.size()));
+            CHECK(stdext::to_utf32_length(post16, option) == stdext::to_utf32_length(stdext::make_generator(post16)));
+        }
+
+        // Long strings, so that errors fall on either side of the chunk boundaries.
+        uint64_t x = 0x8877665544332211;
+        for (size_t n = 0; n != 200; ++n)
+        {
+            std::string str8;
+            std::u16string str16;
+            auto count = n < 10 ? 5000 : n % 120;
+            for (size_t part = 0; part != (n < 10 ? 8 : 1); ++part)
+            {
+                auto part8 = random_utf8(count, x);
+                x = x * 6364136223846793005 + 1442695040888963407;
+                auto r = x >> 33;
+                if (r % 2 != 0 && !part8.empty())
+                    part8[(r >> 1) % part8.size()] = char(r >> 20);
+                str8 += part8;
+                str16 += random_utf16(count, x);
+            }
+
+            INFO("case " << n);
+            for (auto option : { stdext::utf_conversion_options::none, sanitize })
+            {
+                CHECK(stdext::to_utf8_length(str8, option) == stdext::to_utf8_length(stdext::make_generator(str8), option));
+                CHECK(stdext::to_utf16_length(str8, option) == stdext::to_utf16_length(stdext::make_generator(str8), option));
+                CHECK(stdext::to_utf32_length(str8, option) == stdext::to_utf32_length(stdext::make_generator(str8), option));
+                CHECK(stdext::to_utf8_length(str16, option) == stdext::to_utf8_length(stdext::make_generator(str16), option));
+                CHECK(stdext::to_utf16_length(str16, option) == stdext::to_utf16_length(stdext::make_generator(str16), option));
+                CHECK(stdext::to_utf32_length(str16, option) == stdext::to_utf32_length(stdext::make_generator(str16), option));
+            }
+        }
+    }
+
+    TEST_CASE("Unicode block conversion generators", "[unicode]")
+    {
+        auto test = read_file(PATH_STR("UTF-8-test.txt"));
+        auto post16 = read_file_utf16(PATH_STR("UTF-16-post.txt"));
+        auto post8 = read_file(PATH_STR("UTF-8-post.txt"));
+
+        std::u16string str16;
+        for (auto gen = test >> stdext::to_utf16(); gen; ++gen)
+            str16.push_back(*gen);
+        CHECK(str16 == post16);
+
+        stdext::stringbuf buf8;
+        CHECK((post16 >> stdext::to_utf8() >> buf8));
+        CHECK(buf8.extract() == post8);
+
+        // Units and chunks may be interleaved.
+        std::string str8;
+        auto gen = post16 >> stdext::to_utf8();
+        while (gen)
+        {
+            str8.push_back(*gen++);
+            auto chunk = gen.next_chunk();
+            str8.append(chunk.data(), chunk.size());
+        }
+        CHECK(str8 == post8);
+
+        // Truncated and malformed input is replaced exactly as by the code-unit-at-a-time generator.
+        uint64_t x = 0x0A1B2C3D4E5F6071;
+        for (size_t n = 0; n != 500; ++n)
+        {
+            auto utf16 = random_utf16(n % 1000, x);
+            auto expected8 = reference_transcode<char>(utf16);
+            stdext::stringbuf chunked;
+            CHECK((utf16 >> stdext::to_utf8() >> chunked));
+            CHECK(chunked.extract() == expected8);
+
+            auto utf8 = random_utf8(n % 1000, x);
+            if (n % 3 == 0 && !utf8.empty())
+                utf8.pop_back();
+            auto expected16 = reference_transcode<char16_t>(utf8);
+            str16.clear();
+            for (auto gen16 = utf8 >> stdext::to_utf16(); gen16; ++gen16)
+                str16.push_back(*gen16);
+            CHECK(str16 == expected16);
+        }
+    }
+
+    TEST_CASE("UTF-8 decoder state machine", "[unicode]")
+    {
+        // Every sequence of up to three bytes, and every four-byte sequence beginning with a
+        // valid three-byte prefix, decodes exactly as with the reference decoder.
+        auto check = [](const uint8_t* bytes, size_t count)
+        {
+            stdext::utfstate_t state, expected_state;
+            for (size_t n = 0; n != count; ++n)
+            {
+                auto result = stdext::to_utf32(char(bytes[n]), state);
+                auto expected = reference_to_utf32(char(bytes[n]), expected_state);
+                if (result != expected || state.consumed != expected_state.consumed || state.remaining != expected_state.remaining)
+                    return false;
+                if (result.first != stdext::utf_result::partial_read)
+                    return true;
+            }
+            return true;
+        };
+
+        size_t failures = 0;
+        uint8_t bytes[4];
+        for (unsigned a = 0; a != 256; ++a)
+        {
+            bytes[0] = uint8_t(a);
+            for (unsigned b = 0; b != 256; ++b)
+            {
+                bytes[1] = uint8_t(b);
+                for (unsigned c = 0; c != 256; ++c)
+                {
+                    bytes[2] = uint8_t(c);
+                    failures += !check(bytes, 3);
+                    if (a >= 0xF0 && a < 0xF5)
+                    {
+                        for (unsigned d = 0x70; d != 0xD0; ++d)
+                        {
+                            bytes[3] = uint8_t(d);
+                            failures += !check(bytes, 4);
+                        }
+                    }
+                }
+            }
+        }
+        CHECK(failures == 0);
+
+        auto test = read_file(PATH_STR("UTF-8-test.txt"));
+        CHECK(decode_utf8(test, [](char in, stdext::utfstate_t& state) { return stdext::to_utf32(in, state); })
+            == decode_utf8(test, reference_to_utf32));
+    }
+
+    TEST_CASE("UTF-8 decoder benchmark", "[.benchmark]")
+    {
+        // The stress test file, which is mostly ASCII, and random text, which is mostly not.
+        auto test = read_file(PATH_STR("UTF-8-test.txt"));
+        std::string inputs[2];
+        uint64_t x = 0x0123456789ABCDEF;
+        while (inputs[0].size() < (size_t(1) << 24))
+            inputs[0] += test;
+        while (inputs[1].size() < (size_t(1) << 24))
+            inputs[1] += random_utf8(4096, x);
+
+        using decoder = std::pair<stdext::utf_result, char32_t> (*)(char, stdext::utfstate_t&);
+        for (auto& input : inputs)
+        {
+            auto measure = [&](decoder decode)
+            {
+                // Call both decoders out of line.
+                volatile decoder indirect = decode;
+                auto start = std::chrono::steady_clock::now();
+                auto sum = decode_utf8(input, [&](char in, stdext::utfstate_t& state) { return indirect(in, state); });
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                return std::make_pair(sum, input.size() / elapsed.count() / 1e6);
+            };
+
+            auto table = measure(stdext::to_utf32);
+            auto reference = measure(reference_to_utf32);
+            CHECK(table.first == reference.first);
+            WARN((&input == inputs ? "UTF-8-test.txt" : "random text") << ": table-driven " << table.second
+                << " MB/s; reference " << reference.second << " MB/s");
+        }
+    }
+
+    TEST_CASE("UTF transcoding input stream", "[unicode]")
+    {
+        constexpr stdext::utf_encoding encodings[] = {
+            stdext::utf_encoding::utf8, stdext::utf_encoding::utf16le, stdext::utf_encoding::utf16be,
+            stdext::utf_encoding::utf32le, stdext::utf_encoding::utf32be
+        };
+        const std::string post[] = {
+            read_file(PATH_STR("UTF-8-post.txt")), read_file(PATH_STR("UTF-16-post.txt")), read_file(PATH_STR("UTF-32-post.txt"))
+        };
+        auto text = [&](stdext::utf_encoding encoding)
+        {
+            auto n = size_t(encoding);
+            return encode_units(post[(n + 1) / 2], encoding);
+        };
+
+        for (auto from : encodings)
+        {
+            auto in = text(from);
+            for (auto to : encodings)
+            {
+                auto expected = text(to);
+                for (size_t limit : { 1, 7, 4096, 1 << 20 })
+                {
+                    for (size_t chunk : { 1, 3, 64, 1000, 1 << 20 })
+                    {
+                        trickle_stream source(in, limit);
+                        stdext::utf_transcoding_input_stream stream(source, from, to);
+                        REQUIRE(read_stream(stream, chunk) == expected);
+                    }
+                }
+            }
+        }
+
+        SECTION("invalid input")
+        {
+            auto test = read_file(PATH_STR("UTF-8-test.txt"));
+            for (auto to : encodings)
+            {
+                auto expected = text(to);
+                for (size_t limit : { 1, 5, 1 << 20 })
+                {
+                    trickle_stream source(test, limit);
+                    stdext::utf_transcoding_input_stream stream(source, stdext::utf_encoding::utf8, to,
+                        stdext::utf_stream_options::sanitize);
+                    REQUIRE(read_stream(stream, 4096) == expected);
+                }
+
+                stdext::memory_input_stream source(reinterpret_cast<const std::byte*>(test.data()), test.size());
+                stdext::utf_transcoding_input_stream stream(source, stdext::utf_encoding::utf8, to);
+                REQUIRE_THROWS_AS(read_stream(stream, 4096), stdext::stream_error);
+            }
+
+            uint64_t x = 0x0123456789ABCDEF;
+            for (size_t n = 0; n != 200; ++n)
+            {
+                auto str = random_utf16(x >> 54, x);
+                std::string in(reinterpret_cast<const char*>(str.data()), str.size() * sizeof(char16_t));
+                trickle_stream source(in, 1 + (x >> 60));
+                stdext::utf_transcoding_input_stream stream(source, stdext::utf_encoding::utf16le, stdext::utf_encoding::utf8,
+                    stdext::utf_stream_options::sanitize);
+                REQUIRE(read_stream(stream, 1 + (x >> 56)) == reference_transcode<char>(str));
+            }
+        }
+
+        SECTION("truncated input")
+        {
+            // A partial UTF-8 sequence, and half of a UTF-16 code unit.
+            const std::pair<stdext::utf_encoding, std::string> inputs[] = {
+                { stdext::utf_encoding::utf8, "abc\xE4\xB8" },
+                { stdext::utf_encoding::utf16le, "ab=" }
+            };
+            for (auto& [from, str] : inputs)
+            {
+                stdext::memory_input_stream source(reinterpret_cast<const std::byte*>(str.data()), str.size());
+                stdext::utf_transcoding_input_stream stream(source, from, stdext::utf_encoding::utf8,
+                    stdext::utf_stream_options::sanitize);
+                auto converted = read_stream(stream, 16);
+                REQUIRE(converted.size() >= 3);
+                REQUIRE(converted.substr(converted.size() - 3) == "\xEF\xBF\xBD");
+
+                source.reset(reinterpret_cast<const std::byte*>(str.data()), str.size());
+                stdext::utf_transcoding_input_stream strict(source, from, stdext::utf_encoding::utf8);
+                REQUIRE_THROWS_AS(read_stream(strict, 16), stdext::stream_error);
+            }
+        }
+
+        SECTION("byte order mark")
+        {
+            auto bom = [](stdext::utf_encoding encoding)
+            {
+                char16_t bom16 = 0xFEFF;
+                char32_t bom32 = 0xFEFF;
+                switch (encoding)
+                {
+                case stdext::utf_encoding::utf8:
+                    return std::string("\xEF\xBB\xBF");
+                case stdext::utf_encoding::utf16le:
+                case stdext::utf_encoding::utf16be:
+                    return encode_units(std::string(reinterpret_cast<const char*>(&bom16), sizeof(bom16)), encoding);
+                default:
+                    return encode_units(std::string(reinterpret_cast<const char*>(&bom32), sizeof(bom32)), encoding);
+                }
+            };
+
+            auto expected = text(stdext::utf_encoding::utf16le);
+            for (auto from : encodings)
+            {
+                auto in = bom(from) + text(from);
+                for (size_t limit : { 1, 3, 1 << 20 })
+                {
+                    trickle_stream source(in, limit);
+                    stdext::utf_transcoding_input_stream stream(source, stdext::utf_encoding::utf8, stdext::utf_encoding::utf16le,
+                        stdext::utf_stream_options::detect_bom);
+                    REQUIRE(stream.source_encoding() == from);
+                    REQUIRE(read_stream(stream, 256) == expected);
+                }
+
+                // Without detection, the byte order mark is text like any other.
+                stdext::memory_input_stream source(reinterpret_cast<const std::byte*>(in.data()), in.size());
+                stdext::utf_transcoding_input_stream stream(source, from, stdext::utf_encoding::utf16le);
+                REQUIRE(read_stream(stream, 256) == bom(stdext::utf_encoding::utf16le) + expected);
+            }
+
+            // Text without a byte order mark is read in the given encoding.
+            auto in = text(stdext::utf_encoding::utf16be);
+            stdext::memory_input_stream source(reinterpret_cast<const std::byte*>(in.data()), in.size());
+            stdext::utf_transcoding_input_stream stream(source, stdext::utf_encoding::utf16be, stdext::utf_encoding::utf16le,
+                stdext::utf_stream_options::detect_bom);
+            REQUIRE(stream.source_encoding() == stdext::utf_encoding::utf16be);
+            REQUIRE(read_stream(stream, 256) == expected);
+        }
+
+        SECTION("skip")
+        {
+            auto in = text(stdext::utf_encoding::utf8);
+            auto expected = text(stdext::utf_encoding::utf16le);
+            stdext::memory_input_stream source(reinterpret_cast<const std::byte*>(in.data()), in.size());
+            stdext::utf_transcoding_input_stream stream(source, stdext::utf_encoding::utf8, stdext::utf_encoding::utf16le);
+            stream.skip_all<char16_t>(1000);
+            REQUIRE(read_stream(stream, 100) == expected.substr(2000));
+        }
+    }
+
+    TEST_CASE("UTF-8 index", "[unicode]")
+    {
+        uint64_t x = 0x0123456789ABCDEF;
+        auto next = [&] { x = x * 6364136223846793005 + 1442695040888963407; return size_t(x >> 33); };
+
+        // Random text with the occasional stray trailing byte.
+        auto random_text = [&](size_t count)
+        {
+            auto str = random_utf8(count, x);
+            for (auto n = str.size() / 64; n != 0; --n)
+                str.insert(next() % (str.size() + 1), 1, char(0x80 + next() % 0x40));
+            return str;
+        };
+
+        auto check = [](const std::string& str, const stdext::utf8_index& index, size_t step)
+        {
+            std::vector<size_t> starts;
+            for (size_t n = 0; n != str.size(); ++n)
+            {
+                if (!stdext::utf8_is_trailing(str[n]))
+                    starts.push_back(n);
+            }
+
+            stdext::array_view<const char> view(str.data(), str.size());
+            REQUIRE(index.size() == starts.size());
+            REQUIRE(index.size_bytes() == str.size());
+            REQUIRE(index.byte_offset(view, starts.size()) == str.size());
+            for (size_t i = 0; i < starts.size(); i += step)
+            {
+                if (index.byte_offset(view, i) != starts[i])
+                    REQUIRE(index.byte_offset(view, i) == starts[i]);
+            }
+
+            auto i = starts.begin();
+            for (size_t n = 0; n <= str.size(); n += step)
+            {
+                i = std::lower_bound(i, starts.end(), n);
+                if (index.code_point_index(view, n) != size_t(i - starts.begin()))
+                    REQUIRE(index.code_point_index(view, n) == size_t(i - starts.begin()));
+            }
+        };
+
+        SECTION("construction")
+        {
+            for (size_t count : { 0, 1, 20, 40, 100, 1000, 100000 })
+            {
+                auto str = random_text(count);
+                check(str, stdext::utf8_index({ str.data(), str.size() }), 1);
+            }
+
+            // Text that begins partway through a code point.
+            std::string str = "\x80\x80" "abc\xCE\xB1";
+            stdext::utf8_index index({ str.data(), str.size() });
+            check(str, index, 1);
+            REQUIRE(index.byte_offset({ str.data(), str.size() }, 0) == 2);
+            REQUIRE(index.code_point_index({ str.data(), str.size() }, 0) == 0);
+        }
+
+        SECTION("update")
+        {
+            auto str = random_text(50000);
+            stdext::utf8_index index({ str.data(), str.size() });
+            for (size_t n = 1; n <= 300; ++n)
+            {
+                auto offset = next() % (str.size() + 1);
+                auto erased = std::min(next() % (n % 50 == 0 ? 100000 : 300), str.size() - offset);
+                auto inserted = random_text(next() % (n % 40 == 0 ? 50000 : 100));
+                str.replace(offset, erased, inserted);
+                index.update({ str.data(), str.size() }, offset, erased, inserted.size());
+                check(str, index, n % 25 == 0 ? 1 : 997);
+            }
+
+            str.clear();
+            index.assign({ str.data(), str.size() });
+            check(str, index, 1);
+        }
+    }
+
+    TEST_CASE("Parallel UTF-8 conversion", "[unicode]")
+    {
+        // Large enough to be split into several chunks.
+        uint64_t x = 0x0123456789ABCDEF;
+        std::string text;
+        while (text.size() < (size_t(3) << 20))
+            text += random_utf8(4096, x);
+
+        std::vector<std::string> inputs = { text, text, text, text };
+        inputs[1].replace(inputs[1].size() / 2, 1, "\xFF");
+        while (!stdext::utf8_is_leading(inputs[2].back()))
+            inputs[2].pop_back();
+        inputs[2].back() = '\xF0';
+        inputs[2] += "\x9F\x98";
+
+        // Sequences cut short by the chunk boundaries, in otherwise valid text.
+        auto cut = [](std::string& str, size_t pos, const std::string& partial)
+        {
+            auto first = pos - partial.size() - 8;
+            auto last = pos + 8;
+            while (stdext::utf8_is_trailing(str[first]))
+                --first;
+            while (stdext::utf8_is_trailing(str[last]))
+                ++last;
+            str.replace(first, last - first, std::string(last - first, 'a'));
+            str.replace(pos - partial.size(), partial.size(), partial);
+        };
+        cut(inputs[3], inputs[3].size() / 3, "\xE4\xB8");
+        cut(inputs[3], inputs[3].size() / 3 * 2, "\xF0");
+
+        for (auto& input : inputs)
+        {
+            stdext::array_view<const char> in(input.data(), input.size());
+            REQUIRE(stdext::utf8_validate_parallel(in, 4) == stdext::utf8_validate(in));
+
+            for (auto options : { stdext::utf_conversion_options::none, stdext::utf_conversion_options::sanitize,
+                stdext::utf_conversion_options::assume_valid })
+            {
+                REQUIRE(stdext::to_utf16_length_parallel(in, options, 4) == stdext::to_utf16_length(in, options));
+            }
+
+            auto length = stdext::to_utf16_length(in, stdext::utf_conversion_options::sanitize).second + 1;
+            for (auto options : { stdext::utf_conversion_options::none, stdext::utf_conversion_options::sanitize })
+            {
+                for (auto size : { length, length / 2 })
+                {
+                    std::u16string expected(size, u'\0');
+                    std::u16string converted(size, u'\0');
+                    auto result = stdext::transcode(in, { expected.data(), expected.size() }, options);
+                    auto parallel = stdext::transcode_parallel(in, { converted.data(), converted.size() }, options, 4);
+                    REQUIRE(parallel.result == result.result);
+                    REQUIRE(parallel.consumed == result.consumed);
+                    REQUIRE(parallel.produced == result.produced);
+                    REQUIRE(converted.compare(0, parallel.produced, expected, 0, result.produced) == 0);
+                }
+            }
+        }
+    }
+
+    TEST_CASE("Unicode character properties", "[unicode]")
+    {
+        using category = stdext::unicode_general_category;
+        CHECK(stdext::general_category(U'A') == category::uppercase_letter);
+        CHECK(stdext::general_category(U'a') == category::lowercase_letter);
+        CHECK(stdext::general_category(U'\u01C5') == category::titlecase_letter);
+        CHECK(stdext::general_category(U'\u4E00') == category::other_letter);
+        CHECK(stdext::general_category(U'\u0300') == category::nonspacing_mark);
+        CHECK(stdext::general_category(U'7') == category::decimal_number);
+        CHECK(stdext::general_category(U'(') == category::open_punctuation);
+        CHECK(stdext::general_category(U'\u20AC') == category::currency_symbol);
+        CHECK(stdext::general_category(U'\U0001F600') == category::other_symbol);
+        CHECK(stdext::general_category(U' ') == category::space_separator);
+        CHECK(stdext::general_category(U'\u2028') == category::line_separator);
+        CHECK(stdext::general_category(U'\0') == category::control);
+        CHECK(stdext::general_category(U'\u200B') == category::format);
+        CHECK(stdext::general_category(char32_t(0xD800)) == category::surrogate);
+        CHECK(stdext::general_category(U'\uE000') == category::private_use);
+        CHECK(stdext::general_category(U'\u0378') == category::unassigned);
+        CHECK(stdext::general_category(U'\U0010FFFF') == category::unassigned);
+        CHECK(stdext::general_category(char32_t(0x110000)) == category::unassigned);
+
+        for (char32_t c = 0; c != 0x80; ++c)
+            CHECK(stdext::simple_casefold(c) == (c >= U'A' && c <= U'Z' ? c + 0x20 : c));
+        CHECK(stdext::simple_casefold(U'\u212A') == U'k');
+        CHECK(stdext::simple_casefold(U'\u017F') == U's');
+        CHECK(stdext::simple_casefold(U'\u03A3') == U'\u03C3');
+        CHECK(stdext::simple_casefold(U'\u03C2') == U'\u03C3');
+        CHECK(stdext::simple_casefold(U'\u1E9E') == U'\u00DF');
+        CHECK(stdext::simple_casefold(U'\u00DF') == U'\u00DF');
+        CHECK(stdext::simple_casefold(U'\u0130') == U'\u0130');
+        CHECK(stdext::simple_casefold(U'\U00010400') == U'\U00010428');
+        CHECK(stdext::simple_casefold(char32_t(0x110000)) == char32_t(0x110000));
+    }
+
+    TEST_CASE("UTF-8 case-insensitive comparison", "[unicode]")
+    {
+        auto compare = [](const std::string& lhs, const std::string& rhs)
+        {
+            return stdext::utf8_casefold_compare({ lhs.data(), lhs.size() }, { rhs.data(), rhs.size() });
+        };
+        auto hash = [](const std::string& str)
+        {
+            return stdext::utf8_casefold_hash({ str.data(), str.size() });
+        };
+
+        CHECK(compare("", "") == 0);
+        CHECK(compare("", "a") < 0);
+        CHECK(compare("Hello, World!", "hELLO, wORLD!") == 0);
+        CHECK(compare("The quick brown fox jumps", "THE QUICK BROWN FOX JUMPS OVER") < 0);
+        CHECK(compare("abcdefghijklmnopqrstuvwxyz[", "ABCDEFGHIJKLMNOPQRSTUVWXYZ@") > 0);
+        CHECK(compare("\xE2\x84\xAA" "elvin", "kelvin") == 0);
+        CHECK(compare("\xC3\x84pfel", "\xC3\xA4PFEL") == 0);
+        CHECK(compare("stra\xC3\x9F" "e", "STRASSE") > 0);
+        CHECK(compare("a\xFF", "A\xEF\xBF\xBD") == 0);
+        CHECK(compare("a\xE4\xB8", "A\xEF\xBF\xBD") == 0);
+        CHECK(hash("\xE2\x84\xAA" "elvin") == hash("KELVIN"));
+        CHECK(hash("a\xFF") == hash("a\xEF\xBF\xBD"));
+        CHECK(hash("Hello") != hash("World"));
+
+        // Random text in which each letter may take any of its cases, compared with a reference
+        // that folds each code point in turn.
+        const std::vector<std::vector<std::string>> letters = {
+            { "a", "A" }, { "k", "K", "\xE2\x84\xAA" }, { "s", "S", "\xC5\xBF" }, { "z", "Z" }, { " " }, { "0" },
+            { "\xC3\xA4", "\xC3\x84" }, { "\xCF\x83", "\xCE\xA3", "\xCF\x82" }, { "\xD0\xB6", "\xD0\x96" },
+            { "\xE4\xB8\x80" }, { "\xF0\x90\x90\xA8", "\xF0\x90\x90\x80" }, { "\xFF" }, { "\xEF\xBF\xBD" }
+        };
+        auto reference = [](const std::string& str)
+        {
+            auto [result, utf32] = stdext::to_u32string(str.c_str(), stdext::utf_conversion_options::sanitize);
+            if (result == stdext::utf_result::partial_read)
+                utf32 += stdext::UNICODE_REPLACEMENT_CHARACTER;
+            for (auto& c : utf32)
+                c = stdext::simple_casefold(c);
+            return utf32;
+        };
+
+        uint64_t x = 0x0123456789ABCDEF;
+        auto next = [&](size_t n)
+        {
+            x = x * 6364136223846793005 + 1442695040888963407;
+            return size_t(x >> 33) % n;
+        };
+
+        for (int iteration = 0; iteration != 2000; ++iteration)
+        {
+            // Mostly ASCII, so that both the block and the code point paths are exercised.
+            auto length = next(80);
+            auto ascii = next(4) != 0;
+            std::string lhs, rhs;
+            for (size_t n = 0; n != length; ++n)
+            {
+                auto& letter = letters[ascii && next(8) != 0 ? next(6) : next(letters.size())];
+                lhs += letter[next(letter.size())];
+                rhs += letter[next(letter.size())];
+            }
+            REQUIRE(compare(lhs, rhs) == 0);
+            REQUIRE(hash(lhs) == hash(rhs));
+
+            if (length != 0)
+            {
+                auto pos = next(rhs.size());
+                if (stdext::utf8_is_trailing(rhs[pos]))
+                    rhs.erase(pos, 1);
+                else
+                    rhs.insert(pos, letters[next(letters.size())].front());
+            }
+
+            auto expected = reference(lhs).compare(reference(rhs));
+            auto result = compare(lhs, rhs);
+            REQUIRE((result < 0) == (expected < 0));
+            REQUIRE((result > 0) == (expected > 0));
+            REQUIRE(compare(rhs, lhs) == -result);
+            if (result == 0)
+                REQUIRE(hash(lhs) == hash(rhs));
+        }
+    }
 }
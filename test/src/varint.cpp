@@ -0,0 +1,155 @@
+#include <stdext/varint.h>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+
+namespace test
+{
+    namespace
+    {
+        // Values with a mix of encoded lengths, weighted towards short encodings.
+        template <typename T>
+        std::vector<T> make_values(size_t count)
+        {
+            std::vector<T> values(count);
+            uint64_t x = 0x0123456789ABCDEF;
+            for (auto& v : values)
+            {
+                x = x * 6364136223846793005 + 1442695040888963407;
+                auto bits = unsigned(x >> 58) % (sizeof(T) * 8 + 1);
+                auto r = x >> 11 ^ x << 21;
+                v = bits == 0 ? T(0) : T(r >> (64 - bits));
+            }
+            return values;
+        }
+    }
+
+    TEST_CASE("varint stream", "[varint]")
+    {
+        std::byte buffer[256];
+        stdext::memory_output_stream out(buffer, std::size(buffer));
+        stdext::write_varint(out, uint32_t(0));
+        stdext::write_varint(out, uint32_t(300));
+        stdext::write_varint(out, uint32_t(0xFFFFFFFF));
+        stdext::write_varint(out, int32_t(-1));
+        stdext::write_varint(out, int64_t(-0x40000000'00000000));
+        stdext::write_varint(out, uint64_t(0xFFFFFFFF'FFFFFFFF));
+        stdext::write_varint(out, uint8_t(200));
+
+        const std::byte expected[] = {
+            std::byte(0x00),
+            std::byte(0xAC), std::byte(0x02),
+            std::byte(0xFF), std::byte(0xFF), std::byte(0xFF), std::byte(0xFF), std::byte(0x0F),
+            std::byte(0x01)
+        };
+        REQUIRE(out.position() >= std::size(expected));
+        CHECK(std::equal(std::begin(expected), std::end(expected), buffer));
+
+        stdext::memory_input_stream in(buffer, size_t(out.position()));
+        CHECK(stdext::read_varint<uint32_t>(in) == 0);
+        CHECK(stdext::read_varint<uint32_t>(in) == 300);
+        CHECK(stdext::read_varint<uint32_t>(in) == 0xFFFFFFFF);
+        CHECK(stdext::read_varint<int32_t>(in) == -1);
+        CHECK(stdext::read_varint<int64_t>(in) == -0x40000000'00000000);
+        CHECK(stdext::read_varint<uint64_t>(in) == 0xFFFFFFFF'FFFFFFFF);
+        CHECK(stdext::read_varint<uint8_t>(in) == 200);
+        CHECK_THROWS_AS(stdext::read_varint<uint32_t>(in), stdext::stream_error);
+
+        // Too large for the requested type.
+        const std::byte large[] = { std::byte(0x80), std::byte(0x80), std::byte(0x80), std::byte(0x80), std::byte(0x10) };
+        stdext::memory_input_stream large_in(large, std::size(large));
+        CHECK_THROWS_AS(stdext::read_varint<uint32_t>(large_in), stdext::stream_error);
+    }
+
+    TEST_CASE("zigzag", "[varint]")
+    {
+        CHECK(stdext::zigzag_encode(0) == 0u);
+        CHECK(stdext::zigzag_encode(-1) == 1u);
+        CHECK(stdext::zigzag_encode(1) == 2u);
+        CHECK(stdext::zigzag_encode(int8_t(-128)) == 255u);
+        CHECK(stdext::zigzag_encode(int64_t(0x7FFFFFFF'FFFFFFFF)) == 0xFFFFFFFF'FFFFFFFE);
+
+        for (int32_t v : { 0, 1, -1, 12345, -12345, INT32_MAX, INT32_MIN })
+            CHECK(stdext::zigzag_decode(stdext::zigzag_encode(v)) == v);
+    }
+
+    TEST_CASE("leb128 bulk", "[varint]")
+    {
+        auto values32 = make_values<uint32_t>(5000);
+        std::vector<std::byte> encoded(values32.size() * stdext::max_varint_size<uint32_t>);
+        auto size = stdext::leb128_encode({ values32.data(), values32.size() }, encoded);
+
+        // The bulk encoding matches the stream encoding.
+        std::vector<std::byte> streamed(encoded.size());
+        stdext::memory_output_stream out(streamed.data(), streamed.size());
+        for (auto v : values32)
+            stdext::write_varint(out, v);
+        REQUIRE(size_t(out.position()) == size);
+        CHECK(std::equal(encoded.begin(), encoded.begin() + ptrdiff_t(size), streamed.begin()));
+
+        std::vector<uint32_t> decoded32(values32.size());
+        CHECK(stdext::leb128_decode({ encoded.data(), size }, decoded32) == size);
+        CHECK(decoded32 == values32);
+
+        // Runs of single-byte values.
+        std::vector<uint32_t> small(1001);
+        for (size_t n = 0; n != small.size(); ++n)
+            small[n] = uint32_t(n % 128);
+        small[500] = 1000000;
+        std::vector<std::byte> small_encoded(small.size() * 5);
+        size = stdext::leb128_encode({ small.data(), small.size() }, small_encoded);
+        std::vector<uint32_t> small_decoded(small.size());
+        CHECK(stdext::leb128_decode({ small_encoded.data(), size }, small_decoded) == size);
+        CHECK(small_decoded == small);
+
+        auto values64 = make_values<uint64_t>(5000);
+        encoded.resize(values64.size() * stdext::max_varint_size<uint64_t>);
+        size = stdext::leb128_encode({ values64.data(), values64.size() }, encoded);
+        std::vector<uint64_t> decoded64(values64.size());
+        CHECK(stdext::leb128_decode({ encoded.data(), size }, decoded64) == size);
+        CHECK(decoded64 == values64);
+
+        // Truncated input and out-of-range values.
+        CHECK_THROWS_AS(stdext::leb128_decode({ encoded.data(), size - 1 }, decoded64), stdext::stream_error);
+        std::vector<std::byte> bad(16, std::byte(0xFF));
+        bad[5] = std::byte(0x01);
+        CHECK_THROWS_AS(stdext::leb128_decode({ bad.data(), bad.size() }, decoded32), stdext::stream_error);
+    }
+
+    TEST_CASE("streamvbyte", "[varint]")
+    {
+        const uint32_t values[] = { 1, 0x1234, 0x123456, 0x12345678, 0xFF };
+        const std::byte expected[] = {
+            std::byte(0xE4), std::byte(0x00),
+            std::byte(0x01),
+            std::byte(0x34), std::byte(0x12),
+            std::byte(0x56), std::byte(0x34), std::byte(0x12),
+            std::byte(0x78), std::byte(0x56), std::byte(0x34), std::byte(0x12),
+            std::byte(0xFF)
+        };
+        std::byte buffer[stdext::streamvbyte_max_size(std::size(values))];
+        auto size = stdext::streamvbyte_encode(values, buffer);
+        REQUIRE(size == std::size(expected));
+        CHECK(std::equal(std::begin(expected), std::end(expected), buffer));
+
+        uint32_t decoded[std::size(values)];
+        CHECK(stdext::streamvbyte_decode({ buffer, size }, decoded) == size);
+        CHECK(std::equal(std::begin(values), std::end(values), decoded));
+
+        for (size_t count : { 0, 1, 3, 4, 7, 8, 9, 31, 1000, 4099 })
+        {
+            auto input = make_values<uint32_t>(count);
+            std::vector<std::byte> encoded(stdext::streamvbyte_max_size(count));
+            size = stdext::streamvbyte_encode({ input.data(), input.size() }, encoded);
+
+            std::vector<uint32_t> output(count);
+            CHECK(stdext::streamvbyte_decode({ encoded.data(), size }, output) == size);
+            CHECK(output == input);
+
+            if (count != 0)
+                CHECK_THROWS_AS(stdext::streamvbyte_decode({ encoded.data(), size - 1 }, output), stdext::stream_error);
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# Generates src/unicode_tables.h from the Unicode Character Database:
+#
+#   unicode_tables.py <ucd-directory> <output>
+#
+# The directory must contain CaseFolding.txt and extracted/DerivedGeneralCategory.txt (or
+# DerivedGeneralCategory.txt), as published at https://www.unicode.org/Public/UCD/.
+#
+# Each property is stored as a two-stage table: the high bits of a code point select a block in
+# the first stage, and the low bits select an entry within that block in the second.  Identical
+# blocks are stored once, and the block size is chosen to minimize the total size.
+
+import os
+import re
+import sys
+
+CODE_POINTS = 0x110000
+
+# In the order of stdext::unicode_general_category.
+CATEGORIES = [
+    'Lu', 'Ll', 'Lt', 'Lm', 'Lo',
+    'Mn', 'Mc', 'Me',
+    'Nd', 'Nl', 'No',
+    'Pc', 'Pd', 'Ps', 'Pe', 'Pi', 'Pf', 'Po',
+    'Sm', 'Sc', 'Sk', 'So',
+    'Zs', 'Zl', 'Zp',
+    'Cc', 'Cf', 'Cs', 'Co', 'Cn'
+]
+
+
+def parse(path):
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if line:
+                yield [field.strip() for field in line.split(';')]
+
+
+def code_range(field):
+    first, _, last = field.partition('..')
+    return int(first, 16), int(last or first, 16)
+
+
+def read_categories(ucd):
+    path = os.path.join(ucd, 'extracted', 'DerivedGeneralCategory.txt')
+    if not os.path.exists(path):
+        path = os.path.join(ucd, 'DerivedGeneralCategory.txt')
+
+    values = [CATEGORIES.index('Cn')] * CODE_POINTS
+    for fields in parse(path):
+        first, last = code_range(fields[0])
+        values[first:last + 1] = [CATEGORIES.index(fields[1])] * (last - first + 1)
+    return values
+
+
+def read_case_folding(ucd):
+    # Simple case folding uses the common and simple mappings.
+    deltas = [0]
+    values = [0] * CODE_POINTS
+    for fields in parse(os.path.join(ucd, 'CaseFolding.txt')):
+        if fields[1] not in ('C', 'S'):
+            continue
+        code = int(fields[0], 16)
+        delta = int(fields[2], 16) - code
+        if delta not in deltas:
+            deltas.append(delta)
+        values[code] = deltas.index(delta)
+    return values, deltas
+
+
+def element_type(values):
+    for bits in (8, 16, 32):
+        if max(values) < 1 << bits:
+            return 'uint%d_t' % bits, bits // 8
+
+
+def split(values):
+    best = None
+    for shift in range(4, 12):
+        size = 1 << shift
+        blocks = {}
+        stage1 = []
+        stage2 = []
+        for first in range(0, CODE_POINTS, size):
+            block = tuple(values[first:first + size])
+            if block not in blocks:
+                blocks[block] = len(blocks)
+                stage2.extend(block)
+            stage1.append(blocks[block])
+        total = len(stage1) * element_type(stage1)[1] + len(stage2) * element_type(stage2)[1]
+        if best is None or total < best[0]:
+            best = (total, shift, stage1, stage2)
+    return best[1:]
+
+
+def format_array(name, values, signed=False):
+    if signed:
+        type = 'int32_t'
+    else:
+        type = element_type(values)[0]
+    lines = ['        constexpr %s %s[%d] = {' % (type, name, len(values))]
+    for first in range(0, len(values), 16):
+        lines.append('            ' + ', '.join(str(v) for v in values[first:first + 16]) + ',')
+    lines[-1] = lines[-1].rstrip(',')
+    lines.append('        };')
+    return '\n'.join(lines)
+
+
+def format_table(name, values):
+    shift, stage1, stage2 = split(values)
+    return '\n'.join([
+        '        constexpr unsigned %s_shift = %d;' % (name, shift),
+        format_array(name + '_stage1', stage1),
+        format_array(name + '_stage2', stage2)
+    ])
+
+
+def version(ucd):
+    with open(os.path.join(ucd, 'CaseFolding.txt'), encoding='utf-8') as f:
+        match = re.search(r'CaseFolding-([0-9.]+)\.txt', f.readline())
+    return match.group(1) if match else 'unknown'
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: unicode_tables.py <ucd-directory> <output>')
+
+    ucd, output = sys.argv[1:]
+    fold, deltas = read_case_folding(ucd)
+    text = '\n'.join([
+        '// Generated by tools/unicode_tables.py from the Unicode Character Database, version %s.' % version(ucd),
+        '// Do not edit.',
+        '',
+        '#ifndef STDEXT_IMPL_UNICODE_TABLES_INCLUDED',
+        '#define STDEXT_IMPL_UNICODE_TABLES_INCLUDED',
+        '#pragma once',
+        '',
+        '#include <cstdint>',
+        '',
+        '',
+        'namespace stdext',
+        '{',
+        '    namespace _private',
+        '    {',
+        format_table('category', read_categories(ucd)),
+        '',
+        format_table('casefold', fold),
+        format_array('casefold_deltas', deltas, signed=True),
+        '    }',
+        '}',
+        '',
+        '#endif',
+        ''
+    ])
+
+    with open(output, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(text)
+
+
+if __name__ == '__main__':
+    main()